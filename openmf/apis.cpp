@@ -8,16 +8,431 @@
 //------------------------------------------------------------------------------------------------------//
 
 #include "apis.h"
+#include "chunk.h"
+#include "event_cache.h"
+#include "sequence.h"
+#include "parallel_sequence.h"
 #include "array_operations.h"
+#include <atomic>
+#include <cstring>
 #include <fstream>
+#include <thread>
 
 using namespace smaf;
 
+//------------------------------------------------------------------------------------------------------//
+// Internal Helpers
+//------------------------------------------------------------------------------------------------------//
+namespace {
+
+// Chunk layout of the score track until the sequence data.
+struct sequence_layout
+{
+	u32_t file_size;											// MMMD Chunk Size
+	u32_t file_size_pos;										// MMMD Chunk Size Position
+	u32_t score_size;											// MTR* Chunk Size
+	u32_t score_size_pos;										// MTR* Chunk Size Position
+	u32_t sequence_size;										// Mtsq Chunk Size
+	u32_t sequence_size_pos;									// Mtsq Chunk Size Position
+	u32_t sequence_pos;											// Head of Sequence Data
+};
+
+// Chunk layout of all tracks.
+struct track_layout
+{
+	u32_t                   file_size;							// MMMD Chunk Size
+	u32_t                   file_size_pos;						// MMMD Chunk Size Position
+	std::vector<track_info> tracks;								// Tracks in File Order
+};
+
+// Tracks collected in the chunk walk.
+struct track_context
+{
+	track_layout* pLayout;										// Result
+	u32_t         file_end;										// End of MMMD Chunk Data (0 = Not Found)
+};
+
+walk_result tracks_file(const chunk_info& rInfo_, const u8_t* /*pAddr_*/, void* pContext_)
+{
+	track_context* pContext = static_cast<track_context*>(pContext_);
+	if (rInfo_.depth != 0 || pContext->file_end != 0) return WR_SKIP;
+	pContext->pLayout->file_size_pos = rInfo_.size_pos;
+	pContext->pLayout->file_size = rInfo_.size;
+	pContext->file_end = (rInfo_.data_pos + rInfo_.size);
+	return WR_CONTINUE;
+}
+
+// Add the track. (Track Number = Last Byte of the Chunk ID)
+walk_result add_track(const chunk_info& rInfo_, track_context& rContext_, bool audio_)
+{
+	if (rInfo_.depth != 1 || rInfo_.pos >= rContext_.file_end) return WR_SKIP;
+
+	track_info track;
+	track.number = (rInfo_.id & 0xFF);
+	track.audio = audio_;
+	track.pos = rInfo_.pos;
+	track.size_pos = rInfo_.size_pos;
+	track.size = rInfo_.size;
+	track.data_pos = rInfo_.data_pos;
+	track.sequence_size_pos = 0;
+	track.sequence_size = 0;
+	track.sequence_pos = 0;
+	rContext_.pLayout->tracks.push_back(track);
+	return WR_CONTINUE;
+}
+
+// Set the first sequence data in the track.
+walk_result add_sequence(const chunk_info& rInfo_, track_context& rContext_, bool audio_)
+{
+	std::vector<track_info>& tracks = rContext_.pLayout->tracks;
+	if (rInfo_.depth != 2 || tracks.empty()) return WR_SKIP;
+
+	track_info& track = tracks.back();
+	if (track.audio != audio_ || track.sequence_size_pos != 0) return WR_SKIP;
+	if (rInfo_.pos < track.data_pos || rInfo_.pos >= (track.data_pos + track.size)) return WR_SKIP;
+	track.sequence_size_pos = rInfo_.size_pos;
+	track.sequence_size = rInfo_.size;
+	track.sequence_pos = rInfo_.data_pos;
+	return WR_SKIP;
+}
+
+walk_result tracks_score(const chunk_info& rInfo_, const u8_t* /*pAddr_*/, void* pContext_)
+{
+	return add_track(rInfo_, *static_cast<track_context*>(pContext_), false);
+}
+
+walk_result tracks_audio(const chunk_info& rInfo_, const u8_t* /*pAddr_*/, void* pContext_)
+{
+	return add_track(rInfo_, *static_cast<track_context*>(pContext_), true);
+}
+
+walk_result tracks_score_sequence(const chunk_info& rInfo_, const u8_t* /*pAddr_*/, void* pContext_)
+{
+	return add_sequence(rInfo_, *static_cast<track_context*>(pContext_), false);
+}
+
+walk_result tracks_audio_sequence(const chunk_info& rInfo_, const u8_t* /*pAddr_*/, void* pContext_)
+{
+	return add_sequence(rInfo_, *static_cast<track_context*>(pContext_), true);
+}
+
+walk_result tracks_skip(const chunk_info& /*rInfo_*/, const u8_t* /*pAddr_*/, void* /*pContext_*/)
+{
+	return WR_SKIP;
+}
+
+// Registry to enumerate the tracks. (Enters MMMD, MTR* and ATR* only.)
+class track_registry : public chunk_registry
+{
+public:
+	track_registry()
+		: chunk_registry()
+	{
+		this->set_callback("MMMD", tracks_file);
+		this->set_callback("MTR*", tracks_score);
+		this->set_callback("ATR*", tracks_audio);
+		this->set_callback("Mtsq", tracks_score_sequence);
+		this->set_callback("Atsq", tracks_audio_sequence);
+		this->set_default_callback(tracks_skip);
+	}
+};
+
+// Analyze the chunk layout of all tracks. (MMMD -> MTR*/ATR* -> Mtsq/Atsq)
+// The chunk index of the event cache is used when it is attached. The callbacks check the depth
+// and the parent range, so visiting every chunk of the index gives the same result as the walk.
+bool analyze_tracks(const MA_3& rSrc_, track_layout& rLayout_)
+{
+	static const track_registry registry;
+
+	rLayout_.tracks.clear();
+	if (rSrc_.empty()) return false;
+
+	track_context context;
+	context.pLayout = &rLayout_;
+	context.file_end = 0;
+
+	const event_cache* pCache = rSrc_.get_cache();
+	if (pCache != nullptr)
+	{
+		for (u32_t n = 0; n < pCache->chunks(); n++)
+		{
+			chunk_info info;
+			if (!pCache->chunk(n, info)) return false;
+			const chunk_registry::entry* pEntry = registry.find(info.id);
+			if (pEntry != nullptr && pEntry->pCallback != nullptr) pEntry->pCallback(info, rSrc_.data_ptr(), &context);
+		}
+	}
+	else
+	{
+		OPENMF_TRACE_SCOPE("header_walk");
+		if (!registry.walk(rSrc_.data_ptr(), rSrc_.size(), &context)) return false;
+	}
+	return (context.file_end != 0);
+}
+
+// Check the track has sequence data to edit.
+bool is_score_sequence(const track_info& rTrack_)
+{
+	return (!rTrack_.audio && rTrack_.sequence_size_pos != 0);
+}
+
+// Return the number of score tracks with sequence data.
+u32_t score_sequences(const track_layout& rLayout_)
+{
+	u32_t n = 0;
+	for (size_t i = 0; i < rLayout_.tracks.size(); i++)
+	{
+		if (is_score_sequence(rLayout_.tracks[i])) n++;
+	}
+	return n;
+}
+
+// Chunk layout of the first score track.
+bool first_layout(const track_layout& rTracks_, sequence_layout& rLayout_)
+{
+	for (size_t i = 0; i < rTracks_.tracks.size(); i++)
+	{
+		const track_info& track = rTracks_.tracks[i];
+		if (track.audio) continue;
+		if (track.sequence_size_pos == 0) return false;			// No Sequence in the First Score Track
+
+		rLayout_.file_size = rTracks_.file_size;
+		rLayout_.file_size_pos = rTracks_.file_size_pos;
+		rLayout_.score_size = track.size;
+		rLayout_.score_size_pos = track.size_pos;
+		rLayout_.sequence_size = track.sequence_size;
+		rLayout_.sequence_size_pos = track.sequence_size_pos;
+		rLayout_.sequence_pos = track.sequence_pos;
+		return true;
+	}
+	return false;
+}
+
+// Return the timebase of the score track.
+timebase track_timebase(const u8_t* pAddr_, const track_info& rTrack_)
+{
+	if (rTrack_.size < 4) return timebase();
+	return timebase(pAddr_[rTrack_.data_pos + 2], pAddr_[rTrack_.data_pos + 3]);
+}
+
+// Collect the data positions of the score tracks. (Fails when a head is shorter than head_size_)
+bool score_heads(const MA_3& rSrc_, u32_t head_size_, std::vector<u32_t>& rDst_)
+{
+	rDst_.clear();
+	track_layout layout;
+	if (!analyze_tracks(rSrc_, layout)) return false;
+
+	for (size_t i = 0; i < layout.tracks.size(); i++)
+	{
+		const track_info& track = layout.tracks[i];
+		if (track.audio) continue;
+		if (track.size < head_size_) return false;
+		rDst_.push_back(track.data_pos);
+	}
+	return !rDst_.empty();
+}
+
+// Rewrite the sequence data of the score track. (Called concurrently, index_ = Index of rTrack_)
+typedef bool (*sequence_rewriter)(const u8_t* pAddr_, const track_info& rTrack_, u32_t index_, std::vector<u8_t>& rDst_, void* pContext_);
+
+// Rewrite the sequence data of every score track on the thread pool and fix the sizes of the
+// sequence, track and file chunks. The tracks are independent, so each worker takes the next
+// track. CRC16 is left to the caller, so it is fixed once after the last change. (rSrc_ != rDst_)
+bool rewrite_tracks(const MA_3& rSrc_, const track_layout& rLayout_, sequence_rewriter pRewrite_, void* pContext_, MA_3& rDst_)
+{
+	OPENMF_TRACE_SCOPE("rewrite_tracks");
+
+	const std::vector<track_info>& tracks = rLayout_.tracks;
+	std::vector<u32_t> targets;
+	for (size_t i = 0; i < tracks.size(); i++)
+	{
+		if (is_score_sequence(tracks[i])) targets.push_back(static_cast<u32_t>(i));
+	}
+	if (targets.empty() || rSrc_ == rDst_) return false;
+
+	// (1) Rewrite the tracks concurrently.
+	//
+	const u8_t* pAddr = rSrc_.data_ptr();
+	const u32_t n = static_cast<u32_t>(targets.size());
+	std::vector<std::vector<u8_t> > sequences(n);
+	std::atomic<u32_t> next(0);
+	std::atomic<u32_t> failed(0);
+	auto worker = [&]() {
+		while (true)
+		{
+			const u32_t index = next++;
+			if (index >= n) break;
+			if (!pRewrite_(pAddr, tracks[targets[index]], targets[index], sequences[index], pContext_)) failed++;
+		}
+	};
+
+	u32_t workers = static_cast<u32_t>(std::thread::hardware_concurrency());
+	if (workers == 0) workers = 1;
+	if (workers > n) workers = n;
+	std::vector<std::thread> pool;
+	for (u32_t i = 1; i < workers; i++)
+	{
+		pool.push_back(std::thread(worker));
+	}
+	worker();
+	for (size_t i = 0; i < pool.size(); i++)
+	{
+		pool[i].join();
+	}
+	if (failed != 0) return false;
+
+	// (2) Copy the chunks between the sequences and fix the sizes.
+	//
+	u64_t dst_size = rSrc_.size();
+	u64_t file_size = rLayout_.file_size;
+	for (u32_t i = 0; i < n; i++)
+	{
+		dst_size = (dst_size + sequences[i].size() - tracks[targets[i]].sequence_size);
+		file_size = (file_size + sequences[i].size() - tracks[targets[i]].sequence_size);
+	}
+	if (dst_size > 0xFFFFFFFF || file_size > 0xFFFFFFFF) return false;
+	if (!rDst_.create(static_cast<u32_t>(dst_size))) return false;
+	u8_t* pDst = rDst_.data_ptr();
+
+	u32_t src_pos = 0;
+	u32_t dst_pos = 0;
+	for (u32_t i = 0; i < n; i++)
+	{
+		const track_info& track = tracks[targets[i]];
+		const std::vector<u8_t>& sequence = sequences[i];
+		for (; src_pos < track.sequence_pos; src_pos++)
+		{
+			pDst[dst_pos++] = pAddr[src_pos];
+		}
+
+		// The track head and the sequence size are before the sequence data.
+		const u32_t size = static_cast<u32_t>(sequence.size());
+		make_size_array((track.size - track.sequence_size + size), MA_3::CHUNK_DATA_SIZE, &pDst[dst_pos - (track.sequence_pos - track.size_pos)]);
+		make_size_array(size, MA_3::CHUNK_DATA_SIZE, &pDst[dst_pos - (track.sequence_pos - track.sequence_size_pos)]);
+
+		for (u32_t j = 0; j < size; j++)
+		{
+			pDst[dst_pos++] = sequence[j];
+		}
+		src_pos += track.sequence_size;
+	}
+	for (; src_pos < rSrc_.size(); src_pos++)
+	{
+		pDst[dst_pos++] = pAddr[src_pos];
+	}
+	make_size_array(static_cast<u32_t>(file_size), MA_3::CHUNK_DATA_SIZE, &pDst[rLayout_.file_size_pos]);
+	return true;
+}
+
+// Write variable size data and advance the write position.
+void write_variable_size(u32_t size_, u8_t* pDst_, u32_t& rPos_)
+{
+	u32_t len;
+	make_variable_size_array(size_, &pDst_[rPos_], len);
+	rPos_ += len;
+}
+
+// Return the size of the event (0 = Error) and set the next state.
+u32_t event_size(const u8_t* pAddr_, sequence_state& rNextState_)
+{
+	const event_info& info = EVENT_TABLE[*pAddr_];
+	rNextState_ = static_cast<sequence_state>(info.next_state);
+	return event_length(pAddr_, info);
+}
+
+// Trailing NOPs and EOS of the sequence. (NOPs and EOS after the last event)
+struct tail_visitor
+{
+	tail_visitor()
+		: nop(0), eos(false), last_gatetime(0), channels(0), time(0), last_time(0), duration_pos(0), tail_pos(0), end_pos(0)
+	{}
+
+	bool duration(u32_t value_, u32_t pos_, u32_t len_)
+	{
+		time += value_;
+		duration_pos = pos_;
+		end_pos = (pos_ + len_);
+		return true;
+	}
+	bool event(const u8_t* pEvent_, u32_t size_, const event_info& rInfo_)
+	{
+		end_pos += size_;
+		if (rInfo_.kind == EK_NOTE) channels |= (1 << (pEvent_[0] & 0x0F));
+		if (rInfo_.kind == EK_EOS_NOP)
+		{
+			if (nop == 0 && !eos) tail_pos = duration_pos;
+			if (size_ == MA_3::EOS_SIZE) eos = true;
+			else nop++;
+		}
+		else
+		{
+			nop = 0;
+			eos = false;
+			last_time = time;
+		}
+		return true;
+	}
+	bool gatetime(u32_t value_, u32_t pos_, u32_t len_)
+	{
+		last_gatetime = value_;
+		end_pos = (pos_ + len_);
+		return true;
+	}
+
+	// Size of the trailing NOPs and EOS with their durations.
+	u32_t reduce_size() const
+	{
+		return (nop != 0 || eos) ? (end_pos - tail_pos) : 0;
+	}
+
+	u32_t nop;													// Number of NOP
+	bool  eos;													// EOS Flag
+	u32_t last_gatetime;										// Last Gatetime
+	u32_t channels;												// Channels of Notes (bit n = Channel n)
+	u64_t time;													// Absolute Time [tick]
+	u64_t last_time;											// Time of the Last Event except NOP/EOS [tick]
+	u32_t duration_pos;											// Position of the Last Duration
+	u32_t tail_pos;												// Position of the Duration of the First Trailing NOP/EOS
+	u32_t end_pos;												// End of the Walked Data
+};
+
+// Drop the trailing NOPs and EOS. (Rewriter for remove_nop)
+bool trim_track(const u8_t* pAddr_, const track_info& rTrack_, u32_t /*index_*/, std::vector<u8_t>& rDst_, void* /*pContext_*/)
+{
+	const u8_t* pSequence = &pAddr_[rTrack_.sequence_pos];
+	tail_visitor tail;
+	if (!walk_sequence(pSequence, rTrack_.sequence_size, tail)) return false;
+	const u32_t reduce_size = tail.reduce_size();
+	if (reduce_size > rTrack_.sequence_size) return false;
+
+	rDst_.assign(pSequence, pSequence + (rTrack_.sequence_size - reduce_size));
+	return true;
+}
+
+}																// namespace
+
+//------------------------------------------------------------------------------------------------------//
+// Event Filter Class
+//------------------------------------------------------------------------------------------------------//
+
+event_filter::event_filter()
+	: mute_mask(0x0000)
+	, target_mask(0xFFFF)
+	, skip_type_mask(1 << channel_status::TYPE_RHYTHM)
+	, transpose(0)
+	, velocity_ratio(1.0)
+{}
+
+event_filter::~event_filter()
+{}
+
 //------------------------------------------------------------------------------------------------------//
 // Load Binary Data from File
 //------------------------------------------------------------------------------------------------------//
 bool smaf::load(const char* szFile, binary_array& rDst_)
 {
+	OPENMF_TRACE_SCOPE("load");
+
 	std::ifstream fin(szFile, std::ios::binary);
 	if (!fin.is_open()) return false;
 
@@ -31,16 +446,12 @@ bool smaf::load(const char* szFile, binary_array& rDst_)
 		return false;
 	}
 
-	u8_t bin;
-	u8_t* pAddr = rDst_.data_ptr();
-	for (u32_t i = 0; i < rDst_.size(); i++)
-	{
-		fin.read(reinterpret_cast<char*>(&bin), sizeof(u8_t));
-		*pAddr++ = bin;
-	}
+	fin.read(reinterpret_cast<char*>(rDst_.data_ptr()), rDst_.size());
+	const bool ok = (static_cast<u32_t>(fin.gcount()) == rDst_.size());
 	fin.close();
+	OPENMF_TRACE_COUNT("load.bytes", rDst_.size());
 
-	return true;
+	return ok;
 }
 
 //------------------------------------------------------------------------------------------------------//
@@ -48,19 +459,19 @@ bool smaf::load(const char* szFile, binary_array& rDst_)
 //------------------------------------------------------------------------------------------------------//
 bool smaf::save(const char* szFile, const binary_array& rSrc_)
 {
+	OPENMF_TRACE_SCOPE("save");
+	OPENMF_TRACE_COUNT("save.bytes", rSrc_.size());
+
 	if (rSrc_.empty()) return false;
 
 	std::ofstream fout(szFile, std::ios::binary);
 	if (!fout.is_open()) return false;
 
-	u8_t* pAddr = rSrc_.data_ptr();
-	for (u32_t i = 0; i < rSrc_.size(); i++)
-	{
-		fout.write(reinterpret_cast<char*>(pAddr++), sizeof(u8_t));
-	}
+	fout.write(reinterpret_cast<const char*>(rSrc_.data_ptr()), rSrc_.size());
+	const bool ok = fout.good();
 	fout.close();
 
-	return true;
+	return ok;
 }
 
 //------------------------------------------------------------------------------------------------------//
@@ -68,19 +479,32 @@ bool smaf::save(const char* szFile, const binary_array& rSrc_)
 //------------------------------------------------------------------------------------------------------//
 bool smaf::fix_crc16(MA_3& rSrcDst_)
 {
-	if (rSrcDst_.empty()) return false;
+	OPENMF_TRACE_SCOPE("fix_crc16");
+	OPENMF_TRACE_COUNT("fix_crc16.bytes", rSrcDst_.size());
 
-	CRC16 crc_gen;
-	if (!crc_gen.initialize(CRC16::POLY)) return false;
+	if (rSrcDst_.empty() || rSrcDst_.size() < MA_3::CRC_SIZE) return false;
 
+	// The tables of calc_crc16 are built once per process. (Same result as CRC16::make)
 	const u32_t act_size = (rSrcDst_.size() - MA_3::CRC_SIZE);
-	const u16_t crc_code = crc_gen.make(rSrcDst_.data_ptr(), act_size);
+	const u16_t crc_code = calc_crc16(rSrcDst_.data_ptr(), act_size);
 
 	rSrcDst_[act_size + 0] = ((crc_code >> 8) & 0xFF);
 	rSrcDst_[act_size + 1] = ((crc_code >> 0) & 0xFF);
 
-	crc_gen.release();
+	return true;
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Enumerate Tracks
+//------------------------------------------------------------------------------------------------------//
+bool smaf::enumerate_tracks(const MA_3& rSrc_, std::vector<track_info>& rDst_)
+{
+	OPENMF_TRACE_SCOPE("enumerate_tracks");
 
+	rDst_.clear();
+	track_layout layout;
+	if (!analyze_tracks(rSrc_, layout)) return false;
+	rDst_.swap(layout.tracks);
 	return true;
 }
 
@@ -89,203 +513,54 @@ bool smaf::fix_crc16(MA_3& rSrcDst_)
 //------------------------------------------------------------------------------------------------------//
 bool smaf::remove_nop(MA_3& rSrcDst_)
 {
+	OPENMF_TRACE_SCOPE("remove_nop");
+	OPENMF_TRACE_COUNT("remove_nop.bytes", rSrcDst_.size());
+
 	const format_type fmt = rSrcDst_.get_format();
 	if (fmt != format_type::MOBILE_NO_COMPRESS) return false;
 
-	u8_t* pAddr = rSrcDst_.data_ptr();
-	u32_t size;
-	u32_t cnt = 0;
-
-	u32_t file_size, score_size, sequence_size;
-	u32_t file_size_pos, score_size_pos, sequence_size_pos;
-
-	if (!check_chunk("MMMD", &pAddr[cnt])) return false;
-	cnt += MA_3::CHUNK_HEAD_SIZE;
-	file_size_pos = cnt;
-	file_size = calc_size(&pAddr[cnt], MA_3::CHUNK_DATA_SIZE);
-	cnt += MA_3::CHUNK_DATA_SIZE;
+	track_layout tracks;
+	if (!analyze_tracks(rSrcDst_, tracks)) return false;
+	if (score_sequences(tracks) == 0) return false;
 
-	if (!check_chunk("CNTI", &pAddr[cnt])) return false;
-	cnt += MA_3::CHUNK_HEAD_SIZE;
-	size = calc_size(&pAddr[cnt], MA_3::CHUNK_DATA_SIZE);
-	cnt += (MA_3::CHUNK_DATA_SIZE + size);
-
-	if (!check_chunk("OPDA", &pAddr[cnt])) return false;
-	cnt += MA_3::CHUNK_HEAD_SIZE;
-	size = calc_size(&pAddr[cnt], MA_3::CHUNK_DATA_SIZE);
-	cnt += (MA_3::CHUNK_DATA_SIZE + size);
-
-	if (!check_chunk("MTR*", &pAddr[cnt])) return false;
-	cnt += MA_3::CHUNK_HEAD_SIZE;
-	score_size_pos = cnt;
-	score_size = calc_size(&pAddr[cnt], MA_3::CHUNK_DATA_SIZE);
-	cnt += MA_3::CHUNK_DATA_SIZE;
-	cnt++;														// Format Type
-	cnt++;														// Sequence Type
-	cnt++;														// Timebase of Duration
-	cnt++;														// Timebase of Gatetime
-	cnt += MA_3::CHANNELS;										// Channel Status
-
-	if (check_chunk("MspI", &pAddr[cnt]))
-	{
-		cnt += MA_3::CHUNK_HEAD_SIZE;
-		size = calc_size(&pAddr[cnt], MA_3::CHUNK_DATA_SIZE);
-		cnt += (MA_3::CHUNK_DATA_SIZE + size);
-	}
-
-	if (check_chunk("Mtsu", &pAddr[cnt]))
+	// Several tracks, or chunks after the sequence data: Every score track is trimmed on the thread pool.
+	const track_info& first = tracks.tracks[0];
+	if (tracks.tracks.size() != 1 || !is_score_sequence(first) || (first.sequence_pos + first.sequence_size + MA_3::CRC_SIZE) != rSrcDst_.size())
 	{
-		cnt += MA_3::CHUNK_HEAD_SIZE;
-		size = calc_size(&pAddr[cnt], MA_3::CHUNK_DATA_SIZE);
-		cnt += (MA_3::CHUNK_DATA_SIZE + size);
+		const MA_3 src(rSrcDst_);
+		if (!rewrite_tracks(src, tracks, trim_track, nullptr, rSrcDst_)) return false;
+		return fix_crc16(rSrcDst_);
 	}
 
-	if (!check_chunk("Mtsq", &pAddr[cnt])) return false;
-	cnt += MA_3::CHUNK_HEAD_SIZE;
-	sequence_size_pos = cnt;
-	sequence_size = calc_size(&pAddr[cnt], MA_3::CHUNK_DATA_SIZE);
-	cnt += MA_3::CHUNK_DATA_SIZE;
-
-	u32_t nNOP = 0;												// Number of NOP
-	bool bEOS = false;											// EOS Flag
-
-	sequence_state next_state = SS_DURATION;
-
-	const u32_t sequence_end = (cnt + sequence_size);
-	while (cnt < sequence_end)
-	{
-		switch (next_state)
-		{
-		case SS_DURATION:
-			next_state = SS_STATUS;
-			{
-				u32_t len;										// For Variable Size
-				u32_t duration = calc_variable_size(&pAddr[cnt], len);
-				cnt += len;
-			}
-			break;
-		case SS_STATUS:
-			switch (pAddr[cnt] & 0xF0)
-			{
-			case SE_NOTE_NOVELOCITY:
-				next_state = SS_GATETIME;
-				{
-					cnt += 2;
-				}
-				break;
-			case SE_NOTE_VELOCITY:
-				next_state = SS_GATETIME;
-				{
-					cnt += 3;
-				}
-				break;
-			case SE_RESERVED_3BYTE:
-				next_state = SS_DURATION;
-				{
-					cnt += 3;
-				}
-				break;
-			case SE_CONTROL_CHANGE:
-				next_state = SS_DURATION;
-				{
-					cnt += 3;
-				}
-				break;
-			case SE_PROGRAM_CHANGE:
-				next_state = SS_DURATION;
-				{
-					cnt += 2;
-				}
-				break;
-			case SE_RESERVED_2BYTE:
-				next_state = SS_DURATION;
-				{
-					cnt += 2;
-				}
-				break;
-			case SE_PITCH_BEND:
-				next_state = SS_DURATION;
-				{
-					cnt += 3;
-				}
-				break;
-			case SE_SYSTEM_EXCLUSIVE:
-				next_state = SS_DURATION;
-				{
-					if (pAddr[cnt] == SE_SYSTEM_EXCLUSIVE)
-					{
-						cnt++;
-						u32_t len;
-						u32_t info_size = calc_variable_size(&pAddr[cnt], len);
-						cnt += (len + info_size);
-					}
-					else if (pAddr[cnt] == SE_EOS_NOP)
-					{
-						if (pAddr[cnt + 1] == 0x2F)
-						{
-							cnt += MA_3::EOS_SIZE;				// EOS
-							bEOS = true;
-						}
-						else
-						{
-							cnt += MA_3::NOP_SIZE;				// NOP
-							nNOP++;
-						}
-					}
-					else
-					{
-						cnt++;
-					}
-				}
-				break;
-			default:
-				return false;									// Error
-			}
-			break;
-		case SS_GATETIME:
-			next_state = SS_DURATION;
-			{
-				u32_t len;										// For Variable Size
-				u32_t gatetime = calc_variable_size(&pAddr[cnt], len);
-				cnt += len;
-
-				nNOP = 0;
-			}
-			break;
-		default:
-			return false;										// Error
-		}
-	}
+	u8_t* pAddr = rSrcDst_.data_ptr();
+	u32_t cnt = first.sequence_pos;
 
-	const u32_t nop_duration = 1;								// NOP's Duration [byte]
-	const u32_t eos_duration = 1;								// EOS's Duration [byte]
+	u32_t file_size = tracks.file_size;
+	u32_t score_size = first.size;
+	u32_t sequence_size = first.sequence_size;
+	const u32_t file_size_pos = tracks.file_size_pos;
+	const u32_t score_size_pos = first.size_pos;
+	const u32_t sequence_size_pos = first.sequence_size_pos;
 
-	u32_t reduce_size = 0;
-	if (bEOS)
-	{
-		reduce_size = ((nNOP * (nop_duration + MA_3::NOP_SIZE)) + (eos_duration + MA_3::EOS_SIZE));
-	}
-	else
-	{
-		reduce_size = (nNOP * (nop_duration + MA_3::NOP_SIZE));
-	}
+	tail_visitor tail;
+	if (!walk_sequence(&pAddr[cnt], sequence_size, tail)) return false;
+	const u32_t reduce_size = tail.reduce_size();
 
 	if (reduce_size != 0)
 	{
 		const u32_t new_size = (rSrcDst_.size() - reduce_size);
-		MA_3 temp(new_size, rSrcDst_.data_ptr());
 
 		file_size -= reduce_size;
-		make_size_array(file_size, MA_3::CHUNK_DATA_SIZE, &temp[file_size_pos]);
+		make_size_array(file_size, MA_3::CHUNK_DATA_SIZE, &rSrcDst_[file_size_pos]);
 
 		score_size -= reduce_size;
-		make_size_array(score_size, MA_3::CHUNK_DATA_SIZE, &temp[score_size_pos]);
+		make_size_array(score_size, MA_3::CHUNK_DATA_SIZE, &rSrcDst_[score_size_pos]);
 
 		sequence_size -= reduce_size;
-		make_size_array(sequence_size, MA_3::CHUNK_DATA_SIZE, &temp[sequence_size_pos]);
+		make_size_array(sequence_size, MA_3::CHUNK_DATA_SIZE, &rSrcDst_[sequence_size_pos]);
 
-		if (!fix_crc16(temp)) return false;
-		rSrcDst_ = temp;
+		if (!rSrcDst_.truncate(new_size)) return false;			// In-place (No Copy)
+		if (!fix_crc16(rSrcDst_)) return false;
 	}
 
 	return true;
@@ -296,45 +571,35 @@ bool smaf::remove_nop(MA_3& rSrcDst_)
 //------------------------------------------------------------------------------------------------------//
 bool smaf::clear_channel_status(MA_3& rSrcDst_)
 {
+	OPENMF_TRACE_SCOPE("clear_channel_status");
+	OPENMF_TRACE_COUNT("clear_channel_status.bytes", rSrcDst_.size());
+
 	if (rSrcDst_.empty()) return false;
 
 	const format_type fmt = rSrcDst_.get_format();
 	if (fmt != format_type::MOBILE_COMPRESS && fmt != format_type::MOBILE_NO_COMPRESS) return false;
 
-	u8_t* pAddr = rSrcDst_.data_ptr();
-	u32_t size;
-
-	if (!check_chunk("MMMD", pAddr)) return false;
-	pAddr += MA_3::CHUNK_HEAD_SIZE;
-	pAddr += MA_3::CHUNK_DATA_SIZE;
-
-	if (!check_chunk("CNTI", pAddr)) return false;
-	pAddr += MA_3::CHUNK_HEAD_SIZE;
-	size = calc_size(pAddr, MA_3::CHUNK_DATA_SIZE);
-	pAddr += (MA_3::CHUNK_DATA_SIZE + size);
-
-	if (!check_chunk("OPDA", pAddr)) return false;
-	pAddr += MA_3::CHUNK_HEAD_SIZE;
-	size = calc_size(pAddr, MA_3::CHUNK_DATA_SIZE);
-	pAddr += (MA_3::CHUNK_DATA_SIZE + size);
-
-	if (!check_chunk("MTR*", pAddr)) return false;
-	pAddr += MA_3::CHUNK_HEAD_SIZE;
-	pAddr += MA_3::CHUNK_DATA_SIZE;
-
-	pAddr++;													// Format Type
-	pAddr++;													// Sequence Type
-	pAddr++;													// Timebase of Duration
-	pAddr++;													// Timebase of Gatetime
+	std::vector<u32_t> heads;
+	if (!score_heads(rSrcDst_, (4 + MA_3::CHANNELS), heads)) return false;
 
 	const channel_status reset = (
 		channel_status::KCS_NOCARE,
 		channel_status::VS_OFF,
 		channel_status::LED_OFF,
 		channel_status::TYPE_NOCARE);
-	for (u32_t ch = 0; ch < MA_3::CHANNELS; ch++)
+	for (size_t i = 0; i < heads.size(); i++)
 	{
-		*pAddr++ = reset();
+		u8_t* pAddr = (rSrcDst_.data_ptr() + heads[i]);
+
+		pAddr++;												// Format Type
+		pAddr++;												// Sequence Type
+		pAddr++;												// Timebase of Duration
+		pAddr++;												// Timebase of Gatetime
+
+		for (u32_t ch = 0; ch < MA_3::CHANNELS; ch++)
+		{
+			*pAddr++ = reset();
+		}
 	}
 
 	return fix_crc16(rSrcDst_);
@@ -345,39 +610,29 @@ bool smaf::clear_channel_status(MA_3& rSrcDst_)
 //------------------------------------------------------------------------------------------------------//
 bool smaf::change_channel_status(MA_3& rSrcDst_, u32_t ch_, const channel_status& rStatus_)
 {
+	OPENMF_TRACE_SCOPE("change_channel_status");
+	OPENMF_TRACE_COUNT("change_channel_status.bytes", rSrcDst_.size());
+
 	if (rSrcDst_.empty() || ch_ >= MA_3::CHANNELS) return false;
 
 	const format_type fmt = rSrcDst_.get_format();
 	if (fmt != format_type::MOBILE_COMPRESS && fmt != format_type::MOBILE_NO_COMPRESS) return false;
 
-	u8_t* pAddr = rSrcDst_.data_ptr();
-	u32_t size;
-
-	if (!check_chunk("MMMD", pAddr)) return false;
-	pAddr += MA_3::CHUNK_HEAD_SIZE;
-	pAddr += MA_3::CHUNK_DATA_SIZE;
-
-	if (!check_chunk("CNTI", pAddr)) return false;
-	pAddr += MA_3::CHUNK_HEAD_SIZE;
-	size = calc_size(pAddr, MA_3::CHUNK_DATA_SIZE);
-	pAddr += (MA_3::CHUNK_DATA_SIZE + size);
-
-	if (!check_chunk("OPDA", pAddr)) return false;
-	pAddr += MA_3::CHUNK_HEAD_SIZE;
-	size = calc_size(pAddr, MA_3::CHUNK_DATA_SIZE);
-	pAddr += (MA_3::CHUNK_DATA_SIZE + size);
+	std::vector<u32_t> heads;
+	if (!score_heads(rSrcDst_, (4 + MA_3::CHANNELS), heads)) return false;
 
-	if (!check_chunk("MTR*", pAddr)) return false;
-	pAddr += MA_3::CHUNK_HEAD_SIZE;
-	pAddr += MA_3::CHUNK_DATA_SIZE;
+	for (size_t i = 0; i < heads.size(); i++)
+	{
+		u8_t* pAddr = (rSrcDst_.data_ptr() + heads[i]);
 
-	pAddr++;													// Format Type
-	pAddr++;													// Sequence Type
-	pAddr++;													// Timebase of Duration
-	pAddr++;													// Timebase of Gatetime
+		pAddr++;												// Format Type
+		pAddr++;												// Sequence Type
+		pAddr++;												// Timebase of Duration
+		pAddr++;												// Timebase of Gatetime
 
-	pAddr += ch_;												// Move to Target Address
-	*pAddr = rStatus_();
+		pAddr += ch_;											// Move to Target Address
+		*pAddr = rStatus_();
+	}
 
 	return fix_crc16(rSrcDst_);
 }
@@ -387,564 +642,1858 @@ bool smaf::change_channel_status(MA_3& rSrcDst_, u32_t ch_, const channel_status
 //------------------------------------------------------------------------------------------------------//
 bool smaf::change_timebase(MA_3& rSrcDst_, const timebase& rNewTimebase_)
 {
+	OPENMF_TRACE_SCOPE("change_timebase");
+	OPENMF_TRACE_COUNT("change_timebase.bytes", rSrcDst_.size());
+
 	if (rSrcDst_.empty() || !rNewTimebase_.is_valid()) return false;
 
 	const format_type fmt = rSrcDst_.get_format();
 	if (fmt != format_type::MOBILE_COMPRESS && fmt != format_type::MOBILE_NO_COMPRESS) return false;
 
-	u8_t* pAddr = rSrcDst_.data_ptr();
-	u32_t size;
-
-	if (!check_chunk("MMMD", pAddr)) return false;
-	pAddr += MA_3::CHUNK_HEAD_SIZE;
-	pAddr += MA_3::CHUNK_DATA_SIZE;
-
-	if (!check_chunk("CNTI", pAddr)) return false;
-	pAddr += MA_3::CHUNK_HEAD_SIZE;
-	size = calc_size(pAddr, MA_3::CHUNK_DATA_SIZE);
-	pAddr += (MA_3::CHUNK_DATA_SIZE + size);
-
-	if (!check_chunk("OPDA", pAddr)) return false;
-	pAddr += MA_3::CHUNK_HEAD_SIZE;
-	size = calc_size(pAddr, MA_3::CHUNK_DATA_SIZE);
-	pAddr += (MA_3::CHUNK_DATA_SIZE + size);
+	std::vector<u32_t> heads;
+	if (!score_heads(rSrcDst_, (4 + MA_3::CHANNELS), heads)) return false;
 
-	if (!check_chunk("MTR*", pAddr)) return false;
-	pAddr += MA_3::CHUNK_HEAD_SIZE;
-	pAddr += MA_3::CHUNK_DATA_SIZE;
+	for (size_t i = 0; i < heads.size(); i++)
+	{
+		u8_t* pAddr = (rSrcDst_.data_ptr() + heads[i]);
 
-	pAddr++;													// Format Type
-	pAddr++;													// Sequence Type
+		pAddr++;												// Format Type
+		pAddr++;												// Sequence Type
 
-	*pAddr++ = rNewTimebase_.D;									// Timebase of Duration
-	*pAddr = rNewTimebase_.G;									// Timebase of Gatetime
+		*pAddr++ = rNewTimebase_.D;								// Timebase of Duration
+		*pAddr = rNewTimebase_.G;								// Timebase of Gatetime
+	}
 
 	return fix_crc16(rSrcDst_);
 }
 
 //------------------------------------------------------------------------------------------------------//
-// Change Tempo
+// Tempo Scaling (Internal for change_tempo)
 //------------------------------------------------------------------------------------------------------//
-bool smaf::change_tempo(const MA_3& rSrc_, const timebase& rNewTimebase_, f64_t ratio_, MA_3& rDst_)
-{
-	const format_type fmt = rSrc_.get_format();
-	if (fmt != format_type::MOBILE_NO_COMPRESS) return false;
-
-	if (!rNewTimebase_.is_valid() || ratio_ == 0.0) return false;
+namespace {
 
-	if (rSrc_ == rDst_) return false;
+const u64_t RATIO_LIMIT = 0xFFFF;								// Max Numerator/Denominator of Tempo Ratio
+const u32_t PARALLEL_SEQUENCE_SIZE = (1024 * 1024);				// Min Sequence Size to Scale Concurrently [byte]
 
-	const timebase curr_timebase = rSrc_.get_timebase();
-	const f64_t ratio = curr_timebase.D_ms() / (rNewTimebase_.D_ms() * ratio_);
+// Approximate a positive ratio with rNum_ / rDen_ by continued fractions.
+bool make_rational(f64_t ratio_, u64_t& rNum_, u64_t& rDen_)
+{
+	if (!(ratio_ > 0.0)) return false;
 
-	u8_t* pAddr = rSrc_.data_ptr();
-	u32_t size;
-	u32_t cnt = 0;
+	u64_t p0 = 0, q0 = 1;
+	u64_t p1 = 1, q1 = 0;
+	f64_t x = ratio_;
+	for (u32_t i = 0; i < 32; i++)
+	{
+		if (x > static_cast<f64_t>(RATIO_LIMIT)) break;
+		const u64_t a = static_cast<u64_t>(x);
+		const u64_t p2 = (a * p1) + p0;
+		const u64_t q2 = (a * q1) + q0;
+		if (p2 > RATIO_LIMIT || q2 > RATIO_LIMIT) break;
+		p0 = p1; q0 = q1;
+		p1 = p2; q1 = q2;
+
+		const f64_t frac = (x - static_cast<f64_t>(a));
+		if (frac < 1.0e-9) break;
+		x = (1.0 / frac);
+	}
+	if (p1 == 0 || q1 == 0) return false;						// Out of Range
 
-	u32_t file_size, score_size, sequence_size;
-	u32_t file_size_pos, score_size_pos, sequence_size_pos;
-
-	if (!check_chunk("MMMD", &pAddr[cnt])) return false;
-	cnt += MA_3::CHUNK_HEAD_SIZE;
-	file_size_pos = cnt;
-	file_size = calc_size(&pAddr[cnt], MA_3::CHUNK_DATA_SIZE);
-	cnt += MA_3::CHUNK_DATA_SIZE;
-
-	if (!check_chunk("CNTI", &pAddr[cnt])) return false;
-	cnt += MA_3::CHUNK_HEAD_SIZE;
-	size = calc_size(&pAddr[cnt], MA_3::CHUNK_DATA_SIZE);
-	cnt += (MA_3::CHUNK_DATA_SIZE + size);
+	rNum_ = p1;
+	rDen_ = q1;
+	return true;
+}
 
-	if (!check_chunk("OPDA", &pAddr[cnt])) return false;
-	cnt += MA_3::CHUNK_HEAD_SIZE;
-	size = calc_size(&pAddr[cnt], MA_3::CHUNK_DATA_SIZE);
-	cnt += (MA_3::CHUNK_DATA_SIZE + size);
+bool scale_sequence(const u8_t* pAddr_, u32_t size_, u64_t num_, u64_t den_, const timebase& rSrc_, const timebase& rDst_, u8_t* pDst_, u32_t& rSize_)
+{
+	scale_visitor scale(num_, den_, pDst_);
+	scale.set_gatetime_ms(rSrc_.D_ms(), rSrc_.G_ms(), rDst_.D_ms(), rDst_.G_ms());
+	if (!walk_sequence(pAddr_, size_, scale)) return false;
+	rSize_ = scale.pos;
+	return true;
+}
 
-	if (!check_chunk("MTR*", &pAddr[cnt])) return false;
-	cnt += MA_3::CHUNK_HEAD_SIZE;
-	score_size_pos = cnt;
-	score_size = calc_size(&pAddr[cnt], MA_3::CHUNK_DATA_SIZE);
-	cnt += MA_3::CHUNK_DATA_SIZE;
-	cnt++;														// Format Type
-	cnt++;														// Sequence Type
-	cnt++;														// Timebase of Duration
-	cnt++;														// Timebase of Gatetime
-	cnt += MA_3::CHANNELS;										// Channel Status
+// Scale the ranges concurrently. The output of each range starts at the sum of the sizes before it.
+// (pDst = nullptr: Measure the output size of each range to rSizes_.)
+bool scale_ranges(const u8_t* pAddr_, const std::vector<sequence_range>& rRanges_, u64_t num_, u64_t den_, const timebase& rSrc_, const timebase& rDst_, u8_t* pDst_, std::vector<u32_t>& rSizes_)
+{
+	if (pDst_ == nullptr) rSizes_.assign(rRanges_.size(), 0);
 
-	if (check_chunk("MspI", &pAddr[cnt]))
+	std::vector<scale_visitor> scale;
+	scale.reserve(rRanges_.size());
+	u32_t pos = 0;
+	for (size_t i = 0; i < rRanges_.size(); i++)
 	{
-		cnt += MA_3::CHUNK_HEAD_SIZE;
-		size = calc_size(&pAddr[cnt], MA_3::CHUNK_DATA_SIZE);
-		cnt += (MA_3::CHUNK_DATA_SIZE + size);
+		scale.push_back(scale_visitor(num_, den_, (pDst_ != nullptr) ? &pDst_[pos] : nullptr, rRanges_[i].time));
+		scale.back().set_gatetime_ms(rSrc_.D_ms(), rSrc_.G_ms(), rDst_.D_ms(), rDst_.G_ms());
+		pos += rSizes_[i];
 	}
+	if (!walk_sequence_parallel(pAddr_, rRanges_, scale.data())) return false;
 
-	if (check_chunk("Mtsu", &pAddr[cnt]))
+	for (size_t i = 0; i < rRanges_.size(); i++)
 	{
-		cnt += MA_3::CHUNK_HEAD_SIZE;
-		size = calc_size(&pAddr[cnt], MA_3::CHUNK_DATA_SIZE);
-		cnt += (MA_3::CHUNK_DATA_SIZE + size);
+		if (pDst_ != nullptr && scale[i].pos != rSizes_[i]) return false;
+		rSizes_[i] = scale[i].pos;
 	}
+	return true;
+}
+
+// Ratio of change_tempo. (new_tick = tick * D_ms(track) * den / (D_ms(new) * num))
+struct tempo_context
+{
+	u64_t    ratio_num;											// Numerator of Tempo Ratio
+	u64_t    ratio_den;											// Denominator of Tempo Ratio
+	timebase new_timebase;										// Timebase of Output
+};
+
+// Scale the track with its own timebase. (Rewriter for change_tempo)
+bool scale_track(const u8_t* pAddr_, const track_info& rTrack_, u32_t /*index_*/, std::vector<u8_t>& rDst_, void* pContext_)
+{
+	const tempo_context* pContext = static_cast<const tempo_context*>(pContext_);
+	const timebase curr_timebase = track_timebase(pAddr_, rTrack_);
+	if (curr_timebase.D_ms() == 0 || curr_timebase.G_ms() == 0) return false;
+
+	const timebase& new_timebase = pContext->new_timebase;
+	const u64_t num = (curr_timebase.D_ms() * pContext->ratio_den);
+	const u64_t den = (new_timebase.D_ms() * pContext->ratio_num);
+	const u8_t* pSequence = &pAddr_[rTrack_.sequence_pos];
+	u32_t size;
+	if (!scale_sequence(pSequence, rTrack_.sequence_size, num, den, curr_timebase, new_timebase, nullptr, size)) return false;
+	rDst_.resize(size);
+	return scale_sequence(pSequence, rTrack_.sequence_size, num, den, curr_timebase, new_timebase, rDst_.data(), size);
+}
 
-	if (!check_chunk("Mtsq", &pAddr[cnt])) return false;
-	cnt += MA_3::CHUNK_HEAD_SIZE;
-	sequence_size_pos = cnt;
-	sequence_size = calc_size(&pAddr[cnt], MA_3::CHUNK_DATA_SIZE);
-	cnt += MA_3::CHUNK_DATA_SIZE;
+}																// namespace
 
-	if (!rDst_.create(cnt, pAddr)) return false;
+//------------------------------------------------------------------------------------------------------//
+// Change Tempo
+//------------------------------------------------------------------------------------------------------//
+bool smaf::change_tempo(const MA_3& rSrc_, const timebase& rNewTimebase_, f64_t ratio_, MA_3& rDst_)
+{
+	OPENMF_TRACE_SCOPE("change_tempo");
+	OPENMF_TRACE_COUNT("change_tempo.bytes", rSrc_.size());
+
+	const format_type fmt = rSrc_.get_format();
+	if (fmt != format_type::MOBILE_NO_COMPRESS) return false;
 
-	sequence_state next_state = SS_DURATION;
+	if (!rNewTimebase_.is_valid() || ratio_ == 0.0) return false;
+
+	const timebase curr_timebase = rSrc_.get_timebase();
+	if (curr_timebase.D_ms() == 0 || curr_timebase.G_ms() == 0) return false;
+
+	// new_tick = tick * D_ms(curr) / (D_ms(new) * ratio_) with ratio_ = ratio_num / ratio_den
+	u64_t ratio_num, ratio_den;
+	if (!make_rational(ratio_, ratio_num, ratio_den)) return false;
+	const u64_t num = (curr_timebase.D_ms() * ratio_den);
+	const u64_t den = (rNewTimebase_.D_ms() * ratio_num);
 
-	const u32_t sequence_end = (cnt + sequence_size);
-	while (cnt < sequence_end)
+	track_layout tracks;
+	if (!analyze_tracks(rSrc_, tracks)) return false;
+	if (score_sequences(tracks) > 1)
 	{
-		switch (next_state)
+		// Several score tracks: Each track is scaled on the thread pool with its own timebase.
+		if (rSrc_ == rDst_)
 		{
-		case SS_DURATION:
-			next_state = SS_STATUS;
-			{
-				u8_t buf[4];									// For Variable Size
-				u32_t len;										// For Variable Size
-				u32_t duration = calc_variable_size(&pAddr[cnt], len);
-				cnt += len;
-				if (duration != 0)
-				{
-					duration = static_cast<u32_t>((duration * ratio) + 0.5);
-				}
-				make_variable_size_array(duration, buf, len);
-				for (u32_t i = 0; i < len; i++)
-				{
-					rDst_.push(buf[i]);
-				}
-			}
-			break;
-		case SS_STATUS:
-			switch (pAddr[cnt] & 0xF0)
-			{
-			case SE_NOTE_NOVELOCITY:
-				next_state = SS_GATETIME;
-				{
-					rDst_.push(pAddr[cnt++]);
-					rDst_.push(pAddr[cnt++]);
-				}
-				break;
-			case SE_NOTE_VELOCITY:
-				next_state = SS_GATETIME;
-				{
-					rDst_.push(pAddr[cnt++]);
-					rDst_.push(pAddr[cnt++]);
-					rDst_.push(pAddr[cnt++]);
-				}
-				break;
-			case SE_RESERVED_3BYTE:
-				next_state = SS_DURATION;
-				{
-					rDst_.push(pAddr[cnt++]);
-					rDst_.push(pAddr[cnt++]);
-					rDst_.push(pAddr[cnt++]);
-				}
-				break;
-			case SE_CONTROL_CHANGE:
-				next_state = SS_DURATION;
-				{
-					rDst_.push(pAddr[cnt++]);
-					rDst_.push(pAddr[cnt++]);
-					rDst_.push(pAddr[cnt++]);
-				}
-				break;
-			case SE_PROGRAM_CHANGE:
-				next_state = SS_DURATION;
-				{
-					rDst_.push(pAddr[cnt++]);
-					rDst_.push(pAddr[cnt++]);
-				}
-				break;
-			case SE_RESERVED_2BYTE:
-				next_state = SS_DURATION;
-				{
-					rDst_.push(pAddr[cnt++]);
-					rDst_.push(pAddr[cnt++]);
-				}
-				break;
-			case SE_PITCH_BEND:
-				next_state = SS_DURATION;
-				{
-					rDst_.push(pAddr[cnt++]);
-					rDst_.push(pAddr[cnt++]);
-					rDst_.push(pAddr[cnt++]);
-				}
-				break;
-			case SE_SYSTEM_EXCLUSIVE:
-				next_state = SS_DURATION;
-				{
-					if (pAddr[cnt] == SE_SYSTEM_EXCLUSIVE)
-					{
-						u32_t len;
-						u32_t info_size;
-						rDst_.push(pAddr[cnt++]);
-						info_size = calc_variable_size(&pAddr[cnt], len);
-
-						for (u32_t i = 0; i < (len + info_size); i++)
-						{
-							rDst_.push(pAddr[cnt++]);
-						}
-					}
-					else if (pAddr[cnt] == SE_EOS_NOP)
-					{
-						rDst_.push(pAddr[cnt++]);
-
-						if (pAddr[cnt] == 0x2F)
-						{
-							// EOS
-							rDst_.push(pAddr[cnt++]);
-							rDst_.push(pAddr[cnt++]);
-						}
-						else
-						{
-							// NOP
-							rDst_.push(pAddr[cnt++]);
-						}
-					}
-					else
-					{
-						rDst_.push(pAddr[cnt++]);
-					}
-				}
-				break;
-			default:
-				return false;									// Error
-			}
-			break;
-		case SS_GATETIME:
-			next_state = SS_DURATION;
-			{
-				u8_t buf[4];									// For Variable Size
-				u32_t len;										// For Variable Size
-				u32_t gatetime = calc_variable_size(&pAddr[cnt], len);
-				cnt += len;
-				if (gatetime != 0)
-				{
-					gatetime = static_cast<u32_t>((gatetime * ratio) + 0.5);
-				}
-				make_variable_size_array(gatetime, buf, len);
-				for (u32_t i = 0; i < len; i++)
-				{
-					rDst_.push(buf[i]);
-				}
-			}
-			break;
-		default:
-			return false;										// Error
+			const MA_3 src(rSrc_);
+			return change_tempo(src, rNewTimebase_, ratio_, rDst_);
+		}
+		tempo_context context;
+		context.ratio_num = ratio_num;
+		context.ratio_den = ratio_den;
+		context.new_timebase = rNewTimebase_;
+		if (!rewrite_tracks(rSrc_, tracks, scale_track, &context, rDst_)) return false;
+		return change_timebase(rDst_, rNewTimebase_);
+	}
+
+	sequence_layout layout;
+	if (!first_layout(tracks, layout)) return false;
+
+	const u8_t* pAddr = rSrc_.data_ptr();
+	const u32_t tail_pos = (layout.sequence_pos + layout.sequence_size);
+	const u32_t tail_size = (rSrc_.size() - tail_pos);
+	u32_t sequence_size;
+
+	if (rSrc_ == rDst_)
+	{
+		// Slowing down can grow the data, so it is scaled from a copy of the source.
+		if (num > den || (curr_timebase.G_ms() * ratio_den) > (rNewTimebase_.G_ms() * ratio_num))
+		{
+			const MA_3 src(rSrc_);
+			return change_tempo(src, rNewTimebase_, ratio_, rDst_);
+		}
+
+		// (1) Compact in place. Every duration and gatetime gets shorter or equal,
+		//     so the write cursor never passes the read cursor.
+		//
+		u8_t* pDst = rDst_.data_ptr();
+		if (!scale_sequence(&pAddr[layout.sequence_pos], layout.sequence_size, num, den, curr_timebase, rNewTimebase_, &pDst[layout.sequence_pos], sequence_size)) return false;
+		for (u32_t i = 0; i < tail_size; i++)
+		{
+			pDst[layout.sequence_pos + sequence_size + i] = pAddr[tail_pos + i];
 		}
+		if (!rDst_.truncate(layout.sequence_pos + sequence_size + tail_size)) return false;
 	}
+	else if (layout.sequence_size >= PARALLEL_SEQUENCE_SIZE)
+	{
+		// (1) Split the long sequence and measure the re-encoded size of each range.
+		//
+		std::vector<sequence_range> ranges;
+		std::vector<u32_t> sizes;
+		if (!split_sequence(&pAddr[layout.sequence_pos], layout.sequence_size, 0, ranges)) return false;
+		if (!scale_ranges(&pAddr[layout.sequence_pos], ranges, num, den, curr_timebase, rNewTimebase_, nullptr, sizes)) return false;
+		sequence_size = 0;
+		for (size_t i = 0; i < sizes.size(); i++)
+		{
+			sequence_size += sizes[i];
+		}
 
-	rDst_.push(0x00);											// Push Dummy CRC Code (Upper 8bit)
-	rDst_.push(0x00);											// Push Dummy CRC Code (Lower 8bit)
+		// (2) Header + Scaled Sequence Data + Remaining Chunks and CRC
+		//
+		if (!rDst_.create(layout.sequence_pos + sequence_size + tail_size)) return false;
+		u8_t* pDst = rDst_.data_ptr();
 
-	s32_t diff_size = (rDst_.size() - rSrc_.size());
-	if (diff_size != 0)
+		for (u32_t i = 0; i < layout.sequence_pos; i++)
+		{
+			pDst[i] = pAddr[i];
+		}
+		if (!scale_ranges(&pAddr[layout.sequence_pos], ranges, num, den, curr_timebase, rNewTimebase_, &pDst[layout.sequence_pos], sizes)) return false;
+		for (u32_t i = 0; i < tail_size; i++)
+		{
+			pDst[layout.sequence_pos + sequence_size + i] = pAddr[tail_pos + i];
+		}
+	}
+	else
 	{
-		file_size += diff_size;
-		make_size_array(file_size, MA_3::CHUNK_DATA_SIZE, &rDst_[file_size_pos]);
+		// (1) Measure the re-encoded sequence size.
+		//
+		if (!scale_sequence(&pAddr[layout.sequence_pos], layout.sequence_size, num, den, curr_timebase, rNewTimebase_, nullptr, sequence_size)) return false;
 
-		score_size += diff_size;
-		make_size_array(score_size, MA_3::CHUNK_DATA_SIZE, &rDst_[score_size_pos]);
+		// (2) Header + Scaled Sequence Data + Remaining Chunks and CRC
+		//
+		if (!rDst_.create(layout.sequence_pos + sequence_size + tail_size)) return false;
+		u8_t* pDst = rDst_.data_ptr();
 
-		sequence_size += diff_size;
-		make_size_array(sequence_size, MA_3::CHUNK_DATA_SIZE, &rDst_[sequence_size_pos]);
+		for (u32_t i = 0; i < layout.sequence_pos; i++)
+		{
+			pDst[i] = pAddr[i];
+		}
+		if (!scale_sequence(&pAddr[layout.sequence_pos], layout.sequence_size, num, den, curr_timebase, rNewTimebase_, &pDst[layout.sequence_pos], sequence_size)) return false;
+		for (u32_t i = 0; i < tail_size; i++)
+		{
+			pDst[layout.sequence_pos + sequence_size + i] = pAddr[tail_pos + i];
+		}
 	}
 
+	// (2) Data Fix
+	//
+	u8_t* pDst = rDst_.data_ptr();
+	const u32_t file_size = (layout.file_size + sequence_size - layout.sequence_size);
+	make_size_array(file_size, MA_3::CHUNK_DATA_SIZE, &pDst[layout.file_size_pos]);
+
+	const u32_t score_size = (layout.score_size + sequence_size - layout.sequence_size);
+	make_size_array(score_size, MA_3::CHUNK_DATA_SIZE, &pDst[layout.score_size_pos]);
+
+	make_size_array(sequence_size, MA_3::CHUNK_DATA_SIZE, &pDst[layout.sequence_size_pos]);
+
 	return change_timebase(rDst_, rNewTimebase_);
 }
 
 //------------------------------------------------------------------------------------------------------//
-// Combine SMAF Data
+// Append Sequence (Internal for combine)
 //------------------------------------------------------------------------------------------------------//
-bool smaf::combine(const MA_3& rSrc1_, const MA_3& rSrc2_, MA_3& rDst_, u32_t gap_)
+namespace {
+
+// Find the head event and the channels of the notes from it. The head is the first note with
+// velocity, or the first event after limit_ when no note with velocity comes before it.
+struct head_visitor
 {
-	const format_type fmt1 = rSrc1_.get_format();
-	const format_type fmt2 = rSrc1_.get_format();
-	if (fmt1 != format_type::MOBILE_NO_COMPRESS || fmt2 != format_type::MOBILE_NO_COMPRESS) return false;
+	explicit head_visitor(u64_t limit_)
+		: limit(limit_), time(0), head_pos(0), head_time(0), event_time(0), found(false), channels(0)
+	{}
 
-	if (rSrc1_ == rDst_ || rSrc2_ == rDst_) return false;
+	bool duration(u32_t value_, u32_t pos_, u32_t /*len_*/)
+	{
+		if (!found)
+		{
+			head_pos = pos_;
+			head_time = time;
+		}
+		time += value_;
+		return true;
+	}
+	bool event(const u8_t* pEvent_, u32_t /*size_*/, const event_info& rInfo_)
+	{
+		if (!found && (time > limit || (rInfo_.kind == EK_NOTE && (pEvent_[0] & 0xF0) == SE_NOTE_VELOCITY)))
+		{
+			found = true;
+			event_time = time;
+		}
+		if (found && rInfo_.kind == EK_NOTE) channels |= (1 << (pEvent_[0] & 0x0F));
+		return true;
+	}
+	bool gatetime(u32_t /*value_*/, u32_t /*pos_*/, u32_t /*len_*/)
+	{
+		return true;
+	}
 
-	// (1) rSrc1_ Analysis
-	//
-	u8_t* pAddr1 = rSrc1_.data_ptr();
-	u32_t size;
-	u32_t cnt = 0;
+	u64_t limit;												// Time Limit of the Head [tick]
+	u64_t time;													// Absolute Time [tick]
+	u32_t head_pos;												// Position of the Head Event (Duration)
+	u64_t head_time;											// Time before the Duration of the Head Event [tick]
+	u64_t event_time;											// Time of the Head Event [tick]
+	bool  found;												// Head Event is Found
+	u32_t channels;												// Channels of Notes from the Head Event (bit n = Channel n)
+};
+
+// Scale the sequence from the first note. The duration of the first note is replaced by the gap.
+struct append_visitor
+{
+	append_visitor(u64_t num_, u64_t den_, u8_t* pDst_, u64_t time_, u32_t gap_)
+		: scale(num_, den_, pDst_, time_), gap(gap_), head(true)
+	{}
 
-	u32_t file_size, score_size, sequence_size;
-	u32_t file_size_pos, score_size_pos, sequence_size_pos;
+	bool duration(u32_t value_, u32_t pos_, u32_t len_)
+	{
+		if (!head) return scale.duration(value_, pos_, len_);
 
-	if (!check_chunk("MMMD", &pAddr1[cnt])) return false;
-	cnt += MA_3::CHUNK_HEAD_SIZE;
-	file_size_pos = cnt;
-	file_size = calc_size(&pAddr1[cnt], MA_3::CHUNK_DATA_SIZE);
-	cnt += MA_3::CHUNK_DATA_SIZE;
+		head = false;
+		scale.src_time += value_;
+		scale.dst_time = (((scale.src_time * scale.num) + scale.half) / scale.den);
+		scale.write_variable_size(gap);
+		return true;
+	}
+	bool event(const u8_t* pEvent_, u32_t size_, const event_info& rInfo_)
+	{
+		return scale.event(pEvent_, size_, rInfo_);
+	}
+	bool gatetime(u32_t value_, u32_t pos_, u32_t len_)
+	{
+		return scale.gatetime(value_, pos_, len_);
+	}
 
-	if (!check_chunk("CNTI", &pAddr1[cnt])) return false;
-	cnt += MA_3::CHUNK_HEAD_SIZE;
-	size = calc_size(&pAddr1[cnt], MA_3::CHUNK_DATA_SIZE);
-	cnt += (MA_3::CHUNK_DATA_SIZE + size);
+	scale_visitor scale;										// Scaling and Output
+	u32_t         gap;											// Duration of Gap [tick]
+	bool          head;											// Next Duration is the First Note's
+};
 
-	if (!check_chunk("OPDA", &pAddr1[cnt])) return false;
-	cnt += MA_3::CHUNK_HEAD_SIZE;
-	size = calc_size(&pAddr1[cnt], MA_3::CHUNK_DATA_SIZE);
-	cnt += (MA_3::CHUNK_DATA_SIZE + size);
+// Merge the channel status of the appended data. A channel keeps its status unless only rSrc2_
+// plays it. On a shared channel, the unset fields are taken from rSrc2_ and the effects are joined.
+channel_status merge_channel_status(const channel_status& rSrc1_, bool used1_, const channel_status& rSrc2_, bool used2_)
+{
+	if (!used2_) return rSrc1_;
+	if (!used1_) return rSrc2_;
+
+	return channel_status(
+		(rSrc1_.kcs() != channel_status::KCS_NOCARE) ? rSrc1_.kcs() : rSrc2_.kcs(),
+		(rSrc1_.vs() | rSrc2_.vs()),
+		(rSrc1_.led() | rSrc2_.led()),
+		(rSrc1_.ch_type() != channel_status::TYPE_NOCARE) ? rSrc1_.ch_type() : rSrc2_.ch_type());
+}
 
-	if (!check_chunk("MTR*", &pAddr1[cnt])) return false;
-	cnt += MA_3::CHUNK_HEAD_SIZE;
-	score_size_pos = cnt;
-	score_size = calc_size(&pAddr1[cnt], MA_3::CHUNK_DATA_SIZE);
-	cnt += MA_3::CHUNK_DATA_SIZE;
-	cnt++;														// Format Type
-	cnt++;														// Sequence Type
-	cnt++;														// Timebase of Duration
-	cnt++;														// Timebase of Gatetime
-	cnt += MA_3::CHANNELS;										// Channel Status
+// Track of rSrc2_ appended to a track of rSrc1_.
+struct append_plan
+{
+	const track_info* pTrack2;									// Track of rSrc2_ (nullptr = Nothing to Append)
+	u32_t             reduce;									// Trailing NOPs and EOS of rSrc1_'s Track [byte]
+	u32_t             head_pos;									// Head Event in rSrc2_'s Sequence Data (Duration)
+	u64_t             head_time;								// Time before the Duration of the Head Event [tick]
+	u64_t             num;										// Numerator of Retiming (D_ms of rSrc2_'s Track)
+	u64_t             den;										// Denominator of Retiming (D_ms of rSrc1_'s Track)
+	u64_t             gate_num;									// G_ms of rSrc2_'s Track
+	u64_t             gate_den;									// G_ms of rSrc1_'s Track
+	u32_t             gap;										// Duration of the Head Event [tick]
+	u32_t             channels1;								// Channels of Notes of rSrc1_'s Track
+	u32_t             channels2;								// Channels of Notes of rSrc2_'s Track from the Head
+};
+
+// Plans of combine. (Indexed by the tracks of rSrc1_)
+struct combine_context
+{
+	const u8_t*               pAddr2;							// Data of rSrc2_
+	std::vector<append_plan>  plans;							// Plans
+};
 
-	if (check_chunk("MspI", &pAddr1[cnt]))
+// rSrc1_'s Track without the trailing NOPs and EOS + rSrc2_'s Track from the Head (Rewriter for combine)
+bool append_track(const u8_t* pAddr_, const track_info& rTrack_, u32_t index_, std::vector<u8_t>& rDst_, void* pContext_)
+{
+	const combine_context* pContext = static_cast<const combine_context*>(pContext_);
+	const append_plan& plan = pContext->plans[index_];
+	const u8_t* pSequence = &pAddr_[rTrack_.sequence_pos];
+	if (plan.pTrack2 == nullptr)
 	{
-		cnt += MA_3::CHUNK_HEAD_SIZE;
-		size = calc_size(&pAddr1[cnt], MA_3::CHUNK_DATA_SIZE);
-		cnt += (MA_3::CHUNK_DATA_SIZE + size);
+		rDst_.assign(pSequence, pSequence + rTrack_.sequence_size);
+		return true;
 	}
 
-	if (check_chunk("Mtsu", &pAddr1[cnt]))
+	const u8_t* pBody = &pContext->pAddr2[plan.pTrack2->sequence_pos + plan.head_pos];
+	const u32_t body_size = (plan.pTrack2->sequence_size - plan.head_pos);
+	append_visitor measure(plan.num, plan.den, nullptr, plan.head_time, plan.gap);
+	measure.scale.set_gatetime_ms(plan.num, plan.gate_num, plan.den, plan.gate_den);
+	if (!walk_sequence(pBody, body_size, measure)) return false;
+
+	const u32_t keep = (rTrack_.sequence_size - plan.reduce);
+	rDst_.resize(keep + measure.scale.pos);
+	for (u32_t i = 0; i < keep; i++)
 	{
-		cnt += MA_3::CHUNK_HEAD_SIZE;
-		size = calc_size(&pAddr1[cnt], MA_3::CHUNK_DATA_SIZE);
-		cnt += (MA_3::CHUNK_DATA_SIZE + size);
+		rDst_[i] = pSequence[i];
 	}
+	append_visitor append(plan.num, plan.den, (rDst_.data() + keep), plan.head_time, plan.gap);
+	append.scale.set_gatetime_ms(plan.num, plan.gate_num, plan.den, plan.gate_den);
+	return walk_sequence(pBody, body_size, append);
+}
 
-	if (!check_chunk("Mtsq", &pAddr1[cnt])) return false;
-	cnt += MA_3::CHUNK_HEAD_SIZE;
-	sequence_size_pos = cnt;
-	sequence_size = calc_size(&pAddr1[cnt], MA_3::CHUNK_DATA_SIZE);
-	cnt += MA_3::CHUNK_DATA_SIZE;
+}																// namespace
 
-	u32_t nNOP = 0;												// Number of NOP
-	bool bEOS = false;											// EOS Flag
-	u32_t last_gatetime;										// Last Gatetime
+//------------------------------------------------------------------------------------------------------//
+// Combine SMAF Data
+//------------------------------------------------------------------------------------------------------//
+bool smaf::combine(const MA_3& rSrc1_, const MA_3& rSrc2_, MA_3& rDst_, u32_t gap_)
+{
+	OPENMF_TRACE_SCOPE("combine");
+	OPENMF_TRACE_COUNT("combine.bytes", (rSrc1_.size() + rSrc2_.size()));
 
-	sequence_state next_state = SS_DURATION;
+	const format_type fmt1 = rSrc1_.get_format();
+	const format_type fmt2 = rSrc2_.get_format();
+	if (fmt1 != format_type::MOBILE_NO_COMPRESS || fmt2 != format_type::MOBILE_NO_COMPRESS) return false;
 
-	const u32_t sequence_end = (cnt + sequence_size);
-	while (cnt < sequence_end)
-	{
-		switch (next_state)
-		{
-		case SS_DURATION:
-			next_state = SS_STATUS;
-			{
-				u32_t len;										// For Variable Size
-				u32_t duration = calc_variable_size(&pAddr1[cnt], len);
-				cnt += len;
-			}
-			break;
-		case SS_STATUS:
-			switch (pAddr1[cnt] & 0xF0)
-			{
-			case SE_NOTE_NOVELOCITY:
-				next_state = SS_GATETIME;
-				{
-					cnt += 2;
-				}
-				break;
-			case SE_NOTE_VELOCITY:
-				next_state = SS_GATETIME;
-				{
-					cnt += 3;
-				}
-				break;
-			case SE_RESERVED_3BYTE:
-				next_state = SS_DURATION;
-				{
-					cnt += 3;
-				}
-				break;
-			case SE_CONTROL_CHANGE:
-				next_state = SS_DURATION;
-				{
-					cnt += 3;
-				}
-				break;
-			case SE_PROGRAM_CHANGE:
-				next_state = SS_DURATION;
-				{
-					cnt += 2;
-				}
-				break;
-			case SE_RESERVED_2BYTE:
-				next_state = SS_DURATION;
-				{
-					cnt += 2;
-				}
-				break;
-			case SE_PITCH_BEND:
-				next_state = SS_DURATION;
-				{
-					cnt += 3;
-				}
-				break;
-			case SE_SYSTEM_EXCLUSIVE:
-				next_state = SS_DURATION;
-				{
-					if (pAddr1[cnt] == SE_SYSTEM_EXCLUSIVE)
-					{
-						cnt++;
-						u32_t len;
-						u32_t info_size = calc_variable_size(&pAddr1[cnt], len);
-						cnt += (len + info_size);
-					}
-					else if (pAddr1[cnt] == SE_EOS_NOP)
-					{
-						if (pAddr1[cnt + 1] == 0x2F)
-						{
-							cnt += MA_3::EOS_SIZE;				// EOS
-							bEOS = true;
-						}
-						else
-						{
-							cnt += MA_3::NOP_SIZE;				// NOP
-							nNOP++;
-						}
-					}
-					else
-					{
-						cnt++;
-					}
-				}
-				break;
-			default:
-				return false;									// Error
-			}
-			break;
-		case SS_GATETIME:
-			next_state = SS_DURATION;
-			{
-				u32_t len;										// For Variable Size
-				last_gatetime = calc_variable_size(&pAddr1[cnt], len);
-				cnt += len;
+	if (rSrc1_ == rDst_ || rSrc2_ == rDst_) return false;
 
-				nNOP = 0;
-			}
-			break;
-		default:
-			return false;										// Error
-		}
-	}
+	// rSrc2_ is retimed to the timebase of rSrc1_. (tick1 = tick2 * D_ms(2) / D_ms(1) per track)
+	const timebase timebase1 = rSrc1_.get_timebase();
+	if (timebase1.D_ms() == 0) return false;
+
+	track_layout tracks1, tracks2;
+	if (!analyze_tracks(rSrc1_, tracks1) || !analyze_tracks(rSrc2_, tracks2)) return false;
 
-	const u32_t nop_duration = 1;								// NOP's Duration [byte]
-	const u32_t eos_duration = 1;								// EOS's Duration [byte]
+	combine_context context;
+	context.pAddr2 = rSrc2_.data_ptr();
+	context.plans.resize(tracks1.tracks.size());
 
-	u32_t reduce_size = 0;
-	if (bEOS)
+	// (1) rSrc1_ Analysis (End of the Last Note of all Tracks [ms])
+	//
+	const u8_t* pAddr1 = rSrc1_.data_ptr();
+	u64_t end_ms = 0;
+	std::vector<u64_t> last_time(tracks1.tracks.size(), 0);
+	for (size_t k = 0; k < tracks1.tracks.size(); k++)
 	{
-		reduce_size = ((nNOP * (nop_duration + MA_3::NOP_SIZE)) + (eos_duration + MA_3::EOS_SIZE) + MA_3::CRC_SIZE);
+		const track_info& track = tracks1.tracks[k];
+		append_plan& plan = context.plans[k];
+		plan.pTrack2 = nullptr;
+		if (!is_score_sequence(track)) continue;
+		if (track.size < (4 + MA_3::CHANNELS)) return false;
+
+		plan.den = track_timebase(pAddr1, track).D_ms();
+		plan.gate_den = track_timebase(pAddr1, track).G_ms();
+		if (plan.den == 0 || plan.gate_den == 0) return false;
+
+		tail_visitor tail;
+		if (!walk_sequence(&pAddr1[track.sequence_pos], track.sequence_size, tail)) return false;
+		plan.reduce = tail.reduce_size();
+		if (plan.reduce > track.sequence_size) return false;
+		plan.channels1 = tail.channels;
+		last_time[k] = tail.last_time;
+
+		const u64_t end = ((tail.last_time * plan.den) + (tail.last_gatetime * plan.gate_den));
+		if (end > end_ms) end_ms = end;
 	}
-	else
+
+	// (2) rSrc2_ Analysis (Head = First Note with Velocity of all Tracks)
+	//
+	const u8_t* pAddr2 = rSrc2_.data_ptr();
+	std::vector<u32_t> partner(tracks2.tracks.size(), 0);
+	u64_t head_ms = ~static_cast<u64_t>(0);
+	for (size_t m = 0; m < tracks2.tracks.size(); m++)
 	{
-		reduce_size = (nNOP * (nop_duration + MA_3::NOP_SIZE) + MA_3::CRC_SIZE);
+		const track_info& track2 = tracks2.tracks[m];
+		if (!is_score_sequence(track2)) continue;
+		if (track2.size < (4 + MA_3::CHANNELS)) return false;
+
+		size_t k = 0;
+		while (k < tracks1.tracks.size() && !(is_score_sequence(tracks1.tracks[k]) && tracks1.tracks[k].number == track2.number)) k++;
+		if (k == tracks1.tracks.size()) return false;			// No Track of the same Number in rSrc1_
+		if (context.plans[k].pTrack2 != nullptr) return false;	// Same Number Twice
+		context.plans[k].pTrack2 = &track2;
+		context.plans[k].num = track_timebase(pAddr2, track2).D_ms();
+		context.plans[k].gate_num = track_timebase(pAddr2, track2).G_ms();
+		if (context.plans[k].num == 0 || context.plans[k].gate_num == 0) return false;
+		partner[m] = static_cast<u32_t>(k);
+
+		head_visitor first(~static_cast<u64_t>(0));
+		if (!walk_sequence(&pAddr2[track2.sequence_pos], track2.sequence_size, first)) return false;
+		if (first.found && (first.event_time * context.plans[k].num) < head_ms) head_ms = (first.event_time * context.plans[k].num);
 	}
+	if (head_ms == ~static_cast<u64_t>(0)) return false;		// No Note with Velocity
 
-	// (2) rSrc2_ Analysis
+	// (3) Plans (Every Track starts from the Head, gap_ after the End of rSrc1_)
 	//
-	const u8_t* pAddr2 = rSrc2_.data_ptr();
-	cnt = 0;
+	const u64_t start_ms = (end_ms + (static_cast<u64_t>(gap_) * timebase1.D_ms()));
+	for (size_t m = 0; m < tracks2.tracks.size(); m++)
+	{
+		const track_info& track2 = tracks2.tracks[m];
+		if (!is_score_sequence(track2)) continue;
+		append_plan& plan = context.plans[partner[m]];
+
+		head_visitor head(head_ms / plan.num);
+		if (!walk_sequence(&pAddr2[track2.sequence_pos], track2.sequence_size, head)) return false;
+		if (!head.found)
+		{
+			plan.pTrack2 = nullptr;								// Nothing after the Head
+			continue;
+		}
+
+		const u64_t target = ((start_ms + (head.event_time * plan.num) - head_ms + (plan.den / 2)) / plan.den);
+		if (target < last_time[partner[m]] || (target - last_time[partner[m]]) > 0x0FFFFFFF) return false;
+		plan.gap = static_cast<u32_t>(target - last_time[partner[m]]);
+		plan.head_pos = head.head_pos;
+		plan.head_time = head.head_time;
+		plan.channels2 = head.channels;
+	}
+
+	// (4) rSrc1_ Tracks + rSrc2_ Tracks (Retimed) on the Thread Pool
+	//
+	if (!rewrite_tracks(rSrc1_, tracks1, append_track, &context, rDst_)) return false;
+
+	// (5) Data Fix (Channel Status of the Appended Tracks)
+	//
+	track_layout tracks;
+	if (!analyze_tracks(rDst_, tracks) || tracks.tracks.size() != tracks1.tracks.size()) return false;
+	u8_t* pDst = rDst_.data_ptr();
+	for (size_t k = 0; k < tracks.tracks.size(); k++)
+	{
+		const append_plan& plan = context.plans[k];
+		if (plan.pTrack2 == nullptr) continue;
+
+		const u32_t channel_status_pos = (tracks.tracks[k].data_pos + 4);
+		const u8_t* pStatus2 = &pAddr2[plan.pTrack2->data_pos + 4];
+		for (u32_t ch = 0; ch < MA_3::CHANNELS; ch++)
+		{
+			const u32_t bit = (1 << ch);
+			const channel_status merged = merge_channel_status(
+				channel_status(pDst[channel_status_pos + ch]), ((plan.channels1 & bit) != 0),
+				channel_status(pStatus2[ch]), ((plan.channels2 & bit) != 0));
+			pDst[channel_status_pos + ch] = merged();
+		}
+	}
 
-	if (!check_chunk("MMMD", &pAddr2[cnt])) return false;
-	cnt += MA_3::CHUNK_HEAD_SIZE;
-	cnt += MA_3::CHUNK_DATA_SIZE;
+	return fix_crc16(rDst_);
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Repeat Sequence (Internal for repeat)
+//------------------------------------------------------------------------------------------------------//
+namespace {
 
-	if (!check_chunk("CNTI", &pAddr2[cnt])) return false;
-	cnt += MA_3::CHUNK_HEAD_SIZE;
-	size = calc_size(&pAddr2[cnt], MA_3::CHUNK_DATA_SIZE);
-	cnt += (MA_3::CHUNK_DATA_SIZE + size);
+// Body of a score track repeated by repeat.
+struct repeat_plan
+{
+	bool  repeat;												// The Track is Repeated (Otherwise Copied as It Is)
+	bool  tail_head;											// The Head is a Trailing NOP/EOS (Appended after the Last Gap)
+	u32_t keep;													// Sequence Data without the Trailing NOPs and EOS [byte]
+	u32_t body_pos;												// Head Event in the Sequence Data (After its Duration)
+	u64_t den;													// Duration's Timebase of the Track [ms]
+	u64_t last_time;											// Time of the Last Event except NOP/EOS [tick]
+	u64_t head_time;											// Time of the Head Event [tick]
+	u32_t sequence_size;										// Output Sequence Size [byte]
+};
+
+// Duration of the head event of the copy_-th repeat. (copy_ >= 1, Offsets are rounded on absolute time.)
+// A track without events after the head does not move its last event, so its gap is from the source's.
+bool repeat_gap(const repeat_plan& rPlan_, u64_t period_ms_, u32_t copy_, u32_t& rGap_)
+{
+	const u64_t offset = (((copy_ * period_ms_) + (rPlan_.den / 2)) / rPlan_.den);
+	const u64_t prev_offset = (copy_ == 1 || rPlan_.tail_head) ? 0 : ((((copy_ - 1) * period_ms_) + (rPlan_.den / 2)) / rPlan_.den);
+	const u64_t target = (rPlan_.head_time + offset);
+	const u64_t last = (rPlan_.last_time + prev_offset);
+	if (target < last || (target - last) > 0x0FFFFFFF) return false;
+	rGap_ = static_cast<u32_t>(target - last);
+	return true;
+}
 
-	if (!check_chunk("OPDA", &pAddr2[cnt])) return false;
-	cnt += MA_3::CHUNK_HEAD_SIZE;
-	size = calc_size(&pAddr2[cnt], MA_3::CHUNK_DATA_SIZE);
-	cnt += (MA_3::CHUNK_DATA_SIZE + size);
+}																// namespace
 
-	if (!check_chunk("MTR*", &pAddr2[cnt])) return false;
-	cnt += MA_3::CHUNK_HEAD_SIZE;
-	cnt += MA_3::CHUNK_DATA_SIZE;
-	cnt++;														// Format Type
-	cnt++;														// Sequence Type
-	cnt++;														// Timebase of Duration
-	cnt++;														// Timebase of Gatetime
-	cnt += MA_3::CHANNELS;										// Channel Status
+//------------------------------------------------------------------------------------------------------//
+// Repeat SMAF Data
+//------------------------------------------------------------------------------------------------------//
+bool smaf::repeat(const MA_3& rSrc_, u32_t count_, MA_3& rDst_, u32_t gap_)
+{
+	OPENMF_TRACE_SCOPE("repeat");
+	OPENMF_TRACE_COUNT("repeat.bytes", rSrc_.size());
 
-	if (check_chunk("MspI", &pAddr2[cnt]))
+	const format_type fmt = rSrc_.get_format();
+	if (fmt != format_type::MOBILE_NO_COMPRESS) return false;
+	if (count_ == 0 || rSrc_ == rDst_) return false;
+	if (count_ == 1)
 	{
-		cnt += MA_3::CHUNK_HEAD_SIZE;
-		size = calc_size(&pAddr2[cnt], MA_3::CHUNK_DATA_SIZE);
-		cnt += (MA_3::CHUNK_DATA_SIZE + size);
+		rDst_ = rSrc_;
+		return !rDst_.empty();
 	}
 
-	if (check_chunk("Mtsu", &pAddr2[cnt]))
+	const timebase first_timebase = rSrc_.get_timebase();
+	if (first_timebase.D_ms() == 0) return false;
+
+	track_layout layout;
+	if (!analyze_tracks(rSrc_, layout)) return false;
+
+	// (1) Analysis (End of the Last Note and Head = First Note with Velocity of all Tracks [ms], as combine)
+	//
+	const u8_t* pAddr = rSrc_.data_ptr();
+	std::vector<repeat_plan> plans(layout.tracks.size());
+	u64_t end_ms = 0;
+	u64_t head_ms = ~static_cast<u64_t>(0);
+	for (size_t k = 0; k < layout.tracks.size(); k++)
 	{
-		cnt += MA_3::CHUNK_HEAD_SIZE;
-		size = calc_size(&pAddr2[cnt], MA_3::CHUNK_DATA_SIZE);
-		cnt += (MA_3::CHUNK_DATA_SIZE + size);
+		const track_info& track = layout.tracks[k];
+		repeat_plan& plan = plans[k];
+		plan.repeat = false;
+		plan.tail_head = false;
+		plan.sequence_size = track.sequence_size;
+		if (!is_score_sequence(track)) continue;
+		if (track.size < (4 + MA_3::CHANNELS)) return false;
+
+		plan.den = track_timebase(pAddr, track).D_ms();
+		const u64_t gate_den = track_timebase(pAddr, track).G_ms();
+		if (plan.den == 0 || gate_den == 0) return false;
+
+		tail_visitor tail;
+		if (!walk_sequence(&pAddr[track.sequence_pos], track.sequence_size, tail)) return false;
+		if (tail.reduce_size() > track.sequence_size) return false;
+		plan.keep = (track.sequence_size - tail.reduce_size());
+		plan.last_time = tail.last_time;
+
+		const u64_t end = ((tail.last_time * plan.den) + (tail.last_gatetime * gate_den));
+		if (end > end_ms) end_ms = end;
+
+		head_visitor first(~static_cast<u64_t>(0));
+		if (!walk_sequence(&pAddr[track.sequence_pos], track.sequence_size, first)) return false;
+		if (first.found && (first.event_time * plan.den) < head_ms) head_ms = (first.event_time * plan.den);
 	}
+	if (head_ms == ~static_cast<u64_t>(0)) return false;		// No Note with Velocity
 
-	if (!check_chunk("Mtsq", &pAddr2[cnt])) return false;
-	cnt += MA_3::CHUNK_HEAD_SIZE;
-	cnt += MA_3::CHUNK_DATA_SIZE;
+	// Each repeat starts gap_ after the end of the previous one.
+	const u64_t start_ms = (end_ms + (static_cast<u64_t>(gap_) * first_timebase.D_ms()));
+	if (start_ms < head_ms) return false;
+	const u64_t period_ms = (start_ms - head_ms);
 
-	while (true)
+	// (2) Plans and the Output Size (Prefix + (count_ - 1) * (Gap + Body) + Tail per Track)
+	//
+	u64_t grow = 0;
+	for (size_t k = 0; k < layout.tracks.size(); k++)
 	{
-		if ((pAddr2[cnt] & 0xF0) != SE_NOTE_VELOCITY)			// Search First Note with Velocity.
+		const track_info& track = layout.tracks[k];
+		repeat_plan& plan = plans[k];
+		if (!is_score_sequence(track)) continue;
+
+		head_visitor head(head_ms / plan.den);
+		if (!walk_sequence(&pAddr[track.sequence_pos], track.sequence_size, head)) return false;
+		if (!head.found) continue;								// Nothing after the Head (Same as combine)
+
+		u32_t len;												// For Variable Size
+		read_variable_size(&pAddr[track.sequence_pos + head.head_pos], len);
+		plan.body_pos = (head.head_pos + len);
+		plan.head_time = head.event_time;
+		plan.tail_head = (head.head_pos >= plan.keep);
+		if (plan.body_pos > (plan.tail_head ? track.sequence_size : plan.keep)) return false;
+		plan.repeat = true;
+
+		// Gap (1 byte at least) + Body per repeat, or the last gap + NOPs/EOS from the head.
+		const u32_t body_size = plan.tail_head ? 0 : (plan.keep - plan.body_pos);
+		if ((static_cast<u64_t>(count_ - 1) * (1 + body_size)) > 0xFFFFFFFF) return false;
+		u64_t size = (plan.keep + (static_cast<u64_t>(count_ - 1) * body_size) + (track.sequence_size - (plan.tail_head ? plan.body_pos : plan.keep)));
+		for (u32_t copy = (plan.tail_head ? (count_ - 1) : 1); copy < count_; copy++)
 		{
-			cnt++;
-			continue;
+			u32_t gap;
+			if (!repeat_gap(plan, period_ms, copy, gap)) return false;
+			u8_t buf[4];
+			make_variable_size_array(gap, buf, len);
+			size += len;
 		}
-		break;
+		if (size > 0xFFFFFFFF) return false;
+		plan.sequence_size = static_cast<u32_t>(size);
+		grow += (size - track.sequence_size);
 	}
+	if ((rSrc_.size() + grow) > 0xFFFFFFFF || (layout.file_size + grow) > 0xFFFFFFFF) return false;
 
-	u8_t gap_duration[4];										// Duration of Gap.
-	u32_t gap_duration_len;
-	make_variable_size_array((last_gatetime + gap_), gap_duration, gap_duration_len);
-
-	// (3) rSrc1_ Header + rSrc1_ Sequence Data + Duration of Gap + rSrc2_ Sequence Data
+	// (3) Output (One Allocation, Prefix + Bodies + Tail by memcpy, Gaps in between)
 	//
-	const u32_t src1_size = (rSrc1_.size() - reduce_size);
-	const u32_t src2_size = (rSrc2_.size() - cnt);
-	const u32_t dst_size = (src1_size + gap_duration_len + src2_size);
-	rDst_.create(dst_size);
+	if (!rDst_.create(static_cast<u32_t>(rSrc_.size() + grow))) return false;
+	u8_t* pDst = rDst_.data_ptr();
+	u32_t src_pos = 0;
+	u32_t dst_pos = 0;
+	for (size_t k = 0; k < layout.tracks.size(); k++)
+	{
+		const track_info& track = layout.tracks[k];
+		const repeat_plan& plan = plans[k];
+		if (!plan.repeat) continue;
+
+		std::memcpy(&pDst[dst_pos], &pAddr[src_pos], (track.sequence_pos - src_pos));
+		dst_pos += (track.sequence_pos - src_pos);
+		src_pos = track.sequence_pos;
+
+		// The track head and the sequence size are before the sequence data.
+		make_size_array((track.size - track.sequence_size + plan.sequence_size), MA_3::CHUNK_DATA_SIZE, &pDst[dst_pos - (track.sequence_pos - track.size_pos)]);
+		make_size_array(plan.sequence_size, MA_3::CHUNK_DATA_SIZE, &pDst[dst_pos - (track.sequence_pos - track.sequence_size_pos)]);
+
+		const u8_t* pSequence = &pAddr[track.sequence_pos];
+		const u32_t body_size = plan.tail_head ? 0 : (plan.keep - plan.body_pos);
+		std::memcpy(&pDst[dst_pos], pSequence, plan.keep);
+		dst_pos += plan.keep;
+		for (u32_t copy = (plan.tail_head ? (count_ - 1) : 1); copy < count_; copy++)
+		{
+			u32_t gap;
+			if (!repeat_gap(plan, period_ms, copy, gap)) return false;
+			write_variable_size(gap, pDst, dst_pos);
+			std::memcpy(&pDst[dst_pos], &pSequence[plan.body_pos], body_size);
+			dst_pos += body_size;
+		}
+		// The tail (NOPs and EOS) is copied with the next chunks.
+		src_pos += (plan.tail_head ? plan.body_pos : plan.keep);
+	}
+	std::memcpy(&pDst[dst_pos], &pAddr[src_pos], (rSrc_.size() - src_pos));
+	make_size_array(static_cast<u32_t>(layout.file_size + grow), MA_3::CHUNK_DATA_SIZE, &pDst[layout.file_size_pos]);
+
+	// CRC16 is calculated once over the result.
+	return fix_crc16(rDst_);
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Cut Sequence (Internal for Trim/Split)
+//------------------------------------------------------------------------------------------------------//
+namespace {
+
+const u32_t SEQUENCE_END = 0xFFFFFFFF;							// Open End of Segment
+const u32_t CONTROLS = 128;										// Number of Control Change Numbers
+const u32_t CUT_CHANNELS = 16;									// Channels of State (MA_3::CHANNELS)
 
-	u8_t j = 0;
-	for (u32_t i = 0; i < rDst_.size(); i++)
+// Channel state which is re-emitted at the head of each segment.
+struct channel_state
+{
+	u8_t cc[CONTROLS];											// Control Change Values
+	u8_t cc_valid[CONTROLS];									// Control Change Flags
+	u8_t program;												// Program Change Value
+	u8_t program_valid;											// Program Change Flag
+	u8_t bend[2];												// Pitch Bend Values
+	u8_t bend_valid;											// Pitch Bend Flag
+};
+
+// Append variable size data.
+void push_variable_size(u32_t size_, std::vector<u8_t>& rDst_)
+{
+	u8_t buf[4];												// For Variable Size
+	u32_t len;
+	make_variable_size_array(size_, buf, len);
+	rDst_.insert(rDst_.end(), buf, (buf + len));
+}
+
+// Source bytes of the events in each segment. (Visitor for walk_sequence, Sizes for cut_visitor)
+struct span_visitor
+{
+	span_visitor(const u32_t* pBegin_, const u32_t* pEnd_, u32_t n_, u32_t size_, u32_t* pSpan_)
+		: pBegin(pBegin_), pEnd(pEnd_), n(n_), end_pos(size_), pSpan(pSpan_), time(0), pos(0), first(0), seg(0), in_seg(false), eos(false)
+	{}
+
+	bool duration(u32_t value_, u32_t pos_, u32_t /*len_*/)
 	{
-		if (i < src1_size)
+		if (eos) return true;
+		time += value_;
+		pos = pos_;
+		while (seg < n && time >= pEnd[seg])
 		{
-			rDst_[i] = rSrc1_.at(i);							// rSrc1_ All Data
+			pSpan[seg++] = in_seg ? (pos_ - first) : 0;
+			in_seg = false;
 		}
-		else if (i < (src1_size + gap_duration_len))
+		if (seg < n && !in_seg && time >= pBegin[seg])
 		{
-			rDst_[i] = gap_duration[j++];						// Duration of Gap
+			first = pos_;
+			in_seg = true;
 		}
-		else
+		return true;
+	}
+
+	bool event(const u8_t* /*pEvent_*/, u32_t size_, const event_info& rInfo_)
+	{
+		if (!eos && rInfo_.kind == EK_EOS_NOP && size_ == MA_3::EOS_SIZE)
 		{
-			rDst_[i] = rSrc2_.at(cnt++);						// rSrc2_ Sequence Data
+			eos = true;
+			end_pos = pos;										// Events end at the Duration of EOS
 		}
+		return true;
 	}
 
-	// (4) Data Fix
-	//
-	file_size += (src2_size + gap_duration_len - reduce_size);
-	make_size_array(file_size, MA_3::CHUNK_DATA_SIZE, &rDst_[file_size_pos]);
+	bool gatetime(u32_t /*value_*/, u32_t /*pos_*/, u32_t /*len_*/)
+	{
+		return true;
+	}
 
-	score_size += (src2_size + gap_duration_len - reduce_size);
-	make_size_array(score_size, MA_3::CHUNK_DATA_SIZE, &rDst_[score_size_pos]);
+	// Close the remaining segments at the end of the sequence.
+	void finish()
+	{
+		while (seg < n)
+		{
+			pSpan[seg++] = in_seg ? (end_pos - first) : 0;
+			in_seg = false;
+		}
+	}
 
-	sequence_size += (src2_size + gap_duration_len - reduce_size);
-	make_size_array(sequence_size, MA_3::CHUNK_DATA_SIZE, &rDst_[sequence_size_pos]);
+	const u32_t* pBegin;										// Begin of Segments [tick]
+	const u32_t* pEnd;											// End of Segments [tick]
+	u32_t        n;												// Number of Segments
+	u32_t        end_pos;										// End of the Events [byte]
+	u32_t*       pSpan;											// Source Bytes of Segments
+	u64_t        time;											// Absolute Time [tick]
+	u32_t        pos;											// Position of the Last Duration [byte]
+	u32_t        first;											// Position of the First Duration in the Segment [byte]
+	u32_t        seg;											// Current Segment
+	bool         in_seg;										// Current Segment is Started
+	bool         eos;											// EOS Flag
+};
+
+// Cut the sequence data of a track into the segments in a single pass. (Visitor for walk_sequence)
+//
+// Each segment starts with the channel state at its begin (zero durations) and ends with EOS at its
+// end. Notes crossing the end are clamped. Events after EOS are ignored. Each segment is reserved
+// for its head, its source bytes (pSpan_) and EOS when it is opened.
+struct cut_visitor
+{
+	cut_visitor(const u32_t* pBegin_, const u32_t* pEnd_, u32_t n_, u32_t d_ms_, u32_t g_ms_, const u32_t* pSpan_, std::vector<u8_t>* pDst_)
+		: pBegin(pBegin_), pEnd(pEnd_), n(n_), d_ms(d_ms_), g_ms(g_ms_), pSpan(pSpan_), pDst(pDst_), time(0), last(0), seg(0), in_seg(false), opened(false), eos(false), state()
+	{}
 
-	return fix_crc16(rDst_);
+	// Write the current channel state with zero durations.
+	void open_segment()
+	{
+		std::vector<u8_t>& rDst = pDst[seg];
+		size_t head = 0;
+		for (u32_t ch = 0; ch < CUT_CHANNELS; ch++)
+		{
+			const channel_state& rState = state[ch];
+			for (u32_t cc = 0; cc < CONTROLS; cc++)
+			{
+				if (rState.cc_valid[cc]) head += 4;
+			}
+			if (rState.program_valid) head += 3;
+			if (rState.bend_valid) head += 4;
+		}
+		rDst.reserve(head + pSpan[seg] + 4 + MA_3::EOS_SIZE);	// Head + Events + Last Duration + EOS
+
+		for (u32_t ch = 0; ch < CUT_CHANNELS; ch++)
+		{
+			const channel_state& rState = state[ch];
+			for (u32_t cc = 0; cc < CONTROLS; cc++)
+			{
+				if (!rState.cc_valid[cc]) continue;
+				const u8_t event[] = { 0x00, static_cast<u8_t>(SE_CONTROL_CHANGE | ch), static_cast<u8_t>(cc), rState.cc[cc] };
+				rDst.insert(rDst.end(), event, (event + sizeof(event)));
+			}
+			if (rState.program_valid)
+			{
+				const u8_t event[] = { 0x00, static_cast<u8_t>(SE_PROGRAM_CHANGE | ch), rState.program };
+				rDst.insert(rDst.end(), event, (event + sizeof(event)));
+			}
+			if (rState.bend_valid)
+			{
+				const u8_t event[] = { 0x00, static_cast<u8_t>(SE_PITCH_BEND | ch), rState.bend[0], rState.bend[1] };
+				rDst.insert(rDst.end(), event, (event + sizeof(event)));
+			}
+		}
+		last = pBegin[seg];
+		opened = true;
+	}
+
+	// Write EOS at the end and step to the next segment.
+	void close_segment(u64_t end_)
+	{
+		if (!opened) this->open_segment();
+
+		std::vector<u8_t>& rDst = pDst[seg];
+		push_variable_size(static_cast<u32_t>((end_ > last) ? (end_ - last) : 0), rDst);
+		const u8_t eos_event[] = { SE_EOS_NOP, 0x2F, 0x00 };
+		rDst.insert(rDst.end(), eos_event, (eos_event + sizeof(eos_event)));
+		seg++;
+		opened = false;
+	}
+
+	bool duration(u32_t value_, u32_t /*pos_*/, u32_t /*len_*/)
+	{
+		if (eos) return true;
+		time += value_;
+		while (seg < n && time >= pEnd[seg])
+		{
+			this->close_segment(pEnd[seg]);
+		}
+		in_seg = (seg < n && time >= pBegin[seg]);
+		if (in_seg && !opened) this->open_segment();
+		return true;
+	}
+
+	bool event(const u8_t* pEvent_, u32_t size_, const event_info& rInfo_)
+	{
+		if (eos) return true;
+		if (rInfo_.kind == EK_EOS_NOP && size_ == MA_3::EOS_SIZE)
+		{
+			eos = true;											// EOS (Written on Close)
+			return true;
+		}
+
+		channel_state& rState = state[pEvent_[0] & 0x0F];
+		if (rInfo_.kind == EK_MESSAGE)
+		{
+			switch (pEvent_[0] & 0xF0)
+			{
+			case SE_CONTROL_CHANGE:
+				rState.cc[pEvent_[1]] = pEvent_[2];
+				rState.cc_valid[pEvent_[1]] = 1;
+				break;
+			case SE_PROGRAM_CHANGE:
+				rState.program = pEvent_[1];
+				rState.program_valid = 1;
+				break;
+			case SE_PITCH_BEND:
+				rState.bend[0] = pEvent_[1];
+				rState.bend[1] = pEvent_[2];
+				rState.bend_valid = 1;
+				break;
+			default:
+				break;
+			}
+		}
+
+		if (in_seg)
+		{
+			std::vector<u8_t>& rDst = pDst[seg];
+			push_variable_size(static_cast<u32_t>(time - last), rDst);
+			rDst.insert(rDst.end(), pEvent_, (pEvent_ + size_));
+			last = time;
+		}
+		return true;
+	}
+
+	bool gatetime(u32_t value_, u32_t /*pos_*/, u32_t /*len_*/)
+	{
+		if (eos || !in_seg) return true;
+
+		// Clamp the note crossing the cut. (Rest is on duration's timebase, gatetime on its own.)
+		u64_t gatetime = value_;
+		const u64_t rest = (((static_cast<u64_t>(pEnd[seg]) - time) * d_ms) / g_ms);
+		if (gatetime > rest) gatetime = (rest != 0) ? rest : 1;
+		push_variable_size(static_cast<u32_t>(gatetime), pDst[seg]);
+		return true;
+	}
+
+	// Close the remaining segments at the end of the sequence.
+	void finish()
+	{
+		while (seg < n)
+		{
+			this->close_segment((pEnd[seg] < time) ? pEnd[seg] : time);
+		}
+	}
+
+	const u32_t*       pBegin;									// Begin of Segments [tick]
+	const u32_t*       pEnd;									// End of Segments [tick]
+	u32_t              n;										// Number of Segments
+	u32_t              d_ms;									// Duration's Timebase [ms]
+	u32_t              g_ms;									// Gatetime's Timebase [ms]
+	const u32_t*       pSpan;									// Source Bytes of Segments
+	std::vector<u8_t>* pDst;									// Sequence Data of Segments
+	u64_t              time;									// Absolute Time [tick]
+	u64_t              last;									// Time of Last Written Event [tick]
+	u32_t              seg;										// Current Segment
+	bool               in_seg;									// Current Event is in the Segment
+	bool               opened;									// Segment Head is Written
+	bool               eos;										// EOS Flag
+	channel_state      state[CUT_CHANNELS];						// Channel State
+};
+
+// Segments of all score tracks.
+struct cut_context
+{
+	const u32_t* pBegin;										// Begin of Segments [tick of the first score track]
+	const u32_t* pEnd;											// End of Segments [tick of the first score track]
+	u32_t        n;												// Number of Segments
+	u32_t        first_ms;										// Duration's Timebase of the First Score Track [ms]
+	u32_t        segment;										// Segment to Write
+	std::vector<std::vector<std::vector<u8_t> > > cuts;			// Segments (Index of the Track)
+};
+
+// Convert the tick of the first score track to the timebase of the track.
+u32_t retime_point(u32_t point_, u32_t first_ms_, u32_t d_ms_)
+{
+	if (point_ == SEQUENCE_END) return SEQUENCE_END;
+	const u64_t point = (((static_cast<u64_t>(point_) * first_ms_) + (d_ms_ / 2)) / d_ms_);
+	return (point < SEQUENCE_END) ? static_cast<u32_t>(point) : SEQUENCE_END;
+}
+
+// Cut the track into all segments and write the first one. (Rewriter for cut_sequence)
+bool cut_track(const u8_t* pAddr_, const track_info& rTrack_, u32_t index_, std::vector<u8_t>& rDst_, void* pContext_)
+{
+	cut_context* pContext = static_cast<cut_context*>(pContext_);
+	const timebase tb = track_timebase(pAddr_, rTrack_);
+	if (tb.D_ms() == 0 || tb.G_ms() == 0) return false;
+
+	const u32_t n = pContext->n;
+	std::vector<u32_t> begin(n);
+	std::vector<u32_t> end(n);
+	for (u32_t i = 0; i < n; i++)
+	{
+		begin[i] = retime_point(pContext->pBegin[i], pContext->first_ms, tb.D_ms());
+		end[i] = retime_point(pContext->pEnd[i], pContext->first_ms, tb.D_ms());
+	}
+
+	// (1) Source bytes of each segment (To reserve the segments)
+	const u8_t* pSequence = &pAddr_[rTrack_.sequence_pos];
+	std::vector<u32_t> span(n);
+	span_visitor spans(begin.data(), end.data(), n, rTrack_.sequence_size, span.data());
+	if (!walk_sequence(pSequence, rTrack_.sequence_size, spans)) return false;
+	spans.finish();
+
+	// (2) Segments
+	std::vector<std::vector<u8_t> >& cuts = pContext->cuts[index_];
+	cuts.assign(n, std::vector<u8_t>());
+	cut_visitor cut(begin.data(), end.data(), n, tb.D_ms(), tb.G_ms(), span.data(), cuts.data());
+	if (!walk_sequence(pSequence, rTrack_.sequence_size, cut)) return false;
+	cut.finish();
+
+	rDst_.swap(cuts[0]);
+	return true;
+}
+
+// Write the current segment of the track. (Rewriter for cut_sequence)
+bool cut_segment(const u8_t* /*pAddr_*/, const track_info& /*rTrack_*/, u32_t index_, std::vector<u8_t>& rDst_, void* pContext_)
+{
+	cut_context* pContext = static_cast<cut_context*>(pContext_);
+	rDst_.swap(pContext->cuts[index_][pContext->segment]);
+	return true;
+}
+
+// Cut [pBegin_[i], pEnd_[i]) ranges of every score track into pDst_[i]. (Ranges must be ascending.)
+// Each track is walked once. Audio tracks and other chunks are kept as they are.
+bool cut_sequence(const MA_3& rSrc_, const u32_t* pBegin_, const u32_t* pEnd_, u32_t n_, MA_3* pDst_)
+{
+	const format_type fmt = rSrc_.get_format();
+	if (fmt != format_type::MOBILE_NO_COMPRESS) return false;
+
+	const timebase first_timebase = rSrc_.get_timebase();
+	if (first_timebase.D_ms() == 0) return false;
+
+	track_layout layout;
+	if (!analyze_tracks(rSrc_, layout)) return false;
+
+	cut_context context;
+	context.pBegin = pBegin_;
+	context.pEnd = pEnd_;
+	context.n = n_;
+	context.first_ms = first_timebase.D_ms();
+	context.segment = 0;
+	context.cuts.resize(layout.tracks.size());
+
+	// (1) Cut every score track and write the first segment.
+	//
+	if (!rewrite_tracks(rSrc_, layout, cut_track, &context, pDst_[0])) return false;
+	if (!fix_crc16(pDst_[0])) return false;
+
+	// (2) Write the other segments with the same chunks.
+	//
+	for (u32_t i = 1; i < n_; i++)
+	{
+		context.segment = i;
+		if (!rewrite_tracks(rSrc_, layout, cut_segment, &context, pDst_[i])) return false;
+		if (!fix_crc16(pDst_[i])) return false;
+	}
+	return true;
+}
+
+}																// namespace
+
+//------------------------------------------------------------------------------------------------------//
+// Trim SMAF Data
+//------------------------------------------------------------------------------------------------------//
+bool smaf::trim(const MA_3& rSrc_, u32_t begin_, u32_t end_, MA_3& rDst_)
+{
+	OPENMF_TRACE_SCOPE("trim");
+	OPENMF_TRACE_COUNT("trim.bytes", rSrc_.size());
+
+	if (rSrc_ == rDst_) return false;
+
+	const u32_t end = (end_ == 0) ? SEQUENCE_END : end_;
+	if (begin_ >= end) return false;
+
+	return cut_sequence(rSrc_, &begin_, &end, 1, &rDst_);
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Split SMAF Data
+//------------------------------------------------------------------------------------------------------//
+bool smaf::split(const MA_3& rSrc_, const data_array_<u32_t>& rPoints_, data_array_<MA_3>& rDst_)
+{
+	OPENMF_TRACE_SCOPE("split");
+	OPENMF_TRACE_COUNT("split.bytes", rSrc_.size());
+
+	const u32_t n = (rPoints_.size() + 1);						// Number of Segments
+
+	data_array_<u32_t> begin(n);
+	data_array_<u32_t> end(n);
+	if (begin.empty() || end.empty()) return false;
+
+	begin[0] = 0;
+	for (u32_t i = 0; i < rPoints_.size(); i++)
+	{
+		if (rPoints_.at(i) <= begin[i]) return false;			// Not Ascending
+		end[i] = rPoints_.at(i);
+		begin[i + 1] = rPoints_.at(i);
+	}
+	end[n - 1] = SEQUENCE_END;
+
+	if (!rDst_.create(n)) return false;
+
+	return cut_sequence(rSrc_, begin.data_ptr(), end.data_ptr(), n, rDst_.data_ptr());
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Event Filter (Internal for filter_events)
+//------------------------------------------------------------------------------------------------------//
+namespace {
+
+const u32_t FILTER_CHANNELS = 16;								// Channels of Tables (MA_3::CHANNELS)
+const u32_t NOTES = 128;										// Number of Note Numbers
+
+// Lookup tables per channel. (Note 0xFF = Drop)
+struct filter_tables
+{
+	u8_t mute[FILTER_CHANNELS];									// Channel is Muted
+	u8_t note_map[FILTER_CHANNELS][NOTES];						// New Note Number
+	u8_t velocity_map[FILTER_CHANNELS][NOTES];					// New Velocity
+};
+
+// Filter of the sequence data. (Visitor for walk_sequence)
+//
+// Dropped events and their gatetimes are removed and their durations are added to the next event.
+// The output is never larger than the consumed input, so pDst may be the input. (In-place)
+struct filter_visitor
+{
+	filter_visitor(const filter_tables& rTables_, const u8_t* pSrc_, u8_t* pDst_)
+		: rTables(rTables_), pSrc(pSrc_), pDst(pDst_), pos(0), pending(0), drop(false)
+	{}
+
+	bool duration(u32_t value_, u32_t /*pos_*/, u32_t /*len_*/)
+	{
+		pending += value_;
+		return true;
+	}
+
+	bool event(const u8_t* pEvent_, u32_t size_, const event_info& rInfo_)
+	{
+		const u8_t status = pEvent_[0];
+		const u32_t ch = (status & 0x0F);
+		const bool note = (rInfo_.kind == EK_NOTE);
+
+		drop = (status < SE_SYSTEM_EXCLUSIVE) && rTables.mute[ch];
+		if (note && rTables.note_map[ch][pEvent_[1]] == 0xFF) drop = true;
+		if (drop) return true;
+
+		if (pending > 0x0FFFFFFF) return false;					// Duration Overflow
+		write_variable_size(static_cast<u32_t>(pending), pDst, pos);
+		pending = 0;
+
+		const u8_t note_no = note ? pEvent_[1] : 0;				// Read before overwritten (In-place)
+		const u8_t velocity = (status >= SE_NOTE_VELOCITY && note) ? pEvent_[2] : 0;
+		std::memmove(&pDst[pos], pEvent_, size_);
+		if (note)
+		{
+			pDst[pos + 1] = rTables.note_map[ch][note_no];
+		}
+		if (note && status >= SE_NOTE_VELOCITY)
+		{
+			pDst[pos + 2] = rTables.velocity_map[ch][velocity];
+		}
+		pos += size_;
+		return true;
+	}
+
+	bool gatetime(u32_t /*value_*/, u32_t pos_, u32_t len_)
+	{
+		if (drop) return true;
+		std::memmove(&pDst[pos], &pSrc[pos_], len_);
+		pos += len_;
+		return true;
+	}
+
+	const filter_tables& rTables;								// Lookup Tables
+	const u8_t*          pSrc;									// Sequence Data (Input)
+	u8_t*                pDst;									// Sequence Data (Output)
+	u32_t                pos;									// Output Size [byte]
+	u64_t                pending;								// Duration of Dropped Events
+	bool                 drop;									// Current Event is Dropped
+};
+
+// Build the lookup tables from the channel status of a track.
+void make_filter_tables(const event_filter& rFilter_, const channel_status* pStatus_, filter_tables& rTables_)
+{
+	for (u32_t ch = 0; ch < FILTER_CHANNELS; ch++)
+	{
+		const u8_t type = pStatus_[ch].ch_type();
+		const bool target
+			= ((rFilter_.target_mask >> ch) & 0x1)
+			&& !((rFilter_.skip_type_mask >> type) & 0x1);
+
+		rTables_.mute[ch] = ((rFilter_.mute_mask >> ch) & 0x1);
+		for (u32_t n = 0; n < NOTES; n++)
+		{
+			const s32_t note = static_cast<s32_t>(n) + (target ? rFilter_.transpose : 0);
+			rTables_.note_map[ch][n] = (note < 0 || note >= static_cast<s32_t>(NOTES)) ? 0xFF : static_cast<u8_t>(note);
+
+			u32_t velocity = n;
+			if (target && n != 0)
+			{
+				velocity = static_cast<u32_t>((n * rFilter_.velocity_ratio) + 0.5);
+				if (velocity < 1) velocity = 1;
+				if (velocity > 0x7F) velocity = 0x7F;
+			}
+			rTables_.velocity_map[ch][n] = static_cast<u8_t>(velocity);
+		}
+	}
+}
+
+// Filter the track with the tables of its own channel status. (Rewriter for filter_events)
+bool filter_track(const u8_t* pAddr_, const track_info& rTrack_, u32_t /*index_*/, std::vector<u8_t>& rDst_, void* pContext_)
+{
+	const event_filter* pFilter = static_cast<const event_filter*>(pContext_);
+
+	channel_status status[FILTER_CHANNELS];						// Default when the Track Head is Short
+	if (rTrack_.size >= (4 + FILTER_CHANNELS))
+	{
+		for (u32_t ch = 0; ch < FILTER_CHANNELS; ch++)
+		{
+			status[ch] = pAddr_[rTrack_.data_pos + 4 + ch];
+		}
+	}
+	filter_tables tables;
+	make_filter_tables(*pFilter, status, tables);
+
+	const u8_t* pSequence = &pAddr_[rTrack_.sequence_pos];
+	rDst_.resize(rTrack_.sequence_size);
+	filter_visitor filter(tables, pSequence, rDst_.data());
+	if (!walk_sequence(pSequence, rTrack_.sequence_size, filter)) return false;
+	rDst_.resize(filter.pos);
+	return true;
+}
+
+}																// namespace
+
+//------------------------------------------------------------------------------------------------------//
+// Filter Events (Mute/Transpose/Scale Velocity)
+//------------------------------------------------------------------------------------------------------//
+bool smaf::filter_events(const MA_3& rSrc_, const event_filter& rFilter_, MA_3& rDst_)
+{
+	OPENMF_TRACE_SCOPE("filter_events");
+	OPENMF_TRACE_COUNT("filter_events.bytes", rSrc_.size());
+
+	const format_type fmt = rSrc_.get_format();
+	if (fmt != format_type::MOBILE_NO_COMPRESS) return false;
+
+	track_layout tracks;
+	if (!analyze_tracks(rSrc_, tracks)) return false;
+	if (score_sequences(tracks) > 1)
+	{
+		// Several score tracks: Each track is filtered on the thread pool with its own channel status.
+		if (rSrc_ == rDst_)
+		{
+			const MA_3 src(rSrc_);
+			return filter_events(src, rFilter_, rDst_);
+		}
+		event_filter context(rFilter_);
+		if (!rewrite_tracks(rSrc_, tracks, filter_track, &context, rDst_)) return false;
+		return fix_crc16(rDst_);
+	}
+
+	sequence_layout layout;
+	if (!first_layout(tracks, layout)) return false;
+
+	// (1) Lookup Tables per Channel (Note 0xFF = Drop)
+	//
+	channel_status status[FILTER_CHANNELS];
+	for (u32_t ch = 0; ch < FILTER_CHANNELS; ch++)
+	{
+		status[ch] = rSrc_.get_channel_status(ch);
+	}
+	filter_tables tables;
+	make_filter_tables(rFilter_, status, tables);
+
+	// (2) Sequence Data (Output is never larger than input, so rSrc_ == rDst_ is compacted in place.)
+	//
+	if (rSrc_ != rDst_)
+	{
+		if (!rDst_.create(rSrc_.size())) return false;
+		for (u32_t i = 0; i < layout.sequence_pos; i++)
+		{
+			rDst_[i] = rSrc_.at(i);								// Header (MMMD ... Mtsq)
+		}
+	}
+	const u8_t* pAddr = rSrc_.data_ptr();
+	u8_t* pDst = rDst_.data_ptr();
+
+	filter_visitor filter(tables, &pAddr[layout.sequence_pos], &pDst[layout.sequence_pos]);
+	if (!walk_sequence(&pAddr[layout.sequence_pos], layout.sequence_size, filter)) return false;
+
+	const u32_t reduce_size = (layout.sequence_size - filter.pos);
+	u32_t pos = (layout.sequence_pos + filter.pos);
+	for (u32_t cnt = (layout.sequence_pos + layout.sequence_size); cnt < rSrc_.size(); cnt++)
+	{
+		pDst[pos++] = pAddr[cnt];								// Remaining Chunks and CRC
+	}
+
+	// (3) Data Fix
+	//
+	if (reduce_size != 0)
+	{
+		if (!rDst_.truncate(pos)) return false;
+
+		make_size_array((layout.file_size - reduce_size), MA_3::CHUNK_DATA_SIZE, &rDst_[layout.file_size_pos]);
+		make_size_array((layout.score_size - reduce_size), MA_3::CHUNK_DATA_SIZE, &rDst_[layout.score_size_pos]);
+		make_size_array((layout.sequence_size - reduce_size), MA_3::CHUNK_DATA_SIZE, &rDst_[layout.sequence_size_pos]);
+	}
+
+	return fix_crc16(rDst_);
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Polyphony Limit (Internal for limit_polyphony)
+//------------------------------------------------------------------------------------------------------//
+namespace {
+
+const u32_t MAX_VOICES = 256;									// Max Voices of limit_polyphony
+const u8_t  DEFAULT_VELOCITY = 0x40;							// Velocity of Note without Velocity (8n)
+
+// Sounding note of limit_polyphony.
+struct voice_slot
+{
+	u64_t start;												// Start Time [ms]
+	u64_t end;													// End Time [ms]
+	u32_t order;												// Order of the Merged Notes
+	u8_t* pEvent;												// Note Message in the Marked Copy
+	u8_t* pGatetime;											// Gatetime in the Marked Copy
+	u32_t gatetime_len;											// Gatetime Size [byte]
+	u32_t g_ms;													// Gatetime's Timebase of the Track [ms]
+	bool  rhythm;												// Rhythm Channel
+	u8_t  velocity;												// Velocity
+};
+
+// Score track of limit_polyphony.
+struct voice_track
+{
+	note_cursor cursor;											// Note Cursor on the Marked Copy
+	u8_t*       pMarked;										// Marked Copy of the Sequence Data
+	u32_t       rhythm_mask;									// Rhythm Channels (Bit n = Channel n)
+};
+
+// Order of stealing. (Rhythm channel, lower velocity, older note first)
+bool steal_first(const voice_slot& rLhs_, const voice_slot& rRhs_)
+{
+	if (rLhs_.rhythm != rRhs_.rhythm) return rLhs_.rhythm;
+	if (rLhs_.velocity != rRhs_.velocity) return (rLhs_.velocity < rRhs_.velocity);
+	return (rLhs_.order < rRhs_.order);
+}
+
+// Write the variable size in len_ bytes. (Leading zero groups are kept, value_ < 2^(7 * len_))
+void write_fixed_variable_size(u32_t value_, u32_t len_, u8_t* pDst_)
+{
+	for (u32_t i = 0; i < len_; i++)
+	{
+		const u32_t shift = (7 * (len_ - 1 - i));
+		pDst_[i] = static_cast<u8_t>(((value_ >> shift) & 0x7F) | (((i + 1) < len_) ? 0x80 : 0x00));
+	}
+}
+
+// Marked copies of the sequences. (Dropped note = Status without bit 7, Shortened gatetime in place)
+struct voice_limit_context
+{
+	std::vector<std::vector<u8_t> > marked;						// Marked Copies (Index of the Track)
+};
+
+// Remove the dropped notes and write the shortest variable sizes. (Rewriter for limit_polyphony)
+bool compact_voices(const u8_t* /*pAddr_*/, const track_info& rTrack_, u32_t index_, std::vector<u8_t>& rDst_, void* pContext_)
+{
+	const voice_limit_context* pContext = static_cast<const voice_limit_context*>(pContext_);
+	const u8_t* pAddr = pContext->marked[index_].data();
+	const u32_t size = rTrack_.sequence_size;
+
+	// The output is never larger than the input. (A dropped note at the end leaves a NOP.)
+	rDst_.resize(size + MA_3::NOP_SIZE);
+	u8_t* pDst = rDst_.data();
+	u32_t pos = 0;
+	u64_t pending = 0;											// Duration of Dropped Notes
+
+	u32_t cnt = 0;
+	while (cnt < size)
+	{
+		u32_t len;												// For Variable Size
+		pending += read_variable_size(&pAddr[cnt], len);
+		cnt += len;
+		if (cnt >= size) break;
+
+		const u8_t status = pAddr[cnt];
+		if (status < SE_NOTE_NOVELOCITY)
+		{
+			// Dropped note and its gatetime.
+			cnt += (status < (SE_NOTE_VELOCITY & 0x7F)) ? 2 : 3;
+			read_variable_size(&pAddr[cnt], len);
+			cnt += len;
+			continue;
+		}
+
+		sequence_state next_state;
+		const u32_t event = event_size(&pAddr[cnt], next_state);
+		if (event == 0 || event > (size - cnt)) return false;	// Error
+		if (pending > 0x0FFFFFFF) return false;					// Duration Overflow
+		write_variable_size(static_cast<u32_t>(pending), pDst, pos);
+		pending = 0;
+		std::memcpy(&pDst[pos], &pAddr[cnt], event);
+		pos += event;
+		cnt += event;
+		if (next_state != SS_GATETIME || cnt >= size) continue;
+
+		write_variable_size(read_variable_size(&pAddr[cnt], len), pDst, pos);
+		cnt += len;
+	}
+	if (pending != 0)
+	{
+		if (pending > 0x0FFFFFFF) return false;					// Duration Overflow
+		write_variable_size(static_cast<u32_t>(pending), pDst, pos);
+		pDst[pos++] = SE_EOS_NOP;
+		pDst[pos++] = 0x00;										// NOP
+	}
+	rDst_.resize(pos);
+	return true;
+}
+
+}																// namespace
+
+//------------------------------------------------------------------------------------------------------//
+// Limit Polyphony
+//------------------------------------------------------------------------------------------------------//
+bool smaf::limit_polyphony(const MA_3& rSrc_, u32_t voices_, MA_3& rDst_, u32_t& rShortened_, u32_t& rDropped_)
+{
+	OPENMF_TRACE_SCOPE("limit_polyphony");
+	OPENMF_TRACE_COUNT("limit_polyphony.bytes", rSrc_.size());
+
+	rShortened_ = 0;
+	rDropped_ = 0;
+	const format_type fmt = rSrc_.get_format();
+	if (fmt != format_type::MOBILE_NO_COMPRESS) return false;
+	if (voices_ == 0 || voices_ > MAX_VOICES || rSrc_ == rDst_) return false;
+
+	track_layout layout;
+	if (!analyze_tracks(rSrc_, layout)) return false;
+
+	// (1) Marked copies of the sequences and the note cursors on them.
+	//
+	const u8_t* pAddr = rSrc_.data_ptr();
+	voice_limit_context context;
+	context.marked.resize(layout.tracks.size());
+	std::vector<voice_track> tracks;
+	for (size_t i = 0; i < layout.tracks.size(); i++)
+	{
+		const track_info& track = layout.tracks[i];
+		if (!is_score_sequence(track)) continue;
+
+		std::vector<u8_t>& marked = context.marked[i];
+		marked.assign(&pAddr[track.sequence_pos], &pAddr[track.sequence_pos + track.sequence_size]);
+		marked.resize(track.sequence_size + note_cursor::TAIL_SIZE, 0x00);
+
+		const timebase tb = track_timebase(pAddr, track);
+		if (tb.D_ms() == 0 || tb.G_ms() == 0) continue;
+
+		voice_track target;
+		target.pMarked = marked.data();
+		target.rhythm_mask = 0;
+		for (u32_t ch = 0; ch < MA_3::CHANNELS && (4 + ch) < track.size; ch++)
+		{
+			const channel_status status(pAddr[track.data_pos + 4 + ch]);
+			if (status.ch_type() == channel_status::TYPE_RHYTHM) target.rhythm_mask |= (1 << ch);
+		}
+		target.cursor.reset(marked.data(), track.sequence_size, tb.D_ms(), tb.G_ms());
+		if (target.cursor.error) return false;
+		tracks.push_back(target);
+	}
+	if (tracks.empty()) return false;
+
+	// (2) Sweep the notes of the merged tracks. (voices_ slots, a full slot table steals one note)
+	//
+	std::vector<voice_slot> slots(voices_);
+	u32_t sounding = 0;
+	u32_t order = 0;
+	while (true)
+	{
+		voice_track* pTrack = nullptr;
+		for (size_t i = 0; i < tracks.size(); i++)
+		{
+			if (!tracks[i].cursor.valid) continue;
+			if (pTrack == nullptr || tracks[i].cursor.start < pTrack->cursor.start) pTrack = &tracks[i];
+		}
+		if (pTrack == nullptr) break;
+
+		const note_cursor& cursor = pTrack->cursor;
+		voice_slot note;
+		note.start = cursor.start;
+		note.end = cursor.end;
+		note.order = order++;
+		note.pEvent = &pTrack->pMarked[cursor.event_pos];
+		note.pGatetime = &pTrack->pMarked[cursor.gatetime_pos];
+		note.gatetime_len = cursor.gatetime_len;
+		note.g_ms = cursor.g_ms;
+		note.rhythm = (((pTrack->rhythm_mask >> cursor.channel) & 0x1) != 0);
+		note.velocity = ((note.pEvent[0] & 0xF0) == SE_NOTE_VELOCITY) ? static_cast<u8_t>(note.pEvent[2] & 0x7F) : DEFAULT_VELOCITY;
+		pTrack->cursor.next();
+		if (pTrack->cursor.error) return false;
+
+		// Release the notes ended by the start.
+		for (u32_t i = 0; i < sounding;)
+		{
+			if (slots[i].end <= note.start) slots[i] = slots[--sounding];
+			else i++;
+		}
+		if (note.end == note.start) continue;					// Gatetime 0
+		if (sounding < voices_)
+		{
+			slots[sounding++] = note;
+			continue;
+		}
+
+		u32_t victim = 0;
+		for (u32_t i = 1; i < sounding; i++)
+		{
+			if (steal_first(slots[i], slots[victim])) victim = i;
+		}
+		if (steal_first(note, slots[victim]))
+		{
+			note.pEvent[0] &= 0x7F;								// Drop the New Note
+			rDropped_++;
+			continue;
+		}
+
+		voice_slot& stolen = slots[victim];
+		const u64_t gatetime = ((note.start - stolen.start) / stolen.g_ms);
+		if (gatetime == 0)
+		{
+			stolen.pEvent[0] &= 0x7F;							// Drop the Stolen Note
+			rDropped_++;
+		}
+		else
+		{
+			write_fixed_variable_size(static_cast<u32_t>(gatetime), stolen.gatetime_len, stolen.pGatetime);
+			rShortened_++;
+		}
+		stolen = note;
+	}
+
+	// (3) Compact the changed tracks.
+	//
+	if (rShortened_ == 0 && rDropped_ == 0)
+	{
+		rDst_ = rSrc_;
+		return true;
+	}
+	if (!rewrite_tracks(rSrc_, layout, compact_voices, &context, rDst_)) return false;
+	return fix_crc16(rDst_);
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Size Optimization (Internal for optimize_size)
+//------------------------------------------------------------------------------------------------------//
+namespace {
+
+const u32_t STATE_CHANNELS = 16;								// Channels of State (MA_3::CHANNELS)
+const u32_t PROGRAM_SLOT = 128;									// State Slot of Program Change (0-127: Control Change)
+const u32_t STATE_SLOTS = 129;									// State Slots per Channel
+const u8_t  STATE_UNKNOWN = 0xFF;								// Unknown State (or No Change)
+const u32_t MAX_VARIABLE_SIZE = 0x0FFFFFFF;						// Max Value of Variable Size (4byte)
+
+// Control change keeps the channel state. (Data entry and increment/decrement depend on the order.)
+bool is_state_control(u32_t control_)
+{
+	return (control_ < 120) && (control_ != 6) && (control_ != 38) && (control_ != 96) && (control_ != 97);
+}
+
+// Size optimization of the sequence. (In-place, the output never overtakes the input.)
+//
+// The output is written only behind the consumed input. Malformed data that would overtake it sets
+// overrun, and the result must be discarded.
+//
+// - NOPs are dropped and their durations are added to the next event.
+// - Program/control changes are held until the tick ends (time, note or other barrier event), and
+//   only the last value of each slot is written when it differs from the channel state.
+// - Durations and gatetimes are written in the shortest variable size.
+struct optimize_visitor
+{
+	optimize_visitor(u8_t* pAddr_, u32_t size_)
+		: pAddr(pAddr_), size(size_), limit(0), pos(0), pending(0), dropped(false), overrun(false), touched(0)
+	{
+		this->clear_state();
+		for (u32_t ch = 0; ch < STATE_CHANNELS; ch++)
+		{
+			for (u32_t slot = 0; slot < STATE_SLOTS; slot++)
+			{
+				next[ch][slot] = STATE_UNKNOWN;
+			}
+		}
+	}
+
+	void clear_state()
+	{
+		for (u32_t ch = 0; ch < STATE_CHANNELS; ch++)
+		{
+			for (u32_t slot = 0; slot < STATE_SLOTS; slot++)
+			{
+				value[ch][slot] = STATE_UNKNOWN;
+			}
+		}
+	}
+
+	// Write a byte behind the consumed input.
+	void put(u8_t data_)
+	{
+		if (pos < limit) pAddr[pos] = data_;
+		else overrun = true;
+		pos++;
+	}
+
+	void put_variable_size(u32_t value_)
+	{
+		u8_t buf[4];											// For Variable Size
+		u32_t len;
+		make_variable_size_array(value_, buf, len);
+		for (u32_t i = 0; i < len; i++)
+		{
+			this->put(buf[i]);
+		}
+	}
+
+	void write_duration()
+	{
+		this->put_variable_size(pending);
+		pending = 0;
+		dropped = false;
+	}
+
+	void write_event(const u8_t* pEvent_, u32_t size_)
+	{
+		this->write_duration();
+		for (u32_t i = 0; i < size_; i++)
+		{
+			this->put(pEvent_[i]);								// Forward Copy (pos <= Source)
+		}
+	}
+
+	void write_nop()
+	{
+		this->write_duration();
+		this->put(SE_EOS_NOP);
+		this->put(0x00);
+	}
+
+	// Write the held changes of the tick in order.
+	void flush()
+	{
+		for (u32_t i = 0; i < touched; i++)
+		{
+			const u32_t ch = (order[i] / STATE_SLOTS);
+			const u32_t slot = (order[i] % STATE_SLOTS);
+			const u8_t data = next[ch][slot];
+			next[ch][slot] = STATE_UNKNOWN;
+			if (data == value[ch][slot])
+			{
+				dropped = true;									// Redundant
+				continue;
+			}
+			value[ch][slot] = data;
+
+			this->write_duration();
+			if (slot == PROGRAM_SLOT)
+			{
+				this->put(static_cast<u8_t>(SE_PROGRAM_CHANGE | ch));
+			}
+			else
+			{
+				this->put(static_cast<u8_t>(SE_CONTROL_CHANGE | ch));
+				this->put(static_cast<u8_t>(slot));
+			}
+			this->put(data);
+		}
+		touched = 0;
+	}
+
+	bool duration(u32_t value_, u32_t pos_, u32_t len_)
+	{
+		limit = (pos_ + len_);
+		if (value_ == 0) return true;
+		this->flush();											// End of Tick
+		if ((pending + value_) > MAX_VARIABLE_SIZE) this->write_nop();
+		pending += value_;
+		return true;
+	}
+
+	bool event(const u8_t* pEvent_, u32_t size_, const event_info& rInfo_)
+	{
+		const u8_t status = pEvent_[0];
+		const u8_t type = (status & 0xF0);
+		const u32_t ch = (status & 0x0F);
+		limit = static_cast<u32_t>((pEvent_ - pAddr) + size_);
+
+		if (rInfo_.kind == EK_EOS_NOP && size_ == MA_3::NOP_SIZE)
+		{
+			dropped = true;										// Duration is kept in pending
+			return true;
+		}
+
+		if (type == SE_PROGRAM_CHANGE || type == SE_CONTROL_CHANGE)
+		{
+			const bool program = (type == SE_PROGRAM_CHANGE);
+			const u32_t slot = program ? PROGRAM_SLOT : pEvent_[1];
+			const u8_t data = program ? pEvent_[1] : pEvent_[2];
+			const bool bank = (!program && (slot == 0 || slot == 32));
+
+			if ((program || (is_state_control(slot) && !bank)) && data < 0x80)
+			{
+				if (next[ch][slot] == STATE_UNKNOWN) order[touched++] = (ch * STATE_SLOTS + slot);
+				next[ch][slot] = data;							// Held until the Tick ends
+				return true;
+			}
+
+			if (bank && data < 0x80 && value[ch][slot] == data)
+			{
+				dropped = true;									// Redundant (Not a Barrier)
+				return true;
+			}
+			this->flush();
+			if (bank && data < 0x80)
+			{
+				value[ch][slot] = data;
+				value[ch][PROGRAM_SLOT] = STATE_UNKNOWN;		// Program Change must follow
+			}
+			else if (!program && slot == 121)
+			{
+				for (u32_t i = 0; i < PROGRAM_SLOT; i++)
+				{
+					value[ch][i] = STATE_UNKNOWN;				// Reset All Controllers
+				}
+			}
+			this->write_event(pEvent_, size_);
+			return true;
+		}
+
+		if (rInfo_.kind == EK_NOTE || rInfo_.kind == EK_EXCLUSIVE || rInfo_.kind == EK_EOS_NOP)
+		{
+			this->flush();										// Barrier
+		}
+		if (rInfo_.kind == EK_EXCLUSIVE)
+		{
+			this->clear_state();								// Exclusive may change any state
+		}
+		this->write_event(pEvent_, size_);
+		return true;
+	}
+
+	bool gatetime(u32_t value_, u32_t pos_, u32_t len_)
+	{
+		limit = (pos_ + len_);
+		this->put_variable_size(value_);
+		return true;
+	}
+
+	// Write the held changes and the remaining duration. (NOP for the dropped events at the end)
+	void finish()
+	{
+		limit = size;
+		this->flush();
+		if (pending == 0) return;
+		if (dropped) this->write_nop();
+		else this->write_duration();
+	}
+
+	u8_t* pAddr;												// Sequence Data (Input and Output)
+	u32_t size;													// Sequence Data Size [byte]
+	u32_t limit;												// End of the Consumed Input
+	u32_t pos;													// Output Size [byte]
+	u32_t pending;												// Duration not written yet
+	bool  dropped;												// Event is dropped after the last written event
+	bool  overrun;												// Output overtook the Input (Malformed Data)
+	u32_t touched;												// Number of Held Slots
+	u8_t  value[STATE_CHANNELS][STATE_SLOTS];					// Channel State
+	u8_t  next[STATE_CHANNELS][STATE_SLOTS];					// Held Change in the Tick
+	u16_t order[STATE_CHANNELS * STATE_SLOTS];					// Held Slots in Order
+};
+
+// Optimize a copy of the sequence data in place. (Rewriter for optimize_size)
+bool optimize_track(const u8_t* pAddr_, const track_info& rTrack_, u32_t /*index_*/, std::vector<u8_t>& rDst_, void* /*pContext_*/)
+{
+	const u8_t* pSequence = &pAddr_[rTrack_.sequence_pos];
+	rDst_.assign(pSequence, (pSequence + rTrack_.sequence_size));
+
+	optimize_visitor optimize(rDst_.data(), rTrack_.sequence_size);
+	if (!walk_sequence(rDst_.data(), rTrack_.sequence_size, optimize)) return false;
+	optimize.finish();
+	if (optimize.overrun || optimize.pos > rTrack_.sequence_size) return false;
+
+	rDst_.resize(optimize.pos);
+	return true;
+}
+
+}																// namespace
+
+//------------------------------------------------------------------------------------------------------//
+// Optimize Sequence Size
+//------------------------------------------------------------------------------------------------------//
+bool smaf::optimize_size(MA_3& rSrcDst_, u32_t& rSaved_)
+{
+	OPENMF_TRACE_SCOPE("optimize_size");
+	OPENMF_TRACE_COUNT("optimize_size.bytes", rSrcDst_.size());
+
+	rSaved_ = 0;
+
+	const format_type fmt = rSrcDst_.get_format();
+	if (fmt != format_type::MOBILE_NO_COMPRESS) return false;
+
+	track_layout tracks;
+	if (!analyze_tracks(rSrcDst_, tracks)) return false;
+	if (score_sequences(tracks) > 1)
+	{
+		// Several score tracks: Each track is optimized on the thread pool and the sizes are fixed once.
+		const MA_3 src(rSrcDst_);
+		if (!rewrite_tracks(src, tracks, optimize_track, nullptr, rSrcDst_)) return false;
+		rSaved_ = (src.size() - rSrcDst_.size());				// Sum of the Tracks
+		return fix_crc16(rSrcDst_);
+	}
+
+	sequence_layout layout;
+	if (!first_layout(tracks, layout)) return false;
+
+	u8_t* pAddr = rSrcDst_.data_ptr();
+	const u32_t sequence_end = (layout.sequence_pos + layout.sequence_size);
+
+	// (1) Sequence Data (One Pass)
+	//
+	optimize_visitor optimize(&pAddr[layout.sequence_pos], layout.sequence_size);
+	if (!walk_sequence(&pAddr[layout.sequence_pos], layout.sequence_size, optimize)) return false;
+	optimize.finish();
+	if (optimize.overrun || optimize.pos > layout.sequence_size) return false;
+
+	const u32_t reduce_size = (layout.sequence_size - optimize.pos);
+	if (reduce_size == 0) return fix_crc16(rSrcDst_);			// Same Size (Changes in a tick may be reordered)
+
+	// (2) Data Fix
+	//
+	u32_t pos = (layout.sequence_pos + optimize.pos);
+	for (u32_t cnt = sequence_end; cnt < rSrcDst_.size(); cnt++)
+	{
+		pAddr[pos++] = pAddr[cnt];								// Remaining Chunks and CRC
+	}
+	if (!rSrcDst_.truncate(pos)) return false;					// In-place (No Copy)
+
+	make_size_array((layout.file_size - reduce_size), MA_3::CHUNK_DATA_SIZE, &rSrcDst_[layout.file_size_pos]);
+	make_size_array((layout.score_size - reduce_size), MA_3::CHUNK_DATA_SIZE, &rSrcDst_[layout.score_size_pos]);
+	make_size_array((layout.sequence_size - reduce_size), MA_3::CHUNK_DATA_SIZE, &rSrcDst_[layout.sequence_size_pos]);
+
+	rSaved_ = reduce_size;
+	return fix_crc16(rSrcDst_);
 }
 
 //------------------------------------------------------------------------------------------------------//
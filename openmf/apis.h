@@ -12,6 +12,7 @@
 #pragma once
 
 #include "core.h"
+#include <vector>
 
 namespace smaf {
 
@@ -42,6 +43,39 @@ enum sequence_event
 	SE_EOS_NOP          = 0xFF									// EOS or NOP
 };
 
+//------------------------------------------------------------------------------------------------------//
+// Event Filter Class (for filter_events)
+//------------------------------------------------------------------------------------------------------//
+class event_filter
+{
+public:
+	event_filter();
+	~event_filter();
+
+public:
+	u16_t mute_mask;											// Channels to Drop (bit n = Channel n)
+	u16_t target_mask;											// Channels to Transpose/Scale (bit n = Channel n)
+	u8_t  skip_type_mask;										// Channel Types to Skip (bit n = channel_status::TYPE_xxx)
+	s32_t transpose;											// Transposition [semitone]
+	f64_t velocity_ratio;										// Velocity Scale Ratio
+};
+
+//------------------------------------------------------------------------------------------------------//
+// Track Information (struct)
+//------------------------------------------------------------------------------------------------------//
+struct track_info
+{
+	u32_t number;												// Track Number (Byte matched by '*')
+	bool  audio;												// Audio Track (ATR*), otherwise Score Track (MTR*)
+	u32_t pos;													// Position of Track Chunk Head
+	u32_t size_pos;												// Position of Track Chunk Size
+	u32_t size;													// Track Chunk Data Size [byte]
+	u32_t data_pos;												// Position of Track Chunk Data
+	u32_t sequence_size_pos;									// Position of Mtsq/Atsq Chunk Size (0 = No Sequence)
+	u32_t sequence_size;										// Mtsq/Atsq Chunk Size [byte]
+	u32_t sequence_pos;											// Head of Sequence Data
+};
+
 //------------------------------------------------------------------------------------------------------//
 // Load Binary Data from File
 //------------------------------------------------------------------------------------------------------//
@@ -58,35 +92,92 @@ bool save(const char* szFile, const binary_array& rSrc_);
 bool fix_crc16(MA_3& rSrcDst_);
 
 //------------------------------------------------------------------------------------------------------//
-// Remove NOP (for Smooth Loop)
+// Enumerate Tracks (Score and Audio Tracks in File Order)
+//------------------------------------------------------------------------------------------------------//
+bool enumerate_tracks(const MA_3& rSrc_, std::vector<track_info>& rDst_);
+
+//------------------------------------------------------------------------------------------------------//
+// Remove NOP (for Smooth Loop, Every Score Track)
 //------------------------------------------------------------------------------------------------------//
 bool remove_nop(MA_3& rSrcDst_);
 
 //------------------------------------------------------------------------------------------------------//
-// Clear Channel Status
+// Clear Channel Status (Every Score Track)
 //------------------------------------------------------------------------------------------------------//
 bool clear_channel_status(MA_3& rSrcDst_);
 
 //------------------------------------------------------------------------------------------------------//
-// Change Channel Status
+// Change Channel Status (Every Score Track)
 //------------------------------------------------------------------------------------------------------//
 bool change_channel_status(MA_3& rSrcDst_, u32_t ch_, const channel_status& rStatus_);
 
 //------------------------------------------------------------------------------------------------------//
-// Change Timebase
+// Change Timebase (Every Score Track)
 //------------------------------------------------------------------------------------------------------//
 bool change_timebase(MA_3& rSrcDst_, const timebase& rNewTimebase_);
 
 //------------------------------------------------------------------------------------------------------//
-// Change Tempo
+// Change Tempo (Every Score Track, rSrc_ == rDst_: In-place)
 //------------------------------------------------------------------------------------------------------//
 bool change_tempo(const MA_3& rSrc_, const timebase& rNewTimebase_, f64_t ratio_, MA_3& rDst_);
 
 //------------------------------------------------------------------------------------------------------//
-// Combine SMAF Data
+// Combine SMAF Data (Each Score Track of rSrc2_ is appended to the Track of the same Number in rSrc1_,
+// rSrc2_ is retimed to the timebase of rSrc1_, gap_ = Tick of rSrc1_'s Timebase)
 //------------------------------------------------------------------------------------------------------//
 bool combine(const MA_3& rSrc1_, const MA_3& rSrc2_, MA_3& rDst_, u32_t gap_ = 1);
 
+//------------------------------------------------------------------------------------------------------//
+// Repeat SMAF Data (count_ Times, as combine of the Data to itself count_ - 1 Times, rSrc_ != rDst_)
+//
+// The source is analyzed once and the body from the head (first note with velocity) is copied after
+// the gap of each repeat, gap_ = Tick of the First Score Track's Timebase. Sizes and CRC16 are fixed.
+//------------------------------------------------------------------------------------------------------//
+bool repeat(const MA_3& rSrc_, u32_t count_, MA_3& rDst_, u32_t gap_ = 1);
+
+//------------------------------------------------------------------------------------------------------//
+// Trim SMAF Data (Every Score Track, begin_/end_ = Tick of the First Score Track's Duration Timebase,
+// end_ = 0: End of Sequence)
+//------------------------------------------------------------------------------------------------------//
+bool trim(const MA_3& rSrc_, u32_t begin_, u32_t end_, MA_3& rDst_);
+
+//------------------------------------------------------------------------------------------------------//
+// Split SMAF Data (Every Score Track, rPoints_ = Ascending Ticks of the First Score Track's Duration
+// Timebase, N Points -> N+1 Segments)
+//------------------------------------------------------------------------------------------------------//
+bool split(const MA_3& rSrc_, const data_array_<u32_t>& rPoints_, data_array_<MA_3>& rDst_);
+
+//------------------------------------------------------------------------------------------------------//
+// Filter Events (Mute/Transpose/Scale Velocity, rSrc_ == rDst_: In-place)
+//------------------------------------------------------------------------------------------------------//
+bool filter_events(const MA_3& rSrc_, const event_filter& rFilter_, MA_3& rDst_);
+
+//------------------------------------------------------------------------------------------------------//
+// Limit Polyphony (Every Score Track, voices_ = 1 to 256, rSrc_ != rDst_)
+//
+// The notes of the score tracks are merged on absolute time. When a note starts on full voices, the
+// note to steal is chosen by rhythm channel, lower velocity and older note in this order. The stolen
+// note is shortened to end at the start, or dropped when it can not be shortened. A new note of lower
+// priority than every sounding note is dropped instead. Sizes and CRC16 are fixed.
+// (rShortened_/rDropped_ = Changed Notes)
+//------------------------------------------------------------------------------------------------------//
+bool limit_polyphony(const MA_3& rSrc_, u32_t voices_, MA_3& rDst_, u32_t& rShortened_, u32_t& rDropped_);
+
+//------------------------------------------------------------------------------------------------------//
+// Optimize Sequence Size (Merge NOPs, Drop Redundant PC/CC, Shortest Variable Size, rSaved_ = Reduced Bytes)
+//------------------------------------------------------------------------------------------------------//
+bool optimize_size(MA_3& rSrcDst_, u32_t& rSaved_);
+
+//------------------------------------------------------------------------------------------------------//
+// Verify SMAF Data (Read Only, No Allocation: Chunk Tree, Sizes, Sequence Events and CRC16)
+//------------------------------------------------------------------------------------------------------//
+bool verify(const u8_t* pAddr_, u32_t size_);
+
+//------------------------------------------------------------------------------------------------------//
+// Calculate CRC16 (Slicing-by-8, Same Result as CRC16::make, crc_ = Result of the Data before to Continue)
+//------------------------------------------------------------------------------------------------------//
+u16_t calc_crc16(const u8_t* pAddr_, u32_t size_, u16_t crc_ = 0x0000);
+
 //------------------------------------------------------------------------------------------------------//
 }																// namespace smaf
 
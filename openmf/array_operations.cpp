@@ -8,7 +8,7 @@
 //------------------------------------------------------------------------------------------------------//
 
 #include "array_operations.h"
-#include <string>
+#include "trace.h"
 
 using namespace smaf;
 
@@ -17,13 +17,29 @@ using namespace smaf;
 //------------------------------------------------------------------------------------------------------//
 bool smaf::check_chunk(const char* szChunkID_, const u8_t* p_)
 {
-	const u32_t len = static_cast<u32_t>(std::strlen(szChunkID_));
-	for (u32_t i = 0; i < len; i++)
+	u32_t mask;
+	const u32_t id = make_chunk_id(szChunkID_, mask);
+	return ((calc_size(p_, 4) & mask) == id) ? true : false;
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Make Chunk ID
+//------------------------------------------------------------------------------------------------------//
+u32_t smaf::make_chunk_id(const char* szChunkID_, u32_t& rMask_)
+{
+	u32_t id = 0;
+	rMask_ = 0;
+	bool end = false;
+	for (u32_t i = 0; i < 4; i++)
 	{
-		if (szChunkID_[i] == '*') continue;						// '*' = No Care
-		if (szChunkID_[i] != p_[i]) return false;
+		if (szChunkID_[i] == '\0') end = true;
+		id <<= 8;
+		rMask_ <<= 8;
+		if (end || szChunkID_[i] == '*') continue;				// '*' = No Care
+		id |= static_cast<u8_t>(szChunkID_[i]);
+		rMask_ |= 0xFF;
 	}
-	return true;
+	return id;
 }
 
 //------------------------------------------------------------------------------------------------------//
@@ -45,6 +61,7 @@ u32_t smaf::calc_size(const u8_t* p_, u32_t len_)
 //------------------------------------------------------------------------------------------------------//
 u32_t smaf::calc_variable_size(const u8_t* p_, u32_t& rLen_)
 {
+	OPENMF_TRACE_COUNT("vlq_decode", 1);
 	u32_t size = 0;
 	rLen_ = 0;
 	for (u32_t i = 0; i < 4; i++)
@@ -81,6 +98,7 @@ void smaf::make_size_array(u32_t size_, u32_t len_, u8_t* p_)
 //------------------------------------------------------------------------------------------------------//
 void smaf::make_variable_size_array(u32_t size_, u8_t* p_, u32_t& rLen_)
 {
+	OPENMF_TRACE_COUNT("vlq_encode", 1);
 	if (size_ <= 0x7F)
 	{
 		rLen_ = 1;
@@ -20,6 +20,11 @@ namespace smaf {
 //------------------------------------------------------------------------------------------------------//
 bool check_chunk(const char* szChunkID_, const u8_t* p_);
 
+//------------------------------------------------------------------------------------------------------//
+// Make Chunk ID ('*' = No Care, rMask_ = Compare Mask)
+//------------------------------------------------------------------------------------------------------//
+u32_t make_chunk_id(const char* szChunkID_, u32_t& rMask_);
+
 //------------------------------------------------------------------------------------------------------//
 // Calculate Data Size
 //------------------------------------------------------------------------------------------------------//
@@ -21,6 +21,8 @@ typedef signed short		s16_t;								// signed 16bit
 typedef unsigned short		u16_t;								// unsigned 16bit
 typedef signed long			s32_t;								// signed 32bit
 typedef unsigned long		u32_t;								// unsigned 32bit
+typedef signed long long	s64_t;								// signed 64bit
+typedef unsigned long long	u64_t;								// unsigned 64bit
 typedef float				f32_t;								// floating point 32bit
 typedef double				f64_t;								// floating point 64bit
 
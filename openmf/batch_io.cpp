@@ -0,0 +1,720 @@
+//------------------------------------------------------------------------------------------------------//
+//
+//                                          License Agreement
+//                                     For Open Source SMAF Library
+//
+//                         Copyright (c) 2015-2017, @shirajira, all rights reserved.
+//
+//------------------------------------------------------------------------------------------------------//
+
+#include "batch_io.h"
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__linux__) && !defined(OPENMF_NO_IO_URING)
+#define OPENMF_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+using namespace smaf;
+
+//------------------------------------------------------------------------------------------------------//
+// Internal Helpers
+//------------------------------------------------------------------------------------------------------//
+namespace {
+
+const u32_t DEFAULT_QUEUE_DEPTH = 256;							// Default Files in Flight per Worker
+const u32_t MAX_FILE_SIZE = 0x7FFFFFFF;							// Max File Size [byte]
+
+// Shared state of the workers.
+struct batch_job
+{
+	const char* const*  pSrc;									// Source Files
+	const char* const*  pDst;									// Destination Files (nullptr = No Save)
+	u32_t               n;										// Number of Files
+	batch_callback      pProcess;								// Process Callback
+	batch_done_callback pDone;									// Done Callback
+	void*               pContext;								// Context for Callbacks
+	std::atomic<u32_t>  next;									// Next File Index
+	std::atomic<u32_t>  failed;									// Failed Files
+};
+
+// Report the result of the file.
+void finish_file(batch_job& rJob_, u32_t index_, bool ok_)
+{
+	if (!ok_) rJob_.failed++;
+	if (rJob_.pDone != nullptr) rJob_.pDone(index_, ok_, rJob_.pContext);
+}
+
+// Load the file with blocking pread.
+bool read_file(const char* szFile_, MA_3& rDst_)
+{
+	const int fd = ::open(szFile_, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) return false;
+
+	struct stat st;
+	bool ok = (::fstat(fd, &st) == 0 && st.st_size > 0 && static_cast<u64_t>(st.st_size) <= MAX_FILE_SIZE);
+	if (ok) ok = rDst_.create(static_cast<u32_t>(st.st_size));
+
+	u32_t pos = 0;
+	while (ok && pos < rDst_.size())
+	{
+		const ssize_t len = ::pread(fd, rDst_.data_ptr() + pos, rDst_.size() - pos, pos);
+		if (len < 0 && errno == EINTR) continue;
+		if (len <= 0) ok = false;
+		else pos += static_cast<u32_t>(len);
+	}
+	::close(fd);
+	return ok;
+}
+
+// Save the file with blocking pwrite.
+bool write_file(const char* szFile_, const MA_3& rSrc_)
+{
+	if (rSrc_.empty()) return false;
+
+	const int fd = ::open(szFile_, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+	if (fd < 0) return false;
+
+	bool ok = write_all(fd, rSrc_.data_ptr(), rSrc_.size(), 0);
+	if (::close(fd) != 0) ok = false;
+	return ok;
+}
+
+// Load, process and save the file with blocking I/O.
+void run_file(batch_job& rJob_, u32_t index_)
+{
+	MA_3 data;
+	bool ok = read_file(rJob_.pSrc[index_], data);
+	OPENMF_TRACE_COUNT("batch_io.bytes_read", ok ? data.size() : 0);
+	if (ok && rJob_.pProcess != nullptr) ok = rJob_.pProcess(index_, data, rJob_.pContext);
+	if (ok && rJob_.pDst != nullptr)
+	{
+		ok = write_file(rJob_.pDst[index_], data);
+		OPENMF_TRACE_COUNT("batch_io.bytes_written", ok ? data.size() : 0);
+	}
+	finish_file(rJob_, index_, ok);
+}
+
+// Worker of the thread pool backend.
+void thread_worker(batch_job& rJob_)
+{
+	while (true)
+	{
+		const u32_t index = rJob_.next++;
+		if (index >= rJob_.n) break;
+		run_file(rJob_, index);
+	}
+}
+
+#ifdef OPENMF_IO_URING
+
+// io_uring with raw system calls. (Single owner thread)
+class uring
+{
+public:
+	uring()
+		: m_fd(-1), m_pending(0)
+		, m_pSqRing(nullptr), m_sqRingSize(0), m_pCqRing(nullptr), m_cqRingSize(0), m_pSqes(nullptr), m_sqesSize(0)
+		, m_pSqHead(nullptr), m_pSqTail(nullptr), m_pSqArray(nullptr), m_sqMask(0), m_sqEntries(0)
+		, m_pCqHead(nullptr), m_pCqTail(nullptr), m_pCqes(nullptr), m_cqMask(0)
+	{}
+	~uring()
+	{
+		this->release();
+	}
+
+	// Set up the ring and check the required operations.
+	bool initialize(u32_t entries_)
+	{
+		io_uring_params params;
+		std::memset(&params, 0, sizeof(params));
+		m_fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries_, &params));
+		if (m_fd < 0) return false;
+
+		m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(__u32);
+		m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+		if (params.features & IORING_FEAT_SINGLE_MMAP)
+		{
+			if (m_cqRingSize > m_sqRingSize) m_sqRingSize = m_cqRingSize;
+			m_cqRingSize = 0;
+		}
+
+		m_pSqRing = ::mmap(nullptr, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+		if (m_pSqRing == MAP_FAILED)
+		{
+			m_pSqRing = nullptr;
+			this->release();
+			return false;
+		}
+		u8_t* pCq = static_cast<u8_t*>(m_pSqRing);
+		if (m_cqRingSize != 0)
+		{
+			m_pCqRing = ::mmap(nullptr, m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+			if (m_pCqRing == MAP_FAILED)
+			{
+				m_pCqRing = nullptr;
+				this->release();
+				return false;
+			}
+			pCq = static_cast<u8_t*>(m_pCqRing);
+		}
+		m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+		void* pSqes = ::mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+		if (pSqes == MAP_FAILED)
+		{
+			this->release();
+			return false;
+		}
+		m_pSqes = static_cast<io_uring_sqe*>(pSqes);
+
+		u8_t* pSq = static_cast<u8_t*>(m_pSqRing);
+		m_pSqHead = reinterpret_cast<__u32*>(pSq + params.sq_off.head);
+		m_pSqTail = reinterpret_cast<__u32*>(pSq + params.sq_off.tail);
+		m_pSqArray = reinterpret_cast<__u32*>(pSq + params.sq_off.array);
+		m_sqMask = *reinterpret_cast<__u32*>(pSq + params.sq_off.ring_mask);
+		m_sqEntries = params.sq_entries;
+		m_pCqHead = reinterpret_cast<__u32*>(pCq + params.cq_off.head);
+		m_pCqTail = reinterpret_cast<__u32*>(pCq + params.cq_off.tail);
+		m_pCqes = reinterpret_cast<io_uring_cqe*>(pCq + params.cq_off.cqes);
+		m_cqMask = *reinterpret_cast<__u32*>(pCq + params.cq_off.ring_mask);
+
+		if (!this->probe())
+		{
+			this->release();
+			return false;
+		}
+		return true;
+	}
+
+	void release()
+	{
+		if (m_pSqes != nullptr) ::munmap(m_pSqes, m_sqesSize);
+		if (m_pCqRing != nullptr) ::munmap(m_pCqRing, m_cqRingSize);
+		if (m_pSqRing != nullptr) ::munmap(m_pSqRing, m_sqRingSize);
+		if (m_fd >= 0) ::close(m_fd);
+		m_pSqes = nullptr;
+		m_pCqRing = nullptr;
+		m_pSqRing = nullptr;
+		m_fd = -1;
+		m_pending = 0;
+	}
+
+	// Get the next submission entry. (nullptr = Full)
+	io_uring_sqe* get_sqe()
+	{
+		const __u32 tail = *m_pSqTail;
+		const __u32 head = __atomic_load_n(m_pSqHead, __ATOMIC_ACQUIRE);
+		if ((tail - head) >= m_sqEntries) return nullptr;
+
+		const __u32 index = (tail & m_sqMask);
+		io_uring_sqe* pSqe = &m_pSqes[index];
+		std::memset(pSqe, 0, sizeof(io_uring_sqe));
+		m_pSqArray[index] = index;
+		__atomic_store_n(m_pSqTail, tail + 1, __ATOMIC_RELEASE);
+		m_pending++;
+		return pSqe;
+	}
+
+	// Submit the pending entries and wait for wait_ completions.
+	bool submit(u32_t wait_)
+	{
+		while (true)
+		{
+			const long ret = ::syscall(__NR_io_uring_enter, m_fd, m_pending, wait_, (wait_ != 0) ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+			if (ret >= 0)
+			{
+				m_pending -= static_cast<u32_t>(ret);
+				return true;
+			}
+			if (errno == EINTR) continue;
+			if (errno == EAGAIN || errno == EBUSY) return true;	// Retry after Reaping
+			return false;
+		}
+	}
+
+	// Wait for a completion without submitting. (false = Error)
+	bool wait()
+	{
+		while (true)
+		{
+			const long ret = ::syscall(__NR_io_uring_enter, m_fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+			if (ret >= 0) return true;
+			if (errno != EINTR) return false;
+		}
+	}
+
+	// Pop the next completion. (false = Empty)
+	bool pop_cqe(io_uring_cqe& rCqe_)
+	{
+		const __u32 head = *m_pCqHead;
+		if (head == __atomic_load_n(m_pCqTail, __ATOMIC_ACQUIRE)) return false;
+		rCqe_ = m_pCqes[head & m_cqMask];
+		__atomic_store_n(m_pCqHead, head + 1, __ATOMIC_RELEASE);
+		return true;
+	}
+
+	u32_t pending() const
+	{
+		return m_pending;
+	}
+
+private:
+	// Check the operations used by the batch. (Kernel 5.6 or later)
+	bool probe()
+	{
+		const u32_t ops = 256;
+		std::vector<u8_t> buf(sizeof(io_uring_probe) + ops * sizeof(io_uring_probe_op), 0);
+		io_uring_probe* pProbe = reinterpret_cast<io_uring_probe*>(&buf[0]);
+		if (::syscall(__NR_io_uring_register, m_fd, IORING_REGISTER_PROBE, pProbe, ops) < 0) return false;
+
+		const u8_t required[] = { IORING_OP_OPENAT, IORING_OP_STATX, IORING_OP_READ, IORING_OP_WRITE, IORING_OP_CLOSE };
+		for (u32_t i = 0; i < sizeof(required); i++)
+		{
+			if (required[i] > pProbe->last_op) return false;
+			if (!(pProbe->ops[required[i]].flags & IO_URING_OP_SUPPORTED)) return false;
+		}
+		return true;
+	}
+
+private:
+	uring(const uring&);
+	uring& operator=(const uring&);
+
+private:
+	int           m_fd;											// Ring File Descriptor
+	u32_t         m_pending;									// Entries not Submitted
+	void*         m_pSqRing;									// Submission Ring
+	size_t        m_sqRingSize;
+	void*         m_pCqRing;									// Completion Ring (nullptr = Single Mmap)
+	size_t        m_cqRingSize;
+	io_uring_sqe* m_pSqes;										// Submission Entries
+	size_t        m_sqesSize;
+	__u32*        m_pSqHead;
+	__u32*        m_pSqTail;
+	__u32*        m_pSqArray;
+	__u32         m_sqMask;
+	__u32         m_sqEntries;
+	__u32*        m_pCqHead;
+	__u32*        m_pCqTail;
+	io_uring_cqe* m_pCqes;
+	__u32         m_cqMask;
+};
+
+// Stage of the file in flight.
+enum slot_stage
+{
+	ST_OPEN_READ = 0,											// openat (Source)
+	ST_STATX,													// statx (File Size)
+	ST_READ,													// read
+	ST_CLOSE_READ,												// close (Source)
+	ST_OPEN_WRITE,												// openat (Destination)
+	ST_WRITE,													// write
+	ST_CLOSE_WRITE												// close (Destination)
+};
+
+// File in flight. (One operation in the ring per slot)
+struct slot
+{
+	bool         busy;											// In Flight
+	u32_t        index;											// File Index
+	slot_stage   stage;											// Stage
+	int          fd;											// File Descriptor
+	bool         ok;											// Result
+	u32_t        pos;											// Read/Written Bytes
+	MA_3         data;											// File Data
+	struct statx stx;											// statx Result
+};
+
+// Queue the operation of the current stage.
+void queue_stage(uring& rRing_, batch_job& rJob_, slot& rSlot_, u32_t id_)
+{
+	io_uring_sqe* pSqe = rRing_.get_sqe();						// Never Full (One Entry per Slot)
+	pSqe->user_data = id_;
+
+	switch (rSlot_.stage)
+	{
+	case ST_OPEN_READ:
+		pSqe->opcode = IORING_OP_OPENAT;
+		pSqe->fd = AT_FDCWD;
+		pSqe->addr = reinterpret_cast<__u64>(rJob_.pSrc[rSlot_.index]);
+		pSqe->open_flags = (O_RDONLY | O_CLOEXEC);
+		break;
+	case ST_STATX:
+		pSqe->opcode = IORING_OP_STATX;
+		pSqe->fd = rSlot_.fd;
+		pSqe->addr = reinterpret_cast<__u64>("");
+		pSqe->len = STATX_SIZE;
+		pSqe->off = reinterpret_cast<__u64>(&rSlot_.stx);
+		pSqe->statx_flags = AT_EMPTY_PATH;
+		break;
+	case ST_READ:
+		pSqe->opcode = IORING_OP_READ;
+		pSqe->fd = rSlot_.fd;
+		pSqe->addr = reinterpret_cast<__u64>(rSlot_.data.data_ptr() + rSlot_.pos);
+		pSqe->len = (rSlot_.data.size() - rSlot_.pos);
+		pSqe->off = rSlot_.pos;
+		break;
+	case ST_OPEN_WRITE:
+		pSqe->opcode = IORING_OP_OPENAT;
+		pSqe->fd = AT_FDCWD;
+		pSqe->addr = reinterpret_cast<__u64>(rJob_.pDst[rSlot_.index]);
+		pSqe->open_flags = (O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC);
+		pSqe->len = 0666;
+		break;
+	case ST_WRITE:
+		pSqe->opcode = IORING_OP_WRITE;
+		pSqe->fd = rSlot_.fd;
+		pSqe->addr = reinterpret_cast<__u64>(rSlot_.data.data_ptr() + rSlot_.pos);
+		pSqe->len = (rSlot_.data.size() - rSlot_.pos);
+		pSqe->off = rSlot_.pos;
+		break;
+	case ST_CLOSE_READ:
+	case ST_CLOSE_WRITE:
+		pSqe->opcode = IORING_OP_CLOSE;
+		pSqe->fd = rSlot_.fd;
+		break;
+	}
+}
+
+// Advance the slot with the completion result. (false = Slot Finished)
+bool advance_stage(batch_job& rJob_, slot& rSlot_, s32_t res_)
+{
+	switch (rSlot_.stage)
+	{
+	case ST_OPEN_READ:
+		if (res_ < 0)
+		{
+			rSlot_.ok = false;									// Not Opened: Nothing to Close
+			return false;
+		}
+		rSlot_.fd = res_;
+		rSlot_.stage = ST_STATX;
+		return true;
+	case ST_STATX:
+		rSlot_.ok = (res_ >= 0 && rSlot_.stx.stx_size > 0 && rSlot_.stx.stx_size <= MAX_FILE_SIZE);
+		if (rSlot_.ok) rSlot_.ok = rSlot_.data.create(static_cast<u32_t>(rSlot_.stx.stx_size));
+		rSlot_.pos = 0;
+		rSlot_.stage = rSlot_.ok ? ST_READ : ST_CLOSE_READ;
+		return true;
+	case ST_READ:
+		if (res_ <= 0)
+		{
+			rSlot_.ok = false;
+			rSlot_.stage = ST_CLOSE_READ;
+			return true;
+		}
+		rSlot_.pos += static_cast<u32_t>(res_);
+		if (rSlot_.pos < rSlot_.data.size()) return true;		// Short Read: Read the Rest
+		OPENMF_TRACE_COUNT("batch_io.bytes_read", rSlot_.data.size());
+		if (rJob_.pProcess != nullptr) rSlot_.ok = rJob_.pProcess(rSlot_.index, rSlot_.data, rJob_.pContext);
+		rSlot_.stage = ST_CLOSE_READ;
+		return true;
+	case ST_CLOSE_READ:
+		if (!rSlot_.ok || rJob_.pDst == nullptr || rSlot_.data.empty())
+		{
+			rSlot_.ok = (rSlot_.ok && (rJob_.pDst == nullptr || !rSlot_.data.empty()));
+			return false;
+		}
+		rSlot_.stage = ST_OPEN_WRITE;
+		return true;
+	case ST_OPEN_WRITE:
+		if (res_ < 0)
+		{
+			rSlot_.ok = false;
+			return false;
+		}
+		rSlot_.fd = res_;
+		rSlot_.pos = 0;
+		rSlot_.stage = ST_WRITE;
+		return true;
+	case ST_WRITE:
+		if (res_ <= 0)
+		{
+			rSlot_.ok = false;
+			rSlot_.stage = ST_CLOSE_WRITE;
+			return true;
+		}
+		rSlot_.pos += static_cast<u32_t>(res_);
+		if (rSlot_.pos >= rSlot_.data.size())
+		{
+			OPENMF_TRACE_COUNT("batch_io.bytes_written", rSlot_.data.size());
+			rSlot_.stage = ST_CLOSE_WRITE;
+		}
+		return true;
+	case ST_CLOSE_WRITE:
+		if (res_ < 0) rSlot_.ok = false;
+		return false;
+	}
+	return false;
+}
+
+// Finish the file in flight with blocking I/O after a ring error. (The operation of the stage has not run.)
+void resume_file(batch_job& rJob_, slot& rSlot_)
+{
+	switch (rSlot_.stage)
+	{
+	case ST_OPEN_READ:
+		run_file(rJob_, rSlot_.index);							// Not Processed: From the Start
+		return;
+	case ST_STATX:
+	case ST_READ:
+		::close(rSlot_.fd);
+		run_file(rJob_, rSlot_.index);							// Not Processed: From the Start
+		return;
+	case ST_CLOSE_READ:
+	case ST_WRITE:
+		::close(rSlot_.fd);
+		break;
+	case ST_OPEN_WRITE:
+		break;
+	case ST_CLOSE_WRITE:
+		finish_file(rJob_, rSlot_.index, (::close(rSlot_.fd) == 0) && rSlot_.ok);
+		return;
+	}
+
+	// Processed: Save the data from the start.
+	bool ok = (rSlot_.ok && (rJob_.pDst == nullptr || !rSlot_.data.empty()));
+	if (ok && rJob_.pDst != nullptr)
+	{
+		ok = write_file(rJob_.pDst[rSlot_.index], rSlot_.data);
+		OPENMF_TRACE_COUNT("batch_io.bytes_written", ok ? rSlot_.data.size() : 0);
+	}
+	finish_file(rJob_, rSlot_.index, ok);
+}
+
+// Worker of the io_uring backend.
+void uring_worker(uring& rRing_, u32_t depth_, batch_job& rJob_)
+{
+	std::vector<slot> slots(depth_);
+	for (u32_t i = 0; i < depth_; i++)
+	{
+		slots[i].busy = false;
+	}
+	std::vector<u32_t> free_slots(depth_);
+	for (u32_t i = 0; i < depth_; i++)
+	{
+		free_slots[i] = (depth_ - 1 - i);
+	}
+
+	u32_t active = 0;
+	bool input_end = false;
+	while (true)
+	{
+		// Fill Free Slots
+		while (!input_end && !free_slots.empty())
+		{
+			const u32_t index = rJob_.next++;
+			if (index >= rJob_.n)
+			{
+				input_end = true;
+				break;
+			}
+			const u32_t id = free_slots.back();
+			free_slots.pop_back();
+			slot& s = slots[id];
+			s.busy = true;
+			s.index = index;
+			s.stage = ST_OPEN_READ;
+			s.fd = -1;
+			s.ok = true;
+			s.pos = 0;
+			queue_stage(rRing_, rJob_, s, id);
+			active++;
+		}
+		if (active == 0) break;
+
+		if (!rRing_.submit(1))
+		{
+			// Ring Error: The submitted operations can still use the slots, so their completions are
+			// reaped first (without queueing the next stages). Entries not submitted never run.
+			u32_t in_flight = (active - rRing_.pending());
+			bool drained = true;
+			while (in_flight > 0 && drained)
+			{
+				io_uring_cqe cqe;
+				if (!rRing_.pop_cqe(cqe))
+				{
+					drained = rRing_.wait();
+					continue;
+				}
+				in_flight--;
+				slot& s = slots[static_cast<u32_t>(cqe.user_data)];
+				if (advance_stage(rJob_, s, cqe.res)) continue;
+				finish_file(rJob_, s.index, s.ok);
+				s.data.release();
+				s.busy = false;
+			}
+
+			// Continue the Files in Flight and the Rest with Blocking I/O
+			if (drained)
+			{
+				for (u32_t i = 0; i < depth_; i++)
+				{
+					if (slots[i].busy) resume_file(rJob_, slots[i]);
+				}
+			}
+			else
+			{
+				// Completions can not be reaped: The files in flight fail, and their buffers are never released.
+				for (u32_t i = 0; i < depth_; i++)
+				{
+					if (slots[i].busy) finish_file(rJob_, slots[i].index, false);
+				}
+				(new std::vector<slot>())->swap(slots);
+			}
+			rRing_.release();
+			thread_worker(rJob_);
+			return;
+		}
+
+		io_uring_cqe cqe;
+		while (rRing_.pop_cqe(cqe))
+		{
+			const u32_t id = static_cast<u32_t>(cqe.user_data);
+			slot& s = slots[id];
+			if (advance_stage(rJob_, s, cqe.res))
+			{
+				queue_stage(rRing_, rJob_, s, id);
+				continue;
+			}
+			finish_file(rJob_, s.index, s.ok);
+			s.data.release();
+			s.busy = false;
+			free_slots.push_back(id);
+			active--;
+		}
+	}
+}
+
+#endif															// OPENMF_IO_URING
+
+}																// namespace
+
+//------------------------------------------------------------------------------------------------------//
+// Batch I/O Class
+//------------------------------------------------------------------------------------------------------//
+
+batch_io::batch_io()
+	: backend(BB_AUTO)
+	, queue_depth(DEFAULT_QUEUE_DEPTH)
+	, threads(0)
+	, pProcess(nullptr)
+	, pDone(nullptr)
+	, pContext(nullptr)
+	, m_used(BB_AUTO)
+	, m_failed(0)
+{}
+
+batch_io::~batch_io()
+{}
+
+bool batch_io::run(const char* const* pSrc_, const char* const* pDst_, u32_t n_)
+{
+	if (pSrc_ == nullptr) return false;
+	OPENMF_TRACE_SCOPE("batch_io::run");
+
+	batch_job job;
+	job.pSrc = pSrc_;
+	job.pDst = pDst_;
+	job.n = n_;
+	job.pProcess = pProcess;
+	job.pDone = pDone;
+	job.pContext = pContext;
+	job.next = 0;
+	job.failed = 0;
+
+	u32_t workers = (threads != 0) ? threads : static_cast<u32_t>(std::thread::hardware_concurrency());
+	if (workers == 0) workers = 1;
+	if (workers > n_) workers = (n_ != 0) ? n_ : 1;
+
+	m_used = BB_THREADS;
+	m_failed = 0;
+
+#ifdef OPENMF_IO_URING
+	if (backend != BB_THREADS)
+	{
+		const u32_t depth = (queue_depth != 0) ? queue_depth : 1;
+		std::vector<uring> rings(workers);
+		bool ready = true;
+		for (u32_t i = 0; i < workers && ready; i++)
+		{
+			ready = rings[i].initialize(depth);
+		}
+
+		if (ready)
+		{
+			m_used = BB_IO_URING;
+			std::vector<std::thread> pool;
+			for (u32_t i = 1; i < workers; i++)
+			{
+				pool.push_back(std::thread(uring_worker, std::ref(rings[i]), depth, std::ref(job)));
+			}
+			uring_worker(rings[0], depth, job);
+			for (size_t i = 0; i < pool.size(); i++)
+			{
+				pool[i].join();
+			}
+			m_failed = job.failed.load();
+			return (m_failed == 0);
+		}
+		if (backend == BB_IO_URING) return false;				// io_uring Unavailable
+	}
+#else
+	if (backend == BB_IO_URING) return false;					// io_uring Unavailable
+#endif
+
+	std::vector<std::thread> pool;
+	for (u32_t i = 1; i < workers; i++)
+	{
+		pool.push_back(std::thread(thread_worker, std::ref(job)));
+	}
+	thread_worker(job);
+	for (size_t i = 0; i < pool.size(); i++)
+	{
+		pool[i].join();
+	}
+	m_failed = job.failed.load();
+	return (m_failed == 0);
+}
+
+batch_backend batch_io::used_backend() const
+{
+	return m_used;
+}
+
+u32_t batch_io::failed() const
+{
+	return m_failed;
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Write All Bytes
+//------------------------------------------------------------------------------------------------------//
+bool smaf::write_all(int fd_, const u8_t* pData_, u64_t size_, s64_t offset_)
+{
+	while (size_ > 0)
+	{
+		const ssize_t len = (offset_ < 0) ? ::write(fd_, pData_, static_cast<size_t>(size_))
+			: ::pwrite(fd_, pData_, static_cast<size_t>(size_), static_cast<off_t>(offset_));
+		if (len < 0 && errno == EINTR) continue;
+		if (len <= 0) return false;
+		pData_ += len;
+		size_ -= static_cast<u64_t>(len);
+		if (offset_ >= 0) offset_ += len;
+	}
+	return true;
+}
+
+//------------------------------------------------------------------------------------------------------//
+// End of File
+//------------------------------------------------------------------------------------------------------//
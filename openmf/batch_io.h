@@ -0,0 +1,86 @@
+//------------------------------------------------------------------------------------------------------//
+//
+//                                          License Agreement
+//                                     For Open Source SMAF Library
+//
+//                         Copyright (c) 2015-2017, @shirajira, all rights reserved.
+//
+//------------------------------------------------------------------------------------------------------//
+
+#ifndef openmf_batch_io_h__
+#define openmf_batch_io_h__
+#pragma once
+
+#include "core.h"
+
+namespace smaf {
+
+//------------------------------------------------------------------------------------------------------//
+// Batch I/O Backend (enum)
+//------------------------------------------------------------------------------------------------------//
+enum batch_backend
+{
+	BB_AUTO = 0,												// io_uring if available, otherwise Threads
+	BB_IO_URING,												// Linux io_uring (Kernel 5.6 or later)
+	BB_THREADS													// Thread Pool of pread/pwrite
+};
+
+//------------------------------------------------------------------------------------------------------//
+// Batch Callbacks
+//
+//   batch_callback      : Process the loaded file. Return false to fail the file. (Not saved)
+//   batch_done_callback : Report the result of the file. (Load, process and save)
+//
+// The callbacks are called concurrently from the worker threads.
+//------------------------------------------------------------------------------------------------------//
+typedef bool (*batch_callback)(u32_t index_, MA_3& rData_, void* pContext_);
+typedef void (*batch_done_callback)(u32_t index_, bool ok_, void* pContext_);
+
+//------------------------------------------------------------------------------------------------------//
+// Batch I/O Class (Load, Process and Save Many Small Files)
+//
+// Each worker keeps up to queue_depth files in flight. With io_uring, open, statx, read, write and
+// close are submitted to the ring of the worker, and the file is read directly into the buffer
+// of its size. The thread pool backend uses blocking open/pread/pwrite per worker.
+//------------------------------------------------------------------------------------------------------//
+class batch_io
+{
+public:
+	batch_io();
+	virtual ~batch_io();
+
+public:
+	// Load pSrc_[i], process it and save to pDst_[i]. (pDst_ = nullptr: No Save)
+	bool run(const char* const* pSrc_, const char* const* pDst_, u32_t n_);
+
+	// Return the backend used in the last run.
+	batch_backend used_backend() const;
+
+	// Return the number of failed files in the last run.
+	u32_t failed() const;
+
+public:
+	batch_backend       backend;								// Backend
+	u32_t               queue_depth;							// Files in Flight per Worker (io_uring)
+	u32_t               threads;								// Number of Workers (0 = Hardware Threads)
+	batch_callback      pProcess;								// Process Callback (nullptr = None)
+	batch_done_callback pDone;									// Done Callback (nullptr = None)
+	void*               pContext;								// Context for Callbacks
+
+private:
+	batch_backend       m_used;									// Used Backend
+	u32_t               m_failed;								// Failed Files
+};
+
+//------------------------------------------------------------------------------------------------------//
+// Write All Bytes (Blocking, Retried on EINTR and Short Writes, offset_ < 0: Current File Position)
+//------------------------------------------------------------------------------------------------------//
+bool write_all(int fd_, const u8_t* pData_, u64_t size_, s64_t offset_ = -1);
+
+//------------------------------------------------------------------------------------------------------//
+}																// namespace smaf
+
+#endif															// openmf_batch_io_h__
+//------------------------------------------------------------------------------------------------------//
+// End of File
+//------------------------------------------------------------------------------------------------------//
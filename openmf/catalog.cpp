@@ -0,0 +1,453 @@
+//------------------------------------------------------------------------------------------------------//
+//
+//                                          License Agreement
+//                                     For Open Source SMAF Library
+//
+//                         Copyright (c) 2015-2017, @shirajira, all rights reserved.
+//
+//------------------------------------------------------------------------------------------------------//
+
+#include "catalog.h"
+#include "apis.h"
+#include "batch_io.h"
+#include "chunk.h"
+#include "sequence.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace smaf;
+
+//------------------------------------------------------------------------------------------------------//
+// Internal Helpers
+//------------------------------------------------------------------------------------------------------//
+namespace {
+
+const char  MAGIC[4] = { 'O', 'M', 'F', 'C' };					// Index Magic
+const u32_t VERSION = 1;										// Index Version
+const u32_t HEAD_SIZE = 32;										// Index Header Size [byte]
+const u32_t ENTRY_SIZE = 32;									// Index Entry Size [byte]
+const u64_t PAGE_SIZE = 4096;									// Page Size for Image Placement [byte]
+
+// Write big endian value.
+void put_value(u64_t value_, u32_t len_, u8_t* p_)
+{
+	for (u32_t i = 0; i < len_; i++)
+	{
+		p_[len_ - 1 - i] = static_cast<u8_t>(value_ & 0xFF);
+		value_ >>= 8;
+	}
+}
+
+// Read big endian value.
+u64_t get_value(const u8_t* p_, u32_t len_)
+{
+	u64_t value = 0;
+	for (u32_t i = 0; i < len_; i++)
+	{
+		value = ((value << 8) | p_[i]);
+	}
+	return value;
+}
+
+void encode_entry(const catalog_entry& rEntry_, u8_t* p_)
+{
+	std::memset(p_, 0, ENTRY_SIZE);
+	put_value(rEntry_.id, 8, &p_[0]);
+	put_value(rEntry_.offset, 8, &p_[8]);
+	put_value(rEntry_.length, 4, &p_[16]);
+	put_value(rEntry_.duration, 4, &p_[20]);
+	put_value(rEntry_.crc, 2, &p_[24]);
+	p_[26] = rEntry_.format;
+	p_[27] = rEntry_.timebase_d;
+	p_[28] = rEntry_.timebase_g;
+}
+
+void decode_entry(const u8_t* p_, catalog_entry& rEntry_)
+{
+	rEntry_.id = get_value(&p_[0], 8);
+	rEntry_.offset = get_value(&p_[8], 8);
+	rEntry_.length = static_cast<u32_t>(get_value(&p_[16], 4));
+	rEntry_.duration = static_cast<u32_t>(get_value(&p_[20], 4));
+	rEntry_.crc = static_cast<u16_t>(get_value(&p_[24], 2));
+	rEntry_.format = p_[26];
+	rEntry_.timebase_d = p_[27];
+	rEntry_.timebase_g = p_[28];
+}
+
+// Check the index header and return the number of entries.
+bool decode_head(const u8_t* p_, u64_t size_, u64_t& rCount_, u64_t& rDataSize_)
+{
+	if (size_ < HEAD_SIZE || std::memcmp(p_, MAGIC, sizeof(MAGIC)) != 0) return false;
+	if (get_value(&p_[4], 2) != VERSION) return false;
+	rCount_ = get_value(&p_[8], 8);
+	rDataSize_ = get_value(&p_[16], 8);
+	return (size_ == (HEAD_SIZE + rCount_ * ENTRY_SIZE));
+}
+
+// Position of the image. (Starts on a new page when it does not fit in the rest of the page.)
+u64_t place_image(u64_t pos_, u64_t length_)
+{
+	const u64_t rest = (PAGE_SIZE - (pos_ % PAGE_SIZE));
+	return (length_ <= rest) ? pos_ : (pos_ + rest);
+}
+
+// Duration of the sequence. (Until the end of the last event or note)
+struct duration_visitor
+{
+	duration_visitor(u32_t d_ms_, u32_t g_ms_)
+		: d_ms(d_ms_), g_ms(g_ms_), time(0), end(0)
+	{}
+
+	bool duration(u32_t value_, u32_t /*pos_*/, u32_t /*len_*/)
+	{
+		time += (static_cast<u64_t>(value_) * d_ms);
+		if (time > end) end = time;
+		return true;
+	}
+
+	bool event(const u8_t* /*pEvent_*/, u32_t /*size_*/, const event_info& /*rInfo_*/)
+	{
+		return true;
+	}
+
+	bool gatetime(u32_t value_, u32_t /*pos_*/, u32_t /*len_*/)
+	{
+		const u64_t note_end = (time + static_cast<u64_t>(value_) * g_ms);
+		if (note_end > end) end = note_end;
+		return true;
+	}
+
+	u32_t d_ms;													// Duration's Timebase [ms]
+	u32_t g_ms;													// Gatetime's Timebase [ms]
+	u64_t time;													// Current Time [ms]
+	u64_t end;													// End Time [ms]
+};
+
+u32_t image_duration(const MA_3& rData_, const timebase& rTimebase_)
+{
+	chunk_info info;
+	if (!rData_.find_chunk("Mtsq", info)) return 0;
+
+	duration_visitor visitor(rTimebase_.D_ms(), rTimebase_.G_ms());
+	walk_sequence(&rData_.data_ptr()[info.data_pos], info.size, visitor);
+	return (visitor.end > 0xFFFFFFFF) ? 0xFFFFFFFF : static_cast<u32_t>(visitor.end);
+}
+
+bool entry_less(const catalog_entry& rLhs_, const catalog_entry& rRhs_)
+{
+	return (rLhs_.id < rRhs_.id);
+}
+
+// Context of add_files.
+struct add_context
+{
+	catalog_writer* pWriter;									// Writer
+	const u64_t*    pIds;										// IDs of the Files
+};
+
+bool add_callback(u32_t index_, MA_3& rData_, void* pContext_)
+{
+	add_context* pContext = static_cast<add_context*>(pContext_);
+	return pContext->pWriter->add(pContext->pIds[index_], rData_);
+}
+
+}																// namespace
+
+//------------------------------------------------------------------------------------------------------//
+// Catalog Writer Class
+//------------------------------------------------------------------------------------------------------//
+catalog_writer::catalog_writer()
+	: m_mutex()
+	, m_path()
+	, m_fd(-1)
+	, m_data_size(0)
+	, m_entry()
+{}
+
+catalog_writer::~catalog_writer()
+{
+	this->close();
+}
+
+bool catalog_writer::open(const char* szPath_)
+{
+	this->close();
+	if (szPath_ == nullptr) return false;
+
+	const std::string path = szPath_;
+	std::vector<catalog_entry> entries;
+	u64_t data_size = 0;
+
+	// Existing Index
+	std::FILE* fp = std::fopen((path + ".idx").c_str(), "rb");
+	if (fp != nullptr)
+	{
+		u8_t head[HEAD_SIZE];
+		u64_t count = 0;
+		bool ok = (std::fread(head, 1, HEAD_SIZE, fp) == HEAD_SIZE);
+		if (ok)
+		{
+			std::fseek(fp, 0, SEEK_END);
+			ok = decode_head(head, static_cast<u64_t>(std::ftell(fp)), count, data_size);
+			std::fseek(fp, HEAD_SIZE, SEEK_SET);
+		}
+		u8_t buffer[ENTRY_SIZE];
+		for (u64_t i = 0; ok && i < count; i++)
+		{
+			ok = (std::fread(buffer, 1, ENTRY_SIZE, fp) == ENTRY_SIZE);
+			catalog_entry entry;
+			decode_entry(buffer, entry);
+			entries.push_back(entry);
+		}
+		std::fclose(fp);
+		if (!ok) return false;									// Broken Index
+	}
+
+	const int fd = ::open((path + ".dat").c_str(), O_RDWR | O_CREAT, 0644);
+	if (fd < 0) return false;
+	struct stat st;
+	if (::fstat(fd, &st) != 0 || static_cast<u64_t>(st.st_size) < data_size)
+	{
+		::close(fd);
+		return false;											// Data is shorter than the Index
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_path = path;
+	m_fd = fd;
+	m_data_size = static_cast<u64_t>(st.st_size);				// Keep Data after the Index (Not Closed)
+	m_entry.swap(entries);
+	return true;
+}
+
+bool catalog_writer::add(u64_t id_, const MA_3& rData_)
+{
+	if (!verify(rData_.data_ptr(), rData_.size())) return false;
+
+	const timebase tb = rData_.get_timebase();
+	catalog_entry entry;
+	entry.id = id_;
+	entry.length = rData_.size();
+	entry.duration = image_duration(rData_, tb);
+	entry.crc = static_cast<u16_t>((rData_.at(rData_.size() - 2) << 8) | rData_.at(rData_.size() - 1));
+	entry.format = static_cast<u8_t>(rData_.get_format());
+	entry.timebase_d = tb.D;
+	entry.timebase_g = tb.G;
+
+	int fd;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_fd < 0) return false;
+		fd = m_fd;
+		entry.offset = place_image(m_data_size, entry.length);
+		m_data_size = (entry.offset + entry.length);
+	}
+
+	OPENMF_TRACE_COUNT("catalog.bytes", entry.length);
+	if (!write_all(fd, rData_.data_ptr(), entry.length, static_cast<s64_t>(entry.offset))) return false;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_entry.push_back(entry);
+	return true;
+}
+
+bool catalog_writer::add_files(const u64_t* pIds_, const char* const* pFiles_, u32_t n_, u32_t threads_)
+{
+	if (pIds_ == nullptr || pFiles_ == nullptr || m_fd < 0) return false;
+	OPENMF_TRACE_SCOPE("catalog_add_files");
+
+	add_context context;
+	context.pWriter = this;
+	context.pIds = pIds_;
+
+	batch_io io;
+	io.threads = threads_;
+	io.pProcess = add_callback;
+	io.pContext = &context;
+	io.run(pFiles_, nullptr, n_);
+	return (io.failed() == 0);
+}
+
+bool catalog_writer::close()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_fd < 0) return false;
+	OPENMF_TRACE_SCOPE("catalog_close");
+
+	// Sort by ID. (The last added entry of the same ID remains.)
+	std::stable_sort(m_entry.begin(), m_entry.end(), entry_less);
+	std::vector<catalog_entry> entries;
+	entries.reserve(m_entry.size());
+	for (size_t i = 0; i < m_entry.size(); i++)
+	{
+		if (!entries.empty() && entries.back().id == m_entry[i].id) entries.back() = m_entry[i];
+		else entries.push_back(m_entry[i]);
+	}
+
+	const u64_t count = entries.size();
+	std::vector<u8_t> index(static_cast<size_t>(HEAD_SIZE + count * ENTRY_SIZE), 0);
+	std::memcpy(&index[0], MAGIC, sizeof(MAGIC));
+	put_value(VERSION, 2, &index[4]);
+	put_value(count, 8, &index[8]);
+	put_value(m_data_size, 8, &index[16]);
+	for (u64_t i = 0; i < count; i++)
+	{
+		encode_entry(entries[i], &index[HEAD_SIZE + i * ENTRY_SIZE]);
+	}
+
+	// Data first, then the index. (The index never refers to unwritten data.)
+	bool ok = (::fsync(m_fd) == 0);
+	::close(m_fd);
+	m_fd = -1;
+
+	const std::string index_file = (m_path + ".idx");
+	const std::string temp_file = (index_file + ".tmp");
+	const int fd = ok ? ::open(temp_file.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644) : -1;
+	if (fd >= 0)
+	{
+		ok = write_all(fd, &index[0], index.size(), 0) && (::fsync(fd) == 0);
+		ok = (::close(fd) == 0) && ok;
+		ok = ok && (std::rename(temp_file.c_str(), index_file.c_str()) == 0);
+		if (!ok) std::remove(temp_file.c_str());
+	}
+	else
+	{
+		ok = false;
+	}
+
+	m_path.clear();
+	m_data_size = 0;
+	m_entry.clear();
+	return ok;
+}
+
+u64_t catalog_writer::size() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_entry.size();
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Catalog Reader Class
+//------------------------------------------------------------------------------------------------------//
+catalog_reader::catalog_reader()
+	: m_pIndex(nullptr)
+	, m_index_size(0)
+	, m_pData(nullptr)
+	, m_data_size(0)
+	, m_count(0)
+{}
+
+catalog_reader::~catalog_reader()
+{
+	this->close();
+}
+
+bool catalog_reader::open(const char* szPath_)
+{
+	this->close();
+	if (szPath_ == nullptr) return false;
+	const std::string path = szPath_;
+
+	// Index (Populated, lookups do not fault)
+	int fd = ::open((path + ".idx").c_str(), O_RDONLY);
+	if (fd < 0) return false;
+	struct stat st;
+	if (::fstat(fd, &st) != 0 || static_cast<u64_t>(st.st_size) < HEAD_SIZE)
+	{
+		::close(fd);
+		return false;
+	}
+	int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+	flags |= MAP_POPULATE;
+#endif
+	void* pIndex = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, flags, fd, 0);
+	::close(fd);
+	if (pIndex == MAP_FAILED) return false;
+	m_pIndex = static_cast<u8_t*>(pIndex);
+	m_index_size = static_cast<size_t>(st.st_size);
+
+	u64_t data_size = 0;
+	if (!decode_head(m_pIndex, m_index_size, m_count, data_size))
+	{
+		this->close();
+		return false;
+	}
+	if (data_size == 0) return true;							// Empty Catalog
+
+	// Data (Private mapping for writable views, random access)
+	fd = ::open((path + ".dat").c_str(), O_RDONLY);
+	if (fd < 0 || ::fstat(fd, &st) != 0 || static_cast<u64_t>(st.st_size) < data_size)
+	{
+		if (fd >= 0) ::close(fd);
+		this->close();
+		return false;
+	}
+	void* pData = ::mmap(nullptr, static_cast<size_t>(data_size), PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (pData == MAP_FAILED)
+	{
+		this->close();
+		return false;
+	}
+	::madvise(pData, static_cast<size_t>(data_size), MADV_RANDOM);
+	m_pData = static_cast<u8_t*>(pData);
+	m_data_size = static_cast<size_t>(data_size);
+	return true;
+}
+
+void catalog_reader::close()
+{
+	if (m_pData != nullptr) ::munmap(m_pData, m_data_size);
+	if (m_pIndex != nullptr) ::munmap(m_pIndex, m_index_size);
+	m_pIndex = nullptr;
+	m_index_size = 0;
+	m_pData = nullptr;
+	m_data_size = 0;
+	m_count = 0;
+}
+
+u64_t catalog_reader::size() const
+{
+	return m_count;
+}
+
+bool catalog_reader::entry(u64_t n_, catalog_entry& rEntry_) const
+{
+	if (n_ >= m_count) return false;
+	decode_entry(&m_pIndex[HEAD_SIZE + n_ * ENTRY_SIZE], rEntry_);
+	return true;
+}
+
+bool catalog_reader::find(u64_t id_, catalog_entry& rEntry_) const
+{
+	u64_t low = 0;
+	u64_t high = m_count;
+	while (low < high)
+	{
+		const u64_t mid = (low + (high - low) / 2);
+		if (get_value(&m_pIndex[HEAD_SIZE + mid * ENTRY_SIZE], 8) < id_) low = (mid + 1);
+		else high = mid;
+	}
+	if (low >= m_count || get_value(&m_pIndex[HEAD_SIZE + low * ENTRY_SIZE], 8) != id_) return false;
+	return this->entry(low, rEntry_);
+}
+
+bool catalog_reader::get(u64_t id_, MA_3& rView_) const
+{
+	catalog_entry entry;
+	if (!this->find(id_, entry)) return false;
+	if (entry.length == 0 || entry.offset > m_data_size || entry.length > (m_data_size - entry.offset)) return false;
+	return rView_.attach(&m_pData[entry.offset], entry.length);
+}
+
+//------------------------------------------------------------------------------------------------------//
+// End of File
+//------------------------------------------------------------------------------------------------------//
@@ -0,0 +1,139 @@
+//------------------------------------------------------------------------------------------------------//
+//
+//                                          License Agreement
+//                                     For Open Source SMAF Library
+//
+//                         Copyright (c) 2015-2017, @shirajira, all rights reserved.
+//
+//------------------------------------------------------------------------------------------------------//
+
+#ifndef openmf_catalog_h__
+#define openmf_catalog_h__
+#pragma once
+
+#include "core.h"
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace smaf {
+
+//------------------------------------------------------------------------------------------------------//
+// Catalog Archive
+//
+// A catalog is a pair of files:
+//
+//   <path>.dat : Append-only data. SMAF images are concatenated. An image never crosses a page
+//                boundary unless it is larger than the rest of the page, then it starts on a new page.
+//   <path>.idx : Index sorted by ID. Header (32byte) and entries (32byte, Big Endian).
+//
+//     Header : "OMFC", Version (2), Reserved (2), Number of Entries (8), Data Size (8), Reserved (8)
+//     Entry  : ID (8), Offset (8), Length (4), Duration [ms] (4), CRC (2), Format (1),
+//              Timebase D (1), Timebase G (1), Reserved (3)
+//
+// The index is rewritten by the writer at close. (Atomic rename)
+//------------------------------------------------------------------------------------------------------//
+
+//------------------------------------------------------------------------------------------------------//
+// Catalog Entry (struct)
+//------------------------------------------------------------------------------------------------------//
+struct catalog_entry
+{
+	u64_t id;													// Tune ID
+	u64_t offset;												// Offset in Data File [byte]
+	u32_t length;												// Image Size [byte]
+	u32_t duration;												// Duration [ms]
+	u16_t crc;													// CRC16 of the Image
+	u8_t  format;												// Format Type
+	u8_t  timebase_d;											// Duration's Timebase Code
+	u8_t  timebase_g;											// Gatetime's Timebase Code
+};
+
+//------------------------------------------------------------------------------------------------------//
+// Catalog Writer Class
+//------------------------------------------------------------------------------------------------------//
+class catalog_writer
+{
+public:
+	catalog_writer();
+	virtual ~catalog_writer();
+
+private:
+	catalog_writer(const catalog_writer&);
+	catalog_writer& operator=(const catalog_writer&);
+
+public:
+	// Open the catalog. (Appends to the existing catalog.)
+	bool open(const char* szPath_);
+
+	// Append the image. (Thread safe, the same ID replaces the older entry at close.)
+	bool add(u64_t id_, const MA_3& rData_);
+
+	// Load the files with batch_io and append them. (threads_ = 0: Hardware Threads)
+	bool add_files(const u64_t* pIds_, const char* const* pFiles_, u32_t n_, u32_t threads_ = 0);
+
+	// Write the sorted index and close the catalog.
+	bool close();
+
+	// Return the number of entries. (Including replaced entries until close.)
+	u64_t size() const;
+
+private:
+	mutable std::mutex         m_mutex;							// Mutex for Data Position and Entries
+	std::string                m_path;							// Catalog Path ("" = Closed)
+	int                        m_fd;							// Data File
+	u64_t                      m_data_size;						// Data Size [byte]
+	std::vector<catalog_entry> m_entry;							// Entries
+};
+
+//------------------------------------------------------------------------------------------------------//
+// Catalog Reader Class
+//
+// The index is populated at open and the data is mapped for random access. The image returned by
+// get is a view of the mapping (no copy). The mapping is private, so changes to the view are never
+// written to the catalog. Views must not be used after close.
+//------------------------------------------------------------------------------------------------------//
+class catalog_reader
+{
+public:
+	catalog_reader();
+	virtual ~catalog_reader();
+
+private:
+	catalog_reader(const catalog_reader&);
+	catalog_reader& operator=(const catalog_reader&);
+
+public:
+	// Open the catalog.
+	bool open(const char* szPath_);
+
+	// Close the catalog.
+	void close();
+
+	// Return the number of entries.
+	u64_t size() const;
+
+	// Return the n-th entry in ID order.
+	bool entry(u64_t n_, catalog_entry& rEntry_) const;
+
+	// Find the entry.
+	bool find(u64_t id_, catalog_entry& rEntry_) const;
+
+	// Attach the image to rView_. (No copy)
+	bool get(u64_t id_, MA_3& rView_) const;
+
+private:
+	u8_t*  m_pIndex;											// Index Mapping
+	size_t m_index_size;										// Index Size [byte]
+	u8_t*  m_pData;												// Data Mapping
+	size_t m_data_size;											// Data Size [byte]
+	u64_t  m_count;												// Number of Entries
+};
+
+//------------------------------------------------------------------------------------------------------//
+}																// namespace smaf
+
+#endif															// openmf_catalog_h__
+//------------------------------------------------------------------------------------------------------//
+// End of File
+//------------------------------------------------------------------------------------------------------//
@@ -0,0 +1,270 @@
+//------------------------------------------------------------------------------------------------------//
+//
+//                                          License Agreement
+//                                     For Open Source SMAF Library
+//
+//                         Copyright (c) 2015-2017, @shirajira, all rights reserved.
+//
+//------------------------------------------------------------------------------------------------------//
+
+#include "chunk.h"
+#include "array_operations.h"
+#include <algorithm>
+
+using namespace smaf;
+
+//------------------------------------------------------------------------------------------------------//
+// Internal Helpers
+//------------------------------------------------------------------------------------------------------//
+namespace {
+
+// Head size of score track. (Format Type, Sequence Type, Timebase D/G and Channel Status)
+u32_t score_track_head_size(const u8_t* pData_, u32_t size_)
+{
+	if (size_ == 0) return 0;
+	const u32_t channels = (pData_[0] == format_type::HANDY_PHONE) ? 2 : MA_3::CHANNELS;
+	return (4 + channels);
+}
+
+// Collect the first chunk which matches with the ID.
+struct find_context
+{
+	u32_t       id;												// Chunk ID
+	u32_t       mask;											// Compare Mask
+	bool        found;											// Found Flag
+	chunk_info* pInfo;											// Result
+};
+
+walk_result find_callback(const chunk_info& rInfo_, const u8_t* /*pAddr_*/, void* pContext_)
+{
+	find_context* pContext = static_cast<find_context*>(pContext_);
+	if ((rInfo_.id & pContext->mask) != pContext->id) return WR_CONTINUE;
+	*pContext->pInfo = rInfo_;
+	pContext->found = true;
+	return WR_STOP;
+}
+
+// Registry to find chunks. (Visits all chunks with the default callback.)
+class find_registry : public chunk_registry
+{
+public:
+	find_registry()
+		: chunk_registry()
+	{
+		this->set_default_callback(find_callback);
+	}
+};
+
+}																// namespace
+
+//------------------------------------------------------------------------------------------------------//
+// Chunk Registry Class
+//------------------------------------------------------------------------------------------------------//
+
+chunk_registry::chunk_registry()
+	: m_entry()
+	, m_table()
+	, m_mask()
+	, m_pDefault(nullptr)
+{
+	this->add("MMMD", CK_CONTAINER, 0, MA_3::CRC_SIZE);			// File (Tail: CRC)
+	this->add("CNTI", CK_LEAF);									// Contents Info
+	this->add("OPDA", CK_CONTAINER);							// Optional Data
+	this->add("Dch*", CK_LEAF);									// Optional Data: Data Chunk
+	this->add("Pro*", CK_LEAF);									// Optional Data: Profile
+	this->add("MTR*", CK_CONTAINER, 0, 0, score_track_head_size);	// Score Track
+	this->add("MspI", CK_LEAF);									// Score Track: Seek & Phrase Info
+	this->add("Mtsu", CK_LEAF);									// Score Track: Setup Data
+	this->add("Mtsq", CK_LEAF);									// Score Track: Sequence Data
+	this->add("Mtsp", CK_CONTAINER);							// Score Track: PCM Stream
+	this->add("Mwa*", CK_LEAF);									// Score Track: PCM Wave Data
+	this->add("ATR*", CK_CONTAINER, 6);							// Audio Track (Head: Format, Sequence, Wave Type, Timebase D/G)
+	this->add("AspI", CK_LEAF);									// Audio Track: Seek & Phrase Info
+	this->add("Atsu", CK_LEAF);									// Audio Track: Setup Data
+	this->add("Atsq", CK_LEAF);									// Audio Track: Sequence Data
+	this->add("Awa*", CK_LEAF);									// Audio Track: Wave Data
+	this->add("GTR*", CK_LEAF);									// Graphics Track
+}
+
+chunk_registry::chunk_registry(const chunk_registry& rRegistry_)
+	: m_entry(rRegistry_.m_entry)
+	, m_table(rRegistry_.m_table)
+	, m_mask(rRegistry_.m_mask)
+	, m_pDefault(rRegistry_.m_pDefault)
+{}
+
+chunk_registry::~chunk_registry()
+{}
+
+chunk_registry& chunk_registry::operator=(const chunk_registry& rRegistry_)
+{
+	m_entry = rRegistry_.m_entry;
+	m_table = rRegistry_.m_table;
+	m_mask = rRegistry_.m_mask;
+	m_pDefault = rRegistry_.m_pDefault;
+	return *this;
+}
+
+bool chunk_registry::add(const char* szChunkID_, chunk_kind kind_, u32_t head_size_, u32_t tail_size_, head_size_func pHeadSize_)
+{
+	if (szChunkID_ == nullptr) return false;
+
+	entry* pEntry = this->find_entry(szChunkID_);
+	if (pEntry != nullptr)
+	{
+		pEntry->kind = kind_;									// Overwrite Chunk Type
+		pEntry->head_size = head_size_;
+		pEntry->tail_size = tail_size_;
+		pEntry->pHeadSize = pHeadSize_;
+		return true;
+	}
+
+	entry new_entry;
+	new_entry.id = make_chunk_id(szChunkID_, new_entry.mask);
+	new_entry.kind = kind_;
+	new_entry.head_size = head_size_;
+	new_entry.tail_size = tail_size_;
+	new_entry.pHeadSize = pHeadSize_;
+	new_entry.pCallback = nullptr;
+	m_entry.push(new_entry);
+	this->rebuild_table();
+	return true;
+}
+
+bool chunk_registry::set_callback(const char* szChunkID_, chunk_callback pCallback_)
+{
+	if (szChunkID_ == nullptr) return false;
+
+	entry* pEntry = this->find_entry(szChunkID_);
+	if (pEntry == nullptr) return false;
+
+	pEntry->pCallback = pCallback_;
+	return true;
+}
+
+void chunk_registry::set_default_callback(chunk_callback pCallback_)
+{
+	m_pDefault = pCallback_;
+}
+
+const chunk_registry::entry* chunk_registry::find(u32_t id_) const
+{
+	// One lookup per mask. (The first registered entry wins, as with the registration order.)
+	const table_entry* pBegin = m_table.data_ptr();
+	const table_entry* pEnd = (pBegin + m_table.size());
+	u32_t found = m_entry.size();
+	for (u32_t i = 0; i < m_mask.size(); i++)
+	{
+		table_entry key;
+		key.mask = m_mask.data_ptr()[i];
+		key.id = (id_ & key.mask);
+		key.index = 0;
+		const table_entry* p = std::lower_bound(pBegin, pEnd, key);
+		if (p != pEnd && p->mask == key.mask && p->id == key.id && p->index < found) found = p->index;
+	}
+	return (found < m_entry.size()) ? &m_entry.data_ptr()[found] : nullptr;
+}
+
+bool chunk_registry::walk(const u8_t* pAddr_, u32_t size_, void* pContext_) const
+{
+	if (pAddr_ == nullptr) return false;
+	OPENMF_TRACE_SCOPE("chunk_walk");
+
+	bool stop = false;
+	return this->walk_range(pAddr_, 0, size_, 0, pContext_, stop);
+}
+
+bool chunk_registry::walk_range(const u8_t* pAddr_, u32_t begin_, u32_t end_, u32_t depth_, void* pContext_, bool& rStop_) const
+{
+	const u32_t head_size = (MA_3::CHUNK_HEAD_SIZE + MA_3::CHUNK_DATA_SIZE);
+
+	u32_t pos = begin_;
+	while ((end_ - pos) >= head_size)
+	{
+		chunk_info info;
+		info.id = calc_size(&pAddr_[pos], MA_3::CHUNK_HEAD_SIZE);
+		info.pos = pos;
+		info.size_pos = (pos + MA_3::CHUNK_HEAD_SIZE);
+		info.size = calc_size(&pAddr_[info.size_pos], MA_3::CHUNK_DATA_SIZE);
+		info.data_pos = (pos + head_size);
+		info.depth = depth_;
+
+		if (info.size > (end_ - info.data_pos)) return false;	// Chunk Overrun
+		OPENMF_TRACE_COUNT("chunks", 1);
+
+		const entry* pEntry = this->find(info.id);
+		const chunk_callback pCallback = (pEntry != nullptr && pEntry->pCallback != nullptr) ? pEntry->pCallback : m_pDefault;
+		const walk_result result = (pCallback != nullptr) ? pCallback(info, pAddr_, pContext_) : WR_CONTINUE;
+
+		if (result == WR_STOP)
+		{
+			rStop_ = true;
+			return true;
+		}
+
+		if (result == WR_CONTINUE && pEntry != nullptr && pEntry->kind == CK_CONTAINER)
+		{
+			const u32_t sub_head = (pEntry->pHeadSize != nullptr)
+				? pEntry->pHeadSize(&pAddr_[info.data_pos], info.size)
+				: pEntry->head_size;
+			if ((sub_head + pEntry->tail_size) > info.size) return false;
+
+			const u32_t sub_begin = (info.data_pos + sub_head);
+			const u32_t sub_end = (info.data_pos + info.size - pEntry->tail_size);
+			if (!this->walk_range(pAddr_, sub_begin, sub_end, (depth_ + 1), pContext_, rStop_)) return false;
+			if (rStop_) return true;
+		}
+
+		pos = (info.data_pos + info.size);
+	}
+	return true;
+}
+
+chunk_registry::entry* chunk_registry::find_entry(const char* szChunkID_)
+{
+	u32_t mask;
+	const u32_t id = make_chunk_id(szChunkID_, mask);
+	for (u32_t i = 0; i < m_entry.size(); i++)
+	{
+		if (m_entry[i].id == id && m_entry[i].mask == mask) return &m_entry[i];
+	}
+	return nullptr;
+}
+
+void chunk_registry::rebuild_table()
+{
+	if (!m_table.create(m_entry.size())) return;
+	for (u32_t i = 0; i < m_entry.size(); i++)
+	{
+		m_table[i].mask = m_entry[i].mask;
+		m_table[i].id = m_entry[i].id;
+		m_table[i].index = i;
+	}
+	std::sort(m_table.data_ptr(), (m_table.data_ptr() + m_table.size()));
+
+	m_mask.release();
+	for (u32_t i = 0; i < m_table.size(); i++)
+	{
+		if (i == 0 || m_table[i].mask != m_table[i - 1].mask) m_mask.push(m_table[i].mask);
+	}
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Find First Chunk
+//------------------------------------------------------------------------------------------------------//
+bool smaf::find_chunk(const u8_t* pAddr_, u32_t size_, const char* szChunkID_, chunk_info& rInfo_)
+{
+	static const find_registry registry;
+
+	find_context context;
+	context.id = make_chunk_id(szChunkID_, context.mask);
+	context.found = false;
+	context.pInfo = &rInfo_;
+
+	if (!registry.walk(pAddr_, size_, &context)) return false;
+	return context.found;
+}
+
+//------------------------------------------------------------------------------------------------------//
+// End of File
+//------------------------------------------------------------------------------------------------------//
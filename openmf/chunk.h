@@ -0,0 +1,137 @@
+//------------------------------------------------------------------------------------------------------//
+//
+//                                          License Agreement
+//                                     For Open Source SMAF Library
+//
+//                         Copyright (c) 2015-2017, @shirajira, all rights reserved.
+//
+//------------------------------------------------------------------------------------------------------//
+
+#ifndef openmf_chunk_h__
+#define openmf_chunk_h__
+#pragma once
+
+#include "core.h"
+
+namespace smaf {
+
+//------------------------------------------------------------------------------------------------------//
+// Chunk Kind (enum)
+//------------------------------------------------------------------------------------------------------//
+enum chunk_kind
+{
+	CK_LEAF = 0,												// Leaf Chunk (Opaque Data)
+	CK_CONTAINER												// Container Chunk (Fixed Head + Sub Chunks + Fixed Tail)
+};
+
+//------------------------------------------------------------------------------------------------------//
+// Walk Result (enum)
+//------------------------------------------------------------------------------------------------------//
+enum walk_result
+{
+	WR_CONTINUE = 0,											// Continue (Enter Sub Chunks)
+	WR_SKIP,													// Continue (Skip Sub Chunks)
+	WR_STOP														// Stop Walking
+};
+
+//------------------------------------------------------------------------------------------------------//
+// Chunk Information (struct)
+//------------------------------------------------------------------------------------------------------//
+struct chunk_info
+{
+	u32_t id;													// Chunk ID (Big Endian)
+	u32_t pos;													// Position of Chunk Head
+	u32_t size_pos;												// Position of Chunk Size
+	u32_t size;													// Chunk Data Size [byte]
+	u32_t data_pos;												// Position of Chunk Data
+	u32_t depth;												// Depth (Top Level = 0)
+};
+
+typedef walk_result (*chunk_callback)(const chunk_info& rInfo_, const u8_t* pAddr_, void* pContext_);
+typedef u32_t (*head_size_func)(const u8_t* pData_, u32_t size_);
+
+//------------------------------------------------------------------------------------------------------//
+// Chunk Registry Class
+//------------------------------------------------------------------------------------------------------//
+class chunk_registry
+{
+public:
+	chunk_registry();
+	chunk_registry(const chunk_registry& rRegistry_);
+	virtual ~chunk_registry();
+
+public:
+	chunk_registry& operator=(const chunk_registry& rRegistry_);
+
+public:
+	// Chunk Type Entry
+	struct entry
+	{
+		u32_t          id;										// Chunk ID (No Care Bytes = 0x00)
+		u32_t          mask;									// Compare Mask (No Care Bytes = 0x00)
+		chunk_kind     kind;									// Chunk Kind
+		u32_t          head_size;								// Fixed Head Size before Sub Chunks [byte]
+		u32_t          tail_size;								// Fixed Tail Size after Sub Chunks [byte]
+		head_size_func pHeadSize;								// Variable Head Size (nullptr = head_size)
+		chunk_callback pCallback;								// Decode Callback (nullptr = Default)
+	};
+
+	// Register chunk type. (The standard SMAF chunks are registered by the constructor.)
+	bool add(const char* szChunkID_, chunk_kind kind_, u32_t head_size_ = 0, u32_t tail_size_ = 0, head_size_func pHeadSize_ = nullptr);
+
+	// Set decode callback for the chunk type.
+	bool set_callback(const char* szChunkID_, chunk_callback pCallback_);
+
+	// Set callback for the chunk types without decode callback. (Includes unknown chunks.)
+	void set_default_callback(chunk_callback pCallback_);
+
+	// Find chunk type. (nullptr = Unknown)
+	const entry* find(u32_t id_) const;
+
+	// Walk chunk tree in file order.
+	bool walk(const u8_t* pAddr_, u32_t size_, void* pContext_) const;
+
+private:
+	// Walk chunks in [begin_, end_).
+	bool walk_range(const u8_t* pAddr_, u32_t begin_, u32_t end_, u32_t depth_, void* pContext_, bool& rStop_) const;
+
+	// Find registered entry by ID string.
+	entry* find_entry(const char* szChunkID_);
+
+	// Rebuild the lookup table from the chunk type table.
+	void rebuild_table();
+
+private:
+	// Lookup Table Entry (Sorted by Mask, Masked ID and Registration Order)
+	struct table_entry
+	{
+		u32_t mask;												// Compare Mask
+		u32_t id;												// Masked Chunk ID
+		u32_t index;											// Index of the Chunk Type Table
+
+		bool operator<(const table_entry& rEntry_) const
+		{
+			if (mask != rEntry_.mask) return (mask < rEntry_.mask);
+			if (id != rEntry_.id) return (id < rEntry_.id);
+			return (index < rEntry_.index);
+		}
+	};
+
+	data_array_<entry>       m_entry;							// Chunk Type Table (Registration Order)
+	data_array_<table_entry> m_table;							// Lookup Table
+	data_array_<u32_t>       m_mask;							// Masks in the Lookup Table
+	chunk_callback           m_pDefault;						// Default Callback
+};
+
+//------------------------------------------------------------------------------------------------------//
+// Find First Chunk ('*' = No Care)
+//------------------------------------------------------------------------------------------------------//
+bool find_chunk(const u8_t* pAddr_, u32_t size_, const char* szChunkID_, chunk_info& rInfo_);
+
+//------------------------------------------------------------------------------------------------------//
+}																// namespace smaf
+
+#endif															// openmf_chunk_h__
+//------------------------------------------------------------------------------------------------------//
+// End of File
+//------------------------------------------------------------------------------------------------------//
@@ -8,6 +8,8 @@
 //------------------------------------------------------------------------------------------------------//
 
 #include "core.h"
+#include "chunk.h"
+#include "event_cache.h"
 #include "array_operations.h"
 
 using namespace smaf;
@@ -92,11 +94,13 @@ u32_t timebase::G_ms() const
 //------------------------------------------------------------------------------------------------------//
 
 channel_status::channel_status()
-	: m_kcs(KCS_NOCARE)
-	, m_vs(VS_OFF)
-	, m_led(LED_OFF)
-	, m_type(TYPE_NOCARE)
-{}
+	: m_status(0x00)											// Reserved Bits = 0
+{
+	m_kcs = KCS_NOCARE;
+	m_vs = VS_OFF;
+	m_led = LED_OFF;
+	m_type = TYPE_NOCARE;
+}
 
 channel_status::channel_status(const channel_status& rStatus_)
 	: m_status(rStatus_())
@@ -107,11 +111,13 @@ channel_status::channel_status(u8_t data_)
 {}
 
 channel_status::channel_status(u8_t kcs_, u8_t vs_, u8_t led_, u8_t type_)
-	: m_kcs(kcs_)
-	, m_vs(vs_)
-	, m_led(led_)
-	, m_type(type_)
-{}
+	: m_status(0x00)											// Reserved Bits = 0
+{
+	m_kcs = kcs_;
+	m_vs = vs_;
+	m_led = led_;
+	m_type = type_;
+}
 
 channel_status::~channel_status()
 {}
@@ -160,22 +166,27 @@ const u32_t MA_3::CHANNELS = 16;								// Number of Channels
 
 MA_3::MA_3()
 	: binary_array()
+	, m_pCache(nullptr)
 {}
 
 MA_3::MA_3(const MA_3& rData_)
 	: binary_array(rData_)
+	, m_pCache(nullptr)
 {}
 
 MA_3::MA_3(const binary_array& rData_)
 	: binary_array(rData_)
+	, m_pCache(nullptr)
 {}
 
 MA_3::MA_3(u32_t size_)
 	: binary_array(size_)
+	, m_pCache(nullptr)
 {}
 
 MA_3::MA_3(u32_t size_, const u8_t* pArr_)
 	: binary_array(size_, pArr_)
+	, m_pCache(nullptr)
 {}
 
 MA_3::~MA_3()
@@ -189,6 +200,7 @@ MA_3& MA_3::operator=(const MA_3& rData_)
 
 bool MA_3::shrink_to_fit()
 {
+	OPENMF_TRACE_SCOPE("MA_3::shrink_to_fit");
 	if (this->empty()) return false;
 
 	const u8_t* pAddr = this->data_ptr();
@@ -212,28 +224,14 @@ bool MA_3::shrink_to_fit()
 
 format_type MA_3::get_format() const
 {
+	OPENMF_TRACE_SCOPE("MA_3::get_format");
 	if (this->empty()) return format_type::FORMAT_RESERVED;
 
-	const u8_t* pAddr = this->data_ptr();
-	u32_t size;
-
-	if (!check_chunk("MMMD", pAddr)) return format_type::FORMAT_RESERVED;
-	pAddr += CHUNK_HEAD_SIZE;
-	pAddr += CHUNK_DATA_SIZE;
-
-	if (!check_chunk("CNTI", pAddr)) return format_type::FORMAT_RESERVED;
-	pAddr += CHUNK_HEAD_SIZE;
-	size = calc_size(pAddr, CHUNK_DATA_SIZE);
-	pAddr += (CHUNK_DATA_SIZE + size);
+	chunk_info score;
+	if (!this->find_chunk("MTR*", score)) return format_type::FORMAT_RESERVED;
+	if (score.size == 0) return format_type::FORMAT_RESERVED;
 
-	if (!check_chunk("OPDA", pAddr)) return format_type::FORMAT_RESERVED;
-	pAddr += CHUNK_HEAD_SIZE;
-	size = calc_size(pAddr, CHUNK_DATA_SIZE);
-	pAddr += (CHUNK_DATA_SIZE + size);
-
-	if (!check_chunk("MTR*", pAddr)) return format_type::FORMAT_RESERVED;
-	pAddr += CHUNK_HEAD_SIZE;
-	pAddr += CHUNK_DATA_SIZE;
+	const u8_t* pAddr = (this->data_ptr() + score.data_pos);
 
 	format_type fmt;
 	switch (*pAddr)
@@ -256,28 +254,14 @@ format_type MA_3::get_format() const
 
 timebase MA_3::get_timebase() const
 {
+	OPENMF_TRACE_SCOPE("MA_3::get_timebase");
 	if (this->empty()) return timebase();
 
-	const u8_t* pAddr = this->data_ptr();
-	u32_t size;
-
-	if (!check_chunk("MMMD", pAddr)) return timebase();
-	pAddr += CHUNK_HEAD_SIZE;
-	pAddr += CHUNK_DATA_SIZE;
-
-	if (!check_chunk("CNTI", pAddr)) return timebase();
-	pAddr += CHUNK_HEAD_SIZE;
-	size = calc_size(pAddr, CHUNK_DATA_SIZE);
-	pAddr += (CHUNK_DATA_SIZE + size);
-
-	if (!check_chunk("OPDA", pAddr)) return timebase();
-	pAddr += CHUNK_HEAD_SIZE;
-	size = calc_size(pAddr, CHUNK_DATA_SIZE);
-	pAddr += (CHUNK_DATA_SIZE + size);
+	chunk_info score;
+	if (!this->find_chunk("MTR*", score)) return timebase();
+	if (score.size < 4) return timebase();
 
-	if (!check_chunk("MTR*", pAddr)) return timebase();
-	pAddr += CHUNK_HEAD_SIZE;
-	pAddr += CHUNK_DATA_SIZE;
+	const u8_t* pAddr = (this->data_ptr() + score.data_pos);
 
 	pAddr++;													// Format Type
 	pAddr++;													// Sequence Type
@@ -289,28 +273,14 @@ timebase MA_3::get_timebase() const
 
 channel_status MA_3::get_channel_status(u32_t ch_) const
 {
+	OPENMF_TRACE_SCOPE("MA_3::get_channel_status");
 	if (this->empty() || ch_ >= CHANNELS) return channel_status();
 
-	const u8_t* pAddr = this->data_ptr();
-	u32_t size;
-
-	if (!check_chunk("MMMD", pAddr)) return channel_status();
-	pAddr += CHUNK_HEAD_SIZE;
-	pAddr += CHUNK_DATA_SIZE;
-
-	if (!check_chunk("CNTI", pAddr)) return channel_status();
-	pAddr += CHUNK_HEAD_SIZE;
-	size = calc_size(pAddr, CHUNK_DATA_SIZE);
-	pAddr += (CHUNK_DATA_SIZE + size);
+	chunk_info score;
+	if (!this->find_chunk("MTR*", score)) return channel_status();
+	if (score.size < (4 + CHANNELS)) return channel_status();
 
-	if (!check_chunk("OPDA", pAddr)) return channel_status();
-	pAddr += CHUNK_HEAD_SIZE;
-	size = calc_size(pAddr, CHUNK_DATA_SIZE);
-	pAddr += (CHUNK_DATA_SIZE + size);
-
-	if (!check_chunk("MTR*", pAddr)) return channel_status();
-	pAddr += CHUNK_HEAD_SIZE;
-	pAddr += CHUNK_DATA_SIZE;
+	const u8_t* pAddr = (this->data_ptr() + score.data_pos);
 
 	pAddr++;													// Format Type
 	pAddr++;													// Sequence Type
@@ -325,6 +295,26 @@ channel_status MA_3::get_channel_status(u32_t ch_) const
 	return ch_status[ch_];
 }
 
+bool MA_3::attach_cache(const event_cache* pCache_)
+{
+	if (pCache_ != nullptr && !pCache_->validate(*this)) return false;
+	m_pCache = pCache_;
+	return true;
+}
+
+const event_cache* MA_3::get_cache() const
+{
+	if (m_pCache == nullptr || !m_pCache->matches(this->data_ptr(), this->size())) return nullptr;
+	return m_pCache;
+}
+
+bool MA_3::find_chunk(const char* szChunkID_, chunk_info& rInfo_) const
+{
+	const event_cache* pCache = this->get_cache();
+	if (pCache != nullptr) return pCache->find(szChunkID_, rInfo_);
+	return smaf::find_chunk(this->data_ptr(), this->size(), szChunkID_, rInfo_);
+}
+
 //------------------------------------------------------------------------------------------------------//
 // CRC16 Class
 //------------------------------------------------------------------------------------------------------//
@@ -343,6 +333,7 @@ CRC16::~CRC16()
 
 bool CRC16::initialize(u16_t polynomial_)
 {
+	OPENMF_TRACE_SCOPE("CRC16::initialize");
 	if (!m_table.create(TABLE_SIZE)) return false;
 
 	for (u16_t i = 0; i < TABLE_SIZE; i++)
@@ -377,6 +368,8 @@ void CRC16::release()
 u16_t CRC16::make(const u8_t* pArr_, u32_t len_) const
 {
 	if (!this->is_initialized()) return u16_t(0x0000);
+	OPENMF_TRACE_SCOPE("CRC16::make");
+	OPENMF_TRACE_COUNT("crc_bytes", len_);
 
 	u16_t r = 0xFFFF;
 	for (u32_t i = 0; i < len_; i++)
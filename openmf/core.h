@@ -12,6 +12,7 @@
 #pragma once
 
 #include "basic_type.h"
+#include "trace.h"
 
 namespace smaf {
 
@@ -140,22 +141,26 @@ public:
 	data_array_()
 		: m_size(0)
 		, m_pDataArr(nullptr)
+		, m_owner(true)
 	{}
 	data_array_(const data_array_& rData_)
 		: m_size(0)
 		, m_pDataArr(nullptr)
+		, m_owner(true)
 	{
 		this->create(rData_.size(), rData_.data_ptr());
 	}
 	data_array_(u32_t size_)
 		: m_size(0)
 		, m_pDataArr(nullptr)
+		, m_owner(true)
 	{
 		this->create(size_);
 	}
 	data_array_(u32_t size_, const tp_* pArr_)
 		: m_size(0)
 		, m_pDataArr(nullptr)
+		, m_owner(true)
 	{
 		this->create(size_, pArr_);
 	}
@@ -187,6 +192,8 @@ public:
 		this->release();
 		m_pDataArr = new tp_[size_];
 		if (m_pDataArr == nullptr) return false;
+		OPENMF_TRACE_COUNT("alloc", 1);
+		OPENMF_TRACE_COUNT("alloc_bytes", size_ * sizeof(tp_));
 		m_size = size_;
 		return true;
 	}
@@ -202,6 +209,60 @@ public:
 		return true;
 	}
 
+	// Attach external memory without copy. (Not released, see release.)
+	virtual bool attach(tp_* pArr_, u32_t size_)
+	{
+		if (pArr_ == nullptr || size_ == 0) return false;
+		this->release();
+		m_pDataArr = pArr_;
+		m_size = size_;
+		m_owner = false;
+		return true;
+	}
+
+	// Check the memory is owned by this array. (false = Attached)
+	virtual bool is_owner() const
+	{
+		return m_owner;
+	}
+
+	// Resize memory and keep data.
+	virtual bool resize(u32_t size_)
+	{
+		if (size_ == this->size()) return true;
+		if (size_ == 0)
+		{
+			this->release();
+			return true;
+		}
+		tp_* pArr = new tp_[size_];
+		if (pArr == nullptr) return false;
+		OPENMF_TRACE_COUNT("realloc", 1);
+		OPENMF_TRACE_COUNT("alloc_bytes", size_ * sizeof(tp_));
+		const u32_t keep_size = (size_ < this->size()) ? size_ : this->size();
+		for (u32_t i = 0; i < keep_size; i++)
+		{
+			pArr[i] = m_pDataArr[i];
+		}
+		this->release();
+		m_pDataArr = pArr;
+		m_size = size_;
+		return true;
+	}
+
+	// Truncate data size without reallocation. (Memory is kept until release.)
+	virtual bool truncate(u32_t size_)
+	{
+		if (size_ > this->size()) return false;
+		if (size_ == 0)
+		{
+			this->release();
+			return true;
+		}
+		m_size = size_;
+		return true;
+	}
+
 	// Set data to all elements.
 	virtual void set(const tp_& rVal_)
 	{
@@ -225,10 +286,11 @@ public:
 	{
 		if (!this->empty())
 		{
-			delete[] m_pDataArr;
+			if (m_owner) delete[] m_pDataArr;
 			m_pDataArr = nullptr;
 			m_size = 0;
 		}
+		m_owner = true;
 	}
 
 	// Access data.
@@ -265,13 +327,14 @@ public:
 		}
 		else
 		{
+			OPENMF_TRACE_COUNT("push_realloc", 1);
 			const u32_t new_size = (this->size() + 1);
 			data_array_ temp(new_size);
-			for (u32_t i = 0; i < new_size; i++)
+			for (u32_t i = 0; i < this->size(); i++)
 			{
 				temp[i] = (*this)[i];
-				if (i == this->size()) temp[i] = rData_;
 			}
+			temp[this->size()] = rData_;
 			*this = temp;
 		}
 	}
@@ -294,10 +357,14 @@ public:
 protected:
 	u32_t m_size;												// Data Size (Protected Member)
 	tp_*  m_pDataArr;											// Array Ptr (Protected Member)
+	bool  m_owner;												// Owned Memory (false = Attached)
 };
 
 typedef data_array_<u8_t> binary_array;							// Data Array for Binary
 
+struct chunk_info;
+class event_cache;
+
 //------------------------------------------------------------------------------------------------------//
 // SMAF Data Class (MA-3)
 //------------------------------------------------------------------------------------------------------//
@@ -333,6 +400,19 @@ public:
 
 	// Return channel status.
 	channel_status get_channel_status(u32_t ch_) const;
+
+	// Attach the event cache. (Checked with the size and CRC16 of the data, nullptr = Detach)
+	// The cache must live longer than the attachment. Edits must fix CRC16 (see fix_crc16).
+	bool attach_cache(const event_cache* pCache_);
+
+	// Return the event cache. (nullptr = Not attached or the data is changed)
+	const event_cache* get_cache() const;
+
+	// Find first chunk. ('*' = No Care, from the event cache if attached)
+	bool find_chunk(const char* szChunkID_, chunk_info& rInfo_) const;
+
+private:
+	const event_cache* m_pCache;								// Event Cache (nullptr = None)
 };
 
 //------------------------------------------------------------------------------------------------------//
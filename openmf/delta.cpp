@@ -0,0 +1,748 @@
+//------------------------------------------------------------------------------------------------------//
+//
+//                                          License Agreement
+//                                     For Open Source SMAF Library
+//
+//                         Copyright (c) 2015-2017, @shirajira, all rights reserved.
+//
+//------------------------------------------------------------------------------------------------------//
+
+#include "delta.h"
+#include "apis.h"
+#include "array_operations.h"
+#include "sequence.h"
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+using namespace smaf;
+
+//------------------------------------------------------------------------------------------------------//
+// Internal Helpers
+//------------------------------------------------------------------------------------------------------//
+namespace {
+
+const u8_t  PATCH_MAGIC[4] = { 'O', 'M', 'F', 'P' };			// Magic Number
+const u8_t  PATCH_VERSION = 1;									// Format Version
+const u32_t MAX_IMAGE_SIZE = 0x07FFFFFF;						// Max Image Size (Signed Position fits in VS)
+const u32_t HASH_WINDOW = 8;									// Bytes of Hashed Window
+const u32_t MIN_COPY = 8;										// Min Length of Copy found by Hash
+const u32_t MIN_CONTINUE = 4;									// Min Length of Copy continuing the Last Range
+const u64_t RATIO_LIMIT = (1 << 24);							// Max Numerator/Denominator of Retiming
+const u32_t STREAM_BLOCK = 4096;								// Output Block of apply_patch [byte]
+const u32_t DIGEST_SEED = 0x811C9DC5;							// FNV-1a Offset Basis
+
+enum patch_op
+{
+	OP_END = 0x00,												// End of Patch
+	OP_COPY,													// Copy from the Base
+	OP_ADD,														// Literal Bytes
+	OP_RETIME,													// Retimed Sequence Data of the Base
+	OP_CRC														// CRC16 of the Output before it
+};
+
+// Digest of the image. (FNV-1a 32bit, the CRC16 of SMAF Data including its own CRC16 is a constant)
+u32_t update_digest(const u8_t* pAddr_, u32_t size_, u32_t digest_)
+{
+	for (u32_t i = 0; i < size_; i++)
+	{
+		digest_ = ((digest_ ^ pAddr_[i]) * 0x01000193) & 0xFFFFFFFF;
+	}
+	return digest_;
+}
+
+// Patch encoder. (Literals are merged until the next op.)
+struct patch_writer
+{
+	patch_writer()
+		: data(), literal(), expected(0)
+	{}
+
+	void put(u8_t value_)
+	{
+		data.push_back(value_);
+	}
+	void put_variable_size(u32_t value_)
+	{
+		u8_t buf[4];
+		u32_t len;
+		make_variable_size_array(value_, buf, len);
+		data.insert(data.end(), buf, buf + len);
+	}
+	void put_position(u32_t pos_)
+	{
+		const s64_t delta = static_cast<s64_t>(pos_) - static_cast<s64_t>(expected);
+		put_variable_size(static_cast<u32_t>((delta >= 0) ? (delta << 1) : (((-delta) << 1) - 1)));
+	}
+	void put_digest(u32_t digest_)
+	{
+		u8_t buf[4];
+		make_size_array(digest_, 4, buf);
+		data.insert(data.end(), buf, buf + 4);
+	}
+
+	void add(const u8_t* pData_, u32_t size_)
+	{
+		literal.insert(literal.end(), pData_, pData_ + size_);
+		expected += size_;
+	}
+	void flush()
+	{
+		if (literal.empty()) return;
+		put(OP_ADD);
+		put_variable_size(static_cast<u32_t>(literal.size()));
+		data.insert(data.end(), literal.begin(), literal.end());
+		literal.clear();
+	}
+	void copy(u32_t pos_, u32_t size_)
+	{
+		flush();
+		put(OP_COPY);
+		put_variable_size(size_);
+		put_position(pos_);
+		expected = (pos_ + size_);
+	}
+	void retime(u32_t pos_, u32_t size_, u64_t num_, u64_t den_, u32_t out_size_)
+	{
+		flush();
+		put(OP_RETIME);
+		put_variable_size(size_);
+		put_position(pos_);
+		put_variable_size(static_cast<u32_t>(num_));
+		put_variable_size(static_cast<u32_t>(den_));
+		put_variable_size(out_size_);
+		expected = (pos_ + size_);
+	}
+	void crc()
+	{
+		flush();
+		put(OP_CRC);
+		expected += MA_3::CRC_SIZE;
+	}
+
+	std::vector<u8_t> data;										// Patch
+	std::vector<u8_t> literal;									// Pending Literal Bytes
+	u32_t             expected;									// Expected Base Position of the Next Copy
+};
+
+// Patch decoder. (Bounds checked)
+struct patch_reader
+{
+	patch_reader(const u8_t* pAddr_, u32_t size_)
+		: pAddr(pAddr_), size(size_), pos(0), expected(0)
+	{}
+
+	bool get(u8_t& rValue_)
+	{
+		if (pos >= size) return false;
+		rValue_ = pAddr[pos++];
+		return true;
+	}
+	bool get_variable_size(u32_t& rValue_)
+	{
+		u32_t value = 0;
+		for (u32_t len = 0; len < 4; len++)
+		{
+			u8_t b;
+			if (!get(b)) return false;
+			value = ((value << 7) | (b & 0x7F));
+			if ((b & 0x80) == 0)
+			{
+				rValue_ = value;
+				return true;
+			}
+		}
+		return false;											// Too Long
+	}
+	bool get_position(u32_t& rPos_)
+	{
+		u32_t value;
+		if (!get_variable_size(value)) return false;
+		const s64_t delta = (value & 1) ? -(static_cast<s64_t>(value >> 1) + 1) : static_cast<s64_t>(value >> 1);
+		const s64_t pos = (static_cast<s64_t>(expected) + delta);
+		if (pos < 0 || pos > static_cast<s64_t>(MAX_IMAGE_SIZE)) return false;
+		rPos_ = static_cast<u32_t>(pos);
+		return true;
+	}
+	bool get_digest(u32_t& rValue_)
+	{
+		u32_t value = 0;
+		for (u32_t i = 0; i < 4; i++)
+		{
+			u8_t b;
+			if (!get(b)) return false;
+			value = ((value << 8) | b);
+		}
+		rValue_ = value;
+		return true;
+	}
+
+	const u8_t* pAddr;											// Patch
+	u32_t       size;											// Patch Size [byte]
+	u32_t       pos;											// Read Position
+	u32_t       expected;										// Expected Base Position of the Next Copy
+};
+
+// Patch header.
+struct patch_head
+{
+	u32_t base_size;											// Base Size [byte]
+	u32_t base_digest;											// Digest of the Base
+	u32_t target_size;											// Target Size [byte]
+	u32_t target_digest;										// Digest of the Target
+};
+
+bool read_head(patch_reader& rReader_, patch_head& rHead_)
+{
+	for (u32_t i = 0; i < 4; i++)
+	{
+		u8_t b;
+		if (!rReader_.get(b) || b != PATCH_MAGIC[i]) return false;
+	}
+	u8_t version;
+	if (!rReader_.get(version) || version != PATCH_VERSION) return false;
+	return (rReader_.get_variable_size(rHead_.base_size) && rReader_.get_digest(rHead_.base_digest)
+		&& rReader_.get_variable_size(rHead_.target_size) && rReader_.get_digest(rHead_.target_digest));
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Matching (Internal for make_patch)
+//------------------------------------------------------------------------------------------------------//
+
+// Hash index of the windows of the base. (Last position wins)
+class window_index
+{
+public:
+	window_index(const u8_t* pAddr_, u32_t size_)
+		: m_table(), m_mask(0)
+	{
+		u32_t n = 1024;
+		while (n < (size_ * 2) && n < (1U << 26)) n <<= 1;
+		m_table.assign(n, 0);
+		m_mask = (n - 1);
+		for (u32_t pos = 0; (pos + HASH_WINDOW) <= size_; pos++)
+		{
+			m_table[hash(&pAddr_[pos])] = (pos + 1);
+		}
+	}
+
+	// Return the candidate position + 1. (0 = None)
+	u32_t find(const u8_t* pWindow_) const
+	{
+		return m_table[hash(pWindow_)];
+	}
+
+private:
+	u32_t hash(const u8_t* pWindow_) const
+	{
+		u64_t value;
+		std::memcpy(&value, pWindow_, sizeof(value));
+		return static_cast<u32_t>((value * 0x9E3779B97F4A7C15ULL) >> 32) & m_mask;
+	}
+
+private:
+	std::vector<u32_t> m_table;									// Position + 1 per Hash
+	u32_t              m_mask;									// Table Mask
+};
+
+u32_t match_length(const u8_t* pBase_, const u8_t* pTarget_, u32_t limit_)
+{
+	u32_t len = 0;
+	while (len < limit_ && pBase_[len] == pTarget_[len]) len++;
+	return len;
+}
+
+// Encode target [begin_, end_) as copies and literals.
+void diff_range(const MA_3& rBase_, const window_index& rIndex_, const u8_t* pTarget_, u32_t begin_, u32_t end_, patch_writer& rWriter_)
+{
+	const u8_t* pBase = rBase_.data_ptr();
+	const u32_t base_size = rBase_.size();
+	u32_t pos = begin_;
+	while (pos < end_)
+	{
+		u32_t copy_pos = 0;
+		u32_t copy_len = 0;
+
+		// Continue the last range. (Header edits and size fields are skipped as short literals.)
+		const u32_t expected = rWriter_.expected;
+		if (expected < base_size)
+		{
+			const u32_t limit = ((base_size - expected) < (end_ - pos)) ? (base_size - expected) : (end_ - pos);
+			const u32_t len = match_length(&pBase[expected], &pTarget_[pos], limit);
+			if (len >= MIN_CONTINUE)
+			{
+				copy_pos = expected;
+				copy_len = len;
+			}
+		}
+
+		// Shifted data.
+		if (copy_len < MIN_COPY && (pos + HASH_WINDOW) <= end_)
+		{
+			const u32_t candidate = rIndex_.find(&pTarget_[pos]);
+			if (candidate != 0)
+			{
+				const u32_t base_pos = (candidate - 1);
+				const u32_t limit = ((base_size - base_pos) < (end_ - pos)) ? (base_size - base_pos) : (end_ - pos);
+				const u32_t len = match_length(&pBase[base_pos], &pTarget_[pos], limit);
+				if (len >= MIN_COPY && len > copy_len)
+				{
+					copy_pos = base_pos;
+					copy_len = len;
+				}
+			}
+		}
+
+		if (copy_len != 0)
+		{
+			rWriter_.copy(copy_pos, copy_len);
+			pos += copy_len;
+		}
+		else
+		{
+			rWriter_.add(&pTarget_[pos], 1);
+			pos++;
+		}
+	}
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Retiming (Internal for make_patch)
+//------------------------------------------------------------------------------------------------------//
+
+// Event stream of the sequence data.
+struct timeline_visitor
+{
+	timeline_visitor()
+		: time(0), times(), events(), gates()
+	{}
+
+	bool duration(u32_t value_, u32_t /*pos_*/, u32_t /*len_*/)
+	{
+		time += value_;
+		times.push_back(time);
+		return true;
+	}
+	bool event(const u8_t* pEvent_, u32_t size_, const event_info& /*rInfo_*/)
+	{
+		events.push_back(pEvent_);
+		events.push_back(pEvent_ + size_);
+		return true;
+	}
+	bool gatetime(u32_t value_, u32_t /*pos_*/, u32_t /*len_*/)
+	{
+		gates.push_back(time);
+		gates.push_back(value_);
+		return true;
+	}
+
+	u64_t                    time;								// Absolute Time [tick]
+	std::vector<u64_t>       times;								// Time after each Duration [tick]
+	std::vector<const u8_t*> events;							// Begin/End of each Event
+	std::vector<u64_t>       gates;								// Time/Value of each Gatetime [tick]
+};
+
+// Narrow [rLo_, rHi_] to the ratios that round base_ to target_.
+void limit_ratio(u64_t base_, u64_t target_, f64_t& rLo_, f64_t& rHi_)
+{
+	if (base_ == 0) return;
+	const f64_t lo = (static_cast<f64_t>(target_) - 0.5) / static_cast<f64_t>(base_);
+	const f64_t hi = (static_cast<f64_t>(target_) + 0.5) / static_cast<f64_t>(base_);
+	if (lo > rLo_) rLo_ = lo;
+	if (hi < rHi_) rHi_ = hi;
+}
+
+// Simplest fraction in [lo_, hi_]. (Continued fractions)
+bool simplest_fraction(f64_t lo_, f64_t hi_, u64_t& rNum_, u64_t& rDen_)
+{
+	if (!(lo_ > 0.0) || !(hi_ >= lo_)) return false;
+
+	u64_t p0 = 0, q0 = 1;
+	u64_t p1 = 1, q1 = 0;
+	f64_t lo = lo_, hi = hi_;
+	for (u32_t i = 0; i < 32; i++)
+	{
+		const f64_t a = std::floor(lo);
+		if (lo == a || a < std::floor(hi))
+		{
+			const u64_t c = static_cast<u64_t>((lo == a) ? a : (a + 1.0));
+			rNum_ = (c * p1) + p0;
+			rDen_ = (c * q1) + q0;
+			return (rNum_ != 0 && rNum_ <= RATIO_LIMIT && rDen_ <= RATIO_LIMIT);
+		}
+		const u64_t t = static_cast<u64_t>(a);
+		const u64_t p2 = (t * p1) + p0;
+		const u64_t q2 = (t * q1) + q0;
+		if (p2 > RATIO_LIMIT || q2 > RATIO_LIMIT) return false;
+		p0 = p1; q0 = q1;
+		p1 = p2; q1 = q2;
+
+		const f64_t next_lo = 1.0 / (hi - a);
+		hi = 1.0 / (lo - a);
+		lo = next_lo;
+	}
+	return false;
+}
+
+// Find the ratio which retimes the base sequence to the target sequence. (Verified by re-encoding)
+bool find_retime(const u8_t* pBase_, u32_t base_size_, const u8_t* pTarget_, u32_t target_size_, u64_t& rNum_, u64_t& rDen_)
+{
+	timeline_visitor base, target;
+	if (!walk_sequence(pBase_, base_size_, base) || !walk_sequence(pTarget_, target_size_, target)) return false;
+	if (base.times.size() != target.times.size() || base.events.size() != target.events.size() || base.gates.size() != target.gates.size()) return false;
+	if (base.time == 0) return false;							// Nothing to Retime
+
+	for (size_t i = 0; i < base.events.size(); i += 2)
+	{
+		const size_t size = (base.events[i + 1] - base.events[i]);
+		if (size != static_cast<size_t>(target.events[i + 1] - target.events[i])) return false;
+		if (std::memcmp(base.events[i], target.events[i], size) != 0) return false;
+	}
+
+	f64_t lo = 0.0;
+	f64_t hi = 1.0e18;
+	for (size_t i = 0; i < base.times.size(); i++)
+	{
+		if (base.times[i] == 0 && target.times[i] != 0) return false;
+		limit_ratio(base.times[i], target.times[i], lo, hi);
+	}
+	for (size_t i = 0; i < base.gates.size(); i += 2)
+	{
+		if (target.gates[i + 1] > 1) limit_ratio((base.gates[i] + base.gates[i + 1]), (target.gates[i] + target.gates[i + 1]), lo, hi);
+	}
+	if (!simplest_fraction(lo, hi, rNum_, rDen_)) return false;
+
+	std::vector<u8_t> check(target_size_);
+	scale_visitor scale(rNum_, rDen_, check.data());
+	scale_visitor measure(rNum_, rDen_, nullptr);
+	if (!walk_sequence(pBase_, base_size_, measure) || measure.pos != target_size_) return false;
+	if (!walk_sequence(pBase_, base_size_, scale)) return false;
+	return (std::memcmp(check.data(), pTarget_, target_size_) == 0);
+}
+
+// Retimed sequence data in the target.
+struct retime_plan
+{
+	u32_t target_pos;											// Position in the Target
+	u32_t size;													// Size in the Target [byte]
+	u32_t base_pos;												// Position in the Base
+	u32_t base_size;											// Size in the Base [byte]
+	u64_t num;													// Numerator of Retiming
+	u64_t den;													// Denominator of Retiming
+};
+
+// Pair the score tracks in order and find the retimed sequence data.
+void plan_retimes(const MA_3& rBase_, const MA_3& rTarget_, u32_t end_, std::vector<retime_plan>& rDst_)
+{
+	std::vector<track_info> base_tracks, target_tracks;
+	if (!enumerate_tracks(rBase_, base_tracks) || !enumerate_tracks(rTarget_, target_tracks)) return;
+
+	std::vector<const track_info*> base, target;
+	for (size_t i = 0; i < base_tracks.size(); i++)
+	{
+		if (!base_tracks[i].audio && base_tracks[i].sequence_size_pos != 0) base.push_back(&base_tracks[i]);
+	}
+	for (size_t i = 0; i < target_tracks.size(); i++)
+	{
+		if (!target_tracks[i].audio && target_tracks[i].sequence_size_pos != 0) target.push_back(&target_tracks[i]);
+	}
+
+	for (size_t i = 0; i < base.size() && i < target.size(); i++)
+	{
+		const track_info& b = *base[i];
+		const track_info& t = *target[i];
+		if ((t.sequence_pos + t.sequence_size) > end_) continue;
+		if (b.sequence_size == t.sequence_size && std::memcmp(&rBase_.data_ptr()[b.sequence_pos], &rTarget_.data_ptr()[t.sequence_pos], b.sequence_size) == 0) continue;
+
+		retime_plan plan;
+		if (!find_retime(&rBase_.data_ptr()[b.sequence_pos], b.sequence_size, &rTarget_.data_ptr()[t.sequence_pos], t.sequence_size, plan.num, plan.den)) continue;
+		plan.target_pos = t.sequence_pos;
+		plan.size = t.sequence_size;
+		plan.base_pos = b.sequence_pos;
+		plan.base_size = b.sequence_size;
+		rDst_.push_back(plan);
+	}
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Output (Internal for apply_patch)
+//------------------------------------------------------------------------------------------------------//
+
+// Output stream with the running CRC16 and digest. Small writes are gathered into blocks.
+class patch_output
+{
+public:
+	patch_output(patch_sink pSink_, void* pContext_)
+		: m_pSink(pSink_), m_pContext(pContext_), m_used(0), m_size(0), m_crc(0x0000), m_digest(DIGEST_SEED)
+	{}
+
+	bool write(const u8_t* pData_, u32_t size_)
+	{
+		m_crc = calc_crc16(pData_, size_, m_crc);
+		m_digest = update_digest(pData_, size_, m_digest);
+		m_size += size_;
+		if (size_ >= STREAM_BLOCK)
+		{
+			return (this->flush() && m_pSink(pData_, size_, m_pContext));
+		}
+		if ((m_used + size_) > STREAM_BLOCK && !this->flush()) return false;
+		std::memcpy(&m_block[m_used], pData_, size_);
+		m_used += size_;
+		return true;
+	}
+
+	bool flush()
+	{
+		if (m_used == 0) return true;
+		const u32_t used = m_used;
+		m_used = 0;
+		return m_pSink(m_block, used, m_pContext);
+	}
+
+	u64_t size() const
+	{
+		return m_size;
+	}
+
+	u16_t crc() const
+	{
+		return m_crc;
+	}
+
+	u32_t digest() const
+	{
+		return m_digest;
+	}
+
+private:
+	patch_sink m_pSink;											// Sink
+	void*      m_pContext;										// Context of Sink
+	u8_t       m_block[STREAM_BLOCK];							// Gathered Output
+	u32_t      m_used;											// Used Bytes of Block
+	u64_t      m_size;											// Output Size [byte]
+	u16_t      m_crc;											// CRC16 of the Output
+	u32_t      m_digest;										// Digest of the Output
+};
+
+// Retime the sequence data of the base into the output in blocks. (Events are copied through scale_visitor.)
+struct retime_visitor
+{
+	retime_visitor(u64_t num_, u64_t den_, patch_output& rOutput_)
+		: scale(num_, den_, nullptr), output(rOutput_), size(0)
+	{
+		scale.pDst = block;
+	}
+
+	bool duration(u32_t value_, u32_t pos_, u32_t len_)
+	{
+		return (this->reserve(4) && scale.duration(value_, pos_, len_));
+	}
+	bool event(const u8_t* pEvent_, u32_t size_, const event_info& rInfo_)
+	{
+		if (size_ > STREAM_BLOCK)
+		{
+			if (!this->flush()) return false;
+			size += size_;
+			return output.write(pEvent_, size_);				// Long Exclusive
+		}
+		return (this->reserve(size_) && scale.event(pEvent_, size_, rInfo_));
+	}
+	bool gatetime(u32_t value_, u32_t pos_, u32_t len_)
+	{
+		return (this->reserve(4) && scale.gatetime(value_, pos_, len_));
+	}
+
+	bool reserve(u32_t size_)
+	{
+		return ((scale.pos + size_) <= STREAM_BLOCK) ? true : this->flush();
+	}
+	bool flush()
+	{
+		const u32_t used = scale.pos;
+		scale.pos = 0;
+		size += used;
+		return output.write(block, used);
+	}
+
+	scale_visitor scale;										// Retiming (Writes to the Block)
+	patch_output& output;										// Output
+	u8_t          block[STREAM_BLOCK];							// Retimed Data
+	u64_t         size;											// Output Size [byte]
+};
+
+// Writer of apply_patch to MA_3.
+struct image_sink
+{
+	u8_t* pDst;													// Output
+	u32_t size;													// Output Size [byte]
+	u32_t pos;													// Write Position
+};
+
+bool write_image(const u8_t* pData_, u32_t size_, void* pContext_)
+{
+	image_sink* pContext = static_cast<image_sink*>(pContext_);
+	if (size_ > (pContext->size - pContext->pos)) return false;
+	std::memcpy(&pContext->pDst[pContext->pos], pData_, size_);
+	pContext->pos += size_;
+	return true;
+}
+
+}																// namespace
+
+//------------------------------------------------------------------------------------------------------//
+// Make Patch
+//------------------------------------------------------------------------------------------------------//
+bool smaf::make_patch(const MA_3& rBase_, const MA_3& rTarget_, binary_array& rPatch_)
+{
+	OPENMF_TRACE_SCOPE("make_patch");
+	OPENMF_TRACE_COUNT("make_patch.bytes", rTarget_.size());
+
+	if (rBase_.empty() || rTarget_.empty()) return false;
+	if (rBase_.size() > MAX_IMAGE_SIZE || rTarget_.size() > MAX_IMAGE_SIZE) return false;
+
+	const u8_t* pTarget = rTarget_.data_ptr();
+	const u32_t target_size = rTarget_.size();
+	patch_writer writer;
+	writer.data.insert(writer.data.end(), PATCH_MAGIC, PATCH_MAGIC + 4);
+	writer.put(PATCH_VERSION);
+	writer.put_variable_size(rBase_.size());
+	writer.put_digest(update_digest(rBase_.data_ptr(), rBase_.size(), DIGEST_SEED));
+	writer.put_variable_size(target_size);
+	writer.put_digest(update_digest(pTarget, target_size, DIGEST_SEED));
+
+	// A valid CRC16 at the end is recomputed by the apply.
+	u32_t end = target_size;
+	if (target_size > MA_3::CRC_SIZE)
+	{
+		const u16_t stored = static_cast<u16_t>((pTarget[target_size - 2] << 8) | pTarget[target_size - 1]);
+		if (calc_crc16(pTarget, (target_size - MA_3::CRC_SIZE)) == stored) end = (target_size - MA_3::CRC_SIZE);
+	}
+
+	std::vector<retime_plan> retimes;
+	plan_retimes(rBase_, rTarget_, end, retimes);
+
+	const window_index index(rBase_.data_ptr(), rBase_.size());
+	u32_t pos = 0;
+	for (size_t i = 0; i < retimes.size(); i++)
+	{
+		const retime_plan& plan = retimes[i];
+		diff_range(rBase_, index, pTarget, pos, plan.target_pos, writer);
+		writer.retime(plan.base_pos, plan.base_size, plan.num, plan.den, plan.size);
+		pos = (plan.target_pos + plan.size);
+	}
+	diff_range(rBase_, index, pTarget, pos, end, writer);
+	if (end != target_size) writer.crc();
+	writer.flush();
+	writer.put(OP_END);
+
+	OPENMF_TRACE_COUNT("make_patch.patch_bytes", writer.data.size());
+	if (!rPatch_.create(static_cast<u32_t>(writer.data.size()))) return false;
+	std::memcpy(rPatch_.data_ptr(), writer.data.data(), writer.data.size());
+	return true;
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Apply Patch (Streamed)
+//------------------------------------------------------------------------------------------------------//
+bool smaf::apply_patch(const MA_3& rBase_, const u8_t* pPatch_, u32_t size_, patch_sink pSink_, void* pContext_)
+{
+	OPENMF_TRACE_SCOPE("apply_patch");
+
+	if (pPatch_ == nullptr || pSink_ == nullptr) return false;
+
+	patch_reader reader(pPatch_, size_);
+	patch_head head;
+	if (!read_head(reader, head)) return false;
+
+	const u8_t* pBase = rBase_.data_ptr();
+	const u32_t base_size = rBase_.size();
+	if (rBase_.empty() || base_size != head.base_size || update_digest(pBase, base_size, DIGEST_SEED) != head.base_digest) return false;
+
+	patch_output output(pSink_, pContext_);
+	while (true)
+	{
+		u8_t op;
+		if (!reader.get(op)) return false;
+		if (op == OP_END) break;
+
+		u32_t size, pos;
+		switch (op)
+		{
+		case OP_COPY:
+			if (!reader.get_variable_size(size) || !reader.get_position(pos)) return false;
+			if (pos > base_size || size > (base_size - pos)) return false;
+			if (!output.write(&pBase[pos], size)) return false;
+			reader.expected = (pos + size);
+			break;
+
+		case OP_ADD:
+			if (!reader.get_variable_size(size) || size > (reader.size - reader.pos)) return false;
+			if (!output.write(&reader.pAddr[reader.pos], size)) return false;
+			reader.pos += size;
+			reader.expected += size;
+			break;
+
+		case OP_RETIME:
+			{
+				u32_t num, den, out_size;
+				if (!reader.get_variable_size(size) || !reader.get_position(pos)) return false;
+				if (!reader.get_variable_size(num) || !reader.get_variable_size(den) || !reader.get_variable_size(out_size)) return false;
+				if (num == 0 || den == 0 || num > RATIO_LIMIT || den > RATIO_LIMIT) return false;
+
+				// Variable sizes are read up to 4 bytes, so the range ends before the CRC16 of the base.
+				if (pos > base_size || size > (base_size - pos) || (pos + size + MA_3::CRC_SIZE) > base_size) return false;
+
+				retime_visitor retime(num, den, output);
+				if (!walk_sequence(&pBase[pos], size, retime) || !retime.flush()) return false;
+				if (retime.size != out_size) return false;
+				reader.expected = (pos + size);
+			}
+			break;
+
+		case OP_CRC:
+			{
+				const u16_t crc = output.crc();
+				const u8_t code[2] = { static_cast<u8_t>((crc >> 8) & 0xFF), static_cast<u8_t>((crc >> 0) & 0xFF) };
+				if (!output.write(code, MA_3::CRC_SIZE)) return false;
+				reader.expected += MA_3::CRC_SIZE;
+			}
+			break;
+
+		default:
+			return false;										// Unknown Op
+		}
+		if (output.size() > head.target_size) return false;
+	}
+
+	if (!output.flush()) return false;
+	OPENMF_TRACE_COUNT("apply_patch.bytes", output.size());
+	return (output.size() == head.target_size && output.digest() == head.target_digest);
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Apply Patch (to MA_3)
+//------------------------------------------------------------------------------------------------------//
+bool smaf::apply_patch(const MA_3& rBase_, const binary_array& rPatch_, MA_3& rDst_)
+{
+	if (rPatch_.empty() || rBase_ == rDst_) return false;
+
+	patch_reader reader(rPatch_.data_ptr(), rPatch_.size());
+	patch_head head;
+	if (!read_head(reader, head) || head.target_size == 0) return false;
+	if (!rDst_.create(head.target_size)) return false;
+
+	image_sink sink;
+	sink.pDst = rDst_.data_ptr();
+	sink.size = head.target_size;
+	sink.pos = 0;
+	if (!apply_patch(rBase_, rPatch_.data_ptr(), rPatch_.size(), write_image, &sink))
+	{
+		rDst_.release();
+		return false;
+	}
+	return true;
+}
+
+//------------------------------------------------------------------------------------------------------//
+// End of File
+//------------------------------------------------------------------------------------------------------//
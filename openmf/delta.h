@@ -0,0 +1,65 @@
+//------------------------------------------------------------------------------------------------------//
+//
+//                                          License Agreement
+//                                     For Open Source SMAF Library
+//
+//                         Copyright (c) 2015-2017, @shirajira, all rights reserved.
+//
+//------------------------------------------------------------------------------------------------------//
+
+#ifndef openmf_delta_h__
+#define openmf_delta_h__
+#pragma once
+
+#include "core.h"
+
+namespace smaf {
+
+//------------------------------------------------------------------------------------------------------//
+// Patch Format (Delta between two Revisions of SMAF Data)
+//
+//   Header  : "OMFP", Version (1), Base Size (VS), Base Digest (4), Target Size (VS), Target Digest (4)
+//   Ops     : Op Code (1) + Operands, ... , OP_END
+//
+//   OP_COPY   : Length (VS), Position (Signed VS) - Copy from the base
+//   OP_ADD    : Length (VS), Bytes - Literal bytes
+//   OP_RETIME : Length (VS), Position (Signed VS), Numerator (VS), Denominator (VS), Output Size (VS)
+//               - Sequence data of the base retimed on absolute time (Same as change_tempo)
+//   OP_CRC    : CRC16 of the output before it (2 bytes are output)
+//
+// VS = Variable Size of SMAF (28bit). Digest = FNV-1a 32bit of the whole image. Values are in big endian. The position of OP_COPY and
+// OP_RETIME is relative to the end of the last base range plus the added bytes after it, so a copy
+// that continues after a changed byte costs a single byte. (Signed = Zigzag encoded)
+//------------------------------------------------------------------------------------------------------//
+
+//------------------------------------------------------------------------------------------------------//
+// Patch Sink (Called with the output in order, false = Abort)
+//------------------------------------------------------------------------------------------------------//
+typedef bool (*patch_sink)(const u8_t* pData_, u32_t size_, void* pContext_);
+
+//------------------------------------------------------------------------------------------------------//
+// Make Patch (rBase_ -> rTarget_)
+//
+// Header edits, size fields and appended data become short literals between copies. Sequence data
+// which is a retimed copy of the base is found per score track, and a valid CRC16 is recomputed by
+// the apply instead of being stored.
+//------------------------------------------------------------------------------------------------------//
+bool make_patch(const MA_3& rBase_, const MA_3& rTarget_, binary_array& rPatch_);
+
+//------------------------------------------------------------------------------------------------------//
+// Apply Patch (Streamed to pSink_ without intermediate Images, Checked with the Target Digest at the End)
+//------------------------------------------------------------------------------------------------------//
+bool apply_patch(const MA_3& rBase_, const u8_t* pPatch_, u32_t size_, patch_sink pSink_, void* pContext_);
+
+//------------------------------------------------------------------------------------------------------//
+// Apply Patch (rDst_ is allocated once with the Target Size)
+//------------------------------------------------------------------------------------------------------//
+bool apply_patch(const MA_3& rBase_, const binary_array& rPatch_, MA_3& rDst_);
+
+//------------------------------------------------------------------------------------------------------//
+}																// namespace smaf
+
+#endif															// openmf_delta_h__
+//------------------------------------------------------------------------------------------------------//
+// End of File
+//------------------------------------------------------------------------------------------------------//
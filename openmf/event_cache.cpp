@@ -0,0 +1,392 @@
+//------------------------------------------------------------------------------------------------------//
+//
+//                                          License Agreement
+//                                     For Open Source SMAF Library
+//
+//                         Copyright (c) 2015-2017, @shirajira, all rights reserved.
+//
+//------------------------------------------------------------------------------------------------------//
+
+#include "event_cache.h"
+#include "apis.h"
+#include "array_operations.h"
+#include "batch_io.h"
+#include "sequence.h"
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace smaf;
+
+//------------------------------------------------------------------------------------------------------//
+// Internal Helpers
+//------------------------------------------------------------------------------------------------------//
+namespace {
+
+const char     MAGIC[4] = { 'O', 'M', 'F', 'E' };				// Cache Magic
+const u32_t    VERSION = 1;										// Cache Version
+const u32_t    BYTE_ORDER_MARK = 0x0102;						// Byte Order Mark
+const u32_t    CHUNK_FIELDS = 6;								// Values per Chunk
+const u32_t    ALIGNMENT = 8;									// Section Alignment [byte]
+
+// Cache header. (Used as mapped)
+struct cache_head
+{
+	char          magic[4];										// "OMFE"
+	std::uint16_t version;										// Version
+	std::uint16_t byte_order;									// Byte Order Mark
+	std::uint32_t source_size;									// Image Size [byte]
+	std::uint16_t source_crc;									// CRC16 of the Image
+	std::uint16_t reserved0;									// Reserved
+	std::uint32_t chunks;										// Number of Chunks
+	std::uint32_t events;										// Number of Events
+	std::uint32_t chunk_pos;									// Chunk Section
+	std::uint32_t time_pos;										// Time Column
+	std::uint32_t offset_pos;									// Offset Column
+	std::uint32_t gatetime_pos;									// Gatetime Column
+	std::uint32_t status_pos;									// Status Column
+	std::uint32_t cache_size;									// Cache Size [byte]
+	std::uint32_t reserved1[4];									// Reserved
+};
+
+static_assert(sizeof(cache_head) == 64, "event cache: header size");
+
+u64_t align_size(u64_t size_)
+{
+	return ((size_ + (ALIGNMENT - 1)) / ALIGNMENT) * ALIGNMENT;
+}
+
+// Collect all chunks in file order.
+walk_result collect_chunk(const chunk_info& rInfo_, const u8_t* /*pAddr_*/, void* pContext_)
+{
+	std::vector<chunk_info>* pChunks = static_cast<std::vector<chunk_info>*>(pContext_);
+	pChunks->push_back(rInfo_);
+	return WR_CONTINUE;
+}
+
+class collect_registry : public chunk_registry
+{
+public:
+	collect_registry()
+		: chunk_registry()
+	{
+		this->set_default_callback(collect_chunk);
+	}
+};
+
+// Decode the events to the columns.
+struct column_visitor
+{
+	column_visitor(const u8_t* pBase_, std::vector<std::uint32_t>& rTime_, std::vector<std::uint32_t>& rOffset_,
+		std::vector<std::uint32_t>& rGatetime_, std::vector<u8_t>& rStatus_)
+		: pBase(pBase_), time(0), times(rTime_), offsets(rOffset_), gatetimes(rGatetime_), status(rStatus_)
+	{}
+
+	bool duration(u32_t value_, u32_t /*pos_*/, u32_t /*len_*/)
+	{
+		time += value_;
+		return (time <= 0xFFFFFFFF);							// Time Overflow
+	}
+	bool event(const u8_t* pEvent_, u32_t /*size_*/, const event_info& /*rInfo_*/)
+	{
+		times.push_back(static_cast<std::uint32_t>(time));
+		offsets.push_back(static_cast<std::uint32_t>(pEvent_ - pBase));
+		gatetimes.push_back(0);
+		status.push_back(pEvent_[0]);
+		return true;
+	}
+	bool gatetime(u32_t value_, u32_t /*pos_*/, u32_t /*len_*/)
+	{
+		gatetimes.back() = static_cast<std::uint32_t>(value_);
+		return true;
+	}
+
+	const u8_t*                 pBase;							// Image
+	u64_t                       time;							// Absolute Time [tick]
+	std::vector<std::uint32_t>& times;							// Time Column
+	std::vector<std::uint32_t>& offsets;						// Offset Column
+	std::vector<std::uint32_t>& gatetimes;						// Gatetime Column
+	std::vector<u8_t>&          status;							// Status Column
+};
+
+// Find the sequence data of the first score track. (Same as first_layout)
+bool find_sequence(const std::vector<chunk_info>& rChunks_, chunk_info& rInfo_)
+{
+	u32_t score_mask, sequence_mask;
+	const u32_t score_id = make_chunk_id("MTR*", score_mask);
+	const u32_t sequence_id = make_chunk_id("Mtsq", sequence_mask);
+
+	size_t i = 0;
+	while (i < rChunks_.size() && (rChunks_[i].id & score_mask) != score_id) i++;
+	if (i == rChunks_.size()) return false;
+
+	const chunk_info& score = rChunks_[i];
+	for (i++; i < rChunks_.size() && rChunks_[i].pos < (score.data_pos + score.size); i++)
+	{
+		if (rChunks_[i].id == sequence_id)
+		{
+			rInfo_ = rChunks_[i];
+			return true;
+		}
+	}
+	return false;
+}
+
+u16_t stored_crc(const u8_t* pAddr_, u32_t size_)
+{
+	return static_cast<u16_t>((pAddr_[size_ - 2] << 8) | pAddr_[size_ - 1]);
+}
+
+}																// namespace
+
+//------------------------------------------------------------------------------------------------------//
+// Event Cache Class
+//------------------------------------------------------------------------------------------------------//
+event_cache::event_cache()
+	: m_buffer()
+	, m_pMap(nullptr)
+	, m_map_size(0)
+	, m_pBase(nullptr)
+	, m_size(0)
+	, m_pChunk(nullptr)
+	, m_chunks(0)
+	, m_events()
+{
+	std::memset(&m_events, 0, sizeof(m_events));
+}
+
+event_cache::~event_cache()
+{
+	this->close();
+}
+
+bool event_cache::build(const MA_3& rSrc_)
+{
+	OPENMF_TRACE_SCOPE("event_cache::build");
+	this->close();
+
+	if (rSrc_.get_format() != format_type::MOBILE_NO_COMPRESS) return false;
+	const u8_t* pAddr = rSrc_.data_ptr();
+	const u32_t size = rSrc_.size();
+	if (size < MA_3::CRC_SIZE || size > 0xFFFFFFFF) return false;
+
+	if (calc_crc16(pAddr, (size - MA_3::CRC_SIZE)) != stored_crc(pAddr, size)) return false;
+
+	// (1) Chunks and Events
+	//
+	static const collect_registry registry;
+	std::vector<chunk_info> chunks;
+	if (!registry.walk(pAddr, size, &chunks)) return false;
+
+	std::vector<std::uint32_t> times, offsets, gatetimes;
+	std::vector<u8_t> status;
+	chunk_info sequence;
+	if (find_sequence(chunks, sequence))
+	{
+		column_visitor visitor(pAddr, times, offsets, gatetimes, status);
+		if (!walk_sequence(&pAddr[sequence.data_pos], sequence.size, visitor)) return false;
+	}
+
+	// (2) Header + Chunks + Columns
+	//
+	cache_head head;
+	std::memset(&head, 0, sizeof(head));
+	std::memcpy(head.magic, MAGIC, sizeof(MAGIC));
+	head.version = static_cast<std::uint16_t>(VERSION);
+	head.byte_order = static_cast<std::uint16_t>(BYTE_ORDER_MARK);
+	head.source_size = static_cast<std::uint32_t>(size);
+	head.source_crc = stored_crc(pAddr, size);
+	head.chunks = static_cast<std::uint32_t>(chunks.size());
+	head.events = static_cast<std::uint32_t>(status.size());
+
+	u64_t pos = sizeof(cache_head);
+	head.chunk_pos = static_cast<std::uint32_t>(pos);
+	pos = align_size(pos + chunks.size() * CHUNK_FIELDS * sizeof(std::uint32_t));
+	head.time_pos = static_cast<std::uint32_t>(pos);
+	pos = align_size(pos + times.size() * sizeof(std::uint32_t));
+	head.offset_pos = static_cast<std::uint32_t>(pos);
+	pos = align_size(pos + offsets.size() * sizeof(std::uint32_t));
+	head.gatetime_pos = static_cast<std::uint32_t>(pos);
+	pos = align_size(pos + gatetimes.size() * sizeof(std::uint32_t));
+	head.status_pos = static_cast<std::uint32_t>(pos);
+	pos = align_size(pos + status.size());
+	if (pos > 0xFFFFFFFF) return false;
+	head.cache_size = static_cast<std::uint32_t>(pos);
+
+	m_buffer.assign(static_cast<size_t>(pos), 0);
+	u8_t* pDst = &m_buffer[0];
+	std::memcpy(pDst, &head, sizeof(head));
+
+	std::uint32_t* pChunk = reinterpret_cast<std::uint32_t*>(&pDst[head.chunk_pos]);
+	for (size_t i = 0; i < chunks.size(); i++)
+	{
+		*pChunk++ = static_cast<std::uint32_t>(chunks[i].id);
+		*pChunk++ = static_cast<std::uint32_t>(chunks[i].pos);
+		*pChunk++ = static_cast<std::uint32_t>(chunks[i].size_pos);
+		*pChunk++ = static_cast<std::uint32_t>(chunks[i].size);
+		*pChunk++ = static_cast<std::uint32_t>(chunks[i].data_pos);
+		*pChunk++ = static_cast<std::uint32_t>(chunks[i].depth);
+	}
+	if (!status.empty())
+	{
+		std::memcpy(&pDst[head.time_pos], &times[0], times.size() * sizeof(std::uint32_t));
+		std::memcpy(&pDst[head.offset_pos], &offsets[0], offsets.size() * sizeof(std::uint32_t));
+		std::memcpy(&pDst[head.gatetime_pos], &gatetimes[0], gatetimes.size() * sizeof(std::uint32_t));
+		std::memcpy(&pDst[head.status_pos], &status[0], status.size());
+	}
+
+	if (this->bind(pDst, pos)) return true;
+	this->close();
+	return false;
+}
+
+bool event_cache::save(const char* szFile_) const
+{
+	if (this->empty()) return false;
+
+	// Written to a temporary file and renamed. (Readers never see a partial cache.)
+	const std::string temp_file = std::string(szFile_) + ".tmp";
+	const int fd = ::open(temp_file.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) return false;
+
+	bool ok = write_all(fd, m_pBase, m_size);
+	ok = (::close(fd) == 0) && ok;
+	ok = ok && (std::rename(temp_file.c_str(), szFile_) == 0);
+	if (!ok) std::remove(temp_file.c_str());
+	return ok;
+}
+
+bool event_cache::open(const char* szFile_)
+{
+	OPENMF_TRACE_SCOPE("event_cache::open");
+	this->close();
+
+	const int fd = ::open(szFile_, O_RDONLY);
+	if (fd < 0) return false;
+
+	struct stat st;
+	if (::fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(cache_head)))
+	{
+		::close(fd);
+		return false;
+	}
+	void* pMap = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+	::close(fd);
+	if (pMap == MAP_FAILED) return false;
+
+	m_pMap = pMap;
+	m_map_size = static_cast<u64_t>(st.st_size);
+	if (this->bind(static_cast<const u8_t*>(pMap), m_map_size)) return true;
+	this->close();
+	return false;
+}
+
+void event_cache::close()
+{
+	if (m_pMap != nullptr) ::munmap(m_pMap, static_cast<size_t>(m_map_size));
+	m_pMap = nullptr;
+	m_map_size = 0;
+	m_buffer.clear();
+	m_pBase = nullptr;
+	m_size = 0;
+	m_pChunk = nullptr;
+	m_chunks = 0;
+	std::memset(&m_events, 0, sizeof(m_events));
+}
+
+bool event_cache::validate(const MA_3& rSrc_) const
+{
+	OPENMF_TRACE_SCOPE("event_cache::validate");
+	if (!this->matches(rSrc_.data_ptr(), rSrc_.size())) return false;
+
+	const cache_head* pHead = reinterpret_cast<const cache_head*>(m_pBase);
+	return (calc_crc16(rSrc_.data_ptr(), (rSrc_.size() - MA_3::CRC_SIZE)) == pHead->source_crc);
+}
+
+bool event_cache::matches(const u8_t* pAddr_, u32_t size_) const
+{
+	if (this->empty() || pAddr_ == nullptr) return false;
+	const cache_head* pHead = reinterpret_cast<const cache_head*>(m_pBase);
+	if (size_ != pHead->source_size || size_ < MA_3::CRC_SIZE) return false;
+	return (stored_crc(pAddr_, size_) == pHead->source_crc);
+}
+
+bool event_cache::empty() const
+{
+	return (m_pBase == nullptr);
+}
+
+u32_t event_cache::chunks() const
+{
+	return m_chunks;
+}
+
+bool event_cache::chunk(u32_t n_, chunk_info& rInfo_) const
+{
+	if (n_ >= m_chunks) return false;
+
+	const std::uint32_t* p = &m_pChunk[n_ * CHUNK_FIELDS];
+	rInfo_.id = p[0];
+	rInfo_.pos = p[1];
+	rInfo_.size_pos = p[2];
+	rInfo_.size = p[3];
+	rInfo_.data_pos = p[4];
+	rInfo_.depth = p[5];
+	return true;
+}
+
+bool event_cache::find(const char* szChunkID_, chunk_info& rInfo_) const
+{
+	u32_t mask;
+	const u32_t id = make_chunk_id(szChunkID_, mask);
+	for (u32_t i = 0; i < m_chunks; i++)
+	{
+		if ((m_pChunk[i * CHUNK_FIELDS] & mask) == id) return this->chunk(i, rInfo_);
+	}
+	return false;
+}
+
+const event_columns& event_cache::events() const
+{
+	return m_events;
+}
+
+bool event_cache::bind(const u8_t* pBase_, u64_t size_)
+{
+	const cache_head* pHead = reinterpret_cast<const cache_head*>(pBase_);
+	if (size_ < sizeof(cache_head) || std::memcmp(pHead->magic, MAGIC, sizeof(MAGIC)) != 0) return false;
+	if (pHead->version != VERSION || pHead->byte_order != BYTE_ORDER_MARK) return false;
+	if (pHead->cache_size != size_) return false;
+
+	// Sections must be aligned and inside the cache.
+	const u64_t chunks = pHead->chunks;
+	const u64_t events = pHead->events;
+	const u64_t column = (events * sizeof(std::uint32_t));
+	const std::uint32_t sections[4] = { pHead->chunk_pos, pHead->time_pos, pHead->offset_pos, pHead->gatetime_pos };
+	const u64_t lengths[4] = { (chunks * CHUNK_FIELDS * sizeof(std::uint32_t)), column, column, column };
+	for (u32_t i = 0; i < 4; i++)
+	{
+		if ((sections[i] % sizeof(std::uint32_t)) != 0 || (sections[i] + lengths[i]) > size_) return false;
+	}
+	if ((pHead->status_pos + events) > size_) return false;
+
+	m_pBase = pBase_;
+	m_size = size_;
+	m_pChunk = reinterpret_cast<const std::uint32_t*>(&pBase_[pHead->chunk_pos]);
+	m_chunks = pHead->chunks;
+	m_events.count = pHead->events;
+	m_events.pTime = reinterpret_cast<const std::uint32_t*>(&pBase_[pHead->time_pos]);
+	m_events.pOffset = reinterpret_cast<const std::uint32_t*>(&pBase_[pHead->offset_pos]);
+	m_events.pGatetime = reinterpret_cast<const std::uint32_t*>(&pBase_[pHead->gatetime_pos]);
+	m_events.pStatus = &pBase_[pHead->status_pos];
+	return true;
+}
+
+//------------------------------------------------------------------------------------------------------//
+// End of File
+//------------------------------------------------------------------------------------------------------//
@@ -0,0 +1,117 @@
+//------------------------------------------------------------------------------------------------------//
+//
+//                                          License Agreement
+//                                     For Open Source SMAF Library
+//
+//                         Copyright (c) 2015-2017, @shirajira, all rights reserved.
+//
+//------------------------------------------------------------------------------------------------------//
+
+#ifndef openmf_event_cache_h__
+#define openmf_event_cache_h__
+#pragma once
+
+#include "core.h"
+#include "chunk.h"
+#include <cstdint>
+#include <vector>
+
+namespace smaf {
+
+//------------------------------------------------------------------------------------------------------//
+// Event Cache File (Sidecar, e.g. <file>.omfe)
+//
+// A snapshot of the decoded chunk tree and the events of the sequence data (Mtsq of the first
+// score track). Values are in the byte order of the host, so the file is used as mapped.
+// Sections start on 8 byte boundaries.
+//
+//   Header  : "OMFE", Version (2), Byte Order Mark 0x0102 (2), Source Size (4), Source CRC16 (2),
+//             Reserved (2), Number of Chunks (4), Number of Events (4), Section Offsets (4 x 5),
+//             Cache Size (4), Reserved (16)
+//   Chunks  : ID, Position, Size Position, Size, Data Position, Depth (4 x 6 per Chunk, File Order)
+//   Columns : Time [tick] (4), Offset [byte] (4), Gatetime [tick] (4), Status (1) per Event
+//
+// The cache belongs to the image of the same size and CRC16.
+//------------------------------------------------------------------------------------------------------//
+
+//------------------------------------------------------------------------------------------------------//
+// Event Columns (struct)
+//------------------------------------------------------------------------------------------------------//
+struct event_columns
+{
+	u32_t                count;									// Number of Events
+	const std::uint32_t* pTime;									// Absolute Time [tick]
+	const std::uint32_t* pOffset;								// Position of Event in the Image [byte]
+	const std::uint32_t* pGatetime;								// Gatetime [tick] (Notes only, otherwise 0)
+	const u8_t*          pStatus;								// Status Byte
+};
+
+//------------------------------------------------------------------------------------------------------//
+// Event Cache Class
+//------------------------------------------------------------------------------------------------------//
+class event_cache
+{
+public:
+	event_cache();
+	virtual ~event_cache();
+
+private:
+	event_cache(const event_cache&);
+	event_cache& operator=(const event_cache&);
+
+public:
+	// Decode the image. (format_type::MOBILE_NO_COMPRESS only)
+	bool build(const MA_3& rSrc_);
+
+	// Save the cache file.
+	bool save(const char* szFile_) const;
+
+	// Map the cache file. (No decoding, the header and the section bounds are checked.)
+	bool open(const char* szFile_);
+
+	// Release the cache.
+	void close();
+
+	// Check the cache belongs to the image. (Size and CRC16 of the whole image)
+	bool validate(const MA_3& rSrc_) const;
+
+	// Check the size and the stored CRC16 of the image. (Quick check for changes)
+	bool matches(const u8_t* pAddr_, u32_t size_) const;
+
+	// Check the cache is loaded.
+	bool empty() const;
+
+	// Return the number of chunks.
+	u32_t chunks() const;
+
+	// Return the n-th chunk in file order.
+	bool chunk(u32_t n_, chunk_info& rInfo_) const;
+
+	// Find the first chunk. ('*' = No Care, same as find_chunk)
+	bool find(const char* szChunkID_, chunk_info& rInfo_) const;
+
+	// Return the event columns.
+	const event_columns& events() const;
+
+private:
+	// Set the section pointers. (Checks the header)
+	bool bind(const u8_t* pBase_, u64_t size_);
+
+private:
+	std::vector<u8_t>     m_buffer;								// Built Cache
+	void*                 m_pMap;								// Mapped Cache File (nullptr = Not Mapped)
+	u64_t                 m_map_size;							// Mapping Size [byte]
+	const u8_t*           m_pBase;								// Cache Data (Buffer or Mapping)
+	u64_t                 m_size;								// Cache Size [byte]
+	const std::uint32_t*  m_pChunk;								// Chunk Section
+	u32_t                 m_chunks;								// Number of Chunks
+	event_columns         m_events;								// Event Columns
+};
+
+//------------------------------------------------------------------------------------------------------//
+}																// namespace smaf
+
+#endif															// openmf_event_cache_h__
+//------------------------------------------------------------------------------------------------------//
+// End of File
+//------------------------------------------------------------------------------------------------------//
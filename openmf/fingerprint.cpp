@@ -0,0 +1,314 @@
+//------------------------------------------------------------------------------------------------------//
+//
+//                                          License Agreement
+//                                     For Open Source SMAF Library
+//
+//                         Copyright (c) 2015-2017, @shirajira, all rights reserved.
+//
+//------------------------------------------------------------------------------------------------------//
+
+#include "fingerprint.h"
+#include "apis.h"
+#include "chunk.h"
+#include "sequence.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace smaf;
+
+//------------------------------------------------------------------------------------------------------//
+// Internal Helpers
+//------------------------------------------------------------------------------------------------------//
+namespace {
+
+const s32_t MAX_INTERVAL = 12;									// Interval Range [semitone] (Clamped)
+const f64_t RHYTHM_RATIO = 1.4;									// Ratio of Inter-Onset Times for Shorter/Longer
+const u32_t RHYTHM_STEPS = 3;									// Number of Rhythm Symbols (Shorter/Same/Longer)
+
+// Onset of the melody.
+struct melody_note
+{
+	u64_t time;													// Onset [ms]
+	u8_t  note;													// Note Number
+};
+
+// Collect the highest note at each onset.
+struct melody_visitor
+{
+	melody_visitor(u32_t d_ms_, const bool* pSkip_, std::vector<melody_note>& rNotes_)
+		: d_ms(d_ms_), time(0), pSkip(pSkip_), notes(rNotes_)
+	{}
+
+	bool duration(u32_t value_, u32_t /*pos_*/, u32_t /*len_*/)
+	{
+		time += (static_cast<u64_t>(value_) * d_ms);
+		return true;
+	}
+
+	bool event(const u8_t* pEvent_, u32_t /*size_*/, const event_info& rInfo_)
+	{
+		if (rInfo_.kind != EK_NOTE || pSkip[pEvent_[0] & 0x0F]) return true;
+
+		const u8_t note = (pEvent_[1] & 0x7F);
+		if (!notes.empty() && notes.back().time == time)
+		{
+			if (note > notes.back().note) notes.back().note = note;
+			return true;
+		}
+		melody_note onset;
+		onset.time = time;
+		onset.note = note;
+		notes.push_back(onset);
+		return true;
+	}
+
+	bool gatetime(u32_t /*value_*/, u32_t /*pos_*/, u32_t /*len_*/)
+	{
+		return true;
+	}
+
+	u32_t                     d_ms;								// Duration's Timebase [ms]
+	u64_t                     time;								// Current Time [ms]
+	const bool*               pSkip;							// Skipped Channels
+	std::vector<melody_note>& notes;							// Melody
+};
+
+s32_t clamp(s32_t value_, s32_t limit_)
+{
+	return (value_ < -limit_) ? -limit_ : ((value_ > limit_) ? limit_ : value_);
+}
+
+// Hash of the n-gram. (Murmur3 finalizer)
+u32_t mix_token(u32_t value_)
+{
+	value_ ^= (value_ >> 16);
+	value_ *= 0x85EBCA6B;
+	value_ &= 0xFFFFFFFF;
+	value_ ^= (value_ >> 13);
+	value_ *= 0xC2B2AE35;
+	value_ &= 0xFFFFFFFF;
+	value_ ^= (value_ >> 16);
+	return value_;
+}
+
+// Candidate of lookup.
+struct candidate
+{
+	u32_t number;												// Tune Number
+	u32_t shared;												// Shared Tokens
+};
+
+void add_candidate(u32_t number_, u8_t shared_, std::vector<candidate>& rDst_)
+{
+	candidate c;
+	c.number = number_;
+	c.shared = shared_;
+	rDst_.push_back(c);
+}
+
+// Collect the tunes of count >= threshold_ and clear the counts. (16 tunes per step with SSE2)
+void collect_candidates(u8_t* pCount_, u32_t n_, u8_t threshold_, std::vector<candidate>& rDst_)
+{
+	u32_t i = 0;
+#if defined(__SSE2__)
+	const __m128i threshold = _mm_set1_epi8(static_cast<char>(threshold_));
+	const __m128i zero = _mm_setzero_si128();
+	for (; (i + 16) <= n_; i += 16)
+	{
+		__m128i* pBlock = reinterpret_cast<__m128i*>(&pCount_[i]);
+		const __m128i count = _mm_loadu_si128(pBlock);
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(count, zero)) == 0xFFFF) continue;
+
+		// count >= threshold <=> max(count, threshold) == count (unsigned)
+		u32_t mask = static_cast<u32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(count, threshold), count)));
+		while (mask != 0)
+		{
+			const u32_t bit = static_cast<u32_t>(__builtin_ctz(static_cast<unsigned int>(mask)));
+			add_candidate(i + bit, pCount_[i + bit], rDst_);
+			mask &= (mask - 1);
+		}
+		_mm_storeu_si128(pBlock, zero);
+	}
+#endif
+	for (; i < n_; i++)
+	{
+		if (pCount_[i] >= threshold_) add_candidate(i, pCount_[i], rDst_);
+		pCount_[i] = 0;
+	}
+}
+
+bool match_better(const similarity_match& rLhs_, const similarity_match& rRhs_)
+{
+	if (rLhs_.score != rRhs_.score) return (rLhs_.score > rRhs_.score);
+	return (rLhs_.id < rRhs_.id);
+}
+
+}																// namespace
+
+//------------------------------------------------------------------------------------------------------//
+// Make Melody Fingerprint
+//------------------------------------------------------------------------------------------------------//
+bool smaf::make_fingerprint(const MA_3& rSrc_, fingerprint& rDst_)
+{
+	OPENMF_TRACE_SCOPE("make_fingerprint");
+
+	rDst_.tokens.clear();
+	rDst_.notes = 0;
+
+	const format_type fmt = rSrc_.get_format();
+	if (fmt != format_type::MOBILE_NO_COMPRESS) return false;
+
+	const timebase tb = rSrc_.get_timebase();
+	if (tb.D_ms() == 0) return false;
+
+	chunk_info info;
+	if (!rSrc_.find_chunk("Mtsq", info)) return false;
+
+	// (1) Melody (Highest Note at each Onset)
+	//
+	bool skip[MA_3::CHANNELS];
+	for (u32_t ch = 0; ch < MA_3::CHANNELS; ch++)
+	{
+		skip[ch] = (rSrc_.get_channel_status(ch).ch_type() == channel_status::TYPE_RHYTHM);
+	}
+	std::vector<melody_note> notes;
+	melody_visitor visitor(tb.D_ms(), skip, notes);
+	if (!walk_sequence(&rSrc_.data_ptr()[info.data_pos], info.size, visitor)) return false;
+	rDst_.notes = static_cast<u32_t>(notes.size());
+
+	// (2) Symbols (Interval and Ratio of Inter-Onset Times, from the 3rd Note)
+	//
+	if (notes.size() < (FINGERPRINT_NGRAM + 2)) return false;	// Too Short
+	std::vector<u8_t> symbols;
+	symbols.reserve(notes.size());
+	for (size_t i = 2; i < notes.size(); i++)
+	{
+		const s32_t interval = clamp(static_cast<s32_t>(notes[i].note) - static_cast<s32_t>(notes[i - 1].note), MAX_INTERVAL);
+		const f64_t ratio = static_cast<f64_t>(notes[i].time - notes[i - 1].time) / static_cast<f64_t>(notes[i - 1].time - notes[i - 2].time);
+		const s32_t rhythm = (ratio < (1.0 / RHYTHM_RATIO)) ? -1 : ((ratio > RHYTHM_RATIO) ? 1 : 0);
+		symbols.push_back(static_cast<u8_t>((interval + MAX_INTERVAL) * RHYTHM_STEPS + (rhythm + 1)));
+	}
+
+	// (3) Tokens (Smallest Hashes of the N-grams)
+	//
+	std::vector<u32_t>& tokens = rDst_.tokens;
+	tokens.reserve(symbols.size());
+	for (size_t i = 0; (i + FINGERPRINT_NGRAM) <= symbols.size(); i++)
+	{
+		u32_t gram = 0;
+		for (u32_t j = 0; j < FINGERPRINT_NGRAM; j++)
+		{
+			gram = ((gram << 8) | symbols[i + j]);
+		}
+		tokens.push_back(mix_token(gram));
+	}
+	std::sort(tokens.begin(), tokens.end());
+	tokens.erase(std::unique(tokens.begin(), tokens.end()), tokens.end());
+	if (tokens.size() > FINGERPRINT_TOKENS) tokens.resize(FINGERPRINT_TOKENS);
+	return true;
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Similarity Index Class
+//------------------------------------------------------------------------------------------------------//
+similarity_index::similarity_index()
+	: min_score(0.3)
+	, m_posting()
+	, m_id()
+	, m_tokens()
+{}
+
+similarity_index::~similarity_index()
+{}
+
+bool similarity_index::add(u64_t id_, const fingerprint& rPrint_)
+{
+	if (rPrint_.tokens.empty() || rPrint_.tokens.size() > FINGERPRINT_TOKENS) return false;
+	if (m_id.size() >= 0xFFFFFFFF) return false;
+
+	const u32_t number = static_cast<u32_t>(m_id.size());
+	for (size_t i = 0; i < rPrint_.tokens.size(); i++)
+	{
+		m_posting[rPrint_.tokens[i]].push_back(number);
+	}
+	m_id.push_back(id_);
+	m_tokens.push_back(static_cast<u8_t>(rPrint_.tokens.size()));
+	return true;
+}
+
+bool similarity_index::lookup(const fingerprint& rPrint_, u32_t max_results_, std::vector<similarity_match>& rDst_) const
+{
+	OPENMF_TRACE_SCOPE("similarity_lookup");
+	rDst_.clear();
+	if (rPrint_.tokens.empty() || rPrint_.tokens.size() > FINGERPRINT_TOKENS) return false;
+
+	// (1) Shared Tokens per Tune (Counts fit in 8bit, FINGERPRINT_TOKENS < 256)
+	//
+	thread_local std::vector<u8_t> count;
+	const u32_t n = static_cast<u32_t>(m_id.size());
+	if (count.size() < n) count.resize(n, 0);
+
+	for (size_t i = 0; i < rPrint_.tokens.size(); i++)
+	{
+		const posting_map::const_iterator it = m_posting.find(rPrint_.tokens[i]);
+		if (it == m_posting.end()) continue;
+		const std::vector<u32_t>& posting = it->second;
+		for (size_t j = 0; j < posting.size(); j++)
+		{
+			count[posting[j]]++;
+		}
+	}
+
+	// (2) Candidates (score <= shared / query tokens, so shared >= min_score * query tokens)
+	//
+	const u32_t query = static_cast<u32_t>(rPrint_.tokens.size());
+	f64_t threshold = std::ceil(min_score * query);
+	if (threshold < 1.0) threshold = 1.0;
+	if (threshold > query) threshold = query;
+	std::vector<candidate> candidates;
+	collect_candidates(count.data(), n, static_cast<u8_t>(threshold), candidates);
+
+	// (3) Score (Jaccard = shared / (query + tune - shared))
+	//
+	for (size_t i = 0; i < candidates.size(); i++)
+	{
+		const candidate& c = candidates[i];
+		similarity_match match;
+		match.id = m_id[c.number];
+		match.shared = c.shared;
+		match.score = static_cast<f64_t>(c.shared) / static_cast<f64_t>(query + m_tokens[c.number] - c.shared);
+		if (match.score >= min_score) rDst_.push_back(match);
+	}
+
+	if (rDst_.size() > max_results_)
+	{
+		std::partial_sort(rDst_.begin(), rDst_.begin() + max_results_, rDst_.end(), match_better);
+		rDst_.resize(max_results_);
+	}
+	else
+	{
+		std::sort(rDst_.begin(), rDst_.end(), match_better);
+	}
+	return true;
+}
+
+u32_t similarity_index::size() const
+{
+	return static_cast<u32_t>(m_id.size());
+}
+
+void similarity_index::clear()
+{
+	m_posting.clear();
+	m_id.clear();
+	m_tokens.clear();
+}
+
+//------------------------------------------------------------------------------------------------------//
+// End of File
+//------------------------------------------------------------------------------------------------------//
@@ -0,0 +1,94 @@
+//------------------------------------------------------------------------------------------------------//
+//
+//                                          License Agreement
+//                                     For Open Source SMAF Library
+//
+//                         Copyright (c) 2015-2017, @shirajira, all rights reserved.
+//
+//------------------------------------------------------------------------------------------------------//
+
+#ifndef openmf_fingerprint_h__
+#define openmf_fingerprint_h__
+#pragma once
+
+#include "core.h"
+#include <unordered_map>
+#include <vector>
+
+namespace smaf {
+
+//------------------------------------------------------------------------------------------------------//
+// Melody Fingerprint (struct)
+//
+// The melody is the highest note at each onset of the melody channels (rhythm channels are skipped).
+// Each step of the melody is a symbol of the interval [semitone] and the ratio of the inter-onset
+// times (shorter, same or longer). Times are in msec, so the symbols do not depend on the timebase,
+// the tempo, the transposition or the voices. The tokens are hashes of FINGERPRINT_NGRAM symbols,
+// and the smallest FINGERPRINT_TOKENS hashes are kept. (Sorted)
+//------------------------------------------------------------------------------------------------------//
+const u32_t FINGERPRINT_NGRAM = 4;								// Symbols per Token
+const u32_t FINGERPRINT_TOKENS = 128;							// Max Tokens per Fingerprint
+
+struct fingerprint
+{
+	std::vector<u32_t> tokens;									// Token Hashes (Sorted, Unique)
+	u32_t              notes;									// Notes in the Melody
+};
+
+//------------------------------------------------------------------------------------------------------//
+// Make Melody Fingerprint (format_type::MOBILE_NO_COMPRESS only)
+//------------------------------------------------------------------------------------------------------//
+bool make_fingerprint(const MA_3& rSrc_, fingerprint& rDst_);
+
+//------------------------------------------------------------------------------------------------------//
+// Similarity Match (struct)
+//------------------------------------------------------------------------------------------------------//
+struct similarity_match
+{
+	u64_t id;													// Tune ID
+	u32_t shared;												// Shared Tokens
+	f64_t score;												// Jaccard Similarity of the Tokens (0.0 - 1.0)
+};
+
+//------------------------------------------------------------------------------------------------------//
+// Similarity Index Class (Inverted Index of Fingerprint Tokens)
+//
+// Tunes are added incrementally. lookup may run concurrently, add must not run with other calls.
+//------------------------------------------------------------------------------------------------------//
+class similarity_index
+{
+public:
+	similarity_index();
+	virtual ~similarity_index();
+
+public:
+	// Add the fingerprint of the tune.
+	bool add(u64_t id_, const fingerprint& rPrint_);
+
+	// Find the tunes of score >= min_score. (Best first, up to max_results_)
+	bool lookup(const fingerprint& rPrint_, u32_t max_results_, std::vector<similarity_match>& rDst_) const;
+
+	// Return the number of tunes.
+	u32_t size() const;
+
+	// Clear all tunes.
+	void clear();
+
+public:
+	f64_t min_score;											// Min Score of Lookup (Default 0.3)
+
+private:
+	typedef std::unordered_map<u32_t, std::vector<u32_t> > posting_map;
+
+	posting_map        m_posting;								// Token -> Tune Numbers (Ascending)
+	std::vector<u64_t> m_id;									// Tune Number -> ID
+	std::vector<u8_t>  m_tokens;								// Tune Number -> Number of Tokens
+};
+
+//------------------------------------------------------------------------------------------------------//
+}																// namespace smaf
+
+#endif															// openmf_fingerprint_h__
+//------------------------------------------------------------------------------------------------------//
+// End of File
+//------------------------------------------------------------------------------------------------------//
@@ -0,0 +1,593 @@
+//------------------------------------------------------------------------------------------------------//
+//
+//                                          License Agreement
+//                                     For Open Source SMAF Library
+//
+//                         Copyright (c) 2015-2017, @shirajira, all rights reserved.
+//
+//------------------------------------------------------------------------------------------------------//
+
+#include "metadata.h"
+#include "apis.h"
+#include "batch_io.h"
+#include "catalog.h"
+#include "chunk.h"
+#include "sequence.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace smaf;
+
+//------------------------------------------------------------------------------------------------------//
+// Internal Helpers
+//------------------------------------------------------------------------------------------------------//
+namespace {
+
+const char  MAGIC[4] = { 'O', 'M', 'F', 'M' };					// Table Magic
+const u32_t VERSION = 1;										// Table Version
+const u32_t BYTE_ORDER_MARK = 0x0102;							// Byte Order Mark
+const u32_t HEAD_SIZE = 32;										// Header Size [byte]
+const u32_t DIRECTORY_SIZE = 32;								// Directory Entry Size [byte]
+const u32_t NAME_SIZE = 16;										// Column Name Size [byte]
+const u32_t ALIGNMENT = 8;										// Column Alignment [byte]
+const u32_t CATALOG_BLOCK = 256;								// Catalog Entries per Claim
+const u32_t CSV_BLOCK = (256 * 1024);							// CSV Write Block [byte]
+
+// Column of tune_metadata.
+struct column_def
+{
+	const char* szName;											// Column Name
+	u32_t       width;											// Column Width [byte]
+	size_t      offset;											// Field Offset in tune_metadata
+	u32_t       field_size;										// Field Size [byte]
+};
+
+#define METADATA_COLUMN(name_, field_, width_) { name_, width_, offsetof(tune_metadata, field_), sizeof(tune_metadata::field_) }
+#define METADATA_STATUS(n_) { "status_" #n_, 1, offsetof(tune_metadata, status) + n_, 1 }
+
+const column_def COLUMNS[] =
+{
+	METADATA_COLUMN("ok", ok, 1),
+	METADATA_COLUMN("size", size, 4),
+	METADATA_COLUMN("format", format, 1),
+	METADATA_COLUMN("d_ms", d_ms, 2),
+	METADATA_COLUMN("g_ms", g_ms, 2),
+	METADATA_STATUS(0), METADATA_STATUS(1), METADATA_STATUS(2), METADATA_STATUS(3),
+	METADATA_STATUS(4), METADATA_STATUS(5), METADATA_STATUS(6), METADATA_STATUS(7),
+	METADATA_STATUS(8), METADATA_STATUS(9), METADATA_STATUS(10), METADATA_STATUS(11),
+	METADATA_STATUS(12), METADATA_STATUS(13), METADATA_STATUS(14), METADATA_STATUS(15),
+	METADATA_COLUMN("content_class", content_class, 1),
+	METADATA_COLUMN("content_type", content_type, 1),
+	METADATA_COLUMN("code_type", code_type, 1),
+	METADATA_COLUMN("copy_status", copy_status, 1),
+	METADATA_COLUMN("copy_count", copy_count, 1),
+	METADATA_COLUMN("score_tracks", score_tracks, 1),
+	METADATA_COLUMN("audio_tracks", audio_tracks, 1),
+	METADATA_COLUMN("events", events, 4),
+	METADATA_COLUMN("notes", notes, 4),
+	METADATA_COLUMN("exclusives", exclusives, 4),
+	METADATA_COLUMN("exclusive_bytes", exclusive_bytes, 4),
+	METADATA_COLUMN("duration_ms", duration_ms, 4),
+	METADATA_COLUMN("crc_ok", crc_ok, 1)
+};
+
+#undef METADATA_COLUMN
+#undef METADATA_STATUS
+
+const u32_t COLUMN_COUNT = static_cast<u32_t>(sizeof(COLUMNS) / sizeof(COLUMNS[0]));
+
+// Integer of 1, 2, 4 or 8 bytes in host byte order.
+u64_t load_value(const u8_t* p_, u32_t size_)
+{
+	switch (size_)
+	{
+	case 1: return *p_;
+	case 2: { std::uint16_t v; std::memcpy(&v, p_, 2); return v; }
+	case 4: { std::uint32_t v; std::memcpy(&v, p_, 4); return v; }
+	default: { std::uint64_t v; std::memcpy(&v, p_, 8); return v; }
+	}
+}
+
+void store_value(u64_t value_, u32_t size_, u8_t* p_)
+{
+	switch (size_)
+	{
+	case 1: *p_ = static_cast<u8_t>(value_); break;
+	case 2: { const std::uint16_t v = static_cast<std::uint16_t>(value_); std::memcpy(p_, &v, 2); break; }
+	case 4: { const std::uint32_t v = static_cast<std::uint32_t>(value_); std::memcpy(p_, &v, 4); break; }
+	default: { const std::uint64_t v = value_; std::memcpy(p_, &v, 8); break; }
+	}
+}
+
+u64_t align_size(u64_t size_)
+{
+	return ((size_ + (ALIGNMENT - 1)) / ALIGNMENT) * ALIGNMENT;
+}
+
+void append_number(u64_t value_, std::string& rDst_)
+{
+	char buf[24];
+	u32_t len = 0;
+	do
+	{
+		buf[len++] = static_cast<char>('0' + (value_ % 10));
+		value_ /= 10;
+	} while (value_ != 0);
+	while (len > 0) rDst_ += buf[--len];
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Extraction (Internal)
+//------------------------------------------------------------------------------------------------------//
+
+// Count the events and find the end of the sequence. (Same end as the duration of catalog)
+struct metadata_visitor
+{
+	metadata_visitor(u32_t d_ms_, u32_t g_ms_, tune_metadata& rRow_)
+		: d_ms(d_ms_), g_ms(g_ms_), time(0), end(0), row(rRow_)
+	{}
+
+	bool duration(u32_t value_, u32_t /*pos_*/, u32_t /*len_*/)
+	{
+		time += (static_cast<u64_t>(value_) * d_ms);
+		if (time > end) end = time;
+		return true;
+	}
+
+	bool event(const u8_t* /*pEvent_*/, u32_t size_, const event_info& rInfo_)
+	{
+		if (rInfo_.kind == EK_EOS_NOP) return true;
+		row.events++;
+		if (rInfo_.kind == EK_NOTE) row.notes++;
+		if (rInfo_.kind == EK_EXCLUSIVE)
+		{
+			row.exclusives++;
+			row.exclusive_bytes += size_;
+		}
+		return true;
+	}
+
+	bool gatetime(u32_t value_, u32_t /*pos_*/, u32_t /*len_*/)
+	{
+		const u64_t note_end = (time + static_cast<u64_t>(value_) * g_ms);
+		if (note_end > end) end = note_end;
+		return true;
+	}
+
+	u32_t          d_ms;										// Duration's Timebase [ms]
+	u32_t          g_ms;										// Gatetime's Timebase [ms]
+	u64_t          time;										// Current Time [ms]
+	u64_t          end;											// End Time [ms]
+	tune_metadata& row;											// Counts
+};
+
+// Context of the walk.
+struct metadata_context
+{
+	tune_metadata* pRow;										// Row
+	u32_t          file_end;									// End of MMMD Data (0 = Not Found)
+	u32_t          track_begin;									// Data of the Current Score Track
+	u32_t          track_end;									// (track_begin == track_end: None)
+	u32_t          d_ms;										// Timebase of the Current Score Track [ms]
+	u32_t          g_ms;
+	bool           walk;										// Walk the Sequence of the Current Score Track
+	bool           first;										// The First Score Track is Found
+};
+
+walk_result metadata_file(const chunk_info& rInfo_, const u8_t* /*pAddr_*/, void* pContext_)
+{
+	metadata_context* pContext = static_cast<metadata_context*>(pContext_);
+	if (rInfo_.depth != 0 || pContext->file_end != 0) return WR_SKIP;
+	pContext->file_end = (rInfo_.data_pos + rInfo_.size);
+	return WR_CONTINUE;
+}
+
+walk_result metadata_contents(const chunk_info& rInfo_, const u8_t* pAddr_, void* pContext_)
+{
+	tune_metadata& row = *static_cast<metadata_context*>(pContext_)->pRow;
+	if (rInfo_.depth != 1 || rInfo_.size < 5) return WR_SKIP;
+
+	const u8_t* p = &pAddr_[rInfo_.data_pos];
+	row.content_class = p[0];
+	row.content_type = p[1];
+	row.code_type = p[2];
+	row.copy_status = p[3];
+	row.copy_count = p[4];
+	return WR_SKIP;
+}
+
+walk_result metadata_score(const chunk_info& rInfo_, const u8_t* pAddr_, void* pContext_)
+{
+	metadata_context* pContext = static_cast<metadata_context*>(pContext_);
+	tune_metadata& row = *pContext->pRow;
+	if (rInfo_.depth != 1) return WR_SKIP;
+	if (row.score_tracks < 0xFF) row.score_tracks++;
+
+	pContext->track_begin = rInfo_.data_pos;
+	pContext->track_end = (rInfo_.data_pos + rInfo_.size);
+	pContext->walk = false;
+	if (rInfo_.size < 4) return WR_SKIP;
+
+	// Format type, sequence type, timebase D/G and channel status.
+	const u8_t* p = &pAddr_[rInfo_.data_pos];
+	const timebase tb(p[2], p[3]);
+	if (!pContext->first)
+	{
+		pContext->first = true;
+		row.format = (p[0] <= MOBILE_NO_COMPRESS) ? p[0] : static_cast<u8_t>(FORMAT_RESERVED);
+		row.d_ms = static_cast<u16_t>(tb.D_ms());
+		row.g_ms = static_cast<u16_t>(tb.G_ms());
+		if (rInfo_.size >= (4 + MA_3::CHANNELS)) std::memcpy(row.status, &p[4], MA_3::CHANNELS);
+	}
+	pContext->d_ms = tb.D_ms();
+	pContext->g_ms = tb.G_ms();
+	pContext->walk = (p[0] == MOBILE_NO_COMPRESS && pContext->d_ms != 0);
+	return WR_CONTINUE;
+}
+
+walk_result metadata_audio(const chunk_info& rInfo_, const u8_t* /*pAddr_*/, void* pContext_)
+{
+	metadata_context* pContext = static_cast<metadata_context*>(pContext_);
+	tune_metadata& row = *pContext->pRow;
+	if (rInfo_.depth == 1 && row.audio_tracks < 0xFF) row.audio_tracks++;
+	return WR_SKIP;
+}
+
+walk_result metadata_sequence(const chunk_info& rInfo_, const u8_t* pAddr_, void* pContext_)
+{
+	metadata_context* pContext = static_cast<metadata_context*>(pContext_);
+	if (rInfo_.depth != 2 || !pContext->walk) return WR_SKIP;
+	if (rInfo_.pos < pContext->track_begin || rInfo_.pos >= pContext->track_end) return WR_SKIP;
+	pContext->walk = false;										// The First Sequence of the Track
+
+	tune_metadata& row = *pContext->pRow;
+	metadata_visitor visitor(pContext->d_ms, pContext->g_ms, row);
+	walk_sequence(&pAddr_[rInfo_.data_pos], rInfo_.size, visitor);
+	if (visitor.end > row.duration_ms) row.duration_ms = (visitor.end > 0xFFFFFFFF) ? 0xFFFFFFFF : static_cast<u32_t>(visitor.end);
+	return WR_SKIP;
+}
+
+walk_result metadata_skip(const chunk_info& /*rInfo_*/, const u8_t* /*pAddr_*/, void* /*pContext_*/)
+{
+	return WR_SKIP;
+}
+
+// Registry to extract the metadata. (Enters MMMD and MTR* only.)
+class metadata_registry : public chunk_registry
+{
+public:
+	metadata_registry()
+		: chunk_registry()
+	{
+		this->set_callback("MMMD", metadata_file);
+		this->set_callback("CNTI", metadata_contents);
+		this->set_callback("MTR*", metadata_score);
+		this->set_callback("ATR*", metadata_audio);
+		this->set_callback("Mtsq", metadata_sequence);
+		this->set_default_callback(metadata_skip);
+	}
+};
+
+// Context of the bulk extraction.
+struct bulk_context
+{
+	metadata_table* pTable;										// Table
+};
+
+bool bulk_callback(u32_t index_, MA_3& rData_, void* pContext_)
+{
+	bulk_context* pContext = static_cast<bulk_context*>(pContext_);
+	tune_metadata row;
+	const bool ok = extract_metadata(rData_, row);
+	pContext->pTable->set(index_, row);
+	return ok;
+}
+
+}																// namespace
+
+//------------------------------------------------------------------------------------------------------//
+// Extract Metadata
+//------------------------------------------------------------------------------------------------------//
+bool smaf::extract_metadata(const MA_3& rSrc_, tune_metadata& rDst_)
+{
+	OPENMF_TRACE_SCOPE("extract_metadata");
+	static const metadata_registry registry;
+
+	std::memset(&rDst_, 0, sizeof(rDst_));
+	rDst_.format = FORMAT_RESERVED;
+	if (rSrc_.empty() || rSrc_.size() <= MA_3::CRC_SIZE) return false;
+	rDst_.size = rSrc_.size();
+
+	metadata_context context;
+	std::memset(&context, 0, sizeof(context));
+	context.pRow = &rDst_;
+	if (!registry.walk(rSrc_.data_ptr(), rSrc_.size(), &context) || context.file_end == 0) return false;
+
+	const u32_t act_size = (rSrc_.size() - MA_3::CRC_SIZE);
+	const u16_t crc = static_cast<u16_t>((rSrc_.at(act_size) << 8) | rSrc_.at(act_size + 1));
+	rDst_.crc_ok = (calc_crc16(rSrc_.data_ptr(), act_size) == crc) ? 1 : 0;
+	rDst_.ok = 1;
+	return true;
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Metadata Table Class
+//------------------------------------------------------------------------------------------------------//
+metadata_table::metadata_table()
+	: m_column(COLUMN_COUNT)
+	, m_rows(0)
+{}
+
+metadata_table::~metadata_table()
+{}
+
+bool metadata_table::resize(u64_t rows_)
+{
+	for (u32_t c = 0; c < COLUMN_COUNT; c++)
+	{
+		m_column[c].assign(static_cast<size_t>(rows_ * COLUMNS[c].width), 0);
+	}
+	m_rows = rows_;
+	return true;
+}
+
+u64_t metadata_table::rows() const
+{
+	return m_rows;
+}
+
+bool metadata_table::set(u64_t row_, const tune_metadata& rRow_)
+{
+	if (row_ >= m_rows) return false;
+	const u8_t* pRow = reinterpret_cast<const u8_t*>(&rRow_);
+	for (u32_t c = 0; c < COLUMN_COUNT; c++)
+	{
+		const column_def& def = COLUMNS[c];
+		store_value(load_value(&pRow[def.offset], def.field_size), def.width, &m_column[c][static_cast<size_t>(row_ * def.width)]);
+	}
+	return true;
+}
+
+bool metadata_table::get(u64_t row_, tune_metadata& rRow_) const
+{
+	if (row_ >= m_rows) return false;
+	std::memset(&rRow_, 0, sizeof(rRow_));
+	u8_t* pRow = reinterpret_cast<u8_t*>(&rRow_);
+	for (u32_t c = 0; c < COLUMN_COUNT; c++)
+	{
+		const column_def& def = COLUMNS[c];
+		store_value(load_value(&m_column[c][static_cast<size_t>(row_ * def.width)], def.width), def.field_size, &pRow[def.offset]);
+	}
+	return true;
+}
+
+const u8_t* metadata_table::column(const char* szName_, u32_t& rWidth_) const
+{
+	for (u32_t c = 0; c < COLUMN_COUNT; c++)
+	{
+		if (std::strcmp(COLUMNS[c].szName, szName_) != 0) continue;
+		rWidth_ = COLUMNS[c].width;
+		return m_column[c].empty() ? nullptr : &m_column[c][0];
+	}
+	return nullptr;
+}
+
+bool metadata_table::write_csv(const char* szFile_, const char* const* pNames_) const
+{
+	OPENMF_TRACE_SCOPE("metadata_table::write_csv");
+	std::FILE* fp = std::fopen(szFile_, "wb");
+	if (fp == nullptr) return false;
+
+	std::string buf = (pNames_ != nullptr) ? "file" : "row";
+	for (u32_t c = 0; c < COLUMN_COUNT; c++)
+	{
+		buf += ',';
+		buf += COLUMNS[c].szName;
+	}
+	buf += '\n';
+
+	bool ok = true;
+	for (u64_t r = 0; ok && r < m_rows; r++)
+	{
+		if (pNames_ != nullptr)
+		{
+			// Quoted when the name has a comma, a quote or a line break.
+			const char* szName = pNames_[r];
+			if (std::strpbrk(szName, ",\"\r\n") == nullptr)
+			{
+				buf += szName;
+			}
+			else
+			{
+				buf += '"';
+				for (const char* p = szName; *p != '\0'; p++)
+				{
+					if (*p == '"') buf += '"';
+					buf += *p;
+				}
+				buf += '"';
+			}
+		}
+		else
+		{
+			append_number(r, buf);
+		}
+		for (u32_t c = 0; c < COLUMN_COUNT; c++)
+		{
+			const u32_t width = COLUMNS[c].width;
+			buf += ',';
+			append_number(load_value(&m_column[c][static_cast<size_t>(r * width)], width), buf);
+		}
+		buf += '\n';
+
+		if (buf.size() >= CSV_BLOCK)
+		{
+			ok = (std::fwrite(buf.data(), 1, buf.size(), fp) == buf.size());
+			buf.clear();
+		}
+	}
+	if (ok && !buf.empty()) ok = (std::fwrite(buf.data(), 1, buf.size(), fp) == buf.size());
+	ok = (std::fclose(fp) == 0) && ok;
+	return ok;
+}
+
+bool metadata_table::save(const char* szFile_) const
+{
+	OPENMF_TRACE_SCOPE("metadata_table::save");
+
+	// Header and directory.
+	std::vector<u8_t> head(HEAD_SIZE + COLUMN_COUNT * DIRECTORY_SIZE, 0);
+	std::memcpy(&head[0], MAGIC, sizeof(MAGIC));
+	store_value(VERSION, 2, &head[4]);
+	store_value(BYTE_ORDER_MARK, 2, &head[6]);
+	store_value(m_rows, 8, &head[8]);
+	store_value(COLUMN_COUNT, 4, &head[16]);
+
+	u64_t offset = align_size(head.size());
+	for (u32_t c = 0; c < COLUMN_COUNT; c++)
+	{
+		u8_t* p = &head[HEAD_SIZE + c * DIRECTORY_SIZE];
+		std::strncpy(reinterpret_cast<char*>(p), COLUMNS[c].szName, NAME_SIZE);
+		store_value(COLUMNS[c].width, 4, &p[16]);
+		store_value(offset, 8, &p[24]);
+		offset = align_size(offset + m_column[c].size());
+	}
+
+	// Written to a temporary file and renamed. (Readers never see a partial table.)
+	const std::string temp_file = std::string(szFile_) + ".tmp";
+	const int fd = ::open(temp_file.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) return false;
+
+	const u8_t padding[ALIGNMENT] = { 0 };
+	bool ok = write_all(fd, &head[0], head.size()) && write_all(fd, padding, align_size(head.size()) - head.size());
+	for (u32_t c = 0; ok && c < COLUMN_COUNT; c++)
+	{
+		const u64_t size = m_column[c].size();
+		ok = (size == 0 || write_all(fd, &m_column[c][0], size)) && write_all(fd, padding, align_size(size) - size);
+	}
+	ok = (::close(fd) == 0) && ok;
+	ok = ok && (std::rename(temp_file.c_str(), szFile_) == 0);
+	if (!ok) std::remove(temp_file.c_str());
+	return ok;
+}
+
+bool metadata_table::load(const char* szFile_)
+{
+	OPENMF_TRACE_SCOPE("metadata_table::load");
+	this->resize(0);
+
+	binary_array file;
+	if (!smaf::load(szFile_, file) || file.size() < HEAD_SIZE) return false;
+	const u8_t* p = file.data_ptr();
+	const u64_t file_size = file.size();
+
+	if (std::memcmp(p, MAGIC, sizeof(MAGIC)) != 0 || load_value(&p[4], 2) != VERSION || load_value(&p[6], 2) != BYTE_ORDER_MARK) return false;
+	const u64_t rows = load_value(&p[8], 8);
+	const u64_t columns = load_value(&p[16], 4);
+	if ((HEAD_SIZE + columns * DIRECTORY_SIZE) > file_size) return false;
+
+	// Columns are found by name. (Unknown columns are ignored, missing columns are an error.)
+	std::vector<const u8_t*> found(COLUMN_COUNT, nullptr);
+	for (u64_t n = 0; n < columns; n++)
+	{
+		const u8_t* pEntry = &p[HEAD_SIZE + n * DIRECTORY_SIZE];
+		char name[NAME_SIZE + 1];
+		std::memcpy(name, pEntry, NAME_SIZE);
+		name[NAME_SIZE] = '\0';
+		const u64_t width = load_value(&pEntry[16], 4);
+		const u64_t offset = load_value(&pEntry[24], 8);
+		for (u32_t c = 0; c < COLUMN_COUNT; c++)
+		{
+			if (std::strcmp(COLUMNS[c].szName, name) != 0) continue;
+			if (width != COLUMNS[c].width || offset > file_size || (rows * width) > (file_size - offset)) return false;
+			found[c] = &p[offset];
+		}
+	}
+	for (u32_t c = 0; c < COLUMN_COUNT; c++)
+	{
+		if (found[c] == nullptr) return false;
+	}
+
+	this->resize(rows);
+	for (u32_t c = 0; c < COLUMN_COUNT; c++)
+	{
+		if (!m_column[c].empty()) std::memcpy(&m_column[c][0], found[c], m_column[c].size());
+	}
+	return true;
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Extract Metadata of the Files
+//------------------------------------------------------------------------------------------------------//
+bool smaf::extract_metadata(const char* const* pFiles_, u32_t n_, metadata_table& rDst_, u32_t threads_)
+{
+	OPENMF_TRACE_SCOPE("extract_metadata_files");
+	if (pFiles_ == nullptr || !rDst_.resize(n_)) return false;
+
+	bulk_context context;
+	context.pTable = &rDst_;
+
+	batch_io io;
+	io.threads = threads_;
+	io.pProcess = bulk_callback;
+	io.pContext = &context;
+	return io.run(pFiles_, nullptr, n_) && (io.failed() == 0);
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Extract Metadata of the Catalog
+//------------------------------------------------------------------------------------------------------//
+bool smaf::extract_metadata(const catalog_reader& rCatalog_, metadata_table& rDst_, u32_t threads_)
+{
+	OPENMF_TRACE_SCOPE("extract_metadata_catalog");
+	const u64_t n = rCatalog_.size();
+	if (!rDst_.resize(n)) return false;
+
+	u32_t threads = (threads_ != 0) ? threads_ : static_cast<u32_t>(std::thread::hardware_concurrency());
+	if (threads == 0) threads = 1;
+	if (threads > ((n + CATALOG_BLOCK - 1) / CATALOG_BLOCK)) threads = static_cast<u32_t>((n + CATALOG_BLOCK - 1) / CATALOG_BLOCK);
+
+	// Blocks of entries are claimed in index order, so the views are read near in the data file.
+	std::atomic<u64_t> next(0);
+	std::atomic<u64_t> failed(0);
+	const auto worker = [&]() {
+		while (true)
+		{
+			const u64_t begin = next.fetch_add(CATALOG_BLOCK);
+			if (begin >= n) break;
+			const u64_t end = ((begin + CATALOG_BLOCK) < n) ? (begin + CATALOG_BLOCK) : n;
+			for (u64_t i = begin; i < end; i++)
+			{
+				catalog_entry entry;
+				MA_3 view;
+				tune_metadata row;
+				if (!rCatalog_.entry(i, entry) || !rCatalog_.get(entry.id, view) || !extract_metadata(view, row)) failed++;
+				else rDst_.set(i, row);
+			}
+		}
+	};
+
+	std::vector<std::thread> workers;
+	for (u32_t i = 1; i < threads; i++)
+	{
+		workers.push_back(std::thread(worker));
+	}
+	worker();
+	for (size_t i = 0; i < workers.size(); i++)
+	{
+		workers[i].join();
+	}
+	return (failed == 0);
+}
+
+//------------------------------------------------------------------------------------------------------//
+// End of File
+//------------------------------------------------------------------------------------------------------//
@@ -0,0 +1,119 @@
+//------------------------------------------------------------------------------------------------------//
+//
+//                                          License Agreement
+//                                     For Open Source SMAF Library
+//
+//                         Copyright (c) 2015-2017, @shirajira, all rights reserved.
+//
+//------------------------------------------------------------------------------------------------------//
+
+#ifndef openmf_metadata_h__
+#define openmf_metadata_h__
+#pragma once
+
+#include "core.h"
+#include <vector>
+
+namespace smaf {
+
+class catalog_reader;
+
+//------------------------------------------------------------------------------------------------------//
+// Tune Metadata (struct, One Row of metadata_table)
+//
+// Format, timebase and channel status are those of the first score track (same as MA_3::get_*).
+// Events are counted in the sequence data of all score tracks (Mobile(NoCompress) only), NOP and
+// EOS are not counted. The duration is the end of the longest track. (Durations and gatetimes)
+//------------------------------------------------------------------------------------------------------//
+struct tune_metadata
+{
+	u8_t  ok;													// Extracted (0 = Not Loaded or not SMAF)
+	u32_t size;													// Image Size [byte]
+	u8_t  format;												// Format Type
+	u16_t d_ms;													// Duration's Timebase [ms] (0 = Reserved)
+	u16_t g_ms;													// Gatetime's Timebase [ms] (0 = Reserved)
+	u8_t  status[16];											// Channel Status (MA_3::CHANNELS)
+	u8_t  content_class;										// CNTI: Contents Class
+	u8_t  content_type;											// CNTI: Contents Type
+	u8_t  code_type;											// CNTI: Contents Code Type
+	u8_t  copy_status;											// CNTI: Copy Status
+	u8_t  copy_count;											// CNTI: Copy Count
+	u8_t  score_tracks;											// Number of Score Tracks
+	u8_t  audio_tracks;											// Number of Audio Tracks
+	u32_t events;												// Number of Events
+	u32_t notes;												// Number of Notes
+	u32_t exclusives;											// Number of System Exclusives
+	u32_t exclusive_bytes;										// Size of System Exclusives [byte]
+	u32_t duration_ms;											// Duration [ms]
+	u8_t  crc_ok;												// CRC16 is Valid
+};
+
+//------------------------------------------------------------------------------------------------------//
+// Extract Metadata (Single Walk of the Chunk Tree and the Sequence Data)
+//------------------------------------------------------------------------------------------------------//
+bool extract_metadata(const MA_3& rSrc_, tune_metadata& rDst_);
+
+//------------------------------------------------------------------------------------------------------//
+// Metadata Table Class (Fixed Width Columns)
+//
+// Binary Format (Host Byte Order, Checked with the Byte Order Mark):
+//
+//   Header    : "OMFM", Version (2), Byte Order Mark 0x0102 (2), Rows (8), Columns (4), Reserved (12)
+//   Directory : Name (16, NUL Padded), Width (4), Reserved (4), Offset (8) per Column
+//   Columns   : rows * width bytes per Column (8 byte aligned)
+//
+// Rows can be set concurrently from different threads.
+//------------------------------------------------------------------------------------------------------//
+class metadata_table
+{
+public:
+	metadata_table();
+	virtual ~metadata_table();
+
+public:
+	// Allocate the rows. (Cleared, ok = 0)
+	bool resize(u64_t rows_);
+
+	// Return the number of rows.
+	u64_t rows() const;
+
+	// Set the row.
+	bool set(u64_t row_, const tune_metadata& rRow_);
+
+	// Get the row.
+	bool get(u64_t row_, tune_metadata& rRow_) const;
+
+	// Return the column. (nullptr = Unknown Name)
+	const u8_t* column(const char* szName_, u32_t& rWidth_) const;
+
+	// Write as CSV with a header line. (pNames_ = First Column, nullptr = Row Number)
+	bool write_csv(const char* szFile_, const char* const* pNames_ = nullptr) const;
+
+	// Save the binary columnar file.
+	bool save(const char* szFile_) const;
+
+	// Load the binary columnar file.
+	bool load(const char* szFile_);
+
+private:
+	std::vector<std::vector<u8_t> > m_column;					// Columns
+	u64_t                           m_rows;						// Number of Rows
+};
+
+//------------------------------------------------------------------------------------------------------//
+// Extract Metadata of the Files (Loaded with batch_io, Row n = pFiles_[n], threads_ = 0: Hardware Threads)
+//------------------------------------------------------------------------------------------------------//
+bool extract_metadata(const char* const* pFiles_, u32_t n_, metadata_table& rDst_, u32_t threads_ = 0);
+
+//------------------------------------------------------------------------------------------------------//
+// Extract Metadata of the Catalog (Row n = n-th Entry in ID Order, Views without Copy)
+//------------------------------------------------------------------------------------------------------//
+bool extract_metadata(const catalog_reader& rCatalog_, metadata_table& rDst_, u32_t threads_ = 0);
+
+//------------------------------------------------------------------------------------------------------//
+}																// namespace smaf
+
+#endif															// openmf_metadata_h__
+//------------------------------------------------------------------------------------------------------//
+// End of File
+//------------------------------------------------------------------------------------------------------//
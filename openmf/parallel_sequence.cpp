@@ -0,0 +1,222 @@
+//------------------------------------------------------------------------------------------------------//
+//
+//                                          License Agreement
+//                                     For Open Source SMAF Library
+//
+//                         Copyright (c) 2015-2017, @shirajira, all rights reserved.
+//
+//------------------------------------------------------------------------------------------------------//
+
+#include "parallel_sequence.h"
+
+using namespace smaf;
+
+//------------------------------------------------------------------------------------------------------//
+// Internal Helpers
+//------------------------------------------------------------------------------------------------------//
+namespace {
+
+const u32_t MIN_PART_SIZE = (64 * 1024);						// Min Chunk Size [byte]
+const u32_t SYNC_EVENTS = 16;									// Well Formed Events to Accept a Boundary
+const u32_t SYNC_WINDOW = 4096;									// Max Search for a Boundary [byte]
+const u32_t NO_BOUNDARY = 0xFFFFFFFF;							// Boundary not Found
+
+// Guessed events of a chunk.
+struct chunk_guess
+{
+	u32_t begin;												// Guessed Boundary (NO_BOUNDARY = None)
+	u32_t exit;													// First Event Boundary at or after the Chunk End
+	u64_t time;													// Total Duration from begin to exit [tick]
+	bool  valid;												// Events from begin to exit are Walkable
+};
+
+// Skip a duration, an event and a gatetime with the rules of walk_sequence.
+bool skip_event(const u8_t* pAddr_, u32_t size_, u32_t& rPos_, u64_t& rTime_)
+{
+	u32_t cnt = rPos_;
+	u32_t value;
+	u32_t len = check_variable_size(pAddr_, cnt, size_, value);	// Duration
+	if (len == 0) return false;									// Error
+	rTime_ += value;
+	cnt += len;
+	if (cnt < size_)
+	{
+		const event_info& info = EVENT_TABLE[pAddr_[cnt]];
+		const u32_t size = check_event(pAddr_, cnt, size_, info);
+		if (size == 0) return false;							// Error
+		cnt += size;
+		if (info.next_state == SS_GATETIME && cnt < size_)
+		{
+			len = check_variable_size(pAddr_, cnt, size_, value);	// Gatetime
+			if (len == 0) return false;							// Error
+			cnt += len;
+		}
+	}
+	rPos_ = cnt;
+	return true;
+}
+
+// Check that well formed events start at the position. (The rules of verify)
+bool is_boundary(const u8_t* pAddr_, u32_t size_, u32_t pos_)
+{
+	u32_t cnt = pos_;
+	for (u32_t n = 0; n < SYNC_EVENTS && cnt < size_; n++)
+	{
+		u32_t value;
+		u32_t len = check_variable_size(pAddr_, cnt, size_, value);	// Duration
+		if (len == 0) return false;
+		cnt += len;
+		if (cnt >= size_) return false;							// Duration without Event
+
+		const event_info& info = EVENT_TABLE[pAddr_[cnt]];
+		const u32_t size = check_event(pAddr_, cnt, size_, info);
+		if (size == 0) return false;
+		cnt += size;
+
+		if (info.next_state == SS_GATETIME)
+		{
+			len = check_variable_size(pAddr_, cnt, size_, value);	// Gatetime
+			if (len == 0) return false;
+			cnt += len;
+		}
+	}
+	return true;
+}
+
+// Guess the first boundary of the chunk and skim the events to the chunk end.
+void guess_chunk(const u8_t* pAddr_, u32_t size_, u32_t begin_, u32_t end_, chunk_guess& rGuess_)
+{
+	rGuess_.begin = NO_BOUNDARY;
+	rGuess_.exit = NO_BOUNDARY;
+	rGuess_.time = 0;
+	rGuess_.valid = false;
+
+	const u32_t limit = ((end_ - begin_) > SYNC_WINDOW) ? (begin_ + SYNC_WINDOW) : end_;
+	if (begin_ == 0) rGuess_.begin = 0;							// The First Chunk starts at the True Boundary
+	for (u32_t pos = begin_; pos < limit && rGuess_.begin == NO_BOUNDARY; pos++)
+	{
+		if (is_boundary(pAddr_, size_, pos)) rGuess_.begin = pos;
+	}
+	if (rGuess_.begin == NO_BOUNDARY) return;
+
+	u32_t pos = rGuess_.begin;
+	u64_t time = 0;
+	while (pos < end_)
+	{
+		if (!skip_event(pAddr_, size_, pos, time)) return;
+	}
+	rGuess_.exit = pos;
+	rGuess_.time = time;
+	rGuess_.valid = true;
+}
+
+// Walk from the true boundary to the chunk end. The guessed events are reused from the point where
+// both walks meet.
+bool repair_chunk(const u8_t* pAddr_, u32_t size_, u32_t end_, const chunk_guess& rGuess_, u32_t& rPos_, u64_t& rTime_)
+{
+	OPENMF_TRACE_COUNT("split_sequence.repairs", 1);
+
+	u32_t pos = rPos_;
+	u64_t time = 0;
+	if (rGuess_.valid)
+	{
+		u32_t guess_pos = rGuess_.begin;
+		u64_t guess_time = 0;
+		while (pos < end_ && guess_pos < end_)
+		{
+			if (pos == guess_pos)
+			{
+				rPos_ = rGuess_.exit;
+				rTime_ += (time + (rGuess_.time - guess_time));
+				return true;
+			}
+			if (pos < guess_pos)
+			{
+				if (!skip_event(pAddr_, size_, pos, time)) return false;
+			}
+			else
+			{
+				skip_event(pAddr_, size_, guess_pos, guess_time);	// Walkable (Checked by guess_chunk)
+			}
+		}
+	}
+	while (pos < end_)
+	{
+		if (!skip_event(pAddr_, size_, pos, time)) return false;
+	}
+	rPos_ = pos;
+	rTime_ += time;
+	return true;
+}
+
+}																// namespace
+
+//------------------------------------------------------------------------------------------------------//
+// Split Sequence Data (Mtsq) on Event Boundaries
+//------------------------------------------------------------------------------------------------------//
+bool smaf::split_sequence(const u8_t* pAddr_, u32_t size_, u32_t parts_, std::vector<sequence_range>& rDst_)
+{
+	OPENMF_TRACE_SCOPE("split_sequence");
+	rDst_.clear();
+
+	u32_t parts = (parts_ != 0) ? parts_ : static_cast<u32_t>(std::thread::hardware_concurrency());
+	if (parts > (size_ / MIN_PART_SIZE)) parts = (size_ / MIN_PART_SIZE);
+	if (parts == 0) parts = 1;
+
+	// (1) Guess the boundaries of the chunks concurrently.
+	//
+	std::vector<u32_t> chunk_end(parts);
+	for (u32_t i = 0; i < parts; i++)
+	{
+		chunk_end[i] = (i == (parts - 1)) ? size_ : static_cast<u32_t>((static_cast<u64_t>(size_) * (i + 1)) / parts);
+	}
+	std::vector<chunk_guess> guess(parts);
+	{
+		std::vector<std::thread> workers;
+		workers.reserve(parts - 1);
+		for (u32_t i = 1; i < parts; i++)
+		{
+			workers.push_back(std::thread([&, i]() {
+				guess_chunk(pAddr_, size_, chunk_end[i - 1], chunk_end[i], guess[i]);
+			}));
+		}
+		guess_chunk(pAddr_, size_, 0, chunk_end[0], guess[0]);
+		for (size_t i = 0; i < workers.size(); i++)
+		{
+			workers[i].join();
+		}
+	}
+
+	// (2) Validate the boundaries in order. (A guess is right when it starts at the true boundary.)
+	//
+	rDst_.resize(parts);
+	u32_t pos = 0;
+	u64_t time = 0;
+	for (u32_t i = 0; i < parts; i++)
+	{
+		sequence_range& range = rDst_[i];
+		range.begin = (pos < size_) ? pos : size_;
+		range.time = time;
+
+		if (pos < chunk_end[i])
+		{
+			const chunk_guess& rGuess = guess[i];
+			if (rGuess.valid && rGuess.begin == pos)
+			{
+				pos = rGuess.exit;
+				time += rGuess.time;
+			}
+			else if (!repair_chunk(pAddr_, size_, chunk_end[i], rGuess, pos, time))
+			{
+				rDst_.clear();
+				return false;
+			}
+		}
+		range.end = (pos < size_) ? pos : size_;
+	}
+	return true;
+}
+
+//------------------------------------------------------------------------------------------------------//
+// End of File
+//------------------------------------------------------------------------------------------------------//
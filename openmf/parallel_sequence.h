@@ -0,0 +1,81 @@
+//------------------------------------------------------------------------------------------------------//
+//
+//                                          License Agreement
+//                                     For Open Source SMAF Library
+//
+//                         Copyright (c) 2015-2017, @shirajira, all rights reserved.
+//
+//------------------------------------------------------------------------------------------------------//
+
+#ifndef openmf_parallel_sequence_h__
+#define openmf_parallel_sequence_h__
+#pragma once
+
+#include "sequence.h"
+#include <thread>
+#include <vector>
+
+namespace smaf {
+
+//------------------------------------------------------------------------------------------------------//
+// Sequence Range (struct)
+//------------------------------------------------------------------------------------------------------//
+struct sequence_range
+{
+	u32_t begin;												// Begin Position [byte] (Event Boundary)
+	u32_t end;													// End Position [byte] (Event Boundary)
+	u64_t time;													// Absolute Time at Begin [tick]
+};
+
+//------------------------------------------------------------------------------------------------------//
+// Split Sequence Data (Mtsq) on Event Boundaries
+//
+// The data is cut into parts_ chunks. Each thread syncs to the first position of its chunk where a
+// run of well formed events starts and skims the events to the end of the chunk. The boundaries are
+// validated in order from the start of the data. A wrong guess is repaired by walking from the true
+// boundary until it meets the guessed events, so the result is the same as a serial walk.
+// (parts_ = 0: Hardware Threads, small data gets fewer parts. Ranges may be empty.)
+//
+// Returns false when the event is invalid. (Same as walk_sequence)
+//------------------------------------------------------------------------------------------------------//
+bool split_sequence(const u8_t* pAddr_, u32_t size_, u32_t parts_, std::vector<sequence_range>& rDst_);
+
+//------------------------------------------------------------------------------------------------------//
+// Walk the Ranges of Sequence Data Concurrently
+//
+// pVisitors_[i] walks rRanges_[i] on its own thread. (See walk_sequence)
+// Positions passed to the visitor are relative to the begin of the range.
+//------------------------------------------------------------------------------------------------------//
+template<typename visitor_> bool walk_sequence_parallel(const u8_t* pAddr_, const std::vector<sequence_range>& rRanges_, visitor_* pVisitors_)
+{
+	const size_t n = rRanges_.size();
+	if (n == 0) return true;
+
+	std::vector<u8_t> result(n, 0);
+	std::vector<std::thread> workers;
+	workers.reserve(n - 1);
+	for (size_t i = 1; i < n; i++)
+	{
+		workers.push_back(std::thread([&, i]() {
+			const sequence_range& range = rRanges_[i];
+			result[i] = walk_sequence(&pAddr_[range.begin], (range.end - range.begin), pVisitors_[i]) ? 1 : 0;
+		}));
+	}
+	result[0] = walk_sequence(&pAddr_[rRanges_[0].begin], (rRanges_[0].end - rRanges_[0].begin), pVisitors_[0]) ? 1 : 0;
+
+	bool ok = (result[0] != 0);
+	for (size_t i = 1; i < n; i++)
+	{
+		workers[i - 1].join();
+		if (result[i] == 0) ok = false;
+	}
+	return ok;
+}
+
+//------------------------------------------------------------------------------------------------------//
+}																// namespace smaf
+
+#endif															// openmf_parallel_sequence_h__
+//------------------------------------------------------------------------------------------------------//
+// End of File
+//------------------------------------------------------------------------------------------------------//
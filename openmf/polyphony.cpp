@@ -0,0 +1,120 @@
+//------------------------------------------------------------------------------------------------------//
+//
+//                                          License Agreement
+//                                     For Open Source SMAF Library
+//
+//                         Copyright (c) 2015-2017, @shirajira, all rights reserved.
+//
+//------------------------------------------------------------------------------------------------------//
+
+#include "polyphony.h"
+#include "apis.h"
+#include "sequence.h"
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+using namespace smaf;
+
+//------------------------------------------------------------------------------------------------------//
+// Internal Helpers
+//------------------------------------------------------------------------------------------------------//
+namespace {
+
+// Sounding note. (Heap entry)
+struct sounding_note
+{
+	u64_t end;													// End Time [ms]
+	u8_t  channel;												// Channel
+};
+
+// Order of the heap. (The earliest end on the top)
+bool later_end(const sounding_note& rLhs_, const sounding_note& rRhs_)
+{
+	return (rLhs_.end > rRhs_.end);
+}
+
+}																// namespace
+
+//------------------------------------------------------------------------------------------------------//
+// Analyze Polyphony
+//------------------------------------------------------------------------------------------------------//
+bool smaf::analyze_polyphony(const MA_3& rSrc_, polyphony_info& rDst_)
+{
+	OPENMF_TRACE_SCOPE("analyze_polyphony");
+	std::memset(&rDst_, 0, sizeof(rDst_));
+
+	std::vector<track_info> tracks;
+	if (!enumerate_tracks(rSrc_, tracks)) return false;
+
+	const u8_t* pAddr = rSrc_.data_ptr();
+	std::vector<note_cursor> cursors;
+	cursors.reserve(tracks.size());
+	for (size_t i = 0; i < tracks.size(); i++)
+	{
+		const track_info& track = tracks[i];
+		if (track.audio || track.sequence_size_pos == 0 || track.size < 4) continue;
+		if (pAddr[track.data_pos] != MOBILE_NO_COMPRESS) continue;
+		const timebase tb(pAddr[track.data_pos + 2], pAddr[track.data_pos + 3]);
+		if (tb.D_ms() == 0 || tb.G_ms() == 0) continue;
+
+		note_cursor cursor;
+		cursor.reset(&pAddr[track.sequence_pos], track.sequence_size, tb.D_ms(), tb.G_ms());
+		if (cursor.error) return false;
+		cursors.push_back(cursor);
+	}
+	if (cursors.empty()) return false;
+
+	sounding_note heap[POLYPHONY_CAPACITY];
+	u32_t sounding = 0;
+	u32_t channel_sounding[16] = {};
+	while (true)
+	{
+		// The next note of the merged tracks. (The earlier track first on the same time)
+		note_cursor* pCursor = nullptr;
+		for (size_t i = 0; i < cursors.size(); i++)
+		{
+			if (!cursors[i].valid) continue;
+			if (pCursor == nullptr || cursors[i].start < pCursor->start) pCursor = &cursors[i];
+		}
+		if (pCursor == nullptr) break;
+
+		const u64_t start = pCursor->start;
+		const u64_t end = pCursor->end;
+		const u8_t ch = pCursor->channel;
+		pCursor->next();
+		if (pCursor->error) return false;
+		rDst_.notes++;
+
+		// Release the notes ended by the start.
+		while (sounding > 0 && heap[0].end <= start)
+		{
+			std::pop_heap(heap, heap + sounding, later_end);
+			sounding--;
+			channel_sounding[heap[sounding].channel]--;
+		}
+		if (end == start) continue;								// Gatetime 0
+		if (sounding == POLYPHONY_CAPACITY) return false;
+
+		heap[sounding].end = end;
+		heap[sounding].channel = ch;
+		sounding++;
+		std::push_heap(heap, heap + sounding, later_end);
+
+		if (sounding > rDst_.peak)
+		{
+			rDst_.peak = sounding;
+			rDst_.peak_ms = start;
+		}
+		if (++channel_sounding[ch] > rDst_.channel_peak[ch])
+		{
+			rDst_.channel_peak[ch] = channel_sounding[ch];
+			rDst_.channel_peak_ms[ch] = start;
+		}
+	}
+	return true;
+}
+
+//------------------------------------------------------------------------------------------------------//
+// End of File
+//------------------------------------------------------------------------------------------------------//
@@ -0,0 +1,53 @@
+//------------------------------------------------------------------------------------------------------//
+//
+//                                          License Agreement
+//                                     For Open Source SMAF Library
+//
+//                         Copyright (c) 2015-2017, @shirajira, all rights reserved.
+//
+//------------------------------------------------------------------------------------------------------//
+
+#ifndef openmf_polyphony_h__
+#define openmf_polyphony_h__
+#pragma once
+
+#include "core.h"
+
+namespace smaf {
+
+//------------------------------------------------------------------------------------------------------//
+// Polyphony Information (struct)
+//
+// A note sounds from its event time to event time + gatetime (Absolute Time [ms]). A note ending at
+// the start of another note does not overlap it, notes of gatetime 0 do not sound. Channels are the
+// channel numbers of the note messages, tracks are combined.
+//------------------------------------------------------------------------------------------------------//
+struct polyphony_info
+{
+	u32_t notes;												// Number of Notes
+	u32_t peak;													// Maximum Simultaneous Notes
+	u64_t peak_ms;												// Time of the Peak [ms] (The First)
+	u32_t channel_peak[16];										// Maximum Simultaneous Notes per Channel
+	u64_t channel_peak_ms[16];									// Time of the Peak per Channel [ms]
+};
+
+//------------------------------------------------------------------------------------------------------//
+// Maximum Simultaneous Notes of analyze_polyphony
+//------------------------------------------------------------------------------------------------------//
+const u32_t POLYPHONY_CAPACITY = 256;
+
+//------------------------------------------------------------------------------------------------------//
+// Analyze Polyphony (Every Score Track, Mobile(NoCompress) only)
+//
+// The score tracks are merged on the fly and swept once, the sounding notes are kept in a heap of
+// POLYPHONY_CAPACITY entries. (No allocation per note, false = More Notes than the Capacity)
+//------------------------------------------------------------------------------------------------------//
+bool analyze_polyphony(const MA_3& rSrc_, polyphony_info& rDst_);
+
+//------------------------------------------------------------------------------------------------------//
+}																// namespace smaf
+
+#endif															// openmf_polyphony_h__
+//------------------------------------------------------------------------------------------------------//
+// End of File
+//------------------------------------------------------------------------------------------------------//
@@ -0,0 +1,411 @@
+//------------------------------------------------------------------------------------------------------//
+//
+//                                          License Agreement
+//                                     For Open Source SMAF Library
+//
+//                         Copyright (c) 2015-2017, @shirajira, all rights reserved.
+//
+//------------------------------------------------------------------------------------------------------//
+
+#ifndef openmf_sequence_h__
+#define openmf_sequence_h__
+#pragma once
+
+#include "apis.h"
+#include "array_operations.h"
+#include <cstring>
+
+namespace smaf {
+
+//------------------------------------------------------------------------------------------------------//
+// Event Kind (enum)
+//------------------------------------------------------------------------------------------------------//
+enum event_kind
+{
+	EK_INVALID = 0,												// Invalid Status (Error)
+	EK_NOTE,													// Note Message (Gatetime follows)
+	EK_MESSAGE,													// Fixed Length Message (A0-EF)
+	EK_EXCLUSIVE,												// System Exclusive (F0 + Variable Size + Data)
+	EK_EOS_NOP,													// EOS (FF 2F 00) or NOP (FF 00)
+	EK_SYSTEM													// Other System Message (1byte)
+};
+
+//------------------------------------------------------------------------------------------------------//
+// Event Information (struct)
+//------------------------------------------------------------------------------------------------------//
+struct event_info
+{
+	u8_t length;												// Event Size [byte] (0 = Variable, see event_length)
+	u8_t next_state;											// Next State (sequence_state)
+	u8_t kind;													// Event Kind (event_kind)
+};
+
+constexpr event_info make_event_info(u32_t length_, sequence_state next_state_, event_kind kind_)
+{
+	return event_info{ static_cast<u8_t>(length_), static_cast<u8_t>(next_state_), static_cast<u8_t>(kind_) };
+}
+
+// Event information of the status byte.
+constexpr event_info status_event_info(u32_t status_)
+{
+	return (status_ < 0x80) ? make_event_info(0, SS_DURATION, EK_INVALID)
+		: (status_ < 0x90) ? make_event_info(2, SS_GATETIME, EK_NOTE)					// 8n: Note without Velocity
+		: (status_ < 0xA0) ? make_event_info(3, SS_GATETIME, EK_NOTE)					// 9n: Note with Velocity
+		: (status_ < 0xC0) ? make_event_info(3, SS_DURATION, EK_MESSAGE)				// An/Bn: Reserved, Control Change
+		: (status_ < 0xE0) ? make_event_info(2, SS_DURATION, EK_MESSAGE)				// Cn/Dn: Program Change, Reserved
+		: (status_ < 0xF0) ? make_event_info(3, SS_DURATION, EK_MESSAGE)				// En: Pitch Bend
+		: (status_ == SE_SYSTEM_EXCLUSIVE) ? make_event_info(0, SS_DURATION, EK_EXCLUSIVE)
+		: (status_ == SE_EOS_NOP) ? make_event_info(0, SS_DURATION, EK_EOS_NOP)
+		: make_event_info(1, SS_DURATION, EK_SYSTEM);
+}
+
+#define OPENMF_EVENT_ROW(h_) \
+	status_event_info(h_ + 0x0), status_event_info(h_ + 0x1), status_event_info(h_ + 0x2), status_event_info(h_ + 0x3), \
+	status_event_info(h_ + 0x4), status_event_info(h_ + 0x5), status_event_info(h_ + 0x6), status_event_info(h_ + 0x7), \
+	status_event_info(h_ + 0x8), status_event_info(h_ + 0x9), status_event_info(h_ + 0xA), status_event_info(h_ + 0xB), \
+	status_event_info(h_ + 0xC), status_event_info(h_ + 0xD), status_event_info(h_ + 0xE), status_event_info(h_ + 0xF)
+
+//------------------------------------------------------------------------------------------------------//
+// Event Table (Status -> Event Information, Built at Compile Time)
+//------------------------------------------------------------------------------------------------------//
+constexpr event_info EVENT_TABLE[256] =
+{
+	OPENMF_EVENT_ROW(0x00), OPENMF_EVENT_ROW(0x10), OPENMF_EVENT_ROW(0x20), OPENMF_EVENT_ROW(0x30),
+	OPENMF_EVENT_ROW(0x40), OPENMF_EVENT_ROW(0x50), OPENMF_EVENT_ROW(0x60), OPENMF_EVENT_ROW(0x70),
+	OPENMF_EVENT_ROW(0x80), OPENMF_EVENT_ROW(0x90), OPENMF_EVENT_ROW(0xA0), OPENMF_EVENT_ROW(0xB0),
+	OPENMF_EVENT_ROW(0xC0), OPENMF_EVENT_ROW(0xD0), OPENMF_EVENT_ROW(0xE0), OPENMF_EVENT_ROW(0xF0)
+};
+
+#undef OPENMF_EVENT_ROW
+
+static_assert(EVENT_TABLE[0x7F].kind == EK_INVALID, "event table: data byte");
+static_assert(EVENT_TABLE[0x85].length == 2 && EVENT_TABLE[0x85].next_state == SS_GATETIME, "event table: note");
+static_assert(EVENT_TABLE[0x9F].length == 3 && EVENT_TABLE[0x9F].next_state == SS_GATETIME, "event table: note");
+static_assert(EVENT_TABLE[0xB0].length == 3 && EVENT_TABLE[0xC0].length == 2 && EVENT_TABLE[0xD3].length == 2, "event table: message");
+static_assert(EVENT_TABLE[0xE0].length == 3 && EVENT_TABLE[0xF1].length == 1, "event table: message");
+static_assert(EVENT_TABLE[0xF0].kind == EK_EXCLUSIVE && EVENT_TABLE[0xFF].kind == EK_EOS_NOP, "event table: system");
+
+//------------------------------------------------------------------------------------------------------//
+// Return Event Size (0 = Error)
+//------------------------------------------------------------------------------------------------------//
+inline u32_t event_length(const u8_t* pAddr_, const event_info& rInfo_)
+{
+	if (rInfo_.length != 0) return rInfo_.length;
+
+	if (rInfo_.kind == EK_EXCLUSIVE)
+	{
+		u32_t len;
+		const u32_t info_size = calc_variable_size(&pAddr_[1], len);
+		return (1 + len + info_size);
+	}
+	if (rInfo_.kind == EK_EOS_NOP)
+	{
+		return (pAddr_[1] == 0x2F) ? MA_3::EOS_SIZE : MA_3::NOP_SIZE;
+	}
+	return 0;													// Error
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Calculate Variable Size (Inline for 1byte)
+//------------------------------------------------------------------------------------------------------//
+inline u32_t read_variable_size(const u8_t* pAddr_, u32_t& rLen_)
+{
+	OPENMF_TRACE_COUNT("vlq_decode", 1);
+	u32_t size = (pAddr_[0] & 0x7F);
+	u32_t len = 1;
+	while ((pAddr_[len - 1] & 0x80) && len < 4)
+	{
+		size = ((size << 7) | (pAddr_[len] & 0x7F));
+		len++;
+	}
+	rLen_ = len;
+	return size;
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Calculate Variable Size with Bounds Check (0 = Error)
+//
+// Returns the size of the variable size. It must end before end_ and be 4 bytes or less.
+//------------------------------------------------------------------------------------------------------//
+inline u32_t check_variable_size(const u8_t* pAddr_, u32_t pos_, u32_t end_, u32_t& rValue_)
+{
+	OPENMF_TRACE_COUNT("vlq_decode", 1);
+	u32_t value = 0;
+	for (u32_t len = 1; len <= 4; len++)
+	{
+		if (pos_ + len > end_) return 0;						// Overrun
+		const u8_t b = pAddr_[pos_ + len - 1];
+		value = ((value << 7) | (b & 0x7F));
+		if ((b & 0x80) == 0)
+		{
+			rValue_ = value;
+			return len;
+		}
+	}
+	return 0;													// Too Long
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Return Event Size with Bounds Check (0 = Error)
+//
+// The event at pos_ (< end_) must end before end_. Unknown meta events, a broken EOS and a data byte
+// of 0x80 or more are errors. (The rules of verify)
+//------------------------------------------------------------------------------------------------------//
+inline u32_t check_event(const u8_t* pAddr_, u32_t pos_, u32_t end_, const event_info& rInfo_)
+{
+	u32_t size = rInfo_.length;
+	if (rInfo_.kind == EK_EXCLUSIVE)
+	{
+		u32_t value;
+		const u32_t len = check_variable_size(pAddr_, (pos_ + 1), end_, value);
+		if (len == 0) return 0;
+		size = (1 + len + value);
+	}
+	else if (rInfo_.kind == EK_EOS_NOP)
+	{
+		if ((pos_ + 1) >= end_) return 0;
+		if (pAddr_[pos_ + 1] == 0x2F)
+		{
+			if ((pos_ + 2) >= end_ || pAddr_[pos_ + 2] != 0x00) return 0;
+			size = MA_3::EOS_SIZE;
+		}
+		else if (pAddr_[pos_ + 1] == 0x00)
+		{
+			size = MA_3::NOP_SIZE;
+		}
+		else
+		{
+			return 0;											// Unknown Meta Event
+		}
+	}
+	else if (rInfo_.kind == EK_INVALID)
+	{
+		return 0;												// Data Byte
+	}
+	if (size > (end_ - pos_)) return 0;							// Event Overrun
+	if (rInfo_.kind == EK_NOTE || rInfo_.kind == EK_MESSAGE)
+	{
+		const u8_t data = (size == 2) ? pAddr_[pos_ + 1] : (pAddr_[pos_ + 1] | pAddr_[pos_ + 2]);
+		if (data & 0x80) return 0;								// Data Byte Expected
+	}
+	return size;
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Walk Sequence Data (Mtsq)
+//
+// The visitor is resolved at compile time. (No indirect calls)
+//
+//   bool duration(u32_t value_, u32_t pos_, u32_t len_);
+//   bool event(const u8_t* pEvent_, u32_t size_, const event_info& rInfo_);
+//   bool gatetime(u32_t value_, u32_t pos_, u32_t len_);
+//
+// Events and variable sizes are bounds checked. (See check_event)
+// Returns false when the event is invalid or the visitor returns false.
+//------------------------------------------------------------------------------------------------------//
+template<typename visitor_> bool walk_sequence(const u8_t* pAddr_, u32_t size_, visitor_& rVisitor_)
+{
+	u32_t cnt = 0;
+	while (cnt < size_)
+	{
+		u32_t value;
+		u32_t len = check_variable_size(pAddr_, cnt, size_, value);	// Duration
+		if (len == 0) return false;								// Error
+		if (!rVisitor_.duration(value, cnt, len)) return false;
+		cnt += len;
+		if (cnt >= size_) break;
+
+		OPENMF_TRACE_COUNT("events", 1);
+		const event_info& info = EVENT_TABLE[pAddr_[cnt]];
+		const u32_t size = check_event(pAddr_, cnt, size_, info);
+		if (size == 0) return false;							// Error
+		if (!rVisitor_.event(&pAddr_[cnt], size, info)) return false;
+		cnt += size;
+		if (info.next_state != SS_GATETIME || cnt >= size_) continue;
+
+		len = check_variable_size(pAddr_, cnt, size_, value);	// Gatetime
+		if (len == 0) return false;								// Error
+		if (!rVisitor_.gatetime(value, cnt, len)) return false;
+		cnt += len;
+	}
+	return true;
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Scale Sequence Data on Absolute Time (Visitor for walk_sequence)
+//
+// new_time = round(time * num_ / den_). The rounding error is carried by the absolute time, so the
+// total length is exact. (pDst = nullptr: Measure the output size only.)
+//
+// A gatetime is scaled as the end of its note. When the gatetime's timebase differs from the
+// duration's, set_gatetime_ms gives both timebases of the input and the output.
+//------------------------------------------------------------------------------------------------------//
+struct scale_visitor
+{
+	scale_visitor(u64_t num_, u64_t den_, u8_t* pDst_, u64_t time_ = 0)
+		: num(num_), den(den_), half(den_ / 2), src_time(time_), dst_time(((time_ * num_) + (den_ / 2)) / den_), pDst(pDst_), pos(0)
+		, src_d_ms(1), src_g_ms(1), dst_d_ms(1), dst_g_ms(1)
+	{}
+
+	// Set the timebases [ms] of the input and the output. (num_ / den_ = src_d_ms_ / dst_d_ms_ / Tempo Ratio)
+	void set_gatetime_ms(u64_t src_d_ms_, u64_t src_g_ms_, u64_t dst_d_ms_, u64_t dst_g_ms_)
+	{
+		src_d_ms = src_d_ms_;
+		src_g_ms = src_g_ms_;
+		dst_d_ms = dst_d_ms_;
+		dst_g_ms = dst_g_ms_;
+	}
+
+	bool duration(u32_t value_, u32_t /*pos_*/, u32_t /*len_*/)
+	{
+		src_time += value_;
+		const u64_t time = (((src_time * num) + half) / den);
+		const u64_t duration = (time - dst_time);
+		if (duration > 0x0FFFFFFF) return false;				// Duration Overflow
+		dst_time = time;
+		this->write_variable_size(duration);
+		return true;
+	}
+	bool event(const u8_t* pEvent_, u32_t size_, const event_info& /*rInfo_*/)
+	{
+		if (pDst != nullptr)
+		{
+			for (u32_t i = 0; i < size_; i++)
+			{
+				pDst[pos + i] = pEvent_[i];
+			}
+		}
+		pos += size_;
+		return true;
+	}
+	bool gatetime(u32_t value_, u32_t /*pos_*/, u32_t /*len_*/)
+	{
+		u64_t gatetime = value_;
+		if (gatetime != 0)
+		{
+			// End of the note from dst_time on the output's duration ticks (x den x src_d_ms). The first
+			// term is the rounding error of dst_time, so the note ends where the durations put it.
+			const s64_t error = static_cast<s64_t>(src_time * num) - static_cast<s64_t>(dst_time * den);
+			const s64_t end = ((error * static_cast<s64_t>(src_d_ms)) + static_cast<s64_t>(gatetime * src_g_ms * num));
+			const u64_t scale = (den * src_d_ms * dst_g_ms);
+			gatetime = (end > 0) ? (((static_cast<u64_t>(end) * dst_d_ms) + (scale / 2)) / scale) : 0;
+			if (gatetime == 0) gatetime = 1;
+			if (gatetime > 0x0FFFFFFF) return false;			// Gatetime Overflow
+		}
+		this->write_variable_size(gatetime);
+		return true;
+	}
+	void write_variable_size(u64_t value_)
+	{
+		u8_t buf[4];											// For Variable Size (Measure Only)
+		u32_t len;
+		make_variable_size_array(static_cast<u32_t>(value_), (pDst != nullptr) ? &pDst[pos] : buf, len);
+		pos += len;
+	}
+
+	u64_t num;													// Numerator of Ratio
+	u64_t den;													// Denominator of Ratio
+	u64_t half;													// Half of Denominator (Rounding)
+	u64_t src_time;												// Absolute Time of Source [tick]
+	u64_t dst_time;												// Absolute Time of Output [tick]
+	u8_t* pDst;													// Output (nullptr = Measure Only)
+	u32_t pos;													// Output Size [byte]
+	u64_t src_d_ms;												// Duration's Timebase of Input [ms]
+	u64_t src_g_ms;												// Gatetime's Timebase of Input [ms]
+	u64_t dst_d_ms;												// Duration's Timebase of Output [ms]
+	u64_t dst_g_ms;												// Gatetime's Timebase of Output [ms]
+};
+
+//------------------------------------------------------------------------------------------------------//
+// Note Cursor (Steps through Sequence Data one Note at a Time, Same Steps as walk_sequence)
+//
+// Notes are on absolute time [ms] with the timebase of the track. The tail of the data is read through
+// a zero padded copy, so the cursor never reads over the end. (error = Invalid Event)
+//------------------------------------------------------------------------------------------------------//
+struct note_cursor
+{
+	static const u32_t TAIL_SIZE = 8;							// Padded Tail of the Sequence Data [byte]
+
+	// Start from the head of the sequence data and step to the first note.
+	void reset(const u8_t* pAddr_, u32_t size_, u32_t d_ms_, u32_t g_ms_)
+	{
+		pAddr = pAddr_;
+		size = size_;
+		pos = 0;
+		d_ms = d_ms_;
+		g_ms = g_ms_;
+		time = 0;
+		error = false;
+		next();
+	}
+
+	// Return the data at the position.
+	const u8_t* at(u8_t (&rTail_)[TAIL_SIZE]) const
+	{
+		if ((size - pos) >= TAIL_SIZE) return &pAddr[pos];
+		std::memset(rTail_, 0, TAIL_SIZE);
+		std::memcpy(rTail_, &pAddr[pos], (size - pos));
+		return rTail_;
+	}
+
+	// Step to the next note.
+	void next()
+	{
+		valid = false;
+		while (pos < size)
+		{
+			u8_t tail[TAIL_SIZE];
+			u32_t len;											// For Variable Size
+			time += (static_cast<u64_t>(read_variable_size(at(tail), len)) * d_ms);
+			pos += len;
+			if (pos >= size) break;
+
+			const u8_t* p = at(tail);
+			const u8_t status = p[0];
+			const event_info& info = EVENT_TABLE[status];
+			const u32_t event_size = event_length(p, info);
+			if (event_size == 0)
+			{
+				error = true;
+				return;
+			}
+			event_pos = pos;
+			pos += event_size;
+			if (info.next_state != SS_GATETIME || pos >= size) continue;
+
+			const u32_t gatetime = read_variable_size(at(tail), len);
+			gatetime_pos = pos;
+			gatetime_len = len;
+			pos += len;
+			start = time;
+			end = (time + static_cast<u64_t>(gatetime) * g_ms);
+			channel = static_cast<u8_t>(status & 0x0F);
+			valid = true;
+			return;
+		}
+	}
+
+	const u8_t* pAddr;											// Sequence Data
+	u32_t       size;											// Sequence Data Size [byte]
+	u32_t       pos;											// Current Position
+	u32_t       d_ms;											// Duration's Timebase [ms]
+	u32_t       g_ms;											// Gatetime's Timebase [ms]
+	u64_t       time;											// Current Time [ms]
+	u64_t       start;											// Start of the Current Note [ms]
+	u64_t       end;											// End of the Current Note [ms]
+	u32_t       event_pos;										// Position of the Note Message
+	u32_t       gatetime_pos;									// Position of the Gatetime
+	u32_t       gatetime_len;									// Gatetime Size [byte]
+	u8_t        channel;										// Channel of the Current Note
+	bool        valid;											// The Current Note is Valid
+	bool        error;											// Invalid Event
+};
+
+
+//------------------------------------------------------------------------------------------------------//
+}																// namespace smaf
+
+#endif															// openmf_sequence_h__
+//------------------------------------------------------------------------------------------------------//
+// End of File
+//------------------------------------------------------------------------------------------------------//
@@ -0,0 +1,855 @@
+//------------------------------------------------------------------------------------------------------//
+//
+//                                          License Agreement
+//                                     For Open Source SMAF Library
+//
+//                         Copyright (c) 2015-2017, @shirajira, all rights reserved.
+//
+//------------------------------------------------------------------------------------------------------//
+
+#include "service.h"
+#include "apis.h"
+#include "batch_io.h"
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace smaf;
+
+//------------------------------------------------------------------------------------------------------//
+// Internal Helpers
+//------------------------------------------------------------------------------------------------------//
+namespace {
+
+const char  MAGIC_REQUEST[4] = { 'O', 'M', 'F', 'Q' };			// Request Magic
+const char  MAGIC_RESPONSE[4] = { 'O', 'M', 'F', 'R' };			// Response Magic
+const u32_t VERSION = 2;										// Protocol Version
+const u32_t MAX_TEXT_SIZE = 4096;								// Max Operations/Path Size [byte]
+const u32_t MAX_INFO_SIZE = (1 << 20);							// Max Info Size [byte]
+const u32_t MAX_IMAGE_SIZE = 0x7FFFFFFF;						// Max Image Size [byte]
+const int   LISTEN_BACKLOG = 128;								// Pending Connections
+#if defined(F_SEAL_WRITE)
+// Seals of a Buffer
+const int   BUFFER_SEALS = (F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE);
+#endif
+
+enum request_kind
+{
+	SQ_PATH = 0,												// Load the File of the Path
+	SQ_BUFFER,													// Image in the passed memfd
+	SQ_STATS													// Statistics
+};
+
+enum response_kind
+{
+	SR_NONE = 0,												// No Output
+	SR_SHARED,													// Result in the passed memfd
+	SR_ERROR													// Failed (Info = Reason)
+};
+
+// Message header.
+struct message_head
+{
+	char          magic[4];										// "OMFQ" (Request) or "OMFR" (Response)
+	std::uint32_t version;										// Version
+	std::uint32_t kind;											// request_kind or response_kind
+	std::uint32_t size;											// Image Size [byte] (Buffer, Input, Shared, Stats)
+	std::uint32_t text_size;									// Operations (Request) or Info (Response) [byte]
+	std::uint32_t path_size;									// Path (Request) [byte]
+	std::uint32_t reserved[2];									// Reserved
+};
+
+static_assert(sizeof(message_head) == 32, "service: header size");
+
+u64_t now_ns()
+{
+	return static_cast<u64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+void make_head(const char* pMagic_, u32_t kind_, message_head& rHead_)
+{
+	std::memset(&rHead_, 0, sizeof(rHead_));
+	std::memcpy(rHead_.magic, pMagic_, 4);
+	rHead_.version = VERSION;
+	rHead_.kind = kind_;
+}
+
+bool send_all(int fd_, const u8_t* pData_, size_t size_)
+{
+	while (size_ > 0)
+	{
+		const ssize_t len = ::send(fd_, pData_, size_, MSG_NOSIGNAL);
+		if (len < 0 && errno == EINTR) continue;
+		if (len <= 0) return false;
+		pData_ += len;
+		size_ -= static_cast<size_t>(len);
+	}
+	return true;
+}
+
+bool recv_all(int fd_, u8_t* pData_, size_t size_)
+{
+	while (size_ > 0)
+	{
+		const ssize_t len = ::recv(fd_, pData_, size_, 0);
+		if (len < 0 && errno == EINTR) continue;
+		if (len <= 0) return false;
+		pData_ += len;
+		size_ -= static_cast<size_t>(len);
+	}
+	return true;
+}
+
+// Send the header and the texts. (fd_ >= 0: Passed with the first byte)
+bool send_message(int fd_, const message_head& rHead_, const std::string& rText_, const std::string& rPath_, int pass_fd_)
+{
+	std::string buf(reinterpret_cast<const char*>(&rHead_), sizeof(rHead_));
+	buf += rText_;
+	buf += rPath_;
+
+	const u8_t* pData = reinterpret_cast<const u8_t*>(buf.data());
+	size_t size = buf.size();
+	if (pass_fd_ >= 0)
+	{
+		struct iovec iov;
+		iov.iov_base = const_cast<u8_t*>(pData);
+		iov.iov_len = size;
+
+		union
+		{
+			char           buf[CMSG_SPACE(sizeof(int))];
+			struct cmsghdr align;
+		} control;
+		std::memset(&control, 0, sizeof(control));
+
+		struct msghdr msg;
+		std::memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = control.buf;
+		msg.msg_controllen = sizeof(control.buf);
+		struct cmsghdr* pCmsg = CMSG_FIRSTHDR(&msg);
+		pCmsg->cmsg_level = SOL_SOCKET;
+		pCmsg->cmsg_type = SCM_RIGHTS;
+		pCmsg->cmsg_len = CMSG_LEN(sizeof(int));
+		std::memcpy(CMSG_DATA(pCmsg), &pass_fd_, sizeof(int));
+
+		ssize_t len;
+		do
+		{
+			len = ::sendmsg(fd_, &msg, MSG_NOSIGNAL);
+		} while (len < 0 && errno == EINTR);
+		if (len <= 0) return false;
+		pData += len;
+		size -= static_cast<size_t>(len);
+	}
+	return send_all(fd_, pData, size);
+}
+
+// Receive the header and a passed descriptor. (false = Closed or Error)
+bool recv_head(int fd_, message_head& rHead_, int& rPassed_)
+{
+	rPassed_ = -1;
+
+	struct iovec iov;
+	iov.iov_base = &rHead_;
+	iov.iov_len = sizeof(rHead_);
+
+	union
+	{
+		char           buf[CMSG_SPACE(sizeof(int))];
+		struct cmsghdr align;
+	} control;
+
+	struct msghdr msg;
+	std::memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof(control.buf);
+
+	ssize_t len;
+	do
+	{
+		len = ::recvmsg(fd_, &msg, MSG_CMSG_CLOEXEC);
+	} while (len < 0 && errno == EINTR);
+	if (len <= 0) return false;
+
+	for (struct cmsghdr* pCmsg = CMSG_FIRSTHDR(&msg); pCmsg != nullptr; pCmsg = CMSG_NXTHDR(&msg, pCmsg))
+	{
+		if (pCmsg->cmsg_level == SOL_SOCKET && pCmsg->cmsg_type == SCM_RIGHTS && pCmsg->cmsg_len >= CMSG_LEN(sizeof(int)))
+		{
+			std::memcpy(&rPassed_, CMSG_DATA(pCmsg), sizeof(int));
+		}
+	}
+	if ((msg.msg_flags & MSG_CTRUNC) != 0 || !recv_all(fd_, reinterpret_cast<u8_t*>(&rHead_) + len, sizeof(rHead_) - static_cast<size_t>(len)))
+	{
+		if (rPassed_ >= 0) ::close(rPassed_);
+		rPassed_ = -1;
+		return false;
+	}
+	return true;
+}
+
+bool recv_text(int fd_, u32_t size_, std::string& rDst_)
+{
+	rDst_.resize(size_);
+	return (size_ == 0) || recv_all(fd_, reinterpret_cast<u8_t*>(&rDst_[0]), size_);
+}
+
+// Create shared memory of the size. (memfd allowing seals, or unlinked POSIX shared memory)
+int create_shared(u32_t size_)
+{
+#if defined(__linux__)
+	const int fd = ::memfd_create("openmf", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+#else
+	char name[64];
+	static std::atomic<u32_t> serial(0);
+	std::snprintf(name, sizeof(name), "/openmf.%ld.%lu", static_cast<long>(::getpid()), static_cast<unsigned long>(serial++));
+	const int fd = ::shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+	if (fd >= 0) ::shm_unlink(name);
+#endif
+	if (fd < 0) return -1;
+	if (::ftruncate(fd, static_cast<off_t>(size_)) != 0)
+	{
+		::close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+// Seal the buffer. (No Shrink, Grow or Write)
+bool seal_buffer(int fd_)
+{
+#if defined(F_SEAL_WRITE)
+	return (::fcntl(fd_, F_ADD_SEALS, BUFFER_SEALS) == 0);
+#else
+	(void)fd_;
+	return false;
+#endif
+}
+
+// Check the seals of the passed buffer.
+bool is_sealed_buffer(int fd_)
+{
+#if defined(F_SEAL_WRITE)
+	const int seals = ::fcntl(fd_, F_GET_SEALS);
+	return (seals >= 0 && (seals & BUFFER_SEALS) == BUFFER_SEALS);
+#else
+	(void)fd_;
+	return false;
+#endif
+}
+
+// Map the passed descriptor. (At least size_ bytes, nullptr = Error)
+void* map_shared(int fd_, u32_t size_, int flags_)
+{
+	struct stat st;
+	if (size_ == 0 || ::fstat(fd_, &st) != 0 || static_cast<u64_t>(st.st_size) < size_) return nullptr;
+	void* pMap = ::mmap(nullptr, size_, PROT_READ | PROT_WRITE, flags_, fd_, 0);
+	return (pMap == MAP_FAILED) ? nullptr : pMap;
+}
+
+// Latency bucket. (1us steps below 16us, then 8 steps per power of 2)
+u32_t latency_bucket(u64_t us_, u32_t buckets_)
+{
+	if (us_ < 16) return static_cast<u32_t>(us_);
+	u32_t e = 4;
+	while ((us_ >> (e + 1)) != 0) e++;
+	const u64_t index = 16 + ((e - 4) * 8) + ((us_ >> (e - 3)) & 7);
+	return (index < buckets_) ? static_cast<u32_t>(index) : (buckets_ - 1);
+}
+
+u64_t latency_upper(u32_t bucket_)
+{
+	if (bucket_ < 16) return bucket_;
+	const u32_t e = ((bucket_ - 16) / 8) + 4;
+	const u64_t sub = ((bucket_ - 16) % 8);
+	return (((8 + sub) << (e - 3)) + (static_cast<u64_t>(1) << (e - 3)) - 1);
+}
+
+}																// namespace
+
+//------------------------------------------------------------------------------------------------------//
+// Service Class
+//------------------------------------------------------------------------------------------------------//
+service::service()
+	: threads(0)
+	, pProcess(nullptr)
+	, pContext(nullptr)
+	, m_socket()
+	, m_listen(-1)
+	, m_stop(false)
+	, m_mutex()
+	, m_ready()
+	, m_queue()
+	, m_returned()
+	, m_requests(0)
+	, m_failed(0)
+	, m_connections(0)
+	, m_max_queue(0)
+	, m_busy(0)
+	, m_max_ns(0)
+{
+	m_wake[0] = -1;
+	m_wake[1] = -1;
+	for (u32_t i = 0; i < LATENCY_BUCKETS; i++)
+	{
+		m_latency[i] = 0;
+	}
+}
+
+service::~service()
+{
+	this->close();
+}
+
+bool service::open(const char* szSocket_)
+{
+	this->close();
+
+	struct sockaddr_un addr;
+	std::memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (szSocket_ == nullptr || std::strlen(szSocket_) >= sizeof(addr.sun_path)) return false;
+	std::strcpy(addr.sun_path, szSocket_);
+
+	// Only a stale socket is removed, never a file of another kind.
+	struct stat st;
+	if (::lstat(szSocket_, &st) == 0)
+	{
+		if (!S_ISSOCK(st.st_mode) || ::unlink(szSocket_) != 0) return false;
+	}
+	else if (errno != ENOENT)
+	{
+		return false;
+	}
+
+	m_listen = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (m_listen < 0) return false;
+
+	// The socket file is created with 0600, so only the owner can connect.
+	const mode_t mask = ::umask(0177);
+	const bool bound = (::bind(m_listen, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == 0);
+	::umask(mask);
+	if (bound) m_socket = szSocket_;
+	if (!bound || ::listen(m_listen, LISTEN_BACKLOG) != 0 || ::pipe2(m_wake, O_CLOEXEC | O_NONBLOCK) != 0)
+	{
+		this->close();
+		return false;
+	}
+	m_stop = false;
+	return true;
+}
+
+bool service::run()
+{
+	OPENMF_TRACE_SCOPE("service::run");
+	if (m_listen < 0 || pProcess == nullptr) return false;
+
+	u32_t n = (threads != 0) ? threads : static_cast<u32_t>(std::thread::hardware_concurrency());
+	if (n == 0) n = 1;
+	std::vector<std::thread> workers;
+	workers.reserve(n);
+	for (u32_t i = 0; i < n; i++)
+	{
+		workers.push_back(std::thread(&service::work, this));
+	}
+
+	// Idle connections are polled here, and a readable one is queued for the workers.
+	std::vector<int> idle, next_idle;
+	std::vector<struct pollfd> fds;
+	while (!m_stop)
+	{
+		fds.clear();
+		struct pollfd pfd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		pfd.fd = m_listen;
+		fds.push_back(pfd);
+		pfd.fd = m_wake[0];
+		fds.push_back(pfd);
+		for (size_t i = 0; i < idle.size(); i++)
+		{
+			pfd.fd = idle[i];
+			fds.push_back(pfd);
+		}
+
+		if (::poll(&fds[0], static_cast<nfds_t>(fds.size()), -1) < 0)
+		{
+			if (errno == EINTR) continue;
+			break;
+		}
+		const u64_t now = now_ns();
+
+		next_idle.clear();
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			for (size_t i = 0; i < idle.size(); i++)
+			{
+				if ((fds[i + 2].revents & (POLLIN | POLLHUP | POLLERR)) == 0)
+				{
+					next_idle.push_back(idle[i]);
+					continue;
+				}
+				pending job;
+				job.fd = idle[i];
+				job.ready_ns = now;
+				m_queue.push_back(job);
+				m_ready.notify_one();
+			}
+			if (m_queue.size() > m_max_queue) m_max_queue = m_queue.size();
+
+			if ((fds[1].revents & POLLIN) != 0)
+			{
+				char buf[64];
+				while (::read(m_wake[0], buf, sizeof(buf)) > 0) {}
+				next_idle.insert(next_idle.end(), m_returned.begin(), m_returned.end());
+				m_returned.clear();
+			}
+		}
+
+		if ((fds[0].revents & POLLIN) != 0)
+		{
+			const int fd = ::accept4(m_listen, nullptr, nullptr, SOCK_CLOEXEC);
+			if (fd >= 0)
+			{
+				next_idle.push_back(fd);
+				m_connections++;
+			}
+		}
+		idle.swap(next_idle);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_ready.notify_all();
+	for (size_t i = 0; i < workers.size(); i++)
+	{
+		workers[i].join();
+	}
+
+	for (size_t i = 0; i < idle.size(); i++)
+	{
+		::close(idle[i]);
+	}
+	for (size_t i = 0; i < m_queue.size(); i++)
+	{
+		::close(m_queue[i].fd);
+	}
+	for (size_t i = 0; i < m_returned.size(); i++)
+	{
+		::close(m_returned[i]);
+	}
+	m_queue.clear();
+	m_returned.clear();
+	m_connections = 0;
+	return true;
+}
+
+void service::stop()
+{
+	m_stop = true;
+	if (m_wake[1] >= 0)
+	{
+		const char c = 0;
+		const ssize_t len = ::write(m_wake[1], &c, 1);
+		(void)len;
+	}
+}
+
+void service::close()
+{
+	if (m_listen >= 0)
+	{
+		::close(m_listen);
+		::unlink(m_socket.c_str());
+		m_listen = -1;
+	}
+	for (u32_t i = 0; i < 2; i++)
+	{
+		if (m_wake[i] >= 0) ::close(m_wake[i]);
+		m_wake[i] = -1;
+	}
+	m_socket.clear();
+}
+
+void service::get_stats(service_stats& rDst_) const
+{
+	std::memset(&rDst_, 0, sizeof(rDst_));
+	rDst_.requests = m_requests;
+	rDst_.failed = m_failed;
+	rDst_.connections = m_connections;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		rDst_.queue_depth = m_queue.size();
+	}
+	rDst_.max_queue_depth = m_max_queue;
+	rDst_.busy = m_busy;
+	rDst_.max_us = (m_max_ns / 1000);
+
+	u64_t count[LATENCY_BUCKETS];
+	u64_t total = 0;
+	for (u32_t i = 0; i < LATENCY_BUCKETS; i++)
+	{
+		count[i] = m_latency[i];
+		total += count[i];
+	}
+	if (total == 0) return;
+
+	const u64_t rank[4] = { (total * 500 + 999) / 1000, (total * 900 + 999) / 1000, (total * 990 + 999) / 1000, (total * 999 + 999) / 1000 };
+	u64_t* pDst[4] = { &rDst_.p50_us, &rDst_.p90_us, &rDst_.p99_us, &rDst_.p999_us };
+	u64_t sum = 0;
+	u32_t k = 0;
+	for (u32_t i = 0; i < LATENCY_BUCKETS && k < 4; i++)
+	{
+		sum += count[i];
+		while (k < 4 && sum >= rank[k])
+		{
+			*pDst[k++] = latency_upper(i);
+		}
+	}
+}
+
+bool service::serve(int fd_, u64_t ready_ns_)
+{
+	message_head head;
+	int passed;
+	if (!recv_head(fd_, head, passed)) return false;
+
+	std::string ops, path;
+	if (std::memcmp(head.magic, MAGIC_REQUEST, 4) != 0 || head.version != VERSION
+		|| head.text_size > MAX_TEXT_SIZE || head.path_size > MAX_TEXT_SIZE
+		|| !recv_text(fd_, head.text_size, ops) || !recv_text(fd_, head.path_size, path))
+	{
+		if (passed >= 0) ::close(passed);
+		return false;											// Protocol Error
+	}
+
+	message_head response;
+	std::string info;
+	if (head.kind == SQ_STATS)
+	{
+		if (passed >= 0) ::close(passed);
+		service_stats stats;
+		this->get_stats(stats);
+		make_head(MAGIC_RESPONSE, SR_NONE, response);
+		response.size = sizeof(stats);
+		response.text_size = sizeof(stats);
+		return send_message(fd_, response, std::string(reinterpret_cast<const char*>(&stats), sizeof(stats)), std::string(), -1);
+	}
+
+	// The image is loaded from the path, or the sealed buffer is mapped private. (Edits stay in the service)
+	MA_3 data;
+	void* pMap = nullptr;
+	bool ok = false;
+	if (head.kind == SQ_PATH)
+	{
+		ok = load(path.c_str(), data);
+		if (!ok) info = "load";
+	}
+	else if (head.kind == SQ_BUFFER && passed >= 0 && head.size <= MAX_IMAGE_SIZE)
+	{
+		pMap = is_sealed_buffer(passed) ? map_shared(passed, head.size, MAP_PRIVATE) : nullptr;
+		ok = (pMap != nullptr && data.attach(static_cast<u8_t*>(pMap), head.size));
+		if (!ok) info = "buffer";
+	}
+	if (passed >= 0) ::close(passed);
+
+	if (ok && !verify(data.data_ptr(), data.size()))
+	{
+		info = "verify";
+		ok = false;
+	}
+	if (ok)
+	{
+		OPENMF_TRACE_SCOPE("service::process");
+		ok = pProcess(ops.c_str(), data, info, pContext);
+	}
+	if (info.size() > MAX_INFO_SIZE) info.resize(MAX_INFO_SIZE);
+
+	int result = -1;
+	if (!ok)
+	{
+		make_head(MAGIC_RESPONSE, SR_ERROR, response);
+	}
+	else if (data.empty())
+	{
+		make_head(MAGIC_RESPONSE, SR_NONE, response);
+	}
+	else
+	{
+		result = create_shared(data.size());
+		if (result >= 0 && write_all(result, data.data_ptr(), data.size()))
+		{
+			make_head(MAGIC_RESPONSE, SR_SHARED, response);
+			response.size = data.size();
+		}
+		else
+		{
+			make_head(MAGIC_RESPONSE, SR_ERROR, response);
+			info = "shared memory";
+			ok = false;
+		}
+	}
+	response.text_size = static_cast<std::uint32_t>(info.size());
+
+	data.release();
+	if (pMap != nullptr) ::munmap(pMap, head.size);
+	const bool sent = send_message(fd_, response, info, std::string(), (response.kind == SR_SHARED) ? result : -1);
+	if (result >= 0) ::close(result);
+	this->record(now_ns() - ready_ns_, ok && sent);
+	return sent;
+}
+
+void service::record(u64_t latency_ns_, bool ok_)
+{
+	m_latency[latency_bucket(latency_ns_ / 1000, LATENCY_BUCKETS)]++;
+	m_requests++;
+	if (!ok_) m_failed++;
+
+	u64_t max = m_max_ns;
+	while (latency_ns_ > max && !m_max_ns.compare_exchange_weak(max, latency_ns_)) {}
+}
+
+void service::work()
+{
+	while (true)
+	{
+		pending job;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_ready.wait(lock, [this]() { return (m_stop || !m_queue.empty()); });
+			if (m_stop) return;
+			job = m_queue.front();
+			m_queue.pop_front();
+		}
+
+		m_busy++;
+		const bool open = this->serve(job.fd, job.ready_ns);
+		m_busy--;
+
+		if (open)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_returned.push_back(job.fd);
+		}
+		else
+		{
+			::close(job.fd);
+			m_connections--;
+		}
+		const char c = 0;
+		const ssize_t len = ::write(m_wake[1], &c, 1);
+		(void)len;
+	}
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Service Result Class
+//------------------------------------------------------------------------------------------------------//
+service_result::service_result()
+	: m_view()
+	, m_pMap(nullptr)
+	, m_map_size(0)
+	, m_info()
+{}
+
+service_result::~service_result()
+{
+	this->release();
+}
+
+MA_3& service_result::data()
+{
+	return m_view;
+}
+
+const std::string& service_result::info() const
+{
+	return m_info;
+}
+
+void service_result::release()
+{
+	m_view.release();
+	if (m_pMap != nullptr) ::munmap(m_pMap, m_map_size);
+	m_pMap = nullptr;
+	m_map_size = 0;
+	m_info.clear();
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Service Client Class
+//------------------------------------------------------------------------------------------------------//
+service_client::service_client()
+	: m_fd(-1)
+{}
+
+service_client::~service_client()
+{
+	this->close();
+}
+
+bool service_client::connect(const char* szSocket_)
+{
+	this->close();
+
+	struct sockaddr_un addr;
+	std::memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (szSocket_ == nullptr || std::strlen(szSocket_) >= sizeof(addr.sun_path)) return false;
+	std::strcpy(addr.sun_path, szSocket_);
+
+	m_fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (m_fd < 0) return false;
+	if (::connect(m_fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0)
+	{
+		this->close();
+		return false;
+	}
+	return true;
+}
+
+void service_client::close()
+{
+	if (m_fd >= 0) ::close(m_fd);
+	m_fd = -1;
+}
+
+bool service_client::call(const char* szOps_, const char* szPath_, service_result& rDst_)
+{
+	OPENMF_TRACE_SCOPE("service_client::call");
+	rDst_.release();
+	if (m_fd < 0 || szOps_ == nullptr || szPath_ == nullptr) return false;
+
+	const std::string ops(szOps_), path(szPath_);
+	if (ops.size() > MAX_TEXT_SIZE || path.size() > MAX_TEXT_SIZE) return false;
+
+	message_head head;
+	make_head(MAGIC_REQUEST, SQ_PATH, head);
+	head.text_size = static_cast<std::uint32_t>(ops.size());
+	head.path_size = static_cast<std::uint32_t>(path.size());
+	if (!send_message(m_fd, head, ops, path, -1))
+	{
+		this->close();
+		return false;
+	}
+	return this->receive(rDst_);
+}
+
+bool service_client::call(const char* szOps_, const MA_3& rSrc_, service_result& rDst_)
+{
+	OPENMF_TRACE_SCOPE("service_client::call");
+	rDst_.release();
+	if (m_fd < 0 || szOps_ == nullptr || rSrc_.empty()) return false;
+
+	const std::string ops(szOps_);
+	if (ops.size() > MAX_TEXT_SIZE || rSrc_.size() > MAX_IMAGE_SIZE) return false;
+
+	// The image is written once to the memfd and sealed, and the service maps it.
+	const int fd = create_shared(rSrc_.size());
+	if (fd < 0) return false;
+	if (!write_all(fd, rSrc_.data_ptr(), rSrc_.size()) || !seal_buffer(fd))
+	{
+		::close(fd);
+		return false;
+	}
+
+	message_head head;
+	make_head(MAGIC_REQUEST, SQ_BUFFER, head);
+	head.size = rSrc_.size();
+	head.text_size = static_cast<std::uint32_t>(ops.size());
+	const bool sent = send_message(m_fd, head, ops, std::string(), fd);
+	::close(fd);
+	if (!sent)
+	{
+		this->close();
+		return false;
+	}
+	return this->receive(rDst_);
+}
+
+bool service_client::query(service_stats& rDst_)
+{
+	if (m_fd < 0) return false;
+
+	message_head head;
+	make_head(MAGIC_REQUEST, SQ_STATS, head);
+	if (!send_message(m_fd, head, std::string(), std::string(), -1))
+	{
+		this->close();
+		return false;
+	}
+
+	int passed;
+	if (!recv_head(m_fd, head, passed))
+	{
+		this->close();
+		return false;
+	}
+	if (passed >= 0) ::close(passed);
+	if (std::memcmp(head.magic, MAGIC_RESPONSE, 4) != 0 || head.size != sizeof(rDst_) || head.text_size != sizeof(rDst_)
+		|| !recv_all(m_fd, reinterpret_cast<u8_t*>(&rDst_), sizeof(rDst_)))
+	{
+		this->close();
+		return false;
+	}
+	return true;
+}
+
+bool service_client::receive(service_result& rDst_)
+{
+	message_head head;
+	int passed;
+	bool ok = recv_head(m_fd, head, passed);
+	ok = (ok && std::memcmp(head.magic, MAGIC_RESPONSE, 4) == 0 && head.version == VERSION && head.text_size <= MAX_INFO_SIZE);
+	ok = (ok && recv_text(m_fd, head.text_size, rDst_.m_info));
+	if (!ok)
+	{
+		if (passed >= 0) ::close(passed);
+		this->close();
+		return false;
+	}
+
+	// The result is taken over with the mapping of the passed memfd.
+	switch (head.kind)
+	{
+	case SR_SHARED:
+		rDst_.m_pMap = (passed >= 0) ? map_shared(passed, head.size, MAP_PRIVATE) : nullptr;
+		ok = (rDst_.m_pMap != nullptr);
+		if (ok)
+		{
+			rDst_.m_map_size = head.size;
+			rDst_.m_view.attach(static_cast<u8_t*>(rDst_.m_pMap), head.size);
+		}
+		break;
+
+	case SR_NONE:
+		ok = true;
+		break;
+
+	default:
+		ok = false;												// SR_ERROR (Info = Reason)
+		break;
+	}
+
+	if (passed >= 0) ::close(passed);
+	return ok;
+}
+
+//------------------------------------------------------------------------------------------------------//
+// End of File
+//------------------------------------------------------------------------------------------------------//
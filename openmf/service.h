@@ -0,0 +1,205 @@
+//------------------------------------------------------------------------------------------------------//
+//
+//                                          License Agreement
+//                                     For Open Source SMAF Library
+//
+//                         Copyright (c) 2015-2017, @shirajira, all rights reserved.
+//
+//------------------------------------------------------------------------------------------------------//
+
+#ifndef openmf_service_h__
+#define openmf_service_h__
+#pragma once
+
+#include "core.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace smaf {
+
+//------------------------------------------------------------------------------------------------------//
+// Service Protocol (Unix Domain Socket, Local Host Only, Host Byte Order)
+//
+//   Request  : Head ("OMFQ") + Operations + Path      (Buffer: Sealed memfd of the image in SCM_RIGHTS)
+//   Response : Head ("OMFR") + Info                    (Shared: memfd of the result in SCM_RIGHTS)
+//
+// A buffer is sealed by the client (No Shrink, Grow or Write) and mapped private by the service, so the
+// image can not change while it is verified and processed, and a failed request leaves it as it was.
+// A result is written once to a new memfd. A connection carries any number of requests in order.
+//------------------------------------------------------------------------------------------------------//
+
+//------------------------------------------------------------------------------------------------------//
+// Service Callback (Run the Operations on rData_, Called concurrently from the Workers)
+//
+// rInfo_ is returned as text. Release rData_ when the operations have no output. (Read Only)
+//------------------------------------------------------------------------------------------------------//
+typedef bool (*service_callback)(const char* szOps_, MA_3& rData_, std::string& rInfo_, void* pContext_);
+
+//------------------------------------------------------------------------------------------------------//
+// Service Statistics (Latency = From the Request is Readable to the Response is Sent)
+//------------------------------------------------------------------------------------------------------//
+struct service_stats
+{
+	u64_t requests;												// Completed Requests
+	u64_t failed;												// Failed Requests
+	u64_t connections;											// Open Connections
+	u64_t queue_depth;											// Requests waiting for a Worker
+	u64_t max_queue_depth;										// Max Queue Depth
+	u64_t busy;													// Busy Workers
+	u64_t p50_us;												// Latency Percentiles [us] (Upper Bound of the Bucket)
+	u64_t p90_us;
+	u64_t p99_us;
+	u64_t p999_us;
+	u64_t max_us;												// Max Latency [us]
+};
+
+//------------------------------------------------------------------------------------------------------//
+// Service Class (Long Running, Shared Worker Pool)
+//------------------------------------------------------------------------------------------------------//
+class service
+{
+public:
+	service();
+	virtual ~service();
+
+private:
+	service(const service&);
+	service& operator=(const service&);
+
+public:
+	// Listen on the socket. (Owner Only, An existing socket file is replaced, Other files are kept.)
+	bool open(const char* szSocket_);
+
+	// Serve the requests until stop. (Blocking)
+	bool run();
+
+	// Stop run. (Any thread, async signal safe)
+	void stop();
+
+	// Close the socket and remove the socket file.
+	void close();
+
+	// Return the statistics.
+	void get_stats(service_stats& rDst_) const;
+
+public:
+	u32_t            threads;									// Number of Workers (0 = Hardware Threads)
+	service_callback pProcess;									// Process Callback
+	void*            pContext;									// Context for Callback
+
+private:
+	// Serve one request of the connection. (false = Closed)
+	bool serve(int fd_, u64_t ready_ns_);
+
+	// Record the latency of the request.
+	void record(u64_t latency_ns_, bool ok_);
+
+	// Worker thread.
+	void work();
+
+private:
+	static const u32_t LATENCY_BUCKETS = 512;					// Latency Histogram Buckets
+
+	struct pending
+	{
+		int   fd;												// Connection
+		u64_t ready_ns;											// Time the Request became Readable [ns]
+	};
+
+	std::string             m_socket;							// Socket File
+	int                     m_listen;							// Listening Socket (-1 = Closed)
+	int                     m_wake[2];							// Wake Pipe of run
+	std::atomic<bool>       m_stop;								// Stop Request
+	mutable std::mutex      m_mutex;							// Mutex for Queues
+	std::condition_variable m_ready;							// Signal for Workers
+	std::deque<pending>     m_queue;							// Requests waiting for a Worker
+	std::vector<int>        m_returned;							// Connections returned by the Workers
+	std::atomic<u64_t>      m_latency[LATENCY_BUCKETS];			// Latency Histogram
+	std::atomic<u64_t>      m_requests;							// Completed Requests
+	std::atomic<u64_t>      m_failed;							// Failed Requests
+	std::atomic<u64_t>      m_connections;						// Open Connections
+	std::atomic<u64_t>      m_max_queue;						// Max Queue Depth
+	std::atomic<u64_t>      m_busy;								// Busy Workers
+	std::atomic<u64_t>      m_max_ns;							// Max Latency [ns]
+};
+
+//------------------------------------------------------------------------------------------------------//
+// Service Result (Mapping of the Result, Released with the Object)
+//------------------------------------------------------------------------------------------------------//
+class service_result
+{
+public:
+	service_result();
+	virtual ~service_result();
+
+private:
+	service_result(const service_result&);
+	service_result& operator=(const service_result&);
+
+public:
+	// Return the result. (View of the shared memory, Empty = No Output)
+	MA_3& data();
+
+	// Return the info.
+	const std::string& info() const;
+
+	// Unmap the result.
+	void release();
+
+private:
+	friend class service_client;
+
+	MA_3        m_view;											// Result
+	void*       m_pMap;											// Mapping (nullptr = None)
+	u64_t       m_map_size;										// Mapping Size [byte]
+	std::string m_info;											// Info
+};
+
+//------------------------------------------------------------------------------------------------------//
+// Service Client Class
+//------------------------------------------------------------------------------------------------------//
+class service_client
+{
+public:
+	service_client();
+	virtual ~service_client();
+
+private:
+	service_client(const service_client&);
+	service_client& operator=(const service_client&);
+
+public:
+	// Connect to the service.
+	bool connect(const char* szSocket_);
+
+	// Close the connection.
+	void close();
+
+	// Run the operations on the file. (Loaded by the service, use an absolute path)
+	bool call(const char* szOps_, const char* szPath_, service_result& rDst_);
+
+	// Run the operations on the image. (Passed in a sealed memfd, no copy in the service)
+	bool call(const char* szOps_, const MA_3& rSrc_, service_result& rDst_);
+
+	// Query the statistics of the service.
+	bool query(service_stats& rDst_);
+
+private:
+	// Receive the response.
+	bool receive(service_result& rDst_);
+
+private:
+	int m_fd;													// Connection (-1 = Closed)
+};
+
+//------------------------------------------------------------------------------------------------------//
+}																// namespace smaf
+
+#endif															// openmf_service_h__
+//------------------------------------------------------------------------------------------------------//
+// End of File
+//------------------------------------------------------------------------------------------------------//
@@ -0,0 +1,32 @@
+//------------------------------------------------------------------------------------------------------//
+//
+//                                          License Agreement
+//                                     For Open Source SMAF Library
+//
+//                         Copyright (c) 2015-2017, @shirajira, all rights reserved.
+//
+//------------------------------------------------------------------------------------------------------//
+
+#ifndef openmf_sjis_table_h__
+#define openmf_sjis_table_h__
+#pragma once
+
+#include "basic_type.h"
+
+namespace smaf {
+
+//------------------------------------------------------------------------------------------------------//
+// Shift-JIS (CP932) Double Byte Table (Internal, for text.cpp)
+//------------------------------------------------------------------------------------------------------//
+const u32_t SJIS_LEADS = 60;									// Lead Bytes 0x81-0x9F, 0xE0-0xFC
+const u32_t SJIS_TRAILS = 188;									// Trail Bytes 0x40-0x7E, 0x80-0xFC
+
+extern const u16_t SJIS_TABLE[SJIS_LEADS * SJIS_TRAILS];		// Code Points (0 = Unmapped)
+
+//------------------------------------------------------------------------------------------------------//
+}																// namespace smaf
+
+#endif															// openmf_sjis_table_h__
+//------------------------------------------------------------------------------------------------------//
+// End of File
+//------------------------------------------------------------------------------------------------------//
@@ -0,0 +1,744 @@
+//------------------------------------------------------------------------------------------------------//
+//
+//                                          License Agreement
+//                                     For Open Source SMAF Library
+//
+//                         Copyright (c) 2015-2017, @shirajira, all rights reserved.
+//
+//------------------------------------------------------------------------------------------------------//
+
+#include "text.h"
+#include "apis.h"
+#include "array_operations.h"
+#include "chunk.h"
+#include "sjis_table.h"
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace smaf;
+
+//------------------------------------------------------------------------------------------------------//
+// Internal Helpers
+//------------------------------------------------------------------------------------------------------//
+namespace {
+
+const u32_t CONTENTS_INFO_SIZE = 5;								// Class, Type, Code Type, Copy Status, Copy Count
+const u32_t CODE_TYPE_POS = 2;									// Position of Code Type in CNTI
+const u32_t ITEM_HEAD_SIZE = 4;									// Dch* Item: Tag (2), Size (2)
+const u32_t MAX_ITEM_SIZE = 0xFFFF;								// Dch* Item Size [byte]
+const u8_t  NO_DATA_CODE = 0xFF;								// No Dch*
+const u32_t REPLACEMENT = 0xFFFD;								// Replacement Character
+
+// Lead byte of a double byte character.
+inline bool is_sjis_lead(u8_t c_)
+{
+	return ((c_ >= 0x81 && c_ <= 0x9F) || (c_ >= 0xE0 && c_ <= 0xFC));
+}
+
+// Trail byte of a double byte character.
+inline bool is_sjis_trail(u8_t c_)
+{
+	return (c_ >= 0x40 && c_ <= 0xFC && c_ != 0x7F);
+}
+
+// Index of the double byte character in SJIS_TABLE.
+inline u32_t sjis_index(u8_t lead_, u8_t trail_)
+{
+	const u32_t row = (lead_ < 0xA0) ? (lead_ - 0x81) : (lead_ - 0xC1);
+	const u32_t col = (trail_ < 0x80) ? (trail_ - 0x40) : (trail_ - 0x41);
+	return (row * SJIS_TRAILS + col);
+}
+
+// UTF-8 of a double byte character.
+struct utf8_char
+{
+	u8_t bytes[3];												// UTF-8 (Padded with 0)
+	u8_t size;													// Size [byte]
+};
+
+// Write the code point as UTF-8.
+inline char* put_utf8(u32_t cp_, char* p_)
+{
+	if (cp_ < 0x80)
+	{
+		*p_++ = static_cast<char>(cp_);
+	}
+	else if (cp_ < 0x800)
+	{
+		*p_++ = static_cast<char>(0xC0 | (cp_ >> 6));
+		*p_++ = static_cast<char>(0x80 | (cp_ & 0x3F));
+	}
+	else if (cp_ < 0x10000)
+	{
+		*p_++ = static_cast<char>(0xE0 | (cp_ >> 12));
+		*p_++ = static_cast<char>(0x80 | ((cp_ >> 6) & 0x3F));
+		*p_++ = static_cast<char>(0x80 | (cp_ & 0x3F));
+	}
+	else
+	{
+		*p_++ = static_cast<char>(0xF0 | (cp_ >> 18));
+		*p_++ = static_cast<char>(0x80 | ((cp_ >> 12) & 0x3F));
+		*p_++ = static_cast<char>(0x80 | ((cp_ >> 6) & 0x3F));
+		*p_++ = static_cast<char>(0x80 | (cp_ & 0x3F));
+	}
+	return p_;
+}
+
+// UTF-8 of the double byte table, so a character is one lookup and one copy. (Unmapped = U+FFFD)
+const utf8_char* utf8_table()
+{
+	static const std::vector<utf8_char> table = []() {
+		std::vector<utf8_char> dst(SJIS_LEADS * SJIS_TRAILS);
+		for (size_t i = 0; i < dst.size(); i++)
+		{
+			char buf[4] = { 0 };
+			const u32_t cp = (SJIS_TABLE[i] != 0) ? SJIS_TABLE[i] : REPLACEMENT;
+			dst[i].size = static_cast<u8_t>(put_utf8(cp, buf) - buf);
+			std::memcpy(dst[i].bytes, buf, 3);
+		}
+		return dst;
+	}();
+	return &table[0];
+}
+
+// Length of the ASCII run at the head. (16 bytes per step with SSE2, otherwise 8 bytes)
+inline u32_t ascii_run(const u8_t* p_, u32_t size_)
+{
+	u32_t i = 0;
+#if defined(__SSE2__)
+	for (; (i + 16) <= size_; i += 16)
+	{
+		const u32_t mask = static_cast<u32_t>(_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&p_[i]))));
+		if (mask != 0) return (i + static_cast<u32_t>(__builtin_ctz(static_cast<unsigned int>(mask))));
+	}
+#else
+	for (; (i + 8) <= size_; i += 8)
+	{
+		u64_t word;
+		std::memcpy(&word, &p_[i], 8);
+		if ((word & 0x8080808080808080ULL) != 0) break;
+	}
+#endif
+	while (i < size_ && p_[i] < 0x80) i++;
+	return i;
+}
+
+// Read a UTF-8 code point. (false = Invalid Sequence)
+bool next_utf8(const u8_t* p_, u32_t size_, u32_t& rPos_, u32_t& rCp_)
+{
+	const u8_t c = p_[rPos_];
+	u32_t len;
+	u32_t cp;
+	if (c < 0x80) { rCp_ = c; rPos_++; return true; }
+	else if (c >= 0xC2 && c <= 0xDF) { len = 2; cp = (c & 0x1F); }
+	else if (c >= 0xE0 && c <= 0xEF) { len = 3; cp = (c & 0x0F); }
+	else if (c >= 0xF0 && c <= 0xF4) { len = 4; cp = (c & 0x07); }
+	else return false;
+
+	if ((rPos_ + len) > size_) return false;
+	for (u32_t i = 1; i < len; i++)
+	{
+		const u8_t t = p_[rPos_ + i];
+		if ((t & 0xC0) != 0x80) return false;
+		cp = ((cp << 6) | (t & 0x3F));
+	}
+	if ((len == 3 && cp < 0x800) || (len == 4 && (cp < 0x10000 || cp > 0x10FFFF))) return false;
+	if (cp >= 0xD800 && cp <= 0xDFFF) return false;
+	rCp_ = cp;
+	rPos_ += len;
+	return true;
+}
+
+// Code points to Shift-JIS, sorted by code point. (The lowest code of duplicates, as CP932)
+typedef std::vector<std::pair<u16_t, u16_t> > sjis_reverse;
+
+const sjis_reverse& reverse_table()
+{
+	static const sjis_reverse table = []() {
+		sjis_reverse dst;
+		dst.reserve(SJIS_LEADS * SJIS_TRAILS);
+		for (u32_t row = 0; row < SJIS_LEADS; row++)
+		{
+			const u32_t lead = (row < 31) ? (row + 0x81) : (row + 0xC1);
+			for (u32_t col = 0; col < SJIS_TRAILS; col++)
+			{
+				const u16_t cp = SJIS_TABLE[row * SJIS_TRAILS + col];
+				const u32_t trail = (col < 63) ? (col + 0x40) : (col + 0x41);
+				if (cp != 0) dst.push_back(std::make_pair(cp, static_cast<u16_t>((lead << 8) | trail)));
+			}
+		}
+		std::stable_sort(dst.begin(), dst.end(), [](const std::pair<u16_t, u16_t>& rLhs_, const std::pair<u16_t, u16_t>& rRhs_) {
+			return (rLhs_.first < rRhs_.first);
+		});
+		return dst;
+	}();
+	return table;
+}
+
+bool encode_sjis(const std::string& rSrc_, std::vector<u8_t>& rDst_)
+{
+	const u8_t* p = reinterpret_cast<const u8_t*>(rSrc_.data());
+	const u32_t size = static_cast<u32_t>(rSrc_.size());
+	const sjis_reverse& table = reverse_table();
+
+	u32_t pos = 0;
+	while (pos < size)
+	{
+		const u32_t run = ascii_run(&p[pos], size - pos);
+		rDst_.insert(rDst_.end(), &p[pos], &p[pos + run]);
+		pos += run;
+		if (pos >= size) break;
+
+		u32_t cp;
+		if (!next_utf8(p, size, pos, cp)) return false;
+		if (cp >= 0xFF61 && cp <= 0xFF9F)
+		{
+			// Half Width Katakana
+			rDst_.push_back(static_cast<u8_t>(cp - 0xFF61 + 0xA1));
+			continue;
+		}
+		if (cp > 0xFFFF) return false;
+
+		const sjis_reverse::const_iterator it = std::lower_bound(table.begin(), table.end(), std::make_pair(static_cast<u16_t>(cp), static_cast<u16_t>(0)));
+		if (it == table.end() || it->first != cp) return false;
+		rDst_.push_back(static_cast<u8_t>(it->second >> 8));
+		rDst_.push_back(static_cast<u8_t>(it->second & 0xFF));
+	}
+	return true;
+}
+
+// Append the big endian code unit.
+void put_unit(u32_t value_, u32_t size_, std::vector<u8_t>& rDst_)
+{
+	for (u32_t i = size_; i > 0; i--)
+	{
+		rDst_.push_back(static_cast<u8_t>(value_ >> ((i - 1) * 8)));
+	}
+}
+
+// Read the big endian code unit.
+inline u32_t get_unit(const u8_t* p_, u32_t size_)
+{
+	u32_t value = 0;
+	for (u32_t i = 0; i < size_; i++)
+	{
+		value = ((value << 8) | p_[i]);
+	}
+	return value;
+}
+
+// Double byte characters can have '\' or ',' in the trail byte.
+inline u32_t char_size(u8_t code_type_, const u8_t* p_, u32_t pos_, u32_t size_)
+{
+	return (code_type_ == TC_SHIFT_JIS && is_sjis_lead(p_[pos_]) && (pos_ + 1) < size_) ? 2 : 1;
+}
+
+// Parse the CNTI options. ("TG:text," ... , NUL = End)
+bool parse_options(u8_t code_type_, const u8_t* p_, u32_t size_, std::vector<text_item>& rDst_)
+{
+	std::vector<u8_t> raw;
+	u32_t pos = 0;
+	while (pos < size_ && p_[pos] != 0x00)
+	{
+		if ((pos + 3) > size_ || p_[pos + 2] != ':') return false;
+		text_item item;
+		item.tag.assign(reinterpret_cast<const char*>(&p_[pos]), 2);
+		pos += 3;
+
+		raw.clear();
+		while (pos < size_ && p_[pos] != ',')
+		{
+			if (p_[pos] == '\\' && (pos + 1) < size_) pos++;
+			const u32_t n = char_size(code_type_, p_, pos, size_);
+			raw.insert(raw.end(), &p_[pos], &p_[pos + n]);
+			pos += n;
+		}
+		pos++;													// ','
+
+		if (!decode_text(code_type_, raw.empty() ? nullptr : &raw[0], static_cast<u32_t>(raw.size()), item.text)) return false;
+		rDst_.push_back(item);
+	}
+	return true;
+}
+
+// Make the CNTI options.
+bool make_options(u8_t code_type_, const std::vector<text_item>& rSrc_, std::vector<u8_t>& rDst_)
+{
+	std::vector<u8_t> raw;
+	for (size_t i = 0; i < rSrc_.size(); i++)
+	{
+		if (rSrc_[i].tag.size() != 2) return false;
+		raw.clear();
+		if (!encode_text(code_type_, rSrc_[i].text, raw)) return false;
+
+		rDst_.insert(rDst_.end(), rSrc_[i].tag.begin(), rSrc_[i].tag.end());
+		rDst_.push_back(':');
+		const u32_t size = static_cast<u32_t>(raw.size());
+		for (u32_t pos = 0; pos < size;)
+		{
+			const u32_t n = char_size(code_type_, &raw[0], pos, size);
+			if (n == 1 && (raw[pos] == ',' || raw[pos] == '\\')) rDst_.push_back('\\');
+			rDst_.insert(rDst_.end(), &raw[pos], &raw[pos + n]);
+			pos += n;
+		}
+		rDst_.push_back(',');
+	}
+	return true;
+}
+
+// Parse the data chunks of Dch*.
+bool parse_data(u8_t code_type_, const u8_t* p_, u32_t size_, std::vector<text_item>& rDst_)
+{
+	u32_t pos = 0;
+	while ((pos + ITEM_HEAD_SIZE) <= size_)
+	{
+		const u32_t item_size = get_unit(&p_[pos + 2], 2);
+		if ((pos + ITEM_HEAD_SIZE + item_size) > size_) return false;
+
+		text_item item;
+		item.tag.assign(reinterpret_cast<const char*>(&p_[pos]), 2);
+		if (!decode_text(code_type_, &p_[pos + ITEM_HEAD_SIZE], item_size, item.text)) return false;
+		rDst_.push_back(item);
+		pos += (ITEM_HEAD_SIZE + item_size);
+	}
+	return (pos == size_);
+}
+
+// Make the data chunks of Dch*.
+bool make_data(u8_t code_type_, const std::vector<text_item>& rSrc_, std::vector<u8_t>& rDst_)
+{
+	for (size_t i = 0; i < rSrc_.size(); i++)
+	{
+		if (rSrc_[i].tag.size() != 2) return false;
+		const size_t head = rDst_.size();
+		rDst_.insert(rDst_.end(), rSrc_[i].tag.begin(), rSrc_[i].tag.end());
+		rDst_.resize(head + ITEM_HEAD_SIZE);
+		if (!encode_text(code_type_, rSrc_[i].text, rDst_)) return false;
+
+		const size_t item_size = (rDst_.size() - head - ITEM_HEAD_SIZE);
+		if (item_size > MAX_ITEM_SIZE) return false;
+		make_size_array(static_cast<u32_t>(item_size), 2, &rDst_[head + 2]);
+	}
+	return true;
+}
+
+// Append the chunk. (ID, Size, Data)
+void put_chunk(const u8_t* pId_, const u8_t* pData_, u32_t size_, std::vector<u8_t>& rDst_)
+{
+	rDst_.insert(rDst_.end(), pId_, pId_ + MA_3::CHUNK_HEAD_SIZE);
+	put_unit(size_, MA_3::CHUNK_DATA_SIZE, rDst_);
+	if (size_ != 0) rDst_.insert(rDst_.end(), pData_, pData_ + size_);
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Text Chunk Layout (Internal)
+//------------------------------------------------------------------------------------------------------//
+
+// Chunk found by the walk.
+struct text_chunk
+{
+	bool  found;												// Found
+	u32_t pos;													// Position of Chunk Head
+	u32_t size;													// Chunk Data Size [byte]
+	u32_t data_pos;												// Position of Chunk Data
+};
+
+// Positions of the text chunks.
+struct text_layout
+{
+	text_chunk file;											// MMMD
+	u32_t      file_size_pos;									// Position of MMMD Size
+	text_chunk contents;										// CNTI
+	text_chunk optional;										// OPDA
+	text_chunk data;											// The First Dch* in OPDA
+};
+
+void set_chunk(const chunk_info& rInfo_, text_chunk& rDst_)
+{
+	rDst_.found = true;
+	rDst_.pos = rInfo_.pos;
+	rDst_.size = rInfo_.size;
+	rDst_.data_pos = rInfo_.data_pos;
+}
+
+walk_result text_file(const chunk_info& rInfo_, const u8_t* /*pAddr_*/, void* pContext_)
+{
+	text_layout* pLayout = static_cast<text_layout*>(pContext_);
+	if (rInfo_.depth != 0 || pLayout->file.found) return WR_SKIP;
+	set_chunk(rInfo_, pLayout->file);
+	pLayout->file_size_pos = rInfo_.size_pos;
+	return WR_CONTINUE;
+}
+
+walk_result text_contents(const chunk_info& rInfo_, const u8_t* /*pAddr_*/, void* pContext_)
+{
+	text_layout* pLayout = static_cast<text_layout*>(pContext_);
+	if (rInfo_.depth == 1 && !pLayout->contents.found) set_chunk(rInfo_, pLayout->contents);
+	return WR_SKIP;
+}
+
+walk_result text_optional(const chunk_info& rInfo_, const u8_t* /*pAddr_*/, void* pContext_)
+{
+	text_layout* pLayout = static_cast<text_layout*>(pContext_);
+	if (rInfo_.depth != 1 || pLayout->optional.found) return WR_SKIP;
+	set_chunk(rInfo_, pLayout->optional);
+	return WR_CONTINUE;
+}
+
+walk_result text_data(const chunk_info& rInfo_, const u8_t* /*pAddr_*/, void* pContext_)
+{
+	text_layout* pLayout = static_cast<text_layout*>(pContext_);
+	if (rInfo_.depth == 2 && !pLayout->data.found) set_chunk(rInfo_, pLayout->data);
+	return WR_SKIP;
+}
+
+walk_result text_skip(const chunk_info& /*rInfo_*/, const u8_t* /*pAddr_*/, void* /*pContext_*/)
+{
+	return WR_SKIP;
+}
+
+// Registry to find the text chunks. (Enters MMMD and OPDA only.)
+class text_registry : public chunk_registry
+{
+public:
+	text_registry()
+		: chunk_registry()
+	{
+		this->set_callback("MMMD", text_file);
+		this->set_callback("CNTI", text_contents);
+		this->set_callback("OPDA", text_optional);
+		this->set_callback("Dch*", text_data);
+		this->set_default_callback(text_skip);
+	}
+};
+
+bool analyze_text(const MA_3& rSrc_, text_layout& rDst_)
+{
+	static const text_registry registry;
+
+	std::memset(&rDst_, 0, sizeof(rDst_));
+	if (rSrc_.empty()) return false;
+	if (!registry.walk(rSrc_.data_ptr(), rSrc_.size(), &rDst_)) return false;
+	return (rDst_.file.found && rDst_.contents.found && rDst_.contents.size >= CONTENTS_INFO_SIZE);
+}
+
+}																// namespace
+
+//------------------------------------------------------------------------------------------------------//
+// Shift-JIS to UTF-8
+//------------------------------------------------------------------------------------------------------//
+u32_t smaf::sjis_to_utf8(const u8_t* pSrc_, u32_t size_, char* pDst_)
+{
+	const utf8_char* pTable = utf8_table();
+	char* p = pDst_;
+	u32_t pos = 0;
+	while (pos < size_)
+	{
+		// ASCII is copied as it is. (Most titles and copyrights)
+		const u32_t run = ascii_run(&pSrc_[pos], size_ - pos);
+		std::memcpy(p, &pSrc_[pos], run);
+		p += run;
+		pos += run;
+		if (pos >= size_) break;
+
+		// Until the next ASCII. (Trail bytes can be ASCII, so they are consumed here.)
+		while (pos < size_ && pSrc_[pos] >= 0x80)
+		{
+			const u8_t c = pSrc_[pos];
+			if (c >= 0xA1 && c <= 0xDF)
+			{
+				p = put_utf8(0xFF61 + (c - 0xA1), p);			// Half Width Katakana
+				pos++;
+			}
+			else if (is_sjis_lead(c) && (pos + 1) < size_ && is_sjis_trail(pSrc_[pos + 1]))
+			{
+				const utf8_char& ch = pTable[sjis_index(c, pSrc_[pos + 1])];
+				std::memcpy(p, ch.bytes, 3);					// 3 bytes of output per 2 bytes of input at most
+				p += ch.size;
+				pos += 2;
+			}
+			else
+			{
+				p = put_utf8(REPLACEMENT, p);					// Invalid Byte (The next byte is read again)
+				pos++;
+			}
+		}
+	}
+	return static_cast<u32_t>(p - pDst_);
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Decode Text to UTF-8
+//------------------------------------------------------------------------------------------------------//
+bool smaf::decode_text(u8_t code_type_, const u8_t* pSrc_, u32_t size_, std::string& rDst_)
+{
+	const size_t head = rDst_.size();
+	switch (code_type_)
+	{
+	case TC_SHIFT_JIS:
+	{
+		rDst_.resize(head + static_cast<size_t>(size_) * 3);
+		const u32_t size = (size_ != 0) ? sjis_to_utf8(pSrc_, size_, &rDst_[head]) : 0;
+		rDst_.resize(head + size);
+		return true;
+	}
+	case TC_LATIN1:
+	{
+		rDst_.resize(head + static_cast<size_t>(size_) * 2);
+		char* p = (size_ != 0) ? &rDst_[head] : nullptr;
+		for (u32_t i = 0; i < size_; i++)
+		{
+			p = put_utf8(pSrc_[i], p);
+		}
+		rDst_.resize((size_ != 0) ? static_cast<size_t>(p - rDst_.data()) : head);
+		return true;
+	}
+	case TC_UTF8:
+		rDst_.append(reinterpret_cast<const char*>(pSrc_), size_);
+		return true;
+	case TC_UCS2:
+	case TC_UTF16:
+	{
+		char buf[4];
+		for (u32_t i = 0; (i + 2) <= size_; i += 2)
+		{
+			u32_t cp = get_unit(&pSrc_[i], 2);
+			if (cp >= 0xD800 && cp <= 0xDBFF && (i + 4) <= size_)
+			{
+				const u32_t low = get_unit(&pSrc_[i + 2], 2);
+				if (low >= 0xDC00 && low <= 0xDFFF)
+				{
+					cp = (0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00));
+					i += 2;
+				}
+			}
+			if (cp >= 0xD800 && cp <= 0xDFFF) cp = REPLACEMENT;	// Unpaired Surrogate
+			rDst_.append(buf, put_utf8(cp, buf) - buf);
+		}
+		return true;
+	}
+	case TC_UCS4:
+	case TC_UTF32:
+	{
+		char buf[4];
+		for (u32_t i = 0; (i + 4) <= size_; i += 4)
+		{
+			u32_t cp = get_unit(&pSrc_[i], 4);
+			if (cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) cp = REPLACEMENT;
+			rDst_.append(buf, put_utf8(cp, buf) - buf);
+		}
+		return true;
+	}
+	default:
+		return false;
+	}
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Encode UTF-8 Text
+//------------------------------------------------------------------------------------------------------//
+bool smaf::encode_text(u8_t code_type_, const std::string& rSrc_, std::vector<u8_t>& rDst_)
+{
+	if (code_type_ == TC_SHIFT_JIS) return encode_sjis(rSrc_, rDst_);
+
+	const u8_t* p = reinterpret_cast<const u8_t*>(rSrc_.data());
+	const u32_t size = static_cast<u32_t>(rSrc_.size());
+	u32_t pos = 0;
+	u32_t cp;
+	switch (code_type_)
+	{
+	case TC_LATIN1:
+		while (pos < size)
+		{
+			if (!next_utf8(p, size, pos, cp) || cp > 0xFF) return false;
+			rDst_.push_back(static_cast<u8_t>(cp));
+		}
+		return true;
+	case TC_UTF8:
+		while (pos < size)
+		{
+			if (!next_utf8(p, size, pos, cp)) return false;
+		}
+		rDst_.insert(rDst_.end(), p, p + size);
+		return true;
+	case TC_UCS2:
+	case TC_UTF16:
+		while (pos < size)
+		{
+			if (!next_utf8(p, size, pos, cp)) return false;
+			if (cp < 0x10000)
+			{
+				put_unit(cp, 2, rDst_);
+			}
+			else
+			{
+				if (code_type_ == TC_UCS2) return false;
+				put_unit(0xD800 + ((cp - 0x10000) >> 10), 2, rDst_);
+				put_unit(0xDC00 + ((cp - 0x10000) & 0x3FF), 2, rDst_);
+			}
+		}
+		return true;
+	case TC_UCS4:
+	case TC_UTF32:
+		while (pos < size)
+		{
+			if (!next_utf8(p, size, pos, cp)) return false;
+			put_unit(cp, 4, rDst_);
+		}
+		return true;
+	default:
+		return false;
+	}
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Read CNTI and OPDA Text
+//------------------------------------------------------------------------------------------------------//
+bool smaf::read_text(const MA_3& rSrc_, tune_text& rDst_)
+{
+	OPENMF_TRACE_SCOPE("read_text");
+
+	rDst_.code_type = TC_SHIFT_JIS;
+	rDst_.options.clear();
+	rDst_.data_code = NO_DATA_CODE;
+	rDst_.data.clear();
+
+	text_layout layout;
+	if (!analyze_text(rSrc_, layout)) return false;
+	const u8_t* pAddr = rSrc_.data_ptr();
+
+	const text_chunk& contents = layout.contents;
+	rDst_.code_type = pAddr[contents.data_pos + CODE_TYPE_POS];
+	bool ok = parse_options(rDst_.code_type, &pAddr[contents.data_pos + CONTENTS_INFO_SIZE], contents.size - CONTENTS_INFO_SIZE, rDst_.options);
+
+	const text_chunk& data = layout.data;
+	if (data.found)
+	{
+		rDst_.data_code = pAddr[data.pos + 3];					// "Dch" + Code Type
+		ok = parse_data(rDst_.data_code, &pAddr[data.data_pos], data.size, rDst_.data) && ok;
+	}
+	return ok;
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Write CNTI and OPDA Text
+//------------------------------------------------------------------------------------------------------//
+bool smaf::write_text(const MA_3& rSrc_, const tune_text& rText_, MA_3& rDst_)
+{
+	OPENMF_TRACE_SCOPE("write_text");
+
+	text_layout layout;
+	if (rSrc_ == rDst_ || !analyze_text(rSrc_, layout)) return false;
+	const u8_t* pAddr = rSrc_.data_ptr();
+	const text_chunk& contents = layout.contents;
+	const text_chunk& optional = layout.optional;
+	const text_chunk& data = layout.data;
+	const u32_t contents_end = (contents.data_pos + contents.size);
+	const u32_t act_size = (rSrc_.size() - MA_3::CRC_SIZE);
+	if (optional.found && optional.pos < contents_end) return false;
+
+	// (1) CNTI: Contents info and the options.
+	//
+	std::vector<u8_t> body(&pAddr[contents.data_pos], &pAddr[contents.data_pos + CONTENTS_INFO_SIZE]);
+	body[CODE_TYPE_POS] = rText_.code_type;
+	if (!make_options(rText_.code_type, rText_.options, body)) return false;
+	std::vector<u8_t> chunks;
+	put_chunk(&pAddr[contents.pos], &body[0], static_cast<u32_t>(body.size()), chunks);
+	const u32_t contents_chunk = static_cast<u32_t>(chunks.size());
+
+	// (2) OPDA: The first Dch* is replaced, other chunks are kept.
+	//
+	std::vector<u8_t> dch;
+	if (!rText_.data.empty())
+	{
+		const u8_t code = (rText_.data_code != NO_DATA_CODE) ? rText_.data_code : rText_.code_type;
+		const u8_t id[4] = { 'D', 'c', 'h', code };
+		body.clear();
+		if (!make_data(code, rText_.data, body)) return false;
+		put_chunk(id, body.empty() ? nullptr : &body[0], static_cast<u32_t>(body.size()), dch);
+	}
+	if (optional.found)
+	{
+		const u32_t optional_end = (optional.data_pos + optional.size);
+		const u32_t split = data.found ? data.pos : optional_end;
+		const u32_t rest = data.found ? (data.data_pos + data.size) : optional_end;
+		body.assign(&pAddr[optional.data_pos], &pAddr[split]);
+		body.insert(body.end(), dch.begin(), dch.end());
+		body.insert(body.end(), &pAddr[rest], &pAddr[optional_end]);
+		put_chunk(&pAddr[optional.pos], body.empty() ? nullptr : &body[0], static_cast<u32_t>(body.size()), chunks);
+	}
+	else if (!dch.empty())
+	{
+		const u8_t id[4] = { 'O', 'P', 'D', 'A' };
+		put_chunk(id, &dch[0], static_cast<u32_t>(dch.size()), chunks);
+	}
+
+	// (3) Copy the other chunks and fix the sizes and CRC16.
+	//
+	const u32_t removed = (contents_end - contents.pos) + (optional.found ? (optional.data_pos + optional.size - optional.pos) : 0);
+	const u64_t dst_size = (static_cast<u64_t>(rSrc_.size()) - removed + chunks.size());
+	const u64_t file_size = (static_cast<u64_t>(layout.file.size) - removed + chunks.size());
+	if (dst_size > 0xFFFFFFFF || file_size > 0xFFFFFFFF) return false;
+	if (!rDst_.create(static_cast<u32_t>(dst_size))) return false;
+	u8_t* pDst = rDst_.data_ptr();
+
+	u32_t dst_pos = 0;
+	std::memcpy(&pDst[dst_pos], pAddr, contents.pos);
+	dst_pos += contents.pos;
+	std::memcpy(&pDst[dst_pos], &chunks[0], contents_chunk);
+	dst_pos += contents_chunk;
+	if (optional.found)
+	{
+		const u32_t optional_end = (optional.data_pos + optional.size);
+		std::memcpy(&pDst[dst_pos], &pAddr[contents_end], optional.pos - contents_end);
+		dst_pos += (optional.pos - contents_end);
+		std::memcpy(&pDst[dst_pos], &chunks[contents_chunk], chunks.size() - contents_chunk);
+		dst_pos += static_cast<u32_t>(chunks.size() - contents_chunk);
+		std::memcpy(&pDst[dst_pos], &pAddr[optional_end], act_size - optional_end);
+		dst_pos += (act_size - optional_end);
+	}
+	else
+	{
+		std::memcpy(&pDst[dst_pos], &chunks[contents_chunk], chunks.size() - contents_chunk);
+		dst_pos += static_cast<u32_t>(chunks.size() - contents_chunk);
+		std::memcpy(&pDst[dst_pos], &pAddr[contents_end], act_size - contents_end);
+		dst_pos += (act_size - contents_end);
+	}
+	make_size_array(static_cast<u32_t>(file_size), MA_3::CHUNK_DATA_SIZE, &pDst[layout.file_size_pos]);
+	return fix_crc16(rDst_);
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Set the Text of the Tag
+//------------------------------------------------------------------------------------------------------//
+void smaf::set_text(tune_text& rText_, const std::string& rTag_, const std::string& rValue_)
+{
+	std::vector<text_item>* pLists[2] = { &rText_.data, &rText_.options };
+	for (u32_t n = 0; n < 2; n++)
+	{
+		std::vector<text_item>& list = *pLists[n];
+		for (size_t i = 0; i < list.size(); i++)
+		{
+			if (list[i].tag != rTag_) continue;
+			if (rValue_.empty()) list.erase(list.begin() + i);
+			else list[i].text = rValue_;
+			return;
+		}
+	}
+	if (rValue_.empty()) return;
+
+	text_item item;
+	item.tag = rTag_;
+	item.text = rValue_;
+	if (rText_.data_code != NO_DATA_CODE) rText_.data.push_back(item);
+	else rText_.options.push_back(item);
+}
+
+//------------------------------------------------------------------------------------------------------//
+// End of File
+//------------------------------------------------------------------------------------------------------//
@@ -0,0 +1,100 @@
+//------------------------------------------------------------------------------------------------------//
+//
+//                                          License Agreement
+//                                     For Open Source SMAF Library
+//
+//                         Copyright (c) 2015-2017, @shirajira, all rights reserved.
+//
+//------------------------------------------------------------------------------------------------------//
+
+#ifndef openmf_text_h__
+#define openmf_text_h__
+#pragma once
+
+#include "core.h"
+#include <string>
+#include <vector>
+
+namespace smaf {
+
+//------------------------------------------------------------------------------------------------------//
+// Text Code Type (enum, CNTI Code Type and the Last Byte of Dch*)
+//------------------------------------------------------------------------------------------------------//
+enum text_code
+{
+	TC_SHIFT_JIS = 0x00,										// Shift-JIS (CP932)
+	TC_LATIN1    = 0x01,										// ISO 8859-1
+	TC_EUC_KR    = 0x02,										// EUC-KR (Not Supported)
+	TC_HZ_GB2312 = 0x03,										// HZ-GB-2312 (Not Supported)
+	TC_BIG5      = 0x04,										// Big5 (Not Supported)
+	TC_KOI8_R    = 0x05,										// KOI8-R (Not Supported)
+	TC_TCVN      = 0x06,										// TCVN-5773 (Not Supported)
+	TC_UCS2      = 0x20,										// UCS-2 (Big Endian)
+	TC_UCS4      = 0x21,										// UCS-4 (Big Endian)
+	TC_UTF7      = 0x22,										// UTF-7 (Not Supported)
+	TC_UTF8      = 0x23,										// UTF-8
+	TC_UTF16     = 0x24,										// UTF-16 (Big Endian)
+	TC_UTF32     = 0x25											// UTF-32 (Big Endian)
+};
+
+//------------------------------------------------------------------------------------------------------//
+// Text Item (struct, "ST" = Title, "AN" = Artist, "CR" = Copyright, ...)
+//------------------------------------------------------------------------------------------------------//
+struct text_item
+{
+	std::string tag;											// Tag (2 Characters)
+	std::string text;											// Text (UTF-8)
+};
+
+//------------------------------------------------------------------------------------------------------//
+// Tune Text (struct)
+//
+// CNTI holds the options as "TG:text," after the 5 bytes of contents info ('\' escapes ',' and '\').
+// OPDA holds the data chunks Dch* of tag (2), size (2) and text. Only the first Dch* is read and
+// written, other chunks in OPDA are kept as they are.
+//------------------------------------------------------------------------------------------------------//
+struct tune_text
+{
+	u8_t                   code_type;							// CNTI Code Type (text_code)
+	std::vector<text_item> options;								// CNTI Options
+	u8_t                   data_code;							// Code Type of Dch* (text_code)
+	std::vector<text_item> data;								// Dch* Data Chunks
+};
+
+//------------------------------------------------------------------------------------------------------//
+// Shift-JIS to UTF-8 (pDst_: 3 * size_ bytes, Return: UTF-8 Size, Unmapped = U+FFFD)
+//------------------------------------------------------------------------------------------------------//
+u32_t sjis_to_utf8(const u8_t* pSrc_, u32_t size_, char* pDst_);
+
+//------------------------------------------------------------------------------------------------------//
+// Decode Text to UTF-8 (Appended to rDst_, false = Unsupported Code Type)
+//------------------------------------------------------------------------------------------------------//
+bool decode_text(u8_t code_type_, const u8_t* pSrc_, u32_t size_, std::string& rDst_);
+
+//------------------------------------------------------------------------------------------------------//
+// Encode UTF-8 Text (Appended to rDst_, false = Unsupported Code Type or not Encodable)
+//------------------------------------------------------------------------------------------------------//
+bool encode_text(u8_t code_type_, const std::string& rSrc_, std::vector<u8_t>& rDst_);
+
+//------------------------------------------------------------------------------------------------------//
+// Read CNTI and OPDA Text (data_code = 0xFF: No Dch*)
+//------------------------------------------------------------------------------------------------------//
+bool read_text(const MA_3& rSrc_, tune_text& rDst_);
+
+//------------------------------------------------------------------------------------------------------//
+// Write CNTI and OPDA Text (Fix the sizes and CRC16, OPDA is added after CNTI when missing, rSrc_ != rDst_)
+//------------------------------------------------------------------------------------------------------//
+bool write_text(const MA_3& rSrc_, const tune_text& rText_, MA_3& rDst_);
+
+//------------------------------------------------------------------------------------------------------//
+// Set the Text of the Tag (Where the tag is, new tags in Dch* if present, otherwise CNTI, Empty = Remove)
+//------------------------------------------------------------------------------------------------------//
+void set_text(tune_text& rText_, const std::string& rTag_, const std::string& rValue_);
+
+//------------------------------------------------------------------------------------------------------//
+}																// namespace smaf
+
+#endif															// openmf_text_h__
+//------------------------------------------------------------------------------------------------------//
+// End of File
+//------------------------------------------------------------------------------------------------------//
@@ -0,0 +1,273 @@
+//------------------------------------------------------------------------------------------------------//
+//
+//                                          License Agreement
+//                                     For Open Source SMAF Library
+//
+//                         Copyright (c) 2015-2017, @shirajira, all rights reserved.
+//
+//------------------------------------------------------------------------------------------------------//
+
+#include "trace.h"
+
+#ifdef OPENMF_TRACE
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+using namespace smaf;
+
+//------------------------------------------------------------------------------------------------------//
+// Internal Helpers
+//------------------------------------------------------------------------------------------------------//
+namespace {
+
+const u32_t MAX_NAMES = 256;									// Max Number of Scope/Counter Names (ID 0 = Overflow)
+const size_t MAX_EVENTS = (1 << 20);							// Max Number of Events per Thread
+
+// Timed event.
+struct event_record
+{
+	u32_t id;													// Scope ID
+	u64_t begin_ns;												// Begin Time [ns]
+	u64_t end_ns;												// End Time [ns]
+};
+
+// Events and counters of one thread. (Written by the owner thread only.)
+struct thread_buffer
+{
+	explicit thread_buffer(u32_t tid_)
+		: tid(tid_)
+		, dropped(0)
+		, events()
+	{
+		std::memset(count, 0, sizeof(count));
+		std::memset(calls, 0, sizeof(calls));
+		std::memset(total_ns, 0, sizeof(total_ns));
+	}
+
+	u32_t                     tid;								// Thread Number
+	u64_t                     dropped;							// Dropped Events (Buffer Full)
+	u64_t                     count[MAX_NAMES];					// Counters
+	u64_t                     calls[MAX_NAMES];					// Scope Calls
+	u64_t                     total_ns[MAX_NAMES];				// Scope Total Time [ns]
+	std::vector<event_record> events;							// Timed Events
+};
+
+// Names and thread buffers.
+struct trace_registry
+{
+	trace_registry()
+		: name_count(1)
+		, origin_ns(trace::now_ns())
+	{
+		names[0] = "(overflow)";
+	}
+
+	std::mutex                                  mutex;			// Mutex for Registration
+	const char*                                 names[MAX_NAMES];	// Registered Names
+	u32_t                                       name_count;		// Number of Names
+	u64_t                                       origin_ns;		// Time Origin [ns]
+	std::vector<std::shared_ptr<thread_buffer> > buffers;		// Thread Buffers
+};
+
+trace_registry& global_registry()
+{
+	static trace_registry registry;
+	return registry;
+}
+
+thread_buffer& local_buffer()
+{
+	thread_local std::shared_ptr<thread_buffer> pBuffer;
+	if (!pBuffer)
+	{
+		trace_registry& registry = global_registry();
+		std::lock_guard<std::mutex> lock(registry.mutex);
+		pBuffer = std::make_shared<thread_buffer>(static_cast<u32_t>(registry.buffers.size()));
+		registry.buffers.push_back(pBuffer);
+	}
+	return *pBuffer;
+}
+
+}																// namespace
+
+//------------------------------------------------------------------------------------------------------//
+// Register Scope/Counter Name
+//------------------------------------------------------------------------------------------------------//
+u32_t smaf::trace::register_name(const char* szName_)
+{
+	trace_registry& registry = global_registry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+
+	for (u32_t i = 1; i < registry.name_count; i++)
+	{
+		if (std::strcmp(registry.names[i], szName_) == 0) return i;
+	}
+	if (registry.name_count >= MAX_NAMES) return 0;				// Overflow
+
+	registry.names[registry.name_count] = szName_;
+	return registry.name_count++;
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Add Count to Counter
+//------------------------------------------------------------------------------------------------------//
+void smaf::trace::add_count(u32_t id_, u64_t n_)
+{
+	local_buffer().count[id_] += n_;
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Add Timed Event
+//------------------------------------------------------------------------------------------------------//
+void smaf::trace::add_event(u32_t id_, u64_t begin_ns_, u64_t end_ns_)
+{
+	thread_buffer& buffer = local_buffer();
+	buffer.calls[id_]++;
+	buffer.total_ns[id_] += (end_ns_ - begin_ns_);
+
+	if (buffer.events.size() >= MAX_EVENTS)
+	{
+		buffer.dropped++;
+		return;
+	}
+	event_record record;
+	record.id = id_;
+	record.begin_ns = begin_ns_;
+	record.end_ns = end_ns_;
+	buffer.events.push_back(record);
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Return Current Time
+//------------------------------------------------------------------------------------------------------//
+u64_t smaf::trace::now_ns()
+{
+	return static_cast<u64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Export Events as Chrome Trace JSON
+//------------------------------------------------------------------------------------------------------//
+bool smaf::trace::export_chrome_trace(const char* szFile_)
+{
+	std::FILE* fp = std::fopen(szFile_, "w");
+	if (fp == nullptr) return false;
+
+	trace_registry& registry = global_registry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+
+	std::fprintf(fp, "{\"traceEvents\":[\n");
+	bool first = true;
+	u64_t last_ns = registry.origin_ns;
+
+	for (size_t b = 0; b < registry.buffers.size(); b++)
+	{
+		const thread_buffer& buffer = *registry.buffers[b];
+
+		std::fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%lu,\"args\":{\"name\":\"thread %lu\"}}",
+			first ? "" : ",\n",
+			static_cast<unsigned long>(buffer.tid),
+			static_cast<unsigned long>(buffer.tid));
+		first = false;
+
+		for (size_t i = 0; i < buffer.events.size(); i++)
+		{
+			const event_record& rec = buffer.events[i];
+			std::fprintf(fp, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%lu,\"ts\":%.3f,\"dur\":%.3f}",
+				registry.names[rec.id],
+				static_cast<unsigned long>(buffer.tid),
+				(rec.begin_ns - registry.origin_ns) / 1000.0,
+				(rec.end_ns - rec.begin_ns) / 1000.0);
+			if (rec.end_ns > last_ns) last_ns = rec.end_ns;
+		}
+	}
+
+	// Counters (Totals of All Threads at the End)
+	std::fprintf(fp, "%s{\"name\":\"counters\",\"ph\":\"C\",\"pid\":1,\"ts\":%.3f,\"args\":{",
+		first ? "" : ",\n",
+		(last_ns - registry.origin_ns) / 1000.0);
+	bool first_arg = true;
+	for (u32_t id = 0; id < registry.name_count; id++)
+	{
+		u64_t total = 0;
+		for (size_t b = 0; b < registry.buffers.size(); b++)
+		{
+			total += registry.buffers[b]->count[id];
+		}
+		if (total == 0) continue;
+		std::fprintf(fp, "%s\"%s\":%llu", first_arg ? "" : ",", registry.names[id], static_cast<unsigned long long>(total));
+		first_arg = false;
+	}
+	std::fprintf(fp, "}}\n]}\n");
+
+	return (std::fclose(fp) == 0);
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Export Counters and Scope Totals as Plain Text
+//------------------------------------------------------------------------------------------------------//
+bool smaf::trace::export_counters(const char* szFile_)
+{
+	std::FILE* fp = std::fopen(szFile_, "w");
+	if (fp == nullptr) return false;
+
+	trace_registry& registry = global_registry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+
+	u64_t dropped = 0;
+	std::fprintf(fp, "# name\tcount\tcalls\ttotal_ms\n");
+	for (u32_t id = 0; id < registry.name_count; id++)
+	{
+		u64_t count = 0, calls = 0, total_ns = 0;
+		for (size_t b = 0; b < registry.buffers.size(); b++)
+		{
+			count += registry.buffers[b]->count[id];
+			calls += registry.buffers[b]->calls[id];
+			total_ns += registry.buffers[b]->total_ns[id];
+			if (id == 0) dropped += registry.buffers[b]->dropped;
+		}
+		if (count == 0 && calls == 0) continue;
+		std::fprintf(fp, "%s\t%llu\t%llu\t%.3f\n",
+			registry.names[id],
+			static_cast<unsigned long long>(count),
+			static_cast<unsigned long long>(calls),
+			total_ns / 1.0e6);
+	}
+	std::fprintf(fp, "# threads=%lu dropped_events=%llu\n",
+		static_cast<unsigned long>(registry.buffers.size()),
+		static_cast<unsigned long long>(dropped));
+
+	return (std::fclose(fp) == 0);
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Clear All Events and Counters
+//------------------------------------------------------------------------------------------------------//
+void smaf::trace::reset()
+{
+	trace_registry& registry = global_registry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+
+	for (size_t b = 0; b < registry.buffers.size(); b++)
+	{
+		thread_buffer& buffer = *registry.buffers[b];
+		std::memset(buffer.count, 0, sizeof(buffer.count));
+		std::memset(buffer.calls, 0, sizeof(buffer.calls));
+		std::memset(buffer.total_ns, 0, sizeof(buffer.total_ns));
+		buffer.events.clear();
+		buffer.dropped = 0;
+	}
+	registry.origin_ns = now_ns();
+}
+
+#endif															// OPENMF_TRACE
+
+//------------------------------------------------------------------------------------------------------//
+// End of File
+//------------------------------------------------------------------------------------------------------//
@@ -0,0 +1,114 @@
+//------------------------------------------------------------------------------------------------------//
+//
+//                                          License Agreement
+//                                     For Open Source SMAF Library
+//
+//                         Copyright (c) 2015-2017, @shirajira, all rights reserved.
+//
+//------------------------------------------------------------------------------------------------------//
+
+#ifndef openmf_trace_h__
+#define openmf_trace_h__
+#pragma once
+
+#include "basic_type.h"
+
+//------------------------------------------------------------------------------------------------------//
+// Instrumentation (Enabled by defining OPENMF_TRACE, otherwise the macros expand to nothing.)
+//
+//   OPENMF_TRACE_SCOPE("name")     : Record the scope as a timed event.
+//   OPENMF_TRACE_COUNT("name", n)  : Add n to the counter. (n is not evaluated when disabled.)
+//
+// Events and counters are recorded per thread without locks and merged on export.
+// Export after the worker threads have finished.
+//------------------------------------------------------------------------------------------------------//
+
+#ifdef OPENMF_TRACE
+
+namespace smaf {
+namespace trace {
+
+//------------------------------------------------------------------------------------------------------//
+// Register Scope/Counter Name (Returns ID, Name must be a string literal.)
+//------------------------------------------------------------------------------------------------------//
+u32_t register_name(const char* szName_);
+
+//------------------------------------------------------------------------------------------------------//
+// Add Count to Counter
+//------------------------------------------------------------------------------------------------------//
+void add_count(u32_t id_, u64_t n_);
+
+//------------------------------------------------------------------------------------------------------//
+// Add Timed Event
+//------------------------------------------------------------------------------------------------------//
+void add_event(u32_t id_, u64_t begin_ns_, u64_t end_ns_);
+
+//------------------------------------------------------------------------------------------------------//
+// Return Current Time [ns]
+//------------------------------------------------------------------------------------------------------//
+u64_t now_ns();
+
+//------------------------------------------------------------------------------------------------------//
+// Export Events as Chrome Trace JSON (chrome://tracing, Perfetto)
+//------------------------------------------------------------------------------------------------------//
+bool export_chrome_trace(const char* szFile_);
+
+//------------------------------------------------------------------------------------------------------//
+// Export Counters and Scope Totals as Plain Text
+//------------------------------------------------------------------------------------------------------//
+bool export_counters(const char* szFile_);
+
+//------------------------------------------------------------------------------------------------------//
+// Clear All Events and Counters
+//------------------------------------------------------------------------------------------------------//
+void reset();
+
+//------------------------------------------------------------------------------------------------------//
+// Scope Class
+//------------------------------------------------------------------------------------------------------//
+class scope
+{
+public:
+	explicit scope(u32_t id_)
+		: m_id(id_)
+		, m_begin(now_ns())
+	{}
+	~scope()
+	{
+		add_event(m_id, m_begin, now_ns());
+	}
+
+private:
+	scope(const scope&);
+	scope& operator=(const scope&);
+
+private:
+	u32_t m_id;													// Scope ID
+	u64_t m_begin;												// Begin Time [ns]
+};
+
+//------------------------------------------------------------------------------------------------------//
+}																// namespace trace
+}																// namespace smaf
+
+#define OPENMF_TRACE_CONCAT_(a, b) a##b
+#define OPENMF_TRACE_CONCAT(a, b) OPENMF_TRACE_CONCAT_(a, b)
+
+#define OPENMF_TRACE_SCOPE(szName_) \
+	static const u32_t OPENMF_TRACE_CONCAT(openmf_trace_id_, __LINE__) = smaf::trace::register_name(szName_); \
+	smaf::trace::scope OPENMF_TRACE_CONCAT(openmf_trace_scope_, __LINE__)(OPENMF_TRACE_CONCAT(openmf_trace_id_, __LINE__))
+
+#define OPENMF_TRACE_COUNT(szName_, n_) \
+	do { static const u32_t openmf_trace_id_ = smaf::trace::register_name(szName_); smaf::trace::add_count(openmf_trace_id_, (n_)); } while (0)
+
+#else
+
+#define OPENMF_TRACE_SCOPE(szName_) ((void)0)
+#define OPENMF_TRACE_COUNT(szName_, n_) ((void)0)
+
+#endif															// OPENMF_TRACE
+
+#endif															// openmf_trace_h__
+//------------------------------------------------------------------------------------------------------//
+// End of File
+//------------------------------------------------------------------------------------------------------//
@@ -0,0 +1,275 @@
+//------------------------------------------------------------------------------------------------------//
+//
+//                                          License Agreement
+//                                     For Open Source SMAF Library
+//
+//                         Copyright (c) 2015-2017, @shirajira, all rights reserved.
+//
+//------------------------------------------------------------------------------------------------------//
+
+#include "apis.h"
+#include "chunk.h"
+#include "sequence.h"
+
+using namespace smaf;
+
+//------------------------------------------------------------------------------------------------------//
+// Internal Helpers
+//------------------------------------------------------------------------------------------------------//
+namespace {
+
+const u32_t MAX_DEPTH = 8;										// Max Depth of Chunk Tree
+const u32_t CRC_BLOCK = 4096;									// CRC Step in Sequence Data [byte]
+const u32_t SLICES = 8;											// CRC Slicing-by-8
+
+// CRC16 tables for slicing-by-8. (Built once, no heap)
+struct crc16_tables
+{
+	crc16_tables()
+	{
+		for (u32_t i = 0; i < 256; i++)
+		{
+			u16_t r = static_cast<u16_t>(i << 8);
+			for (u32_t j = 0; j < 8; j++)
+			{
+				r = (r & 0x8000) ? static_cast<u16_t>((r << 1) ^ CRC16::POLY) : static_cast<u16_t>(r << 1);
+			}
+			table[0][i] = r;
+		}
+		for (u32_t k = 1; k < SLICES; k++)
+		{
+			for (u32_t i = 0; i < 256; i++)
+			{
+				const u16_t r = table[k - 1][i];
+				table[k][i] = static_cast<u16_t>((r << 8) ^ table[0][r >> 8]);
+			}
+		}
+	}
+
+	u16_t table[SLICES][256];									// table[k][i] = CRC of Byte i + k Zero Bytes
+};
+
+const crc16_tables& get_crc16_tables()
+{
+	static const crc16_tables tables;
+	return tables;
+}
+
+// CRC16 over the data in order. (Same result as CRC16::make)
+class crc16_cursor
+{
+public:
+	explicit crc16_cursor(const u8_t* pAddr_, u16_t crc_ = 0x0000)
+		: m_table(get_crc16_tables().table)
+		, m_pAddr(pAddr_)
+		, m_pos(0)
+		, m_crc(~crc_ & 0xFFFF)
+	{}
+
+	// Add the data until the position.
+	void advance(u32_t end_)
+	{
+		if (end_ <= m_pos) return;
+
+		const u8_t* p = &m_pAddr[m_pos];
+		u32_t n = (end_ - m_pos);
+		u32_t r = m_crc;
+		while (n >= SLICES)
+		{
+			r = m_table[7][p[0] ^ (r >> 8)] ^ m_table[6][p[1] ^ (r & 0xFF)]
+				^ m_table[5][p[2]] ^ m_table[4][p[3]] ^ m_table[3][p[4]]
+				^ m_table[2][p[5]] ^ m_table[1][p[6]] ^ m_table[0][p[7]];
+			p += SLICES;
+			n -= SLICES;
+		}
+		while (n-- != 0)
+		{
+			r = ((r << 8) ^ m_table[0][((r >> 8) ^ *p++) & 0xFF]) & 0xFFFF;
+		}
+		m_crc = r;
+		m_pos = end_;
+	}
+
+	// Add the data in blocks. (Keeps the CRC close to the validation)
+	void follow(u32_t pos_)
+	{
+		if (pos_ >= (m_pos + CRC_BLOCK)) this->advance(pos_);
+	}
+
+	u16_t value() const
+	{
+		return static_cast<u16_t>(~m_crc & 0xFFFF);
+	}
+
+private:
+	const u16_t (*m_table)[256];								// Slicing Tables
+	const u8_t*  m_pAddr;										// Data
+	u32_t        m_pos;											// Position of CRC
+	u32_t        m_crc;											// CRC Register
+};
+
+// Verify the event stream of the sequence data. (Events must end at the chunk end.)
+bool verify_sequence(const u8_t* pAddr_, u32_t begin_, u32_t end_, crc16_cursor& rCrc_)
+{
+	u32_t cnt = begin_;
+	while (cnt < end_)
+	{
+		u32_t value;
+		u32_t len = check_variable_size(pAddr_, cnt, end_, value);	// Duration
+		if (len == 0) return false;
+		cnt += len;
+		if (cnt >= end_) return false;							// Duration without Event
+
+		const event_info& info = EVENT_TABLE[pAddr_[cnt]];
+		const u32_t size = check_event(pAddr_, cnt, end_, info);
+		if (size == 0) return false;
+		cnt += size;
+
+		if (info.next_state == SS_GATETIME)
+		{
+			len = check_variable_size(pAddr_, cnt, end_, value);	// Gatetime
+			if (len == 0) return false;
+			cnt += len;
+		}
+		rCrc_.follow(cnt);
+	}
+	return true;
+}
+
+// State of the verification walk.
+struct verify_context
+{
+	const chunk_registry* pRegistry;							// Chunk Types
+	crc16_cursor*         pCrc;									// CRC
+	u32_t                 open;									// Number of Open Levels
+	u32_t                 next[MAX_DEPTH];						// Expected Position of Next Chunk
+	u32_t                 end[MAX_DEPTH];						// End of Level
+	u32_t                 sequences;							// Number of Sequence Data
+	bool                  valid;								// Result
+};
+
+// Close the levels deeper than depth_. (Sub chunks must fill the container.)
+bool close_levels(verify_context& rContext_, u32_t depth_)
+{
+	while (rContext_.open > (depth_ + 1))
+	{
+		rContext_.open--;
+		if (rContext_.next[rContext_.open] != rContext_.end[rContext_.open]) return false;
+	}
+	return true;
+}
+
+walk_result verify_callback(const chunk_info& rInfo_, const u8_t* pAddr_, void* pContext_)
+{
+	verify_context& context = *static_cast<verify_context*>(pContext_);
+	const u32_t depth = rInfo_.depth;
+
+	if (depth >= (MAX_DEPTH - 1) || !close_levels(context, depth) || context.next[depth] != rInfo_.pos)
+	{
+		context.valid = false;
+		return WR_STOP;
+	}
+	if (depth == 0 && !check_chunk("MMMD", &pAddr_[rInfo_.pos]))
+	{
+		context.valid = false;
+		return WR_STOP;
+	}
+
+	const u32_t data_end = (rInfo_.data_pos + rInfo_.size);
+	context.next[depth] = data_end;
+
+	const chunk_registry::entry* pEntry = context.pRegistry->find(rInfo_.id);
+	if (pEntry != nullptr && pEntry->kind == CK_CONTAINER)
+	{
+		const u32_t head = (pEntry->pHeadSize != nullptr)
+			? pEntry->pHeadSize(&pAddr_[rInfo_.data_pos], rInfo_.size)
+			: pEntry->head_size;
+		if ((head + pEntry->tail_size) > rInfo_.size)
+		{
+			context.valid = false;
+			return WR_STOP;
+		}
+		context.next[depth + 1] = (rInfo_.data_pos + head);
+		context.end[depth + 1] = (data_end - pEntry->tail_size);
+		context.open = (depth + 2);
+		context.pCrc->follow(rInfo_.data_pos);
+		return WR_CONTINUE;
+	}
+
+	context.open = (depth + 1);
+	if (check_chunk("Mtsq", &pAddr_[rInfo_.pos]))
+	{
+		context.pCrc->advance(rInfo_.data_pos);
+		if (!verify_sequence(pAddr_, rInfo_.data_pos, data_end, *context.pCrc))
+		{
+			context.valid = false;
+			return WR_STOP;
+		}
+		context.sequences++;
+	}
+	context.pCrc->follow(data_end);
+	return WR_CONTINUE;
+}
+
+// Registry for verification. (Visits all chunks with the default callback.)
+class verify_registry : public chunk_registry
+{
+public:
+	verify_registry()
+		: chunk_registry()
+	{
+		this->set_default_callback(verify_callback);
+	}
+};
+
+}																// namespace
+
+//------------------------------------------------------------------------------------------------------//
+// Verify SMAF Data
+//------------------------------------------------------------------------------------------------------//
+bool smaf::verify(const u8_t* pAddr_, u32_t size_)
+{
+	OPENMF_TRACE_SCOPE("verify");
+	OPENMF_TRACE_COUNT("verify.bytes", size_);
+
+	static const verify_registry registry;
+
+	const u32_t head_size = (MA_3::CHUNK_HEAD_SIZE + MA_3::CHUNK_DATA_SIZE);
+	if (pAddr_ == nullptr || size_ < (head_size + MA_3::CRC_SIZE)) return false;
+	if (!check_chunk("MMMD", pAddr_)) return false;
+	if (calc_size(&pAddr_[MA_3::CHUNK_HEAD_SIZE], MA_3::CHUNK_DATA_SIZE) != (size_ - head_size)) return false;
+
+	crc16_cursor crc(pAddr_);
+
+	verify_context context;
+	context.pRegistry = &registry;
+	context.pCrc = &crc;
+	context.open = 1;
+	context.next[0] = 0;
+	context.end[0] = size_;
+	context.sequences = 0;
+	context.valid = true;
+
+	if (!registry.walk(pAddr_, size_, &context) || !context.valid) return false;
+	if (!close_levels(context, 0) || context.next[0] != size_) return false;
+	if (context.sequences == 0) return false;					// No Sequence Data
+
+	const u32_t crc_pos = (size_ - MA_3::CRC_SIZE);
+	crc.advance(crc_pos);
+	const u16_t crc_code = static_cast<u16_t>((pAddr_[crc_pos] << 8) | pAddr_[crc_pos + 1]);
+	return (crc.value() == crc_code);
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Calculate CRC16
+//------------------------------------------------------------------------------------------------------//
+u16_t smaf::calc_crc16(const u8_t* pAddr_, u32_t size_, u16_t crc_)
+{
+	crc16_cursor crc(pAddr_, crc_);
+	crc.advance(size_);
+	return crc.value();
+}
+
+//------------------------------------------------------------------------------------------------------//
+// End of File
+//------------------------------------------------------------------------------------------------------//
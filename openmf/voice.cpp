@@ -0,0 +1,528 @@
+//------------------------------------------------------------------------------------------------------//
+//
+//                                          License Agreement
+//                                     For Open Source SMAF Library
+//
+//                         Copyright (c) 2015-2017, @shirajira, all rights reserved.
+//
+//------------------------------------------------------------------------------------------------------//
+
+#include "voice.h"
+#include "apis.h"
+#include "array_operations.h"
+#include "chunk.h"
+#include <cstdio>
+#include <cstring>
+#include <utility>
+
+using namespace smaf;
+
+//------------------------------------------------------------------------------------------------------//
+// Internal Helpers
+//------------------------------------------------------------------------------------------------------//
+namespace {
+
+const u64_t HASH_SEED = 0xCBF29CE484222325ULL;					// FNV-1a Offset Basis (64bit)
+const u64_t HASH_PRIME = 0x00000100000001B3ULL;					// FNV-1a Prime (64bit)
+const u32_t MIN_SLOTS = 64;										// Initial Slots of voice_library
+const char  MAGIC[4] = { 'O', 'M', 'F', 'V' };					// Library Magic
+const u32_t VERSION = 1;										// Library Version
+const u32_t HEAD_SIZE = 16;										// Library Header Size [byte]
+const u32_t SEEK_VALUE_SIZE = 4;								// Value Size of "st" and "sp" [byte]
+const u32_t VOICE_HEAD_SIZE = 9;								// 43 79 <Device> 7F 01 <MSB> <LSB> <PC> <Key>
+
+u64_t hash_block(const u8_t* p_, u32_t size_)
+{
+	u64_t hash = HASH_SEED;
+	for (u32_t i = 0; i < size_; i++)
+	{
+		hash = ((hash ^ p_[i]) * HASH_PRIME);
+	}
+	return hash;
+}
+
+void put_u64(u64_t value_, u8_t* p_)
+{
+	for (u32_t i = 0; i < 8; i++)
+	{
+		p_[i] = static_cast<u8_t>(value_ >> ((7 - i) * 8));
+	}
+}
+
+u64_t get_u64(const u8_t* p_)
+{
+	u64_t value = 0;
+	for (u32_t i = 0; i < 8; i++)
+	{
+		value = ((value << 8) | p_[i]);
+	}
+	return value;
+}
+
+// Parse the seek & phrase items. ("st" and "sp" have 4 bytes of value, others end with ',')
+bool parse_seek(const u8_t* pAddr_, u32_t pos_, u32_t size_, std::vector<seek_item>& rDst_)
+{
+	const u32_t end = (pos_ + size_);
+	u32_t pos = pos_;
+	while (pos < end)
+	{
+		if ((pos + 3) > end || pAddr_[pos + 2] != ':') return false;
+		seek_item item;
+		item.tag.assign(reinterpret_cast<const char*>(&pAddr_[pos]), 2);
+		item.pos = (pos + 3);
+		item.value = 0;
+		pos += 3;
+
+		if (item.tag == "st" || item.tag == "sp")
+		{
+			if ((pos + SEEK_VALUE_SIZE) > end) return false;
+			item.value = calc_size(&pAddr_[pos], 2);
+			item.value = ((item.value << 16) | calc_size(&pAddr_[pos + 2], 2));
+			pos += SEEK_VALUE_SIZE;
+		}
+		else
+		{
+			while (pos < end && pAddr_[pos] != ',') pos++;
+		}
+		item.size = (pos - item.pos);
+		if (pos >= end || pAddr_[pos] != ',') return false;
+		pos++;
+		rDst_.push_back(item);
+	}
+	return true;
+}
+
+// Parse the setup messages. (F0 + Variable Size + Data)
+bool parse_setup(const u8_t* pAddr_, u32_t pos_, u32_t size_, std::vector<setup_message>& rDst_)
+{
+	const u32_t end = (pos_ + size_);
+	u32_t pos = pos_;
+	while (pos < end)
+	{
+		if (pAddr_[pos] != SE_SYSTEM_EXCLUSIVE || (pos + 2) > end) return false;
+
+		// The variable size must end in the chunk.
+		u32_t len = 1;
+		while ((pAddr_[pos + len] & 0x80) && len < 4 && (pos + 1 + len) < end) len++;
+		if ((pAddr_[pos + len] & 0x80) != 0) return false;
+		const u32_t data_size = calc_variable_size(&pAddr_[pos + 1], len);
+		if (static_cast<u64_t>(pos) + 1 + len + data_size > end) return false;
+
+		setup_message msg;
+		msg.pos = pos;
+		msg.size = (1 + len + data_size);
+		msg.data_pos = (pos + 1 + len);
+		msg.data_size = data_size;
+
+		const u8_t* p = &pAddr_[msg.data_pos];
+		msg.voice = (data_size > VOICE_HEAD_SIZE && p[0] == 0x43 && p[1] == 0x79 && p[3] == 0x7F && p[4] == 0x01);
+		msg.bank_msb = msg.voice ? p[5] : 0;
+		msg.bank_lsb = msg.voice ? p[6] : 0;
+		msg.program = msg.voice ? p[7] : 0;
+		msg.key = msg.voice ? p[8] : 0;
+		rDst_.push_back(msg);
+		pos += msg.size;
+	}
+	return true;
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Setup Layout (Internal)
+//------------------------------------------------------------------------------------------------------//
+
+// Score track chunk.
+struct track_chunk
+{
+	u32_t size_pos;												// Position of MTR* Size
+	u32_t size;													// MTR* Data Size [byte]
+	u32_t end;													// End of MTR* Data
+};
+
+// Context of the walk.
+struct setup_context
+{
+	std::vector<track_setup>* pTracks;							// Decoded Tracks
+	std::vector<track_chunk>  chunks;							// Track Chunks (Same Order)
+	u32_t                     file_size_pos;					// Position of MMMD Size
+	u32_t                     file_size;						// MMMD Data Size [byte]
+	bool                      file;								// MMMD Found
+	bool                      ok;								// No Error
+};
+
+walk_result setup_file(const chunk_info& rInfo_, const u8_t* /*pAddr_*/, void* pContext_)
+{
+	setup_context* pContext = static_cast<setup_context*>(pContext_);
+	if (rInfo_.depth != 0 || pContext->file) return WR_SKIP;
+	pContext->file = true;
+	pContext->file_size_pos = rInfo_.size_pos;
+	pContext->file_size = rInfo_.size;
+	return WR_CONTINUE;
+}
+
+walk_result setup_track(const chunk_info& rInfo_, const u8_t* pAddr_, void* pContext_)
+{
+	setup_context* pContext = static_cast<setup_context*>(pContext_);
+	if (rInfo_.depth != 1) return WR_SKIP;
+
+	track_setup track;
+	track.number = pAddr_[rInfo_.pos + 3];
+	track.setup_size_pos = 0;
+	track.setup_pos = 0;
+	track.setup_size = 0;
+	pContext->pTracks->push_back(track);
+
+	track_chunk chunk;
+	chunk.size_pos = rInfo_.size_pos;
+	chunk.size = rInfo_.size;
+	chunk.end = (rInfo_.data_pos + rInfo_.size);
+	pContext->chunks.push_back(chunk);
+	return WR_CONTINUE;
+}
+
+// Track of the chunk at depth 2. (nullptr = Not in a Score Track)
+track_setup* current_track(const chunk_info& rInfo_, setup_context* pContext_)
+{
+	if (rInfo_.depth != 2 || pContext_->chunks.empty() || rInfo_.pos >= pContext_->chunks.back().end) return nullptr;
+	return &pContext_->pTracks->back();
+}
+
+walk_result setup_seek(const chunk_info& rInfo_, const u8_t* pAddr_, void* pContext_)
+{
+	setup_context* pContext = static_cast<setup_context*>(pContext_);
+	track_setup* pTrack = current_track(rInfo_, pContext);
+	if (pTrack != nullptr && pTrack->seek.empty())
+	{
+		if (!parse_seek(pAddr_, rInfo_.data_pos, rInfo_.size, pTrack->seek)) pContext->ok = false;
+	}
+	return WR_SKIP;
+}
+
+walk_result setup_data(const chunk_info& rInfo_, const u8_t* pAddr_, void* pContext_)
+{
+	setup_context* pContext = static_cast<setup_context*>(pContext_);
+	track_setup* pTrack = current_track(rInfo_, pContext);
+	if (pTrack != nullptr && pTrack->setup_size_pos == 0)
+	{
+		pTrack->setup_size_pos = rInfo_.size_pos;
+		pTrack->setup_pos = rInfo_.data_pos;
+		pTrack->setup_size = rInfo_.size;
+		if (!parse_setup(pAddr_, rInfo_.data_pos, rInfo_.size, pTrack->messages)) pContext->ok = false;
+	}
+	return WR_SKIP;
+}
+
+walk_result setup_skip(const chunk_info& /*rInfo_*/, const u8_t* /*pAddr_*/, void* /*pContext_*/)
+{
+	return WR_SKIP;
+}
+
+// Registry to decode the setup. (Enters MMMD and MTR* only.)
+class setup_registry : public chunk_registry
+{
+public:
+	setup_registry()
+		: chunk_registry()
+	{
+		this->set_callback("MMMD", setup_file);
+		this->set_callback("MTR*", setup_track);
+		this->set_callback("MspI", setup_seek);
+		this->set_callback("Mtsu", setup_data);
+		this->set_default_callback(setup_skip);
+	}
+};
+
+bool analyze_setup(const MA_3& rSrc_, setup_context& rContext_)
+{
+	static const setup_registry registry;
+
+	rContext_.pTracks->clear();
+	rContext_.chunks.clear();
+	rContext_.file_size_pos = 0;
+	rContext_.file_size = 0;
+	rContext_.file = false;
+	rContext_.ok = true;
+	if (rSrc_.empty()) return false;
+	if (!registry.walk(rSrc_.data_ptr(), rSrc_.size(), &rContext_)) return false;
+	return (rContext_.file && rContext_.ok);
+}
+
+// Slot of the voice. (Bank MSB, Bank LSB, Program, Drum Key)
+inline u32_t voice_slot(const setup_message& rMsg_)
+{
+	return ((static_cast<u32_t>(rMsg_.bank_msb) << 24) | (static_cast<u32_t>(rMsg_.bank_lsb) << 16) | (static_cast<u32_t>(rMsg_.program) << 8) | rMsg_.key);
+}
+
+}																// namespace
+
+//------------------------------------------------------------------------------------------------------//
+// Decode MspI and Mtsu of every Score Track
+//------------------------------------------------------------------------------------------------------//
+bool smaf::decode_setup(const MA_3& rSrc_, std::vector<track_setup>& rDst_)
+{
+	OPENMF_TRACE_SCOPE("decode_setup");
+	setup_context context;
+	context.pTracks = &rDst_;
+	return analyze_setup(rSrc_, context);
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Remove Redundant Voices
+//------------------------------------------------------------------------------------------------------//
+bool smaf::dedup_voices(const MA_3& rSrc_, MA_3& rDst_, u32_t& rRemoved_)
+{
+	OPENMF_TRACE_SCOPE("dedup_voices");
+	rRemoved_ = 0;
+
+	std::vector<track_setup> tracks;
+	setup_context context;
+	context.pTracks = &tracks;
+	if (rSrc_ == rDst_ || !analyze_setup(rSrc_, context)) return false;
+	const u8_t* pAddr = rSrc_.data_ptr();
+
+	// (1) A voice is redundant when its slot already has the same parameters. Other messages
+	//     (reset, ...) can change the voices, so they forget the slots.
+	//
+	std::vector<const setup_message*> removed;
+	std::vector<u32_t> track_removed(tracks.size(), 0);
+	for (size_t t = 0; t < tracks.size(); t++)
+	{
+		std::vector<std::pair<u32_t, const setup_message*> > active;
+		for (size_t i = 0; i < tracks[t].messages.size(); i++)
+		{
+			const setup_message& msg = tracks[t].messages[i];
+			if (!msg.voice)
+			{
+				active.clear();
+				continue;
+			}
+
+			const u32_t slot = voice_slot(msg);
+			size_t n = 0;
+			for (; n < active.size() && active[n].first != slot; n++);
+			if (n < active.size())
+			{
+				const setup_message& prev = *active[n].second;
+				if (prev.data_size == msg.data_size && std::memcmp(&pAddr[prev.data_pos], &pAddr[msg.data_pos], msg.data_size) == 0)
+				{
+					removed.push_back(&msg);
+					track_removed[t] += msg.size;
+					rRemoved_ += msg.size;
+					continue;
+				}
+				active[n].second = &msg;
+			}
+			else
+			{
+				active.push_back(std::make_pair(slot, &msg));
+			}
+		}
+	}
+
+	// (2) Copy without the removed messages and fix the sizes.
+	//
+	if (!rDst_.create(rSrc_.size() - rRemoved_)) return false;
+	u8_t* pDst = rDst_.data_ptr();
+	u32_t src_pos = 0;
+	u32_t dst_pos = 0;
+	for (size_t i = 0; i < removed.size(); i++)
+	{
+		std::memcpy(&pDst[dst_pos], &pAddr[src_pos], removed[i]->pos - src_pos);
+		dst_pos += (removed[i]->pos - src_pos);
+		src_pos = (removed[i]->pos + removed[i]->size);
+	}
+	std::memcpy(&pDst[dst_pos], &pAddr[src_pos], rSrc_.size() - src_pos);
+
+	// Size fields are before the removed messages of their chunk, so they move by the bytes
+	// removed in the earlier tracks.
+	u32_t shift = 0;
+	for (size_t t = 0; t < tracks.size(); t++)
+	{
+		if (track_removed[t] == 0) continue;
+		make_size_array(context.chunks[t].size - track_removed[t], MA_3::CHUNK_DATA_SIZE, &pDst[context.chunks[t].size_pos - shift]);
+		make_size_array(tracks[t].setup_size - track_removed[t], MA_3::CHUNK_DATA_SIZE, &pDst[tracks[t].setup_size_pos - shift]);
+		shift += track_removed[t];
+	}
+	make_size_array(context.file_size - rRemoved_, MA_3::CHUNK_DATA_SIZE, &pDst[context.file_size_pos]);
+	return fix_crc16(rDst_);
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Voice Library Class
+//------------------------------------------------------------------------------------------------------//
+voice_library::voice_library()
+	: m_mutex()
+	, m_pool()
+	, m_offset(1, 0)
+	, m_hash()
+	, m_slot(MIN_SLOTS, 0)
+	, m_references(0)
+	, m_added_bytes(0)
+{}
+
+voice_library::~voice_library()
+{}
+
+u32_t voice_library::find_slot(u64_t hash_, const u8_t* pData_, u32_t size_) const
+{
+	const u32_t mask = static_cast<u32_t>(m_slot.size() - 1);
+	u32_t i = static_cast<u32_t>(hash_ & mask);
+	while (m_slot[i] != 0)
+	{
+		const u32_t id = (m_slot[i] - 1);
+		if (m_hash[id] == hash_ && (m_offset[id + 1] - m_offset[id]) == size_ && std::memcmp(&m_pool[static_cast<size_t>(m_offset[id])], pData_, size_) == 0) break;
+		i = ((i + 1) & mask);
+	}
+	return i;
+}
+
+void voice_library::rehash(u32_t slots_)
+{
+	m_slot.assign(slots_, 0);
+	const u32_t mask = (slots_ - 1);
+	for (u32_t id = 0; id < static_cast<u32_t>(m_hash.size()); id++)
+	{
+		u32_t i = static_cast<u32_t>(m_hash[id] & mask);
+		while (m_slot[i] != 0) i = ((i + 1) & mask);
+		m_slot[i] = (id + 1);
+	}
+}
+
+u32_t voice_library::add(const u8_t* pData_, u32_t size_)
+{
+	const u64_t hash = hash_block(pData_, size_);
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_references++;
+	m_added_bytes += size_;
+
+	// The load factor is kept under 1/2.
+	if ((m_hash.size() + 1) * 2 > m_slot.size()) this->rehash(static_cast<u32_t>(m_slot.size() * 2));
+
+	const u32_t i = this->find_slot(hash, pData_, size_);
+	if (m_slot[i] != 0) return (m_slot[i] - 1);
+
+	const u32_t id = static_cast<u32_t>(m_hash.size());
+	m_pool.insert(m_pool.end(), pData_, pData_ + size_);
+	m_offset.push_back(m_pool.size());
+	m_hash.push_back(hash);
+	m_slot[i] = (id + 1);
+	return id;
+}
+
+bool voice_library::add_tune(const MA_3& rSrc_, std::vector<u32_t>& rIds_)
+{
+	rIds_.clear();
+	std::vector<track_setup> tracks;
+	if (!decode_setup(rSrc_, tracks)) return false;
+
+	const u8_t* pAddr = rSrc_.data_ptr();
+	for (size_t t = 0; t < tracks.size(); t++)
+	{
+		for (size_t i = 0; i < tracks[t].messages.size(); i++)
+		{
+			const setup_message& msg = tracks[t].messages[i];
+			if (msg.voice) rIds_.push_back(this->add(&pAddr[msg.data_pos], msg.data_size));
+		}
+	}
+	return true;
+}
+
+const u8_t* voice_library::get(u32_t id_, u32_t& rSize_) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (id_ >= m_hash.size()) return nullptr;
+	rSize_ = static_cast<u32_t>(m_offset[id_ + 1] - m_offset[id_]);
+	return m_pool.empty() ? nullptr : &m_pool[static_cast<size_t>(m_offset[id_])];
+}
+
+u32_t voice_library::voices() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return static_cast<u32_t>(m_hash.size());
+}
+
+u64_t voice_library::references() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_references;
+}
+
+u64_t voice_library::added_bytes() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_added_bytes;
+}
+
+u64_t voice_library::unique_bytes() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_pool.size();
+}
+
+bool voice_library::save(const char* szFile_) const
+{
+	OPENMF_TRACE_SCOPE("voice_library::save");
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	std::vector<u8_t> head(HEAD_SIZE + m_offset.size() * 8, 0);
+	std::memcpy(&head[0], MAGIC, sizeof(MAGIC));
+	make_size_array(VERSION, 4, &head[4]);
+	make_size_array(static_cast<u32_t>(m_hash.size()), 4, &head[8]);
+	for (size_t i = 0; i < m_offset.size(); i++)
+	{
+		put_u64(m_offset[i], &head[HEAD_SIZE + i * 8]);
+	}
+
+	// Written to a temporary file and renamed. (Readers never see a partial library.)
+	const std::string temp_file = std::string(szFile_) + ".tmp";
+	std::FILE* fp = std::fopen(temp_file.c_str(), "wb");
+	if (fp == nullptr) return false;
+	bool ok = (std::fwrite(&head[0], 1, head.size(), fp) == head.size());
+	ok = ok && (m_pool.empty() || std::fwrite(&m_pool[0], 1, m_pool.size(), fp) == m_pool.size());
+	ok = (std::fclose(fp) == 0) && ok;
+	ok = ok && (std::rename(temp_file.c_str(), szFile_) == 0);
+	if (!ok) std::remove(temp_file.c_str());
+	return ok;
+}
+
+bool voice_library::load(const char* szFile_)
+{
+	OPENMF_TRACE_SCOPE("voice_library::load");
+	binary_array file;
+	if (!smaf::load(szFile_, file) || file.size() < HEAD_SIZE) return false;
+	const u8_t* p = file.data_ptr();
+	if (std::memcmp(p, MAGIC, sizeof(MAGIC)) != 0) return false;
+	if ((static_cast<u32_t>(p[4]) << 24 | static_cast<u32_t>(p[5]) << 16 | static_cast<u32_t>(p[6]) << 8 | p[7]) != VERSION) return false;
+
+	const u64_t voices = (static_cast<u64_t>(p[8]) << 24 | static_cast<u64_t>(p[9]) << 16 | static_cast<u64_t>(p[10]) << 8 | p[11]);
+	const u64_t pool_pos = (HEAD_SIZE + (voices + 1) * 8);
+	if (pool_pos > file.size()) return false;
+
+	// Offsets must grow and end at the end of the file.
+	std::vector<u64_t> offset(static_cast<size_t>(voices + 1));
+	for (size_t i = 0; i < offset.size(); i++)
+	{
+		offset[i] = get_u64(&p[HEAD_SIZE + i * 8]);
+		if ((i == 0 && offset[i] != 0) || (i > 0 && offset[i] < offset[i - 1])) return false;
+	}
+	if (offset.back() != (file.size() - pool_pos)) return false;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_pool.assign(&p[pool_pos], &p[pool_pos] + static_cast<size_t>(offset.back()));
+	m_offset.swap(offset);
+	m_hash.resize(static_cast<size_t>(voices));
+	for (size_t id = 0; id < m_hash.size(); id++)
+	{
+		const u32_t size = static_cast<u32_t>(m_offset[id + 1] - m_offset[id]);
+		m_hash[id] = hash_block(m_pool.empty() ? nullptr : &m_pool[static_cast<size_t>(m_offset[id])], size);
+	}
+	u32_t slots = MIN_SLOTS;
+	while (slots < (m_hash.size() + 1) * 2) slots *= 2;
+	this->rehash(slots);
+	m_references = 0;
+	m_added_bytes = 0;
+	return true;
+}
+
+//------------------------------------------------------------------------------------------------------//
+// End of File
+//------------------------------------------------------------------------------------------------------//
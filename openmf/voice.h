@@ -0,0 +1,145 @@
+//------------------------------------------------------------------------------------------------------//
+//
+//                                          License Agreement
+//                                     For Open Source SMAF Library
+//
+//                         Copyright (c) 2015-2017, @shirajira, all rights reserved.
+//
+//------------------------------------------------------------------------------------------------------//
+
+#ifndef openmf_voice_h__
+#define openmf_voice_h__
+#pragma once
+
+#include "core.h"
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace smaf {
+
+//------------------------------------------------------------------------------------------------------//
+// Seek & Phrase Item (struct, MspI: "st" = Start Point, "sp" = Stop Point, ...)
+//------------------------------------------------------------------------------------------------------//
+struct seek_item
+{
+	std::string tag;											// Tag (2 Characters)
+	u32_t       pos;											// Position of the Value in the Image
+	u32_t       size;											// Value Size [byte]
+	u32_t       value;											// Value of "st" and "sp" (Big Endian, otherwise 0)
+};
+
+//------------------------------------------------------------------------------------------------------//
+// Setup Message (struct, Mtsu: F0 + Variable Size + Data)
+//
+// A voice is the Yamaha mobile voice parameter: 43 79 <Device> 7F 01 <Bank MSB> <Bank LSB> <Program>
+// <Drum Key> <Voice Data> F7. The voice parameter block is the data from 43 to F7.
+//------------------------------------------------------------------------------------------------------//
+struct setup_message
+{
+	u32_t pos;													// Position of F0
+	u32_t size;													// Message Size (F0 to F7) [byte]
+	u32_t data_pos;												// Position of the Data
+	u32_t data_size;											// Data Size [byte]
+	bool  voice;												// Voice Parameter
+	u8_t  bank_msb;												// Bank Select MSB (Voice)
+	u8_t  bank_lsb;												// Bank Select LSB (Voice)
+	u8_t  program;												// Program Number (Voice)
+	u8_t  key;													// Drum Key (Voice)
+};
+
+//------------------------------------------------------------------------------------------------------//
+// Track Setup (struct, MspI and Mtsu of a Score Track)
+//------------------------------------------------------------------------------------------------------//
+struct track_setup
+{
+	u32_t                      number;							// Track Number
+	u32_t                      setup_size_pos;					// Position of Mtsu Size (0 = No Mtsu)
+	u32_t                      setup_pos;						// Position of Mtsu Data
+	u32_t                      setup_size;						// Mtsu Data Size [byte]
+	std::vector<seek_item>     seek;							// MspI Items
+	std::vector<setup_message> messages;						// Mtsu Messages
+};
+
+//------------------------------------------------------------------------------------------------------//
+// Decode MspI and Mtsu of every Score Track
+//------------------------------------------------------------------------------------------------------//
+bool decode_setup(const MA_3& rSrc_, std::vector<track_setup>& rDst_);
+
+//------------------------------------------------------------------------------------------------------//
+// Remove Redundant Voices (Redefinition of a Voice with the Same Parameters, rSrc_ != rDst_)
+//
+// Mtsu, track and file sizes and CRC16 are fixed. rRemoved_ = Removed Bytes.
+//------------------------------------------------------------------------------------------------------//
+bool dedup_voices(const MA_3& rSrc_, MA_3& rDst_, u32_t& rRemoved_);
+
+//------------------------------------------------------------------------------------------------------//
+// Voice Library Class (Content Hashed, One Copy of Each Voice Parameter Block)
+//
+// add and get can be called concurrently. A pointer from get is valid until the next add.
+//
+// Binary Format (Big Endian): "OMFV", Version (4), Voices (4), Reserved (4), Offsets ((Voices + 1) * 8),
+// Blocks
+//------------------------------------------------------------------------------------------------------//
+class voice_library
+{
+public:
+	voice_library();
+	virtual ~voice_library();
+
+private:
+	voice_library(const voice_library&);
+	voice_library& operator=(const voice_library&);
+
+public:
+	// Add the voice parameter block. (Return: Voice ID, the same ID for the same block)
+	u32_t add(const u8_t* pData_, u32_t size_);
+
+	// Add the voices of the tune. (rIds_ = Voice IDs in the order of decode_setup)
+	bool add_tune(const MA_3& rSrc_, std::vector<u32_t>& rIds_);
+
+	// Return the voice parameter block. (nullptr = Unknown ID)
+	const u8_t* get(u32_t id_, u32_t& rSize_) const;
+
+	// Return the number of unique voices.
+	u32_t voices() const;
+
+	// Return the number of added voices.
+	u64_t references() const;
+
+	// Return the size of the added voices. [byte]
+	u64_t added_bytes() const;
+
+	// Return the size of the unique voices. [byte]
+	u64_t unique_bytes() const;
+
+	// Save the library.
+	bool save(const char* szFile_) const;
+
+	// Load the library.
+	bool load(const char* szFile_);
+
+private:
+	// Find the voice or the empty slot. (Locked)
+	u32_t find_slot(u64_t hash_, const u8_t* pData_, u32_t size_) const;
+
+	// Rebuild the slots. (Locked)
+	void rehash(u32_t slots_);
+
+private:
+	mutable std::mutex m_mutex;									// Mutex
+	std::vector<u8_t>  m_pool;									// Voice Parameter Blocks
+	std::vector<u64_t> m_offset;								// Offsets of the Blocks (Voices + 1)
+	std::vector<u64_t> m_hash;									// Hashes of the Blocks
+	std::vector<u32_t> m_slot;									// Open Addressing Slots (Voice ID + 1, 0 = Empty)
+	u64_t              m_references;							// Added Voices
+	u64_t              m_added_bytes;							// Size of the Added Voices [byte]
+};
+
+//------------------------------------------------------------------------------------------------------//
+}																// namespace smaf
+
+#endif															// openmf_voice_h__
+//------------------------------------------------------------------------------------------------------//
+// End of File
+//------------------------------------------------------------------------------------------------------//
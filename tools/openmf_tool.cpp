@@ -0,0 +1,1241 @@
+//------------------------------------------------------------------------------------------------------//
+//
+//                                          License Agreement
+//                                     For Open Source SMAF Library
+//
+//                         Copyright (c) 2015-2017, @shirajira, all rights reserved.
+//
+//------------------------------------------------------------------------------------------------------//
+//
+// openmf-tool: Command Line Batch Tool
+//
+//   g++ -std=c++11 -O2 -pthread -Iopenmf tools/openmf_tool.cpp openmf/*.cpp -o openmf-tool
+//
+//   Add -DOPENMF_TRACE to enable --trace and --counters.
+//
+//------------------------------------------------------------------------------------------------------//
+
+#include "apis.h"
+#include "batch_io.h"
+#include "catalog.h"
+#include "delta.h"
+#include "fingerprint.h"
+#include "metadata.h"
+#include "polyphony.h"
+#include "service.h"
+#include "text.h"
+#include "voice.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#ifndef _WIN32
+#include <glob.h>
+#endif
+
+using namespace smaf;
+
+namespace {
+
+//------------------------------------------------------------------------------------------------------//
+// Command Options
+//------------------------------------------------------------------------------------------------------//
+struct options
+{
+	std::string              command;							// Sub Command
+	std::vector<std::string> args;								// Command Arguments
+	std::vector<std::string> inputs;							// Input Files
+	std::string              out_dir;							// Output Directory ("" = None)
+	bool                     in_place;							// Overwrite Input Files
+	bool                     stats;								// Print Statistics
+	bool                     batch;								// Use Batch I/O (io_uring or pread/pwrite)
+	bool                     buffer;							// Send Images to the Service in Shared Memory
+	std::string              trace_file;						// Chrome Trace Output ("" = None)
+	std::string              counters_file;						// Counters Output ("" = None)
+	std::string              catalog;							// Catalog for metadata ("" = Inputs)
+	std::string              library;							// Voice Library for voices ("" = None)
+	u32_t                    jobs;								// Number of Parallel Jobs
+	u32_t                    gap;								// Gap for combine
+	u64_t                    first_id;							// First ID for pack
+	f64_t                    min_score;							// Min Score for similar
+	timebase                 new_timebase;						// Timebase for tempo ("RESERVED" = Keep)
+	event_filter             filter;							// Filter for filter
+};
+
+//------------------------------------------------------------------------------------------------------//
+// Statistics (Per Stage)
+//------------------------------------------------------------------------------------------------------//
+struct statistics
+{
+	statistics()
+		: files(0), failed(0), bytes_in(0), bytes_out(0), load_ns(0), process_ns(0), save_ns(0)
+	{}
+
+	std::atomic<u64_t> files;									// Processed Files
+	std::atomic<u64_t> failed;									// Failed Files
+	std::atomic<u64_t> bytes_in;								// Loaded Bytes
+	std::atomic<u64_t> bytes_out;								// Saved Bytes
+	std::atomic<u64_t> load_ns;									// Time of Load [ns]
+	std::atomic<u64_t> process_ns;								// Time of Process [ns]
+	std::atomic<u64_t> save_ns;									// Time of Save [ns]
+};
+
+typedef std::chrono::steady_clock clock_type;
+
+u64_t elapsed_ns(const clock_type::time_point& rBegin_)
+{
+	return static_cast<u64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now() - rBegin_).count());
+}
+
+std::mutex g_print_mutex;										// Mutex for stdout/stderr
+
+//------------------------------------------------------------------------------------------------------//
+// Usage
+//------------------------------------------------------------------------------------------------------//
+void usage()
+{
+	std::fprintf(stderr,
+		"usage: openmf-tool <command> [arguments] [options] <input...>\n"
+		"\n"
+		"commands:\n"
+		"  info                          print format, timebase, channel status and tracks\n"
+		"  verify                        print valid files (chunk tree, sizes, events and crc)\n"
+		"  text                          print CNTI options and OPDA data as UTF-8 (tag=text)\n"
+		"  polyphony                     print notes, peak simultaneous notes and per-channel peaks (peak@ms)\n"
+		"  set-text <tag> <text>         change the text of the tag (UTF-8, empty = remove)\n"
+		"  crc                           fix CRC16\n"
+		"  nop                           remove NOP (for smooth loop)\n"
+		"  dedup-voices                  remove voices redefined with the same parameters in Mtsu\n"
+		"  limit-voices <n>              limit simultaneous notes to <n> (steal rhythm, low velocity, old notes)\n"
+		"  optimize                      minimize sequence size (merge NOP, drop redundant PC/CC)\n"
+		"  clear-status                  clear channel status\n"
+		"  status <ch> <hex>             change channel status\n"
+		"  timebase <code>               change timebase (hex code, e.g. 02 = 4ms)\n"
+		"  tempo <ratio>                 change tempo (--timebase <code> to convert timebase)\n"
+		"  trim <begin> <end>            trim by ticks (end = 0: end of sequence)\n"
+		"  split <src> <ticks> <prefix>  split at ticks (e.g. 480,960) into <prefix>-1.mmf, <prefix>-2.mmf, ...\n"
+		"  filter                        --mute <mask> --transpose <n> --velocity <ratio>\n"
+		"  combine <src1> <src2> <dst>   combine two files (--gap <ticks>)\n"
+		"  repeat <count>                repeat the tune <count> times (--gap <ticks>)\n"
+		"  diff <base> <target> <patch>  make a patch from <base> to <target>\n"
+		"  patch <base> <patch> <dst>    apply a patch to <base>\n"
+		"  pack <catalog>                append files to <catalog>.dat/.idx (--first-id <n>)\n"
+		"  metadata <out>                extract metadata columns of the inputs or --catalog <path> (.csv or binary)\n"
+		"  voices                        print voice ids shared across the inputs (--library <file>: save voices)\n"
+		"  similar                       print files with the same melody as an earlier file (--min-score <x>)\n"
+		"  serve <socket>                run the operations of call on -j workers until SIGINT/SIGTERM\n"
+		"  call <socket> <ops>           run \"op args; op args; ...\" in the service (--buffer: send images)\n"
+		"  service-stats <socket>        print requests, queue depth and latency percentiles of the service\n"
+		"\n"
+		"inputs:\n"
+		"  <file>, <glob pattern> or @<manifest> (one path per line)\n"
+		"\n"
+		"options:\n"
+		"  -j <n>                        number of parallel jobs (0 = hardware threads)\n"
+		"  -o <dir>                      output directory\n"
+		"  --in-place                    overwrite input files\n"
+		"  --stats                       print per-stage timings and throughput\n"
+		"  --batch-io                    asynchronous batch i/o (io_uring, fallback: pread/pwrite)\n"
+		"  --trace <file>                write chrome trace json (OPENMF_TRACE build)\n"
+		"  --counters <file>             write instrumentation counters (OPENMF_TRACE build)\n");
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Input Expansion
+//------------------------------------------------------------------------------------------------------//
+bool add_manifest(const std::string& rPath_, std::vector<std::string>& rDst_)
+{
+	std::ifstream fin(rPath_.c_str());
+	if (!fin.is_open()) return false;
+
+	std::string line;
+	while (std::getline(fin, line))
+	{
+		if (!line.empty() && line[line.size() - 1] == '\r') line.erase(line.size() - 1);
+		if (!line.empty()) rDst_.push_back(line);
+	}
+	return true;
+}
+
+bool add_input(const std::string& rArg_, std::vector<std::string>& rDst_)
+{
+	if (rArg_[0] == '@') return add_manifest(rArg_.substr(1), rDst_);
+
+#ifndef _WIN32
+	if (rArg_.find_first_of("*?[") != std::string::npos)
+	{
+		glob_t result;
+		if (glob(rArg_.c_str(), 0, nullptr, &result) != 0) return false;
+		for (size_t i = 0; i < result.gl_pathc; i++)
+		{
+			rDst_.push_back(result.gl_pathv[i]);
+		}
+		globfree(&result);
+		return true;
+	}
+#endif
+
+	rDst_.push_back(rArg_);
+	return true;
+}
+
+std::string output_path(const options& rOpt_, const std::string& rInput_)
+{
+	if (rOpt_.in_place) return rInput_;
+
+	const size_t sep = rInput_.find_last_of("/\\");
+	const std::string name = (sep == std::string::npos) ? rInput_ : rInput_.substr(sep + 1);
+	return rOpt_.out_dir + "/" + name;
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Info
+//------------------------------------------------------------------------------------------------------//
+const char* format_name(format_type fmt_)
+{
+	switch (fmt_)
+	{
+	case format_type::HANDY_PHONE:        return "HandyPhone";
+	case format_type::MOBILE_COMPRESS:    return "Mobile(Compress)";
+	case format_type::MOBILE_NO_COMPRESS: return "Mobile(NoCompress)";
+	default:                              return "Reserved";
+	}
+}
+
+std::string make_info(const MA_3& rData_)
+{
+	const format_type fmt = rData_.get_format();
+	const timebase tb = rData_.get_timebase();
+
+	char buf[128];
+	std::string line;
+	std::snprintf(buf, sizeof(buf), "\tformat=%s\tsize=%lu\ttimebase=%lums/%lums\tstatus=",
+		format_name(fmt),
+		static_cast<unsigned long>(rData_.size()),
+		static_cast<unsigned long>(tb.D_ms()),
+		static_cast<unsigned long>(tb.G_ms()));
+	line += buf;
+
+	for (u32_t ch = 0; ch < MA_3::CHANNELS; ch++)
+	{
+		std::snprintf(buf, sizeof(buf), (ch == 0) ? "%02X" : ",%02X", rData_.get_channel_status(ch)());
+		line += buf;
+	}
+
+	std::vector<track_info> tracks;
+	enumerate_tracks(rData_, tracks);
+	line += "\ttracks=";
+	for (size_t i = 0; i < tracks.size(); i++)
+	{
+		std::snprintf(buf, sizeof(buf), (i == 0) ? "%s%02lX" : ",%s%02lX",
+			tracks[i].audio ? "ATR" : "MTR",
+			static_cast<unsigned long>(tracks[i].number));
+		line += buf;
+	}
+	return line;
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Text ("" = Not Readable, Tabs and Line Breaks in the Text are Spaces)
+//------------------------------------------------------------------------------------------------------//
+void add_text_items(const std::vector<text_item>& rItems_, std::string& rDst_)
+{
+	for (size_t i = 0; i < rItems_.size(); i++)
+	{
+		rDst_ += '\t';
+		rDst_ += rItems_[i].tag;
+		rDst_ += '=';
+		const size_t head = rDst_.size();
+		rDst_ += rItems_[i].text;
+		std::replace_if(rDst_.begin() + head, rDst_.end(), [](char c_) { return (c_ == '\t' || c_ == '\r' || c_ == '\n'); }, ' ');
+	}
+}
+
+std::string make_text(const MA_3& rData_)
+{
+	tune_text text;
+	if (!read_text(rData_, text)) return std::string();
+
+	std::string line;
+	add_text_items(text.options, line);
+	add_text_items(text.data, line);
+	return line.empty() ? std::string("\t") : line;
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Polyphony ("" = Not Analyzable)
+//------------------------------------------------------------------------------------------------------//
+std::string make_polyphony(const MA_3& rData_)
+{
+	polyphony_info info;
+	if (!analyze_polyphony(rData_, info)) return std::string();
+
+	char buf[64];
+	std::string line;
+	std::snprintf(buf, sizeof(buf), "\tnotes=%lu\tpeak=%lu@%llu\tchannels=",
+		static_cast<unsigned long>(info.notes),
+		static_cast<unsigned long>(info.peak),
+		static_cast<unsigned long long>(info.peak_ms));
+	line += buf;
+
+	for (u32_t ch = 0; ch < MA_3::CHANNELS; ch++)
+	{
+		std::snprintf(buf, sizeof(buf), (ch == 0) ? "%lu@%llu" : ",%lu@%llu",
+			static_cast<unsigned long>(info.channel_peak[ch]),
+			static_cast<unsigned long long>(info.channel_peak_ms[ch]));
+		line += buf;
+	}
+	return line;
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Check Read Only Command
+//------------------------------------------------------------------------------------------------------//
+bool read_only(const std::string& rCommand_)
+{
+	return (rCommand_ == "info" || rCommand_ == "verify" || rCommand_ == "text" || rCommand_ == "polyphony");
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Process One File
+//------------------------------------------------------------------------------------------------------//
+bool process(const options& rOpt_, MA_3& rData_, std::string& rInfo_)
+{
+	const std::string& cmd = rOpt_.command;
+
+	if (cmd == "info")
+	{
+		rInfo_ = make_info(rData_);
+		return (rData_.get_format() != format_type::FORMAT_RESERVED);
+	}
+	if (cmd == "verify") return verify(rData_.data_ptr(), rData_.size());
+	if (cmd == "text")
+	{
+		rInfo_ = make_text(rData_);
+		return !rInfo_.empty();
+	}
+	if (cmd == "polyphony")
+	{
+		rInfo_ = make_polyphony(rData_);
+		return !rInfo_.empty();
+	}
+	if (cmd == "set-text")
+	{
+		tune_text text;
+		if (!read_text(rData_, text)) return false;
+		set_text(text, rOpt_.args[0], rOpt_.args[1]);
+		MA_3 dst;
+		if (!write_text(rData_, text, dst)) return false;
+		rData_ = dst;
+		return true;
+	}
+	if (cmd == "crc") return fix_crc16(rData_);
+	if (cmd == "nop") return remove_nop(rData_);
+	if (cmd == "dedup-voices")
+	{
+		u32_t removed;
+		MA_3 dst;
+		if (!dedup_voices(rData_, dst, removed)) return false;
+		if (removed != 0) rData_ = dst;
+		return true;
+	}
+	if (cmd == "repeat")
+	{
+		const u32_t count = static_cast<u32_t>(std::strtoul(rOpt_.args[0].c_str(), nullptr, 10));
+		MA_3 dst;
+		if (!repeat(rData_, count, dst, rOpt_.gap)) return false;
+		rData_ = dst;
+		return true;
+	}
+	if (cmd == "limit-voices")
+	{
+		const u32_t voices = static_cast<u32_t>(std::strtoul(rOpt_.args[0].c_str(), nullptr, 10));
+		u32_t shortened, dropped;
+		MA_3 dst;
+		if (!limit_polyphony(rData_, voices, dst, shortened, dropped)) return false;
+		if (shortened != 0 || dropped != 0) rData_ = dst;
+		return true;
+	}
+	if (cmd == "optimize")
+	{
+		u32_t saved;
+		return optimize_size(rData_, saved);
+	}
+	if (cmd == "clear-status") return clear_channel_status(rData_);
+	if (cmd == "status")
+	{
+		const u32_t ch = static_cast<u32_t>(std::strtoul(rOpt_.args[0].c_str(), nullptr, 10));
+		const u8_t status = static_cast<u8_t>(std::strtoul(rOpt_.args[1].c_str(), nullptr, 16));
+		return change_channel_status(rData_, ch, channel_status(status));
+	}
+	if (cmd == "timebase")
+	{
+		const u8_t code = static_cast<u8_t>(std::strtoul(rOpt_.args[0].c_str(), nullptr, 16));
+		return change_timebase(rData_, timebase(code));
+	}
+	if (cmd == "tempo")
+	{
+		const f64_t ratio = std::strtod(rOpt_.args[0].c_str(), nullptr);
+		const timebase tb = rOpt_.new_timebase.is_valid() ? rOpt_.new_timebase : rData_.get_timebase();
+		return change_tempo(rData_, tb, ratio, rData_);
+	}
+	if (cmd == "trim")
+	{
+		const u32_t begin = static_cast<u32_t>(std::strtoul(rOpt_.args[0].c_str(), nullptr, 10));
+		const u32_t end = static_cast<u32_t>(std::strtoul(rOpt_.args[1].c_str(), nullptr, 10));
+		MA_3 dst;
+		if (!trim(rData_, begin, end, dst)) return false;
+		rData_ = dst;
+		return true;
+	}
+	if (cmd == "filter") return filter_events(rData_, rOpt_.filter, rData_);
+
+	return false;
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Batch Worker
+//------------------------------------------------------------------------------------------------------//
+void worker(const options& rOpt_, std::atomic<u64_t>& rNext_, statistics& rStats_)
+{
+	const bool write = !read_only(rOpt_.command);
+
+	while (true)
+	{
+		const u64_t n = rNext_++;
+		if (n >= rOpt_.inputs.size()) break;
+		const std::string& path = rOpt_.inputs[static_cast<size_t>(n)];
+
+		clock_type::time_point t = clock_type::now();
+		MA_3 data;
+		bool ok = load(path.c_str(), data);
+		rStats_.load_ns += elapsed_ns(t);
+		if (ok) rStats_.bytes_in += data.size();
+
+		std::string info;
+		if (ok)
+		{
+			t = clock_type::now();
+			ok = process(rOpt_, data, info);
+			rStats_.process_ns += elapsed_ns(t);
+		}
+
+		if (ok && write)
+		{
+			t = clock_type::now();
+			ok = save(output_path(rOpt_, path).c_str(), data);
+			rStats_.save_ns += elapsed_ns(t);
+			if (ok) rStats_.bytes_out += data.size();
+		}
+
+		rStats_.files++;
+		if (!ok) rStats_.failed++;
+
+		std::lock_guard<std::mutex> lock(g_print_mutex);
+		if (!ok) std::fprintf(stderr, "error: %s\n", path.c_str());
+		else if (!write) std::printf("%s%s\n", path.c_str(), info.c_str());
+	}
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Batch I/O (Load and save in batch_io, process in the callback)
+//------------------------------------------------------------------------------------------------------//
+struct batch_context
+{
+	const options* pOpt;										// Options
+	statistics*    pStats;										// Statistics
+};
+
+bool batch_process(u32_t index_, MA_3& rData_, void* pContext_)
+{
+	batch_context* pContext = static_cast<batch_context*>(pContext_);
+	const options& opt = *pContext->pOpt;
+	pContext->pStats->bytes_in += rData_.size();
+
+	const clock_type::time_point t = clock_type::now();
+	std::string info;
+	const bool ok = process(opt, rData_, info);
+	pContext->pStats->process_ns += elapsed_ns(t);
+
+	if (ok && !read_only(opt.command)) pContext->pStats->bytes_out += rData_.size();
+	if (ok && read_only(opt.command))
+	{
+		std::lock_guard<std::mutex> lock(g_print_mutex);
+		std::printf("%s%s\n", opt.inputs[index_].c_str(), info.c_str());
+	}
+	return ok;
+}
+
+void batch_done(u32_t index_, bool ok_, void* pContext_)
+{
+	batch_context* pContext = static_cast<batch_context*>(pContext_);
+	pContext->pStats->files++;
+	if (ok_) return;
+
+	pContext->pStats->failed++;
+	std::lock_guard<std::mutex> lock(g_print_mutex);
+	std::fprintf(stderr, "error: %s\n", pContext->pOpt->inputs[index_].c_str());
+}
+
+void run_batch(const options& rOpt_, statistics& rStats_)
+{
+	const size_t n = rOpt_.inputs.size();
+	std::vector<std::string> outputs;
+	std::vector<const char*> src(n), dst;
+	for (size_t i = 0; i < n; i++)
+	{
+		src[i] = rOpt_.inputs[i].c_str();
+	}
+	if (!read_only(rOpt_.command))
+	{
+		outputs.resize(n);
+		dst.resize(n);
+		for (size_t i = 0; i < n; i++)
+		{
+			outputs[i] = output_path(rOpt_, rOpt_.inputs[i]);
+			dst[i] = outputs[i].c_str();
+		}
+	}
+
+	batch_context context;
+	context.pOpt = &rOpt_;
+	context.pStats = &rStats_;
+
+	batch_io io;
+	io.threads = rOpt_.jobs;
+	io.pProcess = batch_process;
+	io.pDone = batch_done;
+	io.pContext = &context;
+	io.run(&src[0], dst.empty() ? nullptr : &dst[0], static_cast<u32_t>(n));
+
+	if (rOpt_.stats) std::fprintf(stderr, "batch io : %s\n", (io.used_backend() == BB_IO_URING) ? "io_uring" : "pread/pwrite");
+}
+
+void print_stats(const statistics& rStats_, u64_t wall_ns_, u32_t jobs_)
+{
+	const f64_t wall_s = (wall_ns_ / 1.0e9);
+	const f64_t files = static_cast<f64_t>(rStats_.files.load());
+	const f64_t mb_in = (rStats_.bytes_in.load() / (1024.0 * 1024.0));
+
+	std::fprintf(stderr, "files    : %llu (failed %llu)\n",
+		static_cast<unsigned long long>(rStats_.files.load()),
+		static_cast<unsigned long long>(rStats_.failed.load()));
+	std::fprintf(stderr, "jobs     : %lu\n", static_cast<unsigned long>(jobs_));
+	std::fprintf(stderr, "bytes    : %llu in, %llu out\n",
+		static_cast<unsigned long long>(rStats_.bytes_in.load()),
+		static_cast<unsigned long long>(rStats_.bytes_out.load()));
+	std::fprintf(stderr, "load     : %10.3f ms (cpu)\n", rStats_.load_ns.load() / 1.0e6);
+	std::fprintf(stderr, "process  : %10.3f ms (cpu)\n", rStats_.process_ns.load() / 1.0e6);
+	std::fprintf(stderr, "save     : %10.3f ms (cpu)\n", rStats_.save_ns.load() / 1.0e6);
+	std::fprintf(stderr, "wall     : %10.3f ms\n", wall_ns_ / 1.0e6);
+	if (wall_s > 0.0)
+	{
+		std::fprintf(stderr, "throughput: %.1f files/s, %.2f MB/s\n", files / wall_s, mb_in / wall_s);
+	}
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Combine (Two Inputs, One Output)
+//------------------------------------------------------------------------------------------------------//
+int run_combine(const options& rOpt_)
+{
+	MA_3 src1, src2, dst;
+	if (!load(rOpt_.args[0].c_str(), src1) || !load(rOpt_.args[1].c_str(), src2))
+	{
+		std::fprintf(stderr, "error: load\n");
+		return 1;
+	}
+	if (!combine(src1, src2, dst, rOpt_.gap) || !save(rOpt_.args[2].c_str(), dst))
+	{
+		std::fprintf(stderr, "error: combine\n");
+		return 1;
+	}
+	return 0;
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Split (One Input, Segments to <prefix>-<n>.mmf)
+//------------------------------------------------------------------------------------------------------//
+int run_split(const options& rOpt_)
+{
+	MA_3 src;
+	if (!load(rOpt_.args[0].c_str(), src))
+	{
+		std::fprintf(stderr, "error: load\n");
+		return 1;
+	}
+
+	// Split points. ("480,960")
+	data_array_<u32_t> points;
+	const std::string& rTicks = rOpt_.args[1];
+	size_t begin = 0;
+	while (begin < rTicks.size())
+	{
+		size_t end = rTicks.find(',', begin);
+		if (end == std::string::npos) end = rTicks.size();
+		points.push(static_cast<u32_t>(std::strtoul(rTicks.substr(begin, end - begin).c_str(), nullptr, 10)));
+		begin = (end + 1);
+	}
+
+	data_array_<MA_3> segments;
+	if (!split(src, points, segments))
+	{
+		std::fprintf(stderr, "error: split\n");
+		return 1;
+	}
+	for (u32_t i = 0; i < segments.size(); i++)
+	{
+		const std::string path = rOpt_.args[2] + "-" + std::to_string(static_cast<unsigned long long>(i + 1)) + ".mmf";
+		if (!save(path.c_str(), segments[i]))
+		{
+			std::fprintf(stderr, "error: %s\n", path.c_str());
+			return 1;
+		}
+		std::printf("%s\t%lu bytes\n", path.c_str(), static_cast<unsigned long>(segments[i].size()));
+	}
+	return 0;
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Diff / Patch (Two Inputs, One Output)
+//------------------------------------------------------------------------------------------------------//
+int run_diff(const options& rOpt_)
+{
+	MA_3 base, target;
+	binary_array patch;
+	if (!load(rOpt_.args[0].c_str(), base) || !load(rOpt_.args[1].c_str(), target))
+	{
+		std::fprintf(stderr, "error: load\n");
+		return 1;
+	}
+	if (!make_patch(base, target, patch) || !save(rOpt_.args[2].c_str(), patch))
+	{
+		std::fprintf(stderr, "error: diff\n");
+		return 1;
+	}
+	std::printf("%s\t%lu -> %lu bytes\n", rOpt_.args[2].c_str(), static_cast<unsigned long>(target.size()), static_cast<unsigned long>(patch.size()));
+	return 0;
+}
+
+bool write_file(const u8_t* pData_, u32_t size_, void* pContext_)
+{
+	std::ofstream& fout = *static_cast<std::ofstream*>(pContext_);
+	fout.write(reinterpret_cast<const char*>(pData_), size_);
+	return fout.good();
+}
+
+int run_patch(const options& rOpt_)
+{
+	MA_3 base;
+	binary_array patch;
+	if (!load(rOpt_.args[0].c_str(), base) || !load(rOpt_.args[1].c_str(), patch))
+	{
+		std::fprintf(stderr, "error: load\n");
+		return 1;
+	}
+
+	// The result is streamed to the file, and removed when the patch fails.
+	std::ofstream fout(rOpt_.args[2].c_str(), std::ios::binary | std::ios::trunc);
+	const bool ok = (fout.is_open() && apply_patch(base, patch.data_ptr(), patch.size(), write_file, &fout));
+	if (fout.is_open()) fout.close();
+	if (!ok || fout.fail())
+	{
+		std::remove(rOpt_.args[2].c_str());
+		std::fprintf(stderr, "error: patch\n");
+		return 1;
+	}
+	return 0;
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Pack (Inputs to Catalog, IDs in Input Order)
+//------------------------------------------------------------------------------------------------------//
+int run_pack(const options& rOpt_)
+{
+	const size_t n = rOpt_.inputs.size();
+	std::vector<const char*> src(n);
+	std::vector<u64_t> ids(n);
+	for (size_t i = 0; i < n; i++)
+	{
+		src[i] = rOpt_.inputs[i].c_str();
+		ids[i] = (rOpt_.first_id + i);
+	}
+
+	catalog_writer writer;
+	if (!writer.open(rOpt_.args[0].c_str()))
+	{
+		std::fprintf(stderr, "error: catalog %s\n", rOpt_.args[0].c_str());
+		return 1;
+	}
+	const bool ok = writer.add_files(&ids[0], &src[0], static_cast<u32_t>(n), rOpt_.jobs);
+	if (!writer.close())
+	{
+		std::fprintf(stderr, "error: catalog %s\n", rOpt_.args[0].c_str());
+		return 1;
+	}
+	for (size_t i = 0; i < n; i++)
+	{
+		std::printf("%llu\t%s\n", static_cast<unsigned long long>(ids[i]), src[i]);
+	}
+	if (!ok) std::fprintf(stderr, "error: some files are not packed\n");
+	return ok ? 0 : 1;
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Metadata (Inputs or Catalog to Columns, CSV when the Output ends with ".csv")
+//------------------------------------------------------------------------------------------------------//
+int run_metadata(const options& rOpt_)
+{
+	const clock_type::time_point begin = clock_type::now();
+	metadata_table table;
+	std::vector<std::string> names;
+	bool ok = true;
+	if (!rOpt_.catalog.empty())
+	{
+		catalog_reader reader;
+		if (!reader.open(rOpt_.catalog.c_str()))
+		{
+			std::fprintf(stderr, "error: catalog %s\n", rOpt_.catalog.c_str());
+			return 1;
+		}
+		ok = extract_metadata(reader, table, rOpt_.jobs);
+		names.resize(static_cast<size_t>(reader.size()));
+		for (u64_t i = 0; i < reader.size(); i++)
+		{
+			catalog_entry entry;
+			if (reader.entry(i, entry)) names[static_cast<size_t>(i)] = std::to_string(static_cast<unsigned long long>(entry.id));
+		}
+	}
+	else
+	{
+		const size_t n = rOpt_.inputs.size();
+		std::vector<const char*> src(n);
+		for (size_t i = 0; i < n; i++)
+		{
+			src[i] = rOpt_.inputs[i].c_str();
+		}
+		ok = extract_metadata(&src[0], static_cast<u32_t>(n), table, rOpt_.jobs);
+		names = rOpt_.inputs;
+	}
+	const u64_t extract_ns = elapsed_ns(begin);
+
+	std::vector<const char*> pNames(names.size());
+	for (size_t i = 0; i < names.size(); i++)
+	{
+		pNames[i] = names[i].c_str();
+	}
+
+	const std::string& rOut = rOpt_.args[0];
+	const bool csv = (rOut.size() >= 4 && rOut.compare(rOut.size() - 4, 4, ".csv") == 0);
+	if (!(csv ? table.write_csv(rOut.c_str(), pNames.empty() ? nullptr : &pNames[0]) : table.save(rOut.c_str())))
+	{
+		std::fprintf(stderr, "error: %s\n", rOut.c_str());
+		return 1;
+	}
+	if (rOpt_.stats)
+	{
+		const f64_t sec = static_cast<f64_t>(extract_ns) / 1e9;
+		std::fprintf(stderr, "rows: %llu, extract: %.3f s (%.0f rows/s)\n", static_cast<unsigned long long>(table.rows()), sec, (sec > 0.0) ? (static_cast<f64_t>(table.rows()) / sec) : 0.0);
+	}
+	if (!ok) std::fprintf(stderr, "error: some files are not extracted (ok = 0)\n");
+	return ok ? 0 : 1;
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Voices (Voice IDs of the Inputs in One Library)
+//------------------------------------------------------------------------------------------------------//
+int run_voices(const options& rOpt_)
+{
+	voice_library library;
+	std::vector<std::string> lines(rOpt_.inputs.size());
+	std::atomic<u64_t> next(0);
+	std::atomic<u64_t> failed(0);
+	auto voices_worker = [&]() {
+		std::vector<u32_t> ids;
+		while (true)
+		{
+			const u64_t i = next++;
+			if (i >= rOpt_.inputs.size()) break;
+			MA_3 data;
+			if (!load(rOpt_.inputs[i].c_str(), data) || !library.add_tune(data, ids))
+			{
+				failed++;
+				continue;
+			}
+			std::string& line = lines[static_cast<size_t>(i)];
+			line = rOpt_.inputs[i] + "\t";
+			for (size_t n = 0; n < ids.size(); n++)
+			{
+				if (n != 0) line += ',';
+				line += std::to_string(static_cast<unsigned long long>(ids[n]));
+			}
+		}
+	};
+
+	u32_t jobs = rOpt_.jobs;
+	if (jobs > rOpt_.inputs.size()) jobs = static_cast<u32_t>(rOpt_.inputs.size());
+	std::vector<std::thread> threads;
+	for (u32_t i = 1; i < jobs; i++)
+	{
+		threads.push_back(std::thread(voices_worker));
+	}
+	voices_worker();
+	for (size_t i = 0; i < threads.size(); i++)
+	{
+		threads[i].join();
+	}
+
+	for (size_t i = 0; i < lines.size(); i++)
+	{
+		if (lines[i].empty()) std::fprintf(stderr, "error: %s\n", rOpt_.inputs[i].c_str());
+		else std::printf("%s\n", lines[i].c_str());
+	}
+	std::fprintf(stderr, "voices: %llu, unique: %lu, bytes: %llu -> %llu\n",
+		static_cast<unsigned long long>(library.references()),
+		static_cast<unsigned long>(library.voices()),
+		static_cast<unsigned long long>(library.added_bytes()),
+		static_cast<unsigned long long>(library.unique_bytes()));
+	if (!rOpt_.library.empty() && !library.save(rOpt_.library.c_str()))
+	{
+		std::fprintf(stderr, "error: %s\n", rOpt_.library.c_str());
+		return 1;
+	}
+	return (failed == 0) ? 0 : 1;
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Similar (Each Input against the Earlier Inputs)
+//------------------------------------------------------------------------------------------------------//
+int run_similar(const options& rOpt_)
+{
+	similarity_index index;
+	index.min_score = rOpt_.min_score;
+
+	u64_t failed = 0;
+	std::vector<similarity_match> matches;
+	for (size_t i = 0; i < rOpt_.inputs.size(); i++)
+	{
+		MA_3 data;
+		fingerprint print;
+		if (!load(rOpt_.inputs[i].c_str(), data) || !make_fingerprint(data, print))
+		{
+			std::fprintf(stderr, "error: %s\n", rOpt_.inputs[i].c_str());
+			failed++;
+			continue;
+		}
+		if (index.lookup(print, 1, matches) && !matches.empty())
+		{
+			std::printf("%s\t%s\t%.3f\n", rOpt_.inputs[i].c_str(), rOpt_.inputs[static_cast<size_t>(matches[0].id)].c_str(), matches[0].score);
+		}
+		index.add(i, print);
+	}
+	return (failed == 0) ? 0 : 1;
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Parse Command Line
+//------------------------------------------------------------------------------------------------------//
+u32_t command_args(const std::string& rCommand_)
+{
+	if (rCommand_ == "similar" || rCommand_ == "voices" || rCommand_ == "dedup-voices") return 0;
+	if (rCommand_ == "info" || rCommand_ == "verify" || rCommand_ == "text" || rCommand_ == "polyphony" || rCommand_ == "crc" || rCommand_ == "nop" || rCommand_ == "optimize" || rCommand_ == "clear-status" || rCommand_ == "filter") return 0;
+	if (rCommand_ == "timebase" || rCommand_ == "tempo" || rCommand_ == "repeat" || rCommand_ == "limit-voices") return 1;
+	if (rCommand_ == "status" || rCommand_ == "trim" || rCommand_ == "set-text") return 2;
+	if (rCommand_ == "combine" || rCommand_ == "split" || rCommand_ == "diff" || rCommand_ == "patch") return 3;
+	if (rCommand_ == "pack" || rCommand_ == "metadata") return 1;
+	if (rCommand_ == "serve" || rCommand_ == "service-stats") return 1;
+	if (rCommand_ == "call") return 2;
+	return 0xFFFFFFFF;											// Unknown Command
+}
+
+bool parse(int argc, char* argv[], options& rOpt_)
+{
+	if (argc < 2) return false;
+
+	rOpt_.command = argv[1];
+	rOpt_.in_place = false;
+	rOpt_.stats = false;
+	rOpt_.batch = false;
+	rOpt_.buffer = false;
+	rOpt_.jobs = 1;
+	rOpt_.gap = 1;
+	rOpt_.first_id = 0;
+	rOpt_.min_score = 0.3;
+
+	const u32_t nargs = command_args(rOpt_.command);
+	if (nargs == 0xFFFFFFFF) return false;
+
+	int i = 2;
+	for (u32_t n = 0; n < nargs; n++, i++)
+	{
+		if (i >= argc) return false;
+		rOpt_.args.push_back(argv[i]);
+	}
+
+	for (; i < argc; i++)
+	{
+		const std::string arg = argv[i];
+		const bool has_value = ((i + 1) < argc);
+		if (arg == "-j" && has_value) rOpt_.jobs = static_cast<u32_t>(std::strtoul(argv[++i], nullptr, 10));
+		else if (arg == "-o" && has_value) rOpt_.out_dir = argv[++i];
+		else if (arg == "--in-place") rOpt_.in_place = true;
+		else if (arg == "--stats") rOpt_.stats = true;
+		else if (arg == "--batch-io") rOpt_.batch = true;
+		else if (arg == "--buffer") rOpt_.buffer = true;
+		else if (arg == "--trace" && has_value) rOpt_.trace_file = argv[++i];
+		else if (arg == "--counters" && has_value) rOpt_.counters_file = argv[++i];
+		else if (arg == "--catalog" && has_value) rOpt_.catalog = argv[++i];
+		else if (arg == "--library" && has_value) rOpt_.library = argv[++i];
+		else if (arg == "--first-id" && has_value) rOpt_.first_id = std::strtoull(argv[++i], nullptr, 10);
+		else if (arg == "--min-score" && has_value) rOpt_.min_score = std::strtod(argv[++i], nullptr);
+		else if (arg == "--gap" && has_value) rOpt_.gap = static_cast<u32_t>(std::strtoul(argv[++i], nullptr, 10));
+		else if (arg == "--timebase" && has_value) rOpt_.new_timebase = timebase(static_cast<u8_t>(std::strtoul(argv[++i], nullptr, 16)));
+		else if (arg == "--mute" && has_value) rOpt_.filter.mute_mask = static_cast<u16_t>(std::strtoul(argv[++i], nullptr, 16));
+		else if (arg == "--transpose" && has_value) rOpt_.filter.transpose = static_cast<s32_t>(std::strtol(argv[++i], nullptr, 10));
+		else if (arg == "--velocity" && has_value) rOpt_.filter.velocity_ratio = std::strtod(argv[++i], nullptr);
+		else if (!add_input(arg, rOpt_.inputs))
+		{
+			std::fprintf(stderr, "error: input %s\n", arg.c_str());
+			return false;
+		}
+	}
+
+#ifndef OPENMF_TRACE
+	if (!rOpt_.trace_file.empty() || !rOpt_.counters_file.empty())
+	{
+		std::fprintf(stderr, "warning: built without OPENMF_TRACE, --trace/--counters are ignored\n");
+	}
+#endif
+
+	if (rOpt_.jobs == 0) rOpt_.jobs = std::thread::hardware_concurrency();
+	if (rOpt_.jobs == 0) rOpt_.jobs = 1;
+
+	if (rOpt_.command == "combine" || rOpt_.command == "split" || rOpt_.command == "diff" || rOpt_.command == "patch") return true;
+	if (rOpt_.command == "serve" || rOpt_.command == "service-stats") return true;
+	if (rOpt_.command == "metadata") return (!rOpt_.catalog.empty() || !rOpt_.inputs.empty());
+	if (rOpt_.inputs.empty()) return false;
+	if (rOpt_.command == "pack" || rOpt_.command == "similar" || rOpt_.command == "voices") return true;
+	if (rOpt_.command == "call") return true;
+	if (!read_only(rOpt_.command) && !rOpt_.in_place && rOpt_.out_dir.empty()) return false;
+	return true;
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Operations of the Service ("op args; op args; ...", Commands of One File)
+//------------------------------------------------------------------------------------------------------//
+bool split_operations(const std::string& rOps_, std::vector<options>& rDst_)
+{
+	rDst_.clear();
+	size_t begin = 0;
+	while (begin <= rOps_.size())
+	{
+		size_t end = rOps_.find(';', begin);
+		if (end == std::string::npos) end = rOps_.size();
+
+		std::vector<std::string> tokens;
+		size_t pos = begin;
+		while (pos < end)
+		{
+			const size_t first = rOps_.find_first_not_of(" \t", pos);
+			if (first == std::string::npos || first >= end) break;
+			size_t last = rOps_.find_first_of(" \t", first);
+			if (last == std::string::npos || last > end) last = end;
+			tokens.push_back(rOps_.substr(first, last - first));
+			pos = last;
+		}
+		begin = (end + 1);
+		if (tokens.empty()) continue;
+
+		options op;
+		op.command = tokens[0];
+		op.args.assign(tokens.begin() + 1, tokens.end());
+		op.gap = 1;												// Default of --gap (repeat)
+		if (op.command == "filter" || command_args(op.command) != op.args.size()) return false;
+		if (op.command == "combine" || op.command == "split" || op.command == "diff" || op.command == "patch" || op.command == "pack") return false;
+		if (op.command == "serve" || op.command == "call" || op.command == "service-stats") return false;
+		if (op.command == "similar" || op.command == "metadata" || op.command == "voices") return false;
+		rDst_.push_back(op);
+	}
+	return !rDst_.empty();
+}
+
+bool read_only_operations(const std::string& rOps_)
+{
+	std::vector<options> ops;
+	if (!split_operations(rOps_, ops)) return false;
+	for (size_t i = 0; i < ops.size(); i++)
+	{
+		if (!read_only(ops[i].command)) return false;
+	}
+	return true;
+}
+
+bool service_process(const char* szOps_, MA_3& rData_, std::string& rInfo_, void* /*pContext_*/)
+{
+	std::vector<options> ops;
+	if (!split_operations(szOps_, ops))
+	{
+		rInfo_ = "operations";
+		return false;
+	}
+
+	bool write = false;
+	for (size_t i = 0; i < ops.size(); i++)
+	{
+		std::string info;
+		if (!process(ops[i], rData_, info))
+		{
+			rInfo_ = ops[i].command;
+			return false;
+		}
+		rInfo_ += info;
+		if (!read_only(ops[i].command)) write = true;
+	}
+	if (!write) rData_.release();								// No Output
+	return true;
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Serve (Until SIGINT/SIGTERM)
+//------------------------------------------------------------------------------------------------------//
+service* g_pService = nullptr;									// Service for Signal Handler
+
+void stop_service(int /*signal_*/)
+{
+	if (g_pService != nullptr) g_pService->stop();
+}
+
+void print_service_stats(const service_stats& rStats_)
+{
+	std::fprintf(stderr, "requests : %llu (failed %llu)\n",
+		static_cast<unsigned long long>(rStats_.requests),
+		static_cast<unsigned long long>(rStats_.failed));
+	std::fprintf(stderr, "queue    : %llu (max %llu), busy %llu, connections %llu\n",
+		static_cast<unsigned long long>(rStats_.queue_depth),
+		static_cast<unsigned long long>(rStats_.max_queue_depth),
+		static_cast<unsigned long long>(rStats_.busy),
+		static_cast<unsigned long long>(rStats_.connections));
+	std::fprintf(stderr, "latency  : p50 %llu us, p90 %llu us, p99 %llu us, p99.9 %llu us, max %llu us\n",
+		static_cast<unsigned long long>(rStats_.p50_us),
+		static_cast<unsigned long long>(rStats_.p90_us),
+		static_cast<unsigned long long>(rStats_.p99_us),
+		static_cast<unsigned long long>(rStats_.p999_us),
+		static_cast<unsigned long long>(rStats_.max_us));
+}
+
+int run_serve(const options& rOpt_)
+{
+	service svc;
+	svc.threads = rOpt_.jobs;
+	svc.pProcess = service_process;
+	if (!svc.open(rOpt_.args[0].c_str()))
+	{
+		std::fprintf(stderr, "error: socket %s\n", rOpt_.args[0].c_str());
+		return 1;
+	}
+
+	g_pService = &svc;
+	std::signal(SIGINT, stop_service);
+	std::signal(SIGTERM, stop_service);
+	const bool ok = svc.run();
+	g_pService = nullptr;
+
+	if (rOpt_.stats)
+	{
+		service_stats stats;
+		svc.get_stats(stats);
+		print_service_stats(stats);
+	}
+	svc.close();
+	return ok ? 0 : 1;
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Call (Inputs to the Service, One Connection per Job)
+//------------------------------------------------------------------------------------------------------//
+void call_worker(const options& rOpt_, std::atomic<u64_t>& rNext_, statistics& rStats_)
+{
+	service_client client;
+	const bool connected = client.connect(rOpt_.args[0].c_str());
+	const std::string& ops = rOpt_.args[1];
+
+	while (true)
+	{
+		const u64_t n = rNext_++;
+		if (n >= rOpt_.inputs.size()) break;
+		const std::string& path = rOpt_.inputs[static_cast<size_t>(n)];
+
+		clock_type::time_point t = clock_type::now();
+		service_result result;
+		bool ok = connected;
+		if (ok && rOpt_.buffer)
+		{
+			MA_3 data;
+			ok = load(path.c_str(), data);
+			rStats_.load_ns += elapsed_ns(t);
+			if (ok) rStats_.bytes_in += data.size();
+			t = clock_type::now();
+			ok = (ok && client.call(ops.c_str(), data, result));
+		}
+		else if (ok)
+		{
+			char* szFull = realpath(path.c_str(), nullptr);
+			ok = (szFull != nullptr && client.call(ops.c_str(), szFull, result));
+			std::free(szFull);
+		}
+		rStats_.process_ns += elapsed_ns(t);
+
+		if (ok && !result.data().empty())
+		{
+			t = clock_type::now();
+			ok = save(output_path(rOpt_, path).c_str(), result.data());
+			rStats_.save_ns += elapsed_ns(t);
+			if (ok) rStats_.bytes_out += result.data().size();
+		}
+
+		rStats_.files++;
+		if (!ok) rStats_.failed++;
+
+		std::lock_guard<std::mutex> lock(g_print_mutex);
+		if (!ok) std::fprintf(stderr, "error: %s%s%s\n", path.c_str(), result.info().empty() ? "" : " ", result.info().c_str());
+		else if (result.data().empty()) std::printf("%s%s\n", path.c_str(), result.info().c_str());
+	}
+}
+
+int run_call(options& rOpt_)
+{
+	if (!read_only_operations(rOpt_.args[1]) && !rOpt_.in_place && rOpt_.out_dir.empty())
+	{
+		std::fprintf(stderr, "error: -o or --in-place is required for \"%s\"\n", rOpt_.args[1].c_str());
+		return 2;
+	}
+
+	statistics stats;
+	std::atomic<u64_t> next(0);
+
+	const clock_type::time_point begin = clock_type::now();
+	if (rOpt_.jobs > rOpt_.inputs.size()) rOpt_.jobs = static_cast<u32_t>(rOpt_.inputs.size());
+
+	std::vector<std::thread> threads;
+	for (u32_t i = 1; i < rOpt_.jobs; i++)
+	{
+		threads.push_back(std::thread(call_worker, std::cref(rOpt_), std::ref(next), std::ref(stats)));
+	}
+	call_worker(rOpt_, next, stats);
+	for (size_t i = 0; i < threads.size(); i++)
+	{
+		threads[i].join();
+	}
+
+	if (rOpt_.stats) print_stats(stats, elapsed_ns(begin), rOpt_.jobs);
+	return (stats.failed.load() == 0) ? 0 : 1;
+}
+
+int run_service_stats(const options& rOpt_)
+{
+	service_client client;
+	service_stats stats;
+	if (!client.connect(rOpt_.args[0].c_str()) || !client.query(stats))
+	{
+		std::fprintf(stderr, "error: service %s\n", rOpt_.args[0].c_str());
+		return 1;
+	}
+	print_service_stats(stats);
+	return 0;
+}
+
+//------------------------------------------------------------------------------------------------------//
+// Instrumentation Export
+//------------------------------------------------------------------------------------------------------//
+void export_trace(const options& rOpt_)
+{
+#ifdef OPENMF_TRACE
+	if (!rOpt_.trace_file.empty() && !trace::export_chrome_trace(rOpt_.trace_file.c_str()))
+	{
+		std::fprintf(stderr, "error: trace %s\n", rOpt_.trace_file.c_str());
+	}
+	if (!rOpt_.counters_file.empty() && !trace::export_counters(rOpt_.counters_file.c_str()))
+	{
+		std::fprintf(stderr, "error: counters %s\n", rOpt_.counters_file.c_str());
+	}
+#else
+	(void)rOpt_;
+#endif
+}
+
+}																// namespace
+
+//------------------------------------------------------------------------------------------------------//
+// Main
+//------------------------------------------------------------------------------------------------------//
+int main(int argc, char* argv[])
+{
+	options opt;
+	if (!parse(argc, argv, opt))
+	{
+		usage();
+		return 2;
+	}
+
+	if (opt.command == "combine" || opt.command == "split" || opt.command == "diff" || opt.command == "patch")
+	{
+		const int result = (opt.command == "combine") ? run_combine(opt) : ((opt.command == "split") ? run_split(opt) : ((opt.command == "diff") ? run_diff(opt) : run_patch(opt)));
+		export_trace(opt);
+		return result;
+	}
+
+	if (opt.command == "serve" || opt.command == "call" || opt.command == "service-stats")
+	{
+		const int result = (opt.command == "serve") ? run_serve(opt) : ((opt.command == "call") ? run_call(opt) : run_service_stats(opt));
+		export_trace(opt);
+		return result;
+	}
+
+	if (opt.command == "pack" || opt.command == "similar" || opt.command == "metadata" || opt.command == "voices")
+	{
+		const int result = (opt.command == "pack") ? run_pack(opt) : ((opt.command == "similar") ? run_similar(opt) : ((opt.command == "metadata") ? run_metadata(opt) : run_voices(opt)));
+		export_trace(opt);
+		return result;
+	}
+
+	statistics stats;
+	std::atomic<u64_t> next(0);
+
+	const clock_type::time_point begin = clock_type::now();
+	if (opt.jobs > opt.inputs.size()) opt.jobs = static_cast<u32_t>(opt.inputs.size());
+
+	if (opt.batch)
+	{
+		run_batch(opt, stats);
+	}
+	else
+	{
+		std::vector<std::thread> threads;
+		for (u32_t i = 1; i < opt.jobs; i++)
+		{
+			threads.push_back(std::thread(worker, std::cref(opt), std::ref(next), std::ref(stats)));
+		}
+		worker(opt, next, stats);
+		for (size_t i = 0; i < threads.size(); i++)
+		{
+			threads[i].join();
+		}
+	}
+
+	if (opt.stats) print_stats(stats, elapsed_ns(begin), opt.jobs);
+	export_trace(opt);
+
+	return (stats.failed.load() == 0) ? 0 : 1;
+}
+
+//------------------------------------------------------------------------------------------------------//
+// End of File
+//------------------------------------------------------------------------------------------------------//